@@ -69,15 +69,21 @@ Acceptor::init(AsyncServerSocket* serverSocket,
         "vip_" + getName(),
         accConfig_.strictSSL, stats);
     }
+    if (accConfig_.privateKeyOffload) {
+      // The offload is shared with the other acceptors of this config, so
+      // this caps their handshakes together rather than ours alone
+      accConfig_.privateKeyOffload->limitPendingOperations(
+        accConfig_.maxConcurrentSSLHandshakes);
+      sslCtxManager_->setPrivateKeyOffload(accConfig_.privateKeyOffload);
+    }
     try {
-      for (const auto& sslCtxConfig : accConfig_.sslContextConfigs) {
-        sslCtxManager_->addSSLContextConfig(
-          sslCtxConfig,
-          accConfig_.sslCacheOptions,
-          &accConfig_.initialTicketSeeds,
-          accConfig_.bindAddress,
-          cacheProvider_);
-      }
+      // all at once, so the SNI index is compiled once rather than per config
+      sslCtxManager_->resetSSLContextConfigs(
+        accConfig_.sslContextConfigs,
+        accConfig_.sslCacheOptions,
+        &accConfig_.initialTicketSeeds,
+        accConfig_.bindAddress,
+        cacheProvider_);
 
       CHECK(sslCtxManager_->getDefaultSSLCtx());
     } catch (const std::runtime_error& ex) {
@@ -113,6 +119,10 @@ void Acceptor::initDownstreamConnectionManager(EventBase* eventBase) {
   state_ = State::kRunning;
   downstreamConnectionManager_ = ConnectionManager::makeUnique(
     eventBase, accConfig_.connectionIdleTimeout, this);
+  if (accConfig_.connectionIdleBucketGranularity.count() > 0) {
+    downstreamConnectionManager_->setIdleBucketGranularity(
+      accConfig_.connectionIdleBucketGranularity);
+  }
 }
 
 void Acceptor::resetSSLContextConfigs() {
@@ -159,13 +169,36 @@ Acceptor::drainAllConnections() {
   }
 }
 
+void Acceptor::onConnectionActivated(const ConnectionManager&) {
+  if (connectionCounter_) {
+    connectionCounter_->onConnectionActivated();
+  }
+}
+
+void Acceptor::onConnectionDeactivated(const ConnectionManager&) {
+  if (connectionCounter_) {
+    connectionCounter_->onConnectionDeactivated();
+  }
+}
+
 void Acceptor::setLoadShedConfig(const LoadShedConfiguration& from,
                        IConnectionCounter* counter) {
   loadShedConfig_ = from;
   connectionCounter_ = counter;
+  if (loadSampler_) {
+    loadSampler_->setConfig(loadShedConfig_);
+  }
 }
 
 bool Acceptor::canAccept(const SocketAddress& address) {
+  if (loadSampler_ && loadShedConfig_.getLoadSheddingEnabled() &&
+      loadSampler_->isOverloaded() &&
+      !loadShedConfig_.isWhitelisted(address)) {
+    LOG_EVERY_N(ERROR, 1000) << "shedding connection because the system is "
+                             << "overloaded";
+    return false;
+  }
+
   if (!connectionCounter_) {
     return true;
   }
@@ -18,6 +18,7 @@
 #include <wangle/acceptor/ServerSocketConfig.h>
 #include <wangle/acceptor/ConnectionCounter.h>
 #include <wangle/acceptor/ConnectionManager.h>
+#include <wangle/acceptor/LoadSampler.h>
 #include <wangle/acceptor/LoadShedConfiguration.h>
 #include <wangle/acceptor/SecureTransportType.h>
 #include <wangle/acceptor/SecurityProtocolContextManager.h>
@@ -317,8 +318,14 @@ class Acceptor :
    */
   folly::EventBase* base_{nullptr};
 
-  virtual uint64_t getConnectionCountForLoadShedding(void) const { return 0; }
-  virtual uint64_t getActiveConnectionCountForLoadShedding() const { return 0; }
+  virtual uint64_t getConnectionCountForLoadShedding(void) const {
+    return connectionCounter_ ?
+      connectionCounter_->getAggregatedConnections() : 0;
+  }
+  virtual uint64_t getActiveConnectionCountForLoadShedding() const {
+    return connectionCounter_ ?
+      connectionCounter_->getAggregatedActiveConnections() : 0;
+  }
   virtual uint64_t getWorkerMaxConnections() const {
     return connectionCounter_->getMaxConnections();
   }
@@ -401,11 +408,26 @@ class Acceptor :
   void onEmpty(const wangle::ConnectionManager& cm) override;
   void onConnectionAdded(const wangle::ConnectionManager& /*cm*/) override {}
   void onConnectionRemoved(const wangle::ConnectionManager& /*cm*/) override {}
+  void onConnectionActivated(const wangle::ConnectionManager& cm) override;
+  void onConnectionDeactivated(const wangle::ConnectionManager& cm) override;
 
   const LoadShedConfiguration& getLoadShedConfiguration() const {
     return loadShedConfig_;
   }
 
+  /**
+   * Shed non-whitelisted connections while the sampler reports the system
+   * as overloaded. One sampler is normally shared by every acceptor. The
+   * sampler is kept on this acceptor's load shed configuration, now and
+   * on every later setLoadShedConfig().
+   */
+  void setLoadSampler(std::shared_ptr<LoadSampler> sampler) {
+    loadSampler_ = std::move(sampler);
+    if (loadSampler_) {
+      loadSampler_->setConfig(loadShedConfig_);
+    }
+  }
+
  protected:
   const ServerSocketConfig accConfig_;
   void setLoadShedConfig(const LoadShedConfiguration& from,
@@ -450,6 +472,7 @@ class Acceptor :
   bool forceShutdownInProgress_{false};
   LoadShedConfiguration loadShedConfig_;
   IConnectionCounter* connectionCounter_{nullptr};
+  std::shared_ptr<LoadSampler> loadSampler_;
   std::chrono::milliseconds gracefulShutdownTimeout_{5000};
 };
 
@@ -0,0 +1,178 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <wangle/acceptor/AggregatedConnectionCounter.h>
+
+#include <folly/Memory.h>
+#include <glog/logging.h>
+
+namespace wangle {
+
+constexpr std::chrono::milliseconds
+  AggregatedConnectionCounter::kDefaultRefreshInterval;
+
+AggregatedConnectionCounter::Worker::~Worker() {
+  parent_->releaseSlot(slot_);
+}
+
+uint64_t AggregatedConnectionCounter::Worker::getNumConnections() const {
+  auto n = slot_->connections.load(std::memory_order_relaxed);
+  return n > 0 ? n : 0;
+}
+
+uint64_t AggregatedConnectionCounter::Worker::getNumActiveConnections() const {
+  auto n = slot_->activeConnections.load(std::memory_order_relaxed);
+  return n > 0 ? n : 0;
+}
+
+uint64_t AggregatedConnectionCounter::Worker::getMaxConnections() const {
+  return parent_->workerMaxConnections_.load(std::memory_order_relaxed);
+}
+
+// Each slot has a single writer, so a plain load + store is enough and
+// avoids a locked read-modify-write on the accept path.
+void AggregatedConnectionCounter::Worker::onConnectionAdded() {
+  auto& c = slot_->connections;
+  c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+void AggregatedConnectionCounter::Worker::onConnectionRemoved() {
+  auto& c = slot_->connections;
+  c.store(c.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+}
+
+void AggregatedConnectionCounter::Worker::onConnectionActivated() {
+  auto& c = slot_->activeConnections;
+  c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+void AggregatedConnectionCounter::Worker::onConnectionDeactivated() {
+  auto& c = slot_->activeConnections;
+  c.store(c.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+}
+
+uint64_t AggregatedConnectionCounter::Worker::getAggregatedConnections()
+    const {
+  return parent_->getNumConnections();
+}
+
+uint64_t AggregatedConnectionCounter::Worker::getAggregatedActiveConnections()
+    const {
+  return parent_->getNumActiveConnections();
+}
+
+std::shared_ptr<AggregatedConnectionCounter>
+AggregatedConnectionCounter::create(
+    uint64_t maxConnections,
+    std::chrono::milliseconds refreshInterval) {
+  std::shared_ptr<AggregatedConnectionCounter> counter(
+      new AggregatedConnectionCounter(maxConnections, refreshInterval));
+  counter->start();
+  return counter;
+}
+
+AggregatedConnectionCounter::AggregatedConnectionCounter(
+    uint64_t maxConnections,
+    std::chrono::milliseconds refreshInterval)
+    : maxConnections_(maxConnections),
+      refreshInterval_(refreshInterval),
+      workerMaxConnections_(maxConnections) {
+  scheduler_.setThreadName("conn-counter");
+}
+
+AggregatedConnectionCounter::~AggregatedConnectionCounter() {
+  stop();
+}
+
+void AggregatedConnectionCounter::start() {
+  // The scheduler never holds a reference, so the destructor (which stops
+  // the scheduler) can't run on the scheduler thread.
+  scheduler_.addFunction([this] { refresh(); }, refreshInterval_, "refresh");
+  scheduler_.start();
+  started_ = true;
+}
+
+void AggregatedConnectionCounter::stop() {
+  if (!started_) {
+    return;
+  }
+  scheduler_.cancelFunctionAndWait("refresh");
+  scheduler_.shutdown();
+  started_ = false;
+}
+
+std::unique_ptr<AggregatedConnectionCounter::Worker>
+AggregatedConnectionCounter::newWorker() {
+  Slot* slot = nullptr;
+  {
+    std::lock_guard<std::mutex> g(slotsMutex_);
+    for (auto& s : slots_) {
+      if (!s->inUse) {
+        slot = s.get();
+        break;
+      }
+    }
+    if (!slot) {
+      slots_.push_back(std::make_unique<Slot>());
+      slot = slots_.back().get();
+    }
+    slot->inUse = true;
+  }
+  refresh();
+  return std::unique_ptr<Worker>(new Worker(shared_from_this(), slot));
+}
+
+void AggregatedConnectionCounter::releaseSlot(Slot* slot) {
+  {
+    std::lock_guard<std::mutex> g(slotsMutex_);
+    if (slot->connections.load(std::memory_order_relaxed) != 0) {
+      LOG(WARNING) << "Releasing connection counter with "
+                   << slot->connections.load(std::memory_order_relaxed)
+                   << " connections outstanding";
+    }
+    slot->connections.store(0, std::memory_order_relaxed);
+    slot->activeConnections.store(0, std::memory_order_relaxed);
+    slot->inUse = false;
+  }
+  refresh();
+}
+
+void AggregatedConnectionCounter::refresh() {
+  int64_t connections = 0;
+  int64_t active = 0;
+  size_t workers = 0;
+  {
+    std::lock_guard<std::mutex> g(slotsMutex_);
+    for (const auto& s : slots_) {
+      if (!s->inUse) {
+        continue;
+      }
+      connections += s->connections.load(std::memory_order_relaxed);
+      active += s->activeConnections.load(std::memory_order_relaxed);
+      ++workers;
+    }
+  }
+  totalConnections_.store(
+      connections > 0 ? connections : 0, std::memory_order_relaxed);
+  totalActiveConnections_.store(
+      active > 0 ? active : 0, std::memory_order_relaxed);
+  // Round up so the shares add up to at least the global limit
+  workerMaxConnections_.store(
+      workers > 1 ? (maxConnections_ + workers - 1) / workers
+                  : maxConnections_,
+      std::memory_order_relaxed);
+}
+
+} // namespace wangle
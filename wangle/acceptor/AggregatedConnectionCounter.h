@@ -0,0 +1,153 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <folly/experimental/FunctionScheduler.h>
+
+#include <wangle/acceptor/ConnectionCounter.h>
+
+namespace wangle {
+
+/**
+ * Connection counts shared by every Acceptor of a server without taking a
+ * lock on the accept path.
+ *
+ * Each acceptor gets a Worker from newWorker() and uses it as its
+ * IConnectionCounter. A Worker only ever writes its own counters, which
+ * live on their own cache lines, so workers never contend. The global
+ * totals are re-summed every refresh interval on a background thread (or
+ * whenever refresh() is called) and published as atomics; reading them
+ * from Acceptor::canAccept() is a single relaxed load. The totals may lag
+ * by up to one refresh interval, which is fine for load shedding.
+ */
+class AggregatedConnectionCounter
+    : public std::enable_shared_from_this<AggregatedConnectionCounter> {
+ private:
+  struct Slot;
+
+ public:
+  class Worker : public IConnectionCounter {
+   public:
+    ~Worker() override;
+
+    /**
+     * Connections owned by this worker only.
+     */
+    uint64_t getNumConnections() const override;
+    uint64_t getNumActiveConnections() const;
+
+    /**
+     * This worker's fair share of the global connection limit. Acceptors
+     * under their share accept without looking at the global totals.
+     */
+    uint64_t getMaxConnections() const override;
+
+    void onConnectionAdded() override;
+    void onConnectionRemoved() override;
+
+    /**
+     * Report a connection moving between idle and active. The Acceptor
+     * using this worker forwards ConnectionManager's activation callbacks.
+     */
+    void onConnectionActivated() override;
+    void onConnectionDeactivated() override;
+
+    uint64_t getAggregatedConnections() const override;
+    uint64_t getAggregatedActiveConnections() const override;
+
+   private:
+    friend class AggregatedConnectionCounter;
+    Worker(std::shared_ptr<AggregatedConnectionCounter> parent, Slot* slot)
+        : parent_(std::move(parent)), slot_(slot) {}
+
+    std::shared_ptr<AggregatedConnectionCounter> parent_;
+    Slot* slot_;
+  };
+
+  static constexpr std::chrono::milliseconds kDefaultRefreshInterval{10};
+
+  static std::shared_ptr<AggregatedConnectionCounter> create(
+      uint64_t maxConnections,
+      std::chrono::milliseconds refreshInterval = kDefaultRefreshInterval);
+
+  ~AggregatedConnectionCounter();
+
+  /**
+   * Allocate counters for one acceptor. The Worker keeps this object alive.
+   */
+  std::unique_ptr<Worker> newWorker();
+
+  uint64_t getNumConnections() const {
+    return totalConnections_.load(std::memory_order_relaxed);
+  }
+  uint64_t getNumActiveConnections() const {
+    return totalActiveConnections_.load(std::memory_order_relaxed);
+  }
+  uint64_t getMaxConnections() const {
+    return maxConnections_;
+  }
+
+  /**
+   * Re-sum the per-worker counters into the published totals now.
+   */
+  void refresh();
+
+  /**
+   * Stop the background refresh. Totals then only change on refresh().
+   */
+  void stop();
+
+ private:
+  // Keep the hot counters of different workers on different cache lines,
+  // including the adjacent line some CPUs prefetch in pairs.
+  static constexpr size_t kFalseSharingRange = 128;
+
+  struct Slot {
+    char padBefore[kFalseSharingRange];
+    std::atomic<int64_t> connections{0};
+    std::atomic<int64_t> activeConnections{0};
+    char padAfter[kFalseSharingRange];
+    // guarded by slotsMutex_
+    bool inUse{false};
+  };
+
+  AggregatedConnectionCounter(
+      uint64_t maxConnections,
+      std::chrono::milliseconds refreshInterval);
+
+  void start();
+  void releaseSlot(Slot* slot);
+
+  const uint64_t maxConnections_;
+  const std::chrono::milliseconds refreshInterval_;
+  folly::FunctionScheduler scheduler_;
+  bool started_{false};
+
+  std::mutex slotsMutex_;
+  std::vector<std::unique_ptr<Slot>> slots_;
+
+  std::atomic<uint64_t> totalConnections_{0};
+  std::atomic<uint64_t> totalActiveConnections_{0};
+  std::atomic<uint64_t> workerMaxConnections_{0};
+};
+
+} // namespace wangle
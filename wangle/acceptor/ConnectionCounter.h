@@ -39,6 +39,21 @@ class IConnectionCounter {
    * Decrement the count of client-side connections.
    */
   virtual void onConnectionRemoved() = 0;
+
+  /**
+   * A connection became busy, or idle again. The Acceptor reports these
+   * from its ConnectionManager.
+   */
+  virtual void onConnectionActivated() {}
+  virtual void onConnectionDeactivated() {}
+
+  /**
+   * Approximate connection counts across every Acceptor sharing this
+   * counter. Counters that only see a single Acceptor return 0.
+   */
+  virtual uint64_t getAggregatedConnections() const { return 0; }
+  virtual uint64_t getAggregatedActiveConnections() const { return 0; }
+
   virtual ~IConnectionCounter() = default;
 };
 
@@ -33,7 +33,8 @@ ConnectionManager::ConnectionManager(folly::EventBase* eventBase,
     idleIterator_(conns_.end()),
     drainHelper_(*this),
     timeout_(timeout),
-    idleConnEarlyDropThreshold_(timeout_ / 2) {
+    idleConnEarlyDropThreshold_(timeout_ / 2),
+    idleSweeper_(*this) {
 
 }
 
@@ -91,11 +92,117 @@ ConnectionManager::addConnection(ManagedConnection* connection,
 void
 ConnectionManager::scheduleTimeout(ManagedConnection* const connection,
     std::chrono::milliseconds timeout) {
-  if (timeout > std::chrono::milliseconds(0)) {
+  if (timeout <= std::chrono::milliseconds(0)) {
+    return;
+  }
+  if (!idleBuckets_.empty() && timeout == timeout_) {
+    connection->cancelTimeout();
+    touchIdleBucket(connection);
+  } else {
+    unlinkIdleBucket(connection);
     connTimeouts_->scheduleTimeout(connection, timeout);
   }
 }
 
+void
+ConnectionManager::cancelIdleTimeout(ManagedConnection* connection) {
+  unlinkIdleBucket(connection);
+}
+
+void
+ConnectionManager::setIdleBucketGranularity(
+    std::chrono::milliseconds granularity) {
+  CHECK(conns_.empty());
+  idleSweeper_.cancelTimeout();
+  idleBucketTick_ = 0;
+  idleBucketGranularity_ = granularity;
+  if (granularity <= std::chrono::milliseconds(0) ||
+      timeout_ <= std::chrono::milliseconds(0)) {
+    idleBuckets_.clear();
+    return;
+  }
+  // A connection refreshed just before a tick is only considered expired
+  // once ticksToExpire full ticks have passed, so it never expires early.
+  // One extra bucket is needed so the expiring bucket is never the current
+  // one.
+  const size_t ticksToExpire =
+    (timeout_.count() + granularity.count() - 1) / granularity.count() + 1;
+  idleBuckets_ = std::vector<IdleBucket>(ticksToExpire + 1);
+}
+
+std::vector<size_t>
+ConnectionManager::getIdleBucketCounts() const {
+  std::vector<size_t> counts;
+  if (idleBuckets_.empty()) {
+    return counts;
+  }
+  // The oldest slot is always empty since it was just expired
+  const size_t n = idleBuckets_.size();
+  counts.reserve(n - 1);
+  for (size_t i = 0; i + 1 < n; i++) {
+    counts.push_back(idleBuckets_[(idleBucketTick_ + n - i) % n].size());
+  }
+  return counts;
+}
+
+size_t
+ConnectionManager::getNumConnectionsIdleFor(
+    std::chrono::milliseconds idleTime) const {
+  if (idleBuckets_.empty()) {
+    return 0;
+  }
+  const size_t n = idleBuckets_.size();
+  // Bucket i has only been idle for more than i - 1 granularities
+  const size_t first = std::max<int64_t>(
+      0,
+      (idleTime.count() + idleBucketGranularity_.count() - 1) /
+        idleBucketGranularity_.count()) + 1;
+  size_t count = 0;
+  for (size_t i = first; i + 1 < n; i++) {
+    count += idleBuckets_[(idleBucketTick_ + n - i) % n].size();
+  }
+  return count;
+}
+
+void
+ConnectionManager::touchIdleBucket(ManagedConnection* connection) {
+  unlinkIdleBucket(connection);
+  connection->idleBucket_ = currentIdleBucket();
+  idleBuckets_[connection->idleBucket_].push_back(*connection);
+  if (numIdleTracked_++ == 0 && !idleSweeper_.isScheduled()) {
+    idleSweeper_.scheduleTimeout(idleBucketGranularity_);
+  }
+}
+
+void
+ConnectionManager::unlinkIdleBucket(ManagedConnection* connection) {
+  if (connection->idleBucketHook_.is_linked()) {
+    auto& bucket = idleBuckets_[connection->idleBucket_];
+    bucket.erase(bucket.iterator_to(*connection));
+    numIdleTracked_--;
+  }
+}
+
+void
+ConnectionManager::sweepIdleBuckets() {
+  DestructorGuard g(this);
+  idleBucketTick_++;
+  // The bucket after the current one was filled ticksToExpire ticks ago
+  auto& expired = idleBuckets_[(idleBucketTick_ + 1) % idleBuckets_.size()];
+  VLOG_IF(4, !expired.empty()) << "expiring " << expired.size()
+                               << " idle connections";
+  while (!expired.empty()) {
+    ManagedConnection& conn = expired.front();
+    expired.pop_front();
+    numIdleTracked_--;
+    // May remove, destroy or re-schedule the connection
+    conn.timeoutExpired();
+  }
+  if (numIdleTracked_ > 0) {
+    idleSweeper_.scheduleTimeout(idleBucketGranularity_);
+  }
+}
+
 void ConnectionManager::scheduleTimeout(
   folly::HHWheelTimer::Callback* callback,
   std::chrono::milliseconds timeout) {
@@ -106,6 +213,7 @@ void
 ConnectionManager::removeConnection(ManagedConnection* connection) {
   if (connection->getConnectionManager() == this) {
     connection->cancelTimeout();
+    unlinkIdleBucket(connection);
     connection->setConnectionManager(nullptr);
 
     // Un-link the connection from our list, being careful to keep the iterator
@@ -119,7 +227,12 @@ ConnectionManager::removeConnection(ManagedConnection* connection) {
     }
     conns_.erase(it);
 
+    bool wasActivated = connection->activated_;
+    connection->activated_ = false;
     if (callback_) {
+      if (wasActivated) {
+        callback_->onConnectionDeactivated(*this);
+      }
       callback_->onConnectionRemoved(*this);
       if (getNumConnections() == 0) {
         callback_->onEmpty(*this);
@@ -268,6 +381,7 @@ ConnectionManager::dropAllConnections() {
     ManagedConnection& conn = conns_.front();
     conns_.pop_front();
     conn.cancelTimeout();
+    unlinkIdleBucket(&conn);
     conn.setConnectionManager(nullptr);
     // For debugging purposes, dump information about the first few
     // connections.
@@ -280,6 +394,7 @@ ConnectionManager::dropAllConnections() {
   drainIterator_ = conns_.end();
   idleIterator_ = conns_.end();
   drainHelper_.cancelLoopCallback();
+  idleSweeper_.cancelTimeout();
 
   if (callback_) {
     callback_->onEmpty(*this);
@@ -310,6 +425,12 @@ ConnectionManager::onActivated(ManagedConnection& conn) {
   }
   conns_.erase(it);
   conns_.push_front(conn);
+  if (!conn.activated_) {
+    conn.activated_ = true;
+    if (callback_) {
+      callback_->onConnectionActivated(*this);
+    }
+  }
 }
 
 void
@@ -328,6 +449,12 @@ ConnectionManager::onDeactivated(ManagedConnection& conn) {
   if (moveDrainIter && drainIterator_ == conns_.end()) {
     drainIterator_--;
   }
+  if (conn.activated_) {
+    conn.activated_ = false;
+    if (callback_) {
+      callback_->onConnectionDeactivated(*this);
+    }
+  }
 }
 
 size_t
@@ -337,6 +464,10 @@ ConnectionManager::dropIdleConnections(size_t num) {
     return 0;
   }
 
+  if (!idleBuckets_.empty()) {
+    return dropIdleBucketConnections(num);
+  }
+
   size_t count = 0;
   while(count < num) {
     auto it = idleIterator_;
@@ -360,4 +491,29 @@ ConnectionManager::dropIdleConnections(size_t num) {
   return count;
 }
 
+size_t
+ConnectionManager::dropIdleBucketConnections(size_t num) {
+  DestructorGuard g(this);
+  const size_t n = idleBuckets_.size();
+  // Only buckets idle for longer than the early drop threshold
+  const size_t last = (idleConnEarlyDropThreshold_.count() +
+    idleBucketGranularity_.count() - 1) / idleBucketGranularity_.count() + 1;
+  size_t count = 0;
+  for (size_t i = n - 2; i >= last && i < n && count < num; i--) {
+    auto& bucket = idleBuckets_[(idleBucketTick_ + n - i) % n];
+    auto it = bucket.begin();
+    while (it != bucket.end() && count < num) {
+      ManagedConnection& conn = *it++;
+      if (conn.activated_) {
+        continue;
+      }
+      // Removes the connection from its bucket
+      conn.dropConnection();
+      count++;
+    }
+  }
+  VLOG(4) << "dropped " << count << "/" << num << " idle connections";
+  return count;
+}
+
 } // wangle
@@ -20,6 +20,7 @@
 #include <chrono>
 #include <iterator>
 #include <utility>
+#include <vector>
 #include <folly/Memory.h>
 #include <folly/io/async/AsyncTimeout.h>
 #include <folly/io/async/HHWheelTimer.h>
@@ -58,6 +59,13 @@ class ConnectionManager: public folly::DelayedDestruction,
      * Invoked when a connection is removed from the ConnectionManager.
      */
     virtual void onConnectionRemoved(const ConnectionManager& cm) = 0;
+
+    /**
+     * Invoked when a connection becomes busy, and when it becomes idle
+     * again or is removed while busy.
+     */
+    virtual void onConnectionActivated(const ConnectionManager& /*cm*/) {}
+    virtual void onConnectionDeactivated(const ConnectionManager& /*cm*/) {}
   };
 
   typedef std::unique_ptr<ConnectionManager, Destructor> UniquePtr;
@@ -96,6 +104,12 @@ class ConnectionManager: public folly::DelayedDestruction,
   void scheduleTimeout(ManagedConnection* const connection,
                        std::chrono::milliseconds timeout);
 
+  /**
+   * Stop tracking the idle timeout of a connection, see
+   * ManagedConnection::cancelIdleTimeout().
+   */
+  void cancelIdleTimeout(ManagedConnection* connection);
+
   /*
    * Schedule a callback on the wheel timer
    */
@@ -137,6 +151,41 @@ class ConnectionManager: public folly::DelayedDestruction,
 
   size_t getNumConnections() const { return conns_.size(); }
 
+  /**
+   * Track default idle timeouts in coarse buckets of the given granularity
+   * instead of one wheel timer entry per connection. Refreshing a
+   * connection's timeout just moves it into the newest bucket, and every
+   * granularity tick expires the whole oldest bucket, so sweeping idle
+   * connections costs O(expired) no matter how many connections are idle.
+   *
+   * Timeouts fire up to one granularity late. Timeouts other than the
+   * default one still go to the wheel timer. dropIdleConnections() then
+   * drops from the oldest buckets, touching only the connections it drops
+   * and busy ones it skips. Pass zero to disable; this must be called
+   * before any connection is added. Acceptors enable it through
+   * ServerSocketConfig::connectionIdleBucketGranularity.
+   */
+  void setIdleBucketGranularity(std::chrono::milliseconds granularity);
+
+  std::chrono::milliseconds getIdleBucketGranularity() const {
+    return idleBucketGranularity_;
+  }
+
+  /**
+   * Number of connections in each idle bucket, newest first. Bucket i holds
+   * connections whose timeout was last refreshed i granularity ticks ago,
+   * so they have been idle for more than i - 1 and less than i + 1
+   * granularities. Empty unless idle buckets are enabled.
+   */
+  std::vector<size_t> getIdleBucketCounts() const;
+
+  /**
+   * Number of connections certainly idle for at least the given time,
+   * counted by whole buckets without touching the connections themselves.
+   * Connections idle for up to two granularities longer may be missed.
+   */
+  size_t getNumConnectionsIdleFor(std::chrono::milliseconds idleTime) const;
+
   template <typename F>
   void iterateConns(F func) {
     auto it = conns_.begin();
@@ -241,6 +290,27 @@ class ConnectionManager: public folly::DelayedDestruction,
     ShutdownState shutdownState_{ShutdownState::NONE};
   };
 
+  /**
+   * Advances the idle buckets once per granularity tick while any
+   * connection is tracked in them.
+   */
+  class IdleSweeper : public folly::AsyncTimeout {
+   public:
+    explicit IdleSweeper(ConnectionManager& manager)
+        : folly::AsyncTimeout(manager.eventBase_),
+          manager_(manager) {}
+
+    void timeoutExpired() noexcept override {
+      manager_.sweepIdleBuckets();
+    }
+
+   private:
+    ConnectionManager& manager_;
+  };
+
+  typedef folly::CountedIntrusiveList<
+    ManagedConnection, &ManagedConnection::idleBucketHook_> IdleBucket;
+
   ~ConnectionManager() override = default;
 
   ConnectionManager(const ConnectionManager&) = delete;
@@ -260,6 +330,14 @@ class ConnectionManager: public folly::DelayedDestruction,
 
   void idleGracefulTimeoutExpired();
 
+  size_t dropIdleBucketConnections(size_t num);
+  void touchIdleBucket(ManagedConnection* connection);
+  void unlinkIdleBucket(ManagedConnection* connection);
+  void sweepIdleBuckets();
+  size_t currentIdleBucket() const {
+    return idleBucketTick_ % idleBuckets_.size();
+  }
+
   /**
    * All the managed connections. idleIterator_ seperates them into two parts:
    * idle and busy ones.  [conns_.begin(), idleIterator_) are the busy ones,
@@ -299,6 +377,16 @@ class ConnectionManager: public folly::DelayedDestruction,
    * time is less than idleConnEarlyDropThreshold_.
    */
   std::chrono::milliseconds idleConnEarlyDropThreshold_;
+
+  /**
+   * Ring of idle buckets, indexed by granularity tick. Connections in the
+   * bucket after the current one have been idle for the full timeout.
+   */
+  std::vector<IdleBucket> idleBuckets_;
+  std::chrono::milliseconds idleBucketGranularity_{0};
+  uint64_t idleBucketTick_{0};
+  size_t numIdleTracked_{0};
+  IdleSweeper idleSweeper_;
 };
 
 } // wangle
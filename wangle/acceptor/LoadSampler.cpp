@@ -0,0 +1,234 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <wangle/acceptor/LoadSampler.h>
+
+#include <folly/Conv.h>
+#include <folly/FileUtil.h>
+#include <folly/String.h>
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <vector>
+
+using folly::StringPiece;
+
+namespace wangle {
+
+namespace {
+
+constexpr double kPpm = 1000000.0;
+constexpr std::chrono::milliseconds kDefaultLoadUpdatePeriod{1000};
+
+uint64_t toPpm(double ratio) {
+  return static_cast<uint64_t>(ratio * kPpm);
+}
+
+}
+
+LoadSampler::LoadSampler(const LoadShedConfiguration& config)
+    : config_(config) {
+  scheduler_.setThreadName("load-sampler");
+}
+
+LoadSampler::~LoadSampler() {
+  stop();
+}
+
+void LoadSampler::setConfig(const LoadShedConfiguration& config) {
+  std::lock_guard<std::mutex> g(configMutex_);
+  config_ = config;
+}
+
+LoadShedConfiguration LoadSampler::getConfig() const {
+  std::lock_guard<std::mutex> g(configMutex_);
+  return config_;
+}
+
+void LoadSampler::start() {
+  if (started_) {
+    return;
+  }
+  auto period = getConfig().getLoadUpdatePeriod();
+  if (period.count() <= 0) {
+    period = kDefaultLoadUpdatePeriod;
+  }
+  scheduler_.addFunction([this] { sampleNow(); }, period, "load-sampler");
+  scheduler_.start();
+  started_ = true;
+}
+
+void LoadSampler::stop() {
+  if (!started_) {
+    return;
+  }
+  scheduler_.cancelFunctionAndWait("load-sampler");
+  scheduler_.shutdown();
+  started_ = false;
+}
+
+void LoadSampler::sampleNow() {
+  CpuTimes cpu;
+  MemInfo mem;
+  if (!readCpuTimes(cpu) || !readMemInfo(mem)) {
+    LOG_EVERY_N(ERROR, 100) << "Failed to read system load";
+    return;
+  }
+  update(cpu, mem);
+}
+
+bool LoadSampler::update(const CpuTimes& cpu, const MemInfo& mem) {
+  const auto config = getConfig();
+  bool overloaded = false;
+
+  if (mem.totalBytes > 0) {
+    auto used = mem.totalBytes - std::min(mem.availableBytes, mem.totalBytes);
+    double memUsage = double(used) / mem.totalBytes;
+    memUsagePpm_.store(toPpm(memUsage), std::memory_order_relaxed);
+    freeMem_.store(mem.availableBytes, std::memory_order_relaxed);
+    overloaded = memUsage > config.getMaxMemUsage() ||
+      mem.availableBytes < config.getMinFreeMem();
+  }
+
+  bool haveDelta = haveCpu_ && cpu.total > lastCpu_.total;
+  if (haveDelta) {
+    double total = cpu.total - lastCpu_.total;
+    double idle = cpu.idle >= lastCpu_.idle ? cpu.idle - lastCpu_.idle : 0;
+    double iowait =
+      cpu.iowait >= lastCpu_.iowait ? cpu.iowait - lastCpu_.iowait : 0;
+    double cpuIdle = std::min(idle / total, 1.0);
+    double cpuUsage = std::max(1.0 - (idle + iowait) / total, 0.0);
+    cpuIdlePpm_.store(toPpm(cpuIdle), std::memory_order_relaxed);
+    cpuUsagePpm_.store(toPpm(cpuUsage), std::memory_order_relaxed);
+
+    size_t window = std::max<uint64_t>(
+        config.getCpuUsageExceedWindowSize(), 1);
+    cpuExceeded_.push_back(
+        cpuUsage > config.getMaxCpuUsage() ||
+        cpuIdle < config.getMinCpuIdle());
+    while (cpuExceeded_.size() > window) {
+      cpuExceeded_.pop_front();
+    }
+    if (cpuExceeded_.size() == window &&
+        std::all_of(cpuExceeded_.begin(), cpuExceeded_.end(),
+                    [](bool exceeded) { return exceeded; })) {
+      overloaded = true;
+    }
+  }
+  lastCpu_ = cpu;
+  haveCpu_ = true;
+
+  if (overloaded != overloaded_.load(std::memory_order_relaxed)) {
+    LOG(INFO) << (overloaded ? "System overloaded" : "System load recovered")
+              << ", cpuUsage=" << getLastSample().cpuUsage
+              << " memUsage=" << getLastSample().memUsage;
+  }
+  overloaded_.store(overloaded, std::memory_order_relaxed);
+  return haveDelta;
+}
+
+LoadSampler::Sample LoadSampler::getLastSample() const {
+  Sample sample;
+  sample.cpuUsage = cpuUsagePpm_.load(std::memory_order_relaxed) / kPpm;
+  sample.cpuIdle = cpuIdlePpm_.load(std::memory_order_relaxed) / kPpm;
+  sample.memUsage = memUsagePpm_.load(std::memory_order_relaxed) / kPpm;
+  sample.freeMem = freeMem_.load(std::memory_order_relaxed);
+  return sample;
+}
+
+bool LoadSampler::readCpuTimes(CpuTimes& out) {
+  std::string contents;
+  if (!folly::readFile("/proc/stat", contents)) {
+    return false;
+  }
+  return parseProcStat(contents, out);
+}
+
+bool LoadSampler::readMemInfo(MemInfo& out) {
+  std::string contents;
+  if (!folly::readFile("/proc/meminfo", contents)) {
+    return false;
+  }
+  return parseMemInfo(contents, out);
+}
+
+bool LoadSampler::parseProcStat(StringPiece contents, CpuTimes& out) {
+  // First line is the aggregate over all cpus:
+  // cpu  user nice system idle iowait irq softirq steal guest guest_nice
+  auto line = contents.split_step('\n');
+  if (!line.removePrefix("cpu ")) {
+    return false;
+  }
+  std::vector<StringPiece> fields;
+  folly::split(' ', line, fields, true);
+  if (fields.size() < 4) {
+    return false;
+  }
+  CpuTimes times;
+  // guest time is already accounted for in user/nice, so stop at steal
+  for (size_t i = 0; i < fields.size() && i < 8; ++i) {
+    auto value = folly::tryTo<uint64_t>(fields[i]);
+    if (!value.hasValue()) {
+      return false;
+    }
+    times.total += value.value();
+    if (i == 3) {
+      times.idle = value.value();
+    } else if (i == 4) {
+      times.iowait = value.value();
+    }
+  }
+  out = times;
+  return true;
+}
+
+bool LoadSampler::parseMemInfo(StringPiece contents, MemInfo& out) {
+  // Lines look like "MemAvailable:   12345 kB". Older kernels lack
+  // MemAvailable, so fall back to free + buffers + cached.
+  uint64_t total = 0, available = 0, free = 0, buffers = 0, cached = 0;
+  bool haveAvailable = false;
+  while (!contents.empty()) {
+    auto line = contents.split_step('\n');
+    auto name = line.split_step(':');
+    line = folly::trimWhitespace(line);
+    auto numEnd = line.find(' ');
+    auto number = numEnd == StringPiece::npos ? line : line.subpiece(0, numEnd);
+    auto value = folly::tryTo<uint64_t>(number);
+    if (!value.hasValue()) {
+      continue;
+    }
+    uint64_t bytes = value.value() * (line.endsWith("kB") ? 1024 : 1);
+    if (name == "MemTotal") {
+      total = bytes;
+    } else if (name == "MemAvailable") {
+      available = bytes;
+      haveAvailable = true;
+    } else if (name == "MemFree") {
+      free = bytes;
+    } else if (name == "Buffers") {
+      buffers = bytes;
+    } else if (name == "Cached") {
+      cached = bytes;
+    }
+  }
+  if (total == 0) {
+    return false;
+  }
+  out.totalBytes = total;
+  out.availableBytes = haveAvailable ? available : free + buffers + cached;
+  return true;
+}
+
+} // namespace wangle
@@ -0,0 +1,126 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+
+#include <folly/Range.h>
+#include <folly/experimental/FunctionScheduler.h>
+
+#include <wangle/acceptor/LoadShedConfiguration.h>
+
+namespace wangle {
+
+/**
+ * Periodically samples system CPU and memory load and publishes whether
+ * the box is overloaded according to a LoadShedConfiguration.
+ *
+ * Sampling happens on a background thread every getLoadUpdatePeriod();
+ * isOverloaded() is a single relaxed atomic load so Acceptor::canAccept()
+ * can consult it for every connection without making any syscalls.
+ *
+ * CPU overload is only declared once getCpuUsageExceedWindowSize()
+ * consecutive samples exceed the CPU limits, so short spikes do not shed
+ * load. Memory limits take effect on the first sample that exceeds them.
+ *
+ * The thresholds can be replaced at any time with setConfig(); each sample
+ * uses the configuration current when it is taken. The sampling period is
+ * read once, by start().
+ */
+class LoadSampler {
+ public:
+  struct CpuTimes {
+    uint64_t total{0};
+    uint64_t idle{0};
+    uint64_t iowait{0};
+  };
+
+  struct MemInfo {
+    uint64_t totalBytes{0};
+    uint64_t availableBytes{0};
+  };
+
+  struct Sample {
+    double cpuUsage{0.0};
+    double cpuIdle{1.0};
+    double memUsage{0.0};
+    uint64_t freeMem{0};
+  };
+
+  explicit LoadSampler(const LoadShedConfiguration& config);
+  virtual ~LoadSampler();
+
+  /**
+   * Start/stop the background sampling thread. A sampler is idle until
+   * started; stop() is called on destruction.
+   */
+  void start();
+  void stop();
+
+  /**
+   * Replace the thresholds used by the following samples. Thread safe.
+   */
+  void setConfig(const LoadShedConfiguration& config);
+
+  LoadShedConfiguration getConfig() const;
+
+  bool isOverloaded() const {
+    return overloaded_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Take one sample and update the overload verdict. Called from the
+   * sampling thread; exposed so callers can drive it synchronously.
+   */
+  void sampleNow();
+
+  /**
+   * Feed one set of readings through the window. Returns false until a
+   * previous CPU reading exists to compute a delta from.
+   */
+  bool update(const CpuTimes& cpu, const MemInfo& mem);
+
+  Sample getLastSample() const;
+
+  static bool parseProcStat(folly::StringPiece contents, CpuTimes& out);
+  static bool parseMemInfo(folly::StringPiece contents, MemInfo& out);
+
+ protected:
+  virtual bool readCpuTimes(CpuTimes& out);
+  virtual bool readMemInfo(MemInfo& out);
+
+ private:
+  mutable std::mutex configMutex_;
+  LoadShedConfiguration config_;
+  folly::FunctionScheduler scheduler_;
+  bool started_{false};
+
+  // Only touched by whichever thread runs sampleNow()
+  bool haveCpu_{false};
+  CpuTimes lastCpu_;
+  std::deque<bool> cpuExceeded_;
+
+  std::atomic<bool> overloaded_{false};
+  std::atomic<uint64_t> cpuUsagePpm_{0};
+  std::atomic<uint64_t> cpuIdlePpm_{1000000};
+  std::atomic<uint64_t> memUsagePpm_{0};
+  std::atomic<uint64_t> freeMem_{0};
+};
+
+} // namespace wangle
@@ -157,6 +157,9 @@ class LoadShedConfiguration {
     return minFreeMem_;
   }
 
+  /**
+   * Set/get how often LoadSampler re-reads system CPU and memory load.
+   */
   void setLoadUpdatePeriod(std::chrono::milliseconds period) {
     period_ = period;
   }
@@ -180,11 +183,11 @@ class LoadShedConfiguration {
   uint64_t acceptPauseOnAcceptorQueueSize_{0};
   uint64_t acceptResumeOnAcceptorQueueSize_{0};
   uint64_t minFreeMem_{0};
-  double maxMemUsage_;
-  double maxCpuUsage_;
+  double maxMemUsage_{1.0};
+  double maxCpuUsage_{1.0};
   double minCpuIdle_{0.0};
   uint64_t cpuUsageExceedWindowSize_{0};
-  std::chrono::milliseconds period_;
+  std::chrono::milliseconds period_{1000};
   bool loadSheddingEnabled_{true};
 };
 
@@ -44,6 +44,14 @@ ManagedConnection::resetTimeoutTo(std::chrono::milliseconds timeout) {
   }
 }
 
+void
+ManagedConnection::cancelIdleTimeout() {
+  cancelTimeout();
+  if (connectionManager_) {
+    connectionManager_->cancelIdleTimeout(this);
+  }
+}
+
 void
 ManagedConnection::scheduleTimeout(
   folly::HHWheelTimer::Callback* callback,
@@ -125,6 +125,12 @@ class ManagedConnection:
    */
   void resetTimeoutTo(std::chrono::milliseconds);
 
+  /**
+   * Stop the idle timeout countdown, whether it is tracked on the wheel
+   * timer or in the connection manager's idle buckets.
+   */
+  void cancelIdleTimeout();
+
   // Schedule an arbitrary timeout on the HHWheelTimer
   virtual void scheduleTimeout(
     folly::HHWheelTimer::Callback* callback,
@@ -156,6 +162,14 @@ class ManagedConnection:
 
   folly::SafeIntrusiveListHook listHook_;
 
+  // Idle bucket this connection is linked into, if the connection manager
+  // tracks idle timeouts in buckets
+  folly::SafeIntrusiveListHook idleBucketHook_;
+  size_t idleBucket_{0};
+
+  // Between the connection manager's onActivated() and onDeactivated()
+  bool activated_{false};
+
 };
 
 std::ostream& operator<<(std::ostream& os, const ManagedConnection& conn);
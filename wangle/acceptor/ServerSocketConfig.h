@@ -15,6 +15,7 @@
  */
 #pragma once
 
+#include <wangle/ssl/PrivateKeyOffload.h>
 #include <wangle/ssl/SSLCacheOptions.h>
 #include <wangle/ssl/SSLContextConfig.h>
 #include <wangle/ssl/TLSTicketKeySeeds.h>
@@ -99,6 +100,13 @@ struct ServerSocketConfig {
    */
   std::chrono::milliseconds connectionIdleTimeout{600000};
 
+  /**
+   * If nonzero, track connectionIdleTimeout in idle buckets of this
+   * granularity instead of one wheel timer entry per connection, see
+   * ConnectionManager::setIdleBucketGranularity().
+   */
+  std::chrono::milliseconds connectionIdleBucketGranularity{0};
+
   /**
    * The number of milliseconds a ssl handshake can timeout (60s)
    */
@@ -142,6 +150,16 @@ struct ServerSocketConfig {
    */
   uint32_t maxConcurrentSSLHandshakes{30720};
 
+  /**
+   * If set, RSA private key operations of SSL handshakes run on this
+   * offload's CPU pool while the handshake is suspended, instead of on the
+   * acceptor's EventBase. The offload is shared by every acceptor built
+   * from this config, and so is its limit: no more than
+   * maxConcurrentSSLHandshakes operations are offloaded at once across all
+   * of them, not per acceptor. Size the pool accordingly.
+   */
+  std::shared_ptr<PrivateKeyOffload> privateKeyOffload;
+
   /**
    * Whether to enable TCP fast open. Before turning this
    * option on, for it to work, it must also be enabled on the
@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 #include <wangle/acceptor/Acceptor.h>
+#include <wangle/acceptor/AggregatedConnectionCounter.h>
 
 #include <gtest/gtest.h>
 
@@ -178,4 +179,97 @@ TEST_F(AcceptorTest, TestCanAcceptWithBothConnectionCountsBreachingThresholds) {
   EXPECT_FALSE(acceptor_.canAccept(address_));
 }
 
+TEST_F(AcceptorTest, TestLoadSamplerFollowsLoadShedConfig) {
+  auto sampler = std::make_shared<LoadSampler>(LoadShedConfiguration());
+  acceptor_.setLoadSampler(sampler);
+
+  LoadSampler::CpuTimes cpu;
+  LoadSampler::MemInfo mem;
+  mem.totalBytes = 100;
+  mem.availableBytes = 15;
+  sampler->update(cpu, mem);
+  EXPECT_TRUE(acceptor_.canAccept(address_));
+
+  // Lowering the limit on the acceptor reaches the shared sampler
+  loadShedConfig_.setMaxMemUsage(0.8);
+  acceptor_.setLoadShedConfig(loadShedConfig_, &connectionCounter_);
+  EXPECT_EQ(0.8, sampler->getConfig().getMaxMemUsage());
+  sampler->update(cpu, mem);
+  EXPECT_FALSE(acceptor_.canAccept(address_));
+
+  // Whitelisted addresses are still accepted
+  loadShedConfig_.addWhitelistAddr(address_.getAddressStr());
+  acceptor_.setLoadShedConfig(loadShedConfig_, &connectionCounter_);
+  EXPECT_TRUE(acceptor_.canAccept(address_));
+}
+
+/**
+ * Acceptor that keeps the default, counter based load shedding counts
+ */
+class CountingAcceptor : public Acceptor {
+  public:
+    explicit CountingAcceptor(const ServerSocketConfig& accConfig) :
+      Acceptor(accConfig) {}
+
+    using Acceptor::setLoadShedConfig;
+    using Acceptor::canAccept;
+    using Acceptor::initDownstreamConnectionManager;
+};
+
+class IdleTestConnection : public ManagedConnection {
+  public:
+    void timeoutExpired() noexcept override {}
+    void describe(std::ostream&) const override {}
+    bool isBusy() const override { return false; }
+    void notifyPendingShutdown() override {}
+    void closeWhenIdle() override {}
+    void dropConnection() override {}
+    void dumpConnectionState(uint8_t) override {}
+};
+
+TEST(AcceptorLoadShedTest, ActiveConnectionsFromConnectionManager) {
+  EventBase evb;
+  CountingAcceptor acceptor { ServerSocketConfig() };
+  acceptor.initDownstreamConnectionManager(&evb);
+  auto cm = acceptor.getConnectionManager();
+
+  // Two acceptors share 4 connections; this one is at its share of 2
+  auto counter = AggregatedConnectionCounter::create(
+      4, std::chrono::hours(1));
+  auto worker = counter->newWorker();
+  auto otherWorker = counter->newWorker();
+  worker->onConnectionAdded();
+  worker->onConnectionAdded();
+  LoadShedConfiguration config;
+  config.setMaxConnections(4);
+  config.setMaxActiveConnections(1);
+  acceptor.setLoadShedConfig(config, worker.get());
+
+  SocketAddress address { "127.0.0.1", 2000 };
+  auto conn = new IdleTestConnection();
+  cm->addConnection(conn);
+  counter->refresh();
+  EXPECT_TRUE(acceptor.canAccept(address));
+
+  // Activation reaches the counter through the acceptor
+  cm->onActivated(*conn);
+  EXPECT_EQ(1, worker->getNumActiveConnections());
+  counter->refresh();
+  EXPECT_FALSE(acceptor.canAccept(address));
+
+  cm->onDeactivated(*conn);
+  counter->refresh();
+  EXPECT_TRUE(acceptor.canAccept(address));
+
+  // Removing a busy connection deactivates it
+  cm->onActivated(*conn);
+  cm->onActivated(*conn);
+  EXPECT_EQ(1, worker->getNumActiveConnections());
+  cm->removeConnection(conn);
+  EXPECT_EQ(0, worker->getNumActiveConnections());
+  counter->refresh();
+  EXPECT_TRUE(acceptor.canAccept(address));
+  conn->destroy();
+}
+
 } // namespace wangle
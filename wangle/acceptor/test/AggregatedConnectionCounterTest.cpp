@@ -0,0 +1,68 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <wangle/acceptor/AggregatedConnectionCounter.h>
+
+#include <gtest/gtest.h>
+
+#include <thread>
+
+using namespace wangle;
+using namespace testing;
+
+TEST(AggregatedConnectionCounterTest, SumsWorkers) {
+  auto counter = AggregatedConnectionCounter::create(
+      100, std::chrono::hours(1));
+  auto w1 = counter->newWorker();
+  auto w2 = counter->newWorker();
+  EXPECT_EQ(50, w1->getMaxConnections());
+
+  w1->onConnectionAdded();
+  w1->onConnectionAdded();
+  w1->onConnectionActivated();
+  w2->onConnectionAdded();
+  EXPECT_EQ(2, w1->getNumConnections());
+  EXPECT_EQ(1, w2->getNumConnections());
+
+  // Totals only move on refresh
+  EXPECT_EQ(0, w1->getAggregatedConnections());
+  counter->refresh();
+  EXPECT_EQ(3, w1->getAggregatedConnections());
+  EXPECT_EQ(3, w2->getAggregatedConnections());
+  EXPECT_EQ(1, w2->getAggregatedActiveConnections());
+
+  w1->onConnectionDeactivated();
+  w1->onConnectionRemoved();
+  counter->refresh();
+  EXPECT_EQ(2, counter->getNumConnections());
+  EXPECT_EQ(0, counter->getNumActiveConnections());
+
+  // Releasing a worker drops its share and hands its limit back
+  w2.reset();
+  EXPECT_EQ(1, counter->getNumConnections());
+  EXPECT_EQ(100, w1->getMaxConnections());
+}
+
+TEST(AggregatedConnectionCounterTest, BackgroundRefresh) {
+  auto counter = AggregatedConnectionCounter::create(
+      10, std::chrono::milliseconds(1));
+  auto w = counter->newWorker();
+  w->onConnectionAdded();
+  for (int i = 0; i < 1000 && counter->getNumConnections() == 0; ++i) {
+    /* sleep override */ std::this_thread::sleep_for(
+        std::chrono::milliseconds(1));
+  }
+  EXPECT_EQ(1, counter->getNumConnections());
+}
@@ -332,6 +332,69 @@ TEST_F(ConnectionManagerTest, testDropIdle) {
   cm_->dropIdleConnections(conns_.size());
 }
 
+TEST_F(ConnectionManagerTest, testIdleBuckets) {
+  auto cm = ConnectionManager::makeUnique(&eventBase_,
+                                          std::chrono::milliseconds(100),
+                                          nullptr);
+  cm->setIdleBucketGranularity(std::chrono::milliseconds(10));
+  auto expiring = MockConnection::makeUnique(this);
+  auto cancelled = MockConnection::makeUnique(this);
+  cm->addConnection(expiring.get(), true);
+  cm->addConnection(cancelled.get(), true);
+
+  auto counts = cm->getIdleBucketCounts();
+  ASSERT_FALSE(counts.empty());
+  EXPECT_EQ(2, counts[0]);
+  EXPECT_EQ(0, cm->getNumConnectionsIdleFor(std::chrono::milliseconds(50)));
+
+  cancelled->cancelIdleTimeout();
+  EXPECT_EQ(1, cm->getIdleBucketCounts()[0]);
+
+  auto start = std::chrono::steady_clock::now();
+  EXPECT_CALL(*expiring, timeoutExpired_())
+    .WillOnce(Invoke([&] { cm->removeConnection(expiring.get()); }));
+  eventBase_.loop();
+  EXPECT_GE(std::chrono::steady_clock::now() - start,
+            std::chrono::milliseconds(100));
+  EXPECT_EQ(1, cm->getNumConnections());
+
+  cm->removeConnection(cancelled.get());
+}
+
+TEST_F(ConnectionManagerTest, testIdleBucketsDropIdle) {
+  auto cm = ConnectionManager::makeUnique(&eventBase_,
+                                          std::chrono::milliseconds(100),
+                                          nullptr);
+  cm->setIdleBucketGranularity(std::chrono::milliseconds(10));
+  auto idle = MockConnection::makeUnique(this);
+  auto touched = MockConnection::makeUnique(this);
+  cm->addConnection(idle.get(), true);
+  cm->addConnection(touched.get(), true);
+
+  eventBase_.runAfterDelay([&] {
+    // Idle for about 40ms, which is only certain for 20ms
+    EXPECT_EQ(2, cm->getNumConnectionsIdleFor(std::chrono::milliseconds(20)));
+    EXPECT_EQ(0, cm->getNumConnectionsIdleFor(std::chrono::milliseconds(60)));
+    touched->resetTimeout();
+    EXPECT_EQ(1, cm->getNumConnectionsIdleFor(std::chrono::milliseconds(20)));
+    // The newest bucket may have been refreshed just now
+    EXPECT_EQ(1, cm->getNumConnectionsIdleFor(std::chrono::milliseconds(0)));
+    // Nothing is past the early drop threshold of timeout / 2 yet
+    EXPECT_EQ(0, cm->dropIdleConnections(2));
+  }, 40);
+
+  eventBase_.runAfterDelay([&] {
+    // Only the connection idle for about 85ms is dropped
+    EXPECT_CALL(*idle, dropConnection())
+      .WillOnce(Invoke([&] { cm->removeConnection(idle.get()); }));
+    EXPECT_EQ(1, cm->dropIdleConnections(2));
+    EXPECT_EQ(1, cm->getNumConnections());
+    cm->removeConnection(touched.get());
+  }, 85);
+
+  eventBase_.loop();
+}
+
 TEST_F(ConnectionManagerTest, testAddDuringShutdown) {
   auto extraConn = MockConnection::makeUnique(this);
   InSequence enforceOrder;
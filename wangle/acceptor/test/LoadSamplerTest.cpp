@@ -0,0 +1,136 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <wangle/acceptor/LoadSampler.h>
+
+#include <gtest/gtest.h>
+
+using namespace wangle;
+using namespace testing;
+
+TEST(LoadSamplerTest, ParseProcStat) {
+  LoadSampler::CpuTimes times;
+  EXPECT_TRUE(LoadSampler::parseProcStat(
+      "cpu  10 20 30 400 50 6 7 8 100 100\ncpu0 1 2 3 4 5 6 7 8 0 0\n",
+      times));
+  EXPECT_EQ(531, times.total);
+  EXPECT_EQ(400, times.idle);
+  EXPECT_EQ(50, times.iowait);
+
+  EXPECT_FALSE(LoadSampler::parseProcStat("intr 1 2 3\n", times));
+  EXPECT_FALSE(LoadSampler::parseProcStat("cpu  1 2 x 4\n", times));
+}
+
+TEST(LoadSamplerTest, ParseMemInfo) {
+  LoadSampler::MemInfo mem;
+  EXPECT_TRUE(LoadSampler::parseMemInfo(
+      "MemTotal:        1000 kB\n"
+      "MemFree:          100 kB\n"
+      "MemAvailable:     400 kB\n"
+      "Buffers:           50 kB\n"
+      "Cached:           200 kB\n",
+      mem));
+  EXPECT_EQ(1000 * 1024, mem.totalBytes);
+  EXPECT_EQ(400 * 1024, mem.availableBytes);
+
+  // No MemAvailable on older kernels
+  EXPECT_TRUE(LoadSampler::parseMemInfo(
+      "MemTotal:        1000 kB\n"
+      "MemFree:          100 kB\n"
+      "Buffers:           50 kB\n"
+      "Cached:           200 kB\n",
+      mem));
+  EXPECT_EQ(350 * 1024, mem.availableBytes);
+
+  EXPECT_FALSE(LoadSampler::parseMemInfo("MemFree: 100 kB\n", mem));
+}
+
+TEST(LoadSamplerTest, CpuExceedWindow) {
+  LoadShedConfiguration config;
+  config.setMaxCpuUsage(0.9);
+  config.setCpuUsageExceedWindowSize(3);
+  LoadSampler sampler(config);
+
+  LoadSampler::MemInfo mem;
+  mem.totalBytes = 100;
+  mem.availableBytes = 50;
+
+  LoadSampler::CpuTimes cpu;
+  EXPECT_FALSE(sampler.update(cpu, mem));
+
+  // Each step is 100 ticks with 5 idle, i.e. 95% busy
+  auto busy = [&] {
+    cpu.total += 100;
+    cpu.idle += 5;
+    return sampler.update(cpu, mem);
+  };
+  EXPECT_TRUE(busy());
+  EXPECT_FALSE(sampler.isOverloaded());
+  EXPECT_TRUE(busy());
+  EXPECT_FALSE(sampler.isOverloaded());
+  EXPECT_TRUE(busy());
+  EXPECT_TRUE(sampler.isOverloaded());
+  EXPECT_NEAR(0.95, sampler.getLastSample().cpuUsage, 0.001);
+
+  // A single quiet sample clears the verdict
+  cpu.total += 100;
+  cpu.idle += 50;
+  EXPECT_TRUE(sampler.update(cpu, mem));
+  EXPECT_FALSE(sampler.isOverloaded());
+}
+
+TEST(LoadSamplerTest, MemoryLimits) {
+  LoadShedConfiguration config;
+  config.setMaxMemUsage(0.8);
+  config.setMinFreeMem(10);
+  LoadSampler sampler(config);
+
+  LoadSampler::CpuTimes cpu;
+  LoadSampler::MemInfo mem;
+  mem.totalBytes = 100;
+  mem.availableBytes = 50;
+  sampler.update(cpu, mem);
+  EXPECT_FALSE(sampler.isOverloaded());
+
+  mem.availableBytes = 15;
+  sampler.update(cpu, mem);
+  EXPECT_TRUE(sampler.isOverloaded());
+  EXPECT_NEAR(0.85, sampler.getLastSample().memUsage, 0.001);
+
+  config.setMaxMemUsage(1.0);
+  LoadSampler lowFree(config);
+  mem.availableBytes = 5;
+  lowFree.update(cpu, mem);
+  EXPECT_TRUE(lowFree.isOverloaded());
+}
+
+TEST(LoadSamplerTest, SetConfig) {
+  LoadShedConfiguration config;
+  LoadSampler sampler(config);
+
+  LoadSampler::CpuTimes cpu;
+  LoadSampler::MemInfo mem;
+  mem.totalBytes = 100;
+  mem.availableBytes = 15;
+  sampler.update(cpu, mem);
+  EXPECT_FALSE(sampler.isOverloaded());
+
+  // The next sample uses the new thresholds
+  config.setMaxMemUsage(0.8);
+  sampler.setConfig(config);
+  EXPECT_EQ(0.8, sampler.getConfig().getMaxMemUsage());
+  sampler.update(cpu, mem);
+  EXPECT_TRUE(sampler.isOverloaded());
+}
@@ -15,8 +15,16 @@
  */
 #pragma once
 
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <array>
+
 namespace wangle {
 
+template <typename Pipeline, typename R>
+constexpr size_t AcceptRoutingHandler<Pipeline, R>::kMaxPeekBytes;
+
 template <typename Pipeline, typename R>
 void AcceptRoutingHandler<Pipeline, R>::read(
     Context*,
@@ -33,31 +41,186 @@ void AcceptRoutingHandler<Pipeline, R>::read(
 
   uint64_t connId = nextConnId_++;
 
-  // Create a new routing pipeline for this connection to read from
-  // the socket until it parses the routing data
-  auto routingPipeline = newRoutingPipeline();
-  routingPipeline->addBack(wangle::AsyncSocketHandler(socket));
-  routingPipeline->addBack(routingHandlerFactory_->newHandler(connId, this));
-  routingPipeline->finalize();
+  auto transportInfo = newTransportInfo(connInfo.tinfo, socket.get());
+  if (!transportInfo) {
+    VLOG(2) << "Socket is no longer valid.";
+    return;
+  }
+
+  // TLS bytes can't be parsed before the handshake, so only plaintext
+  // connections can be routed from peeked bytes
+  auto asyncSocket = dynamic_cast<folly::AsyncSocket*>(socket.get());
+  if (routingHandlerFactory_->getMaxPeekBytes() > 0 && asyncSocket &&
+      connInfo.secureType == SecureTransportType::NONE) {
+    auto evb = asyncSocket->getEventBase();
+    int fd = asyncSocket->detachFd();
+    socket.reset();
+    startPeek(connId, fd, evb, std::move(transportInfo));
+    return;
+  }
+
+  startRoutingPipeline(connId, std::move(socket), std::move(transportInfo));
+}
 
-  // Initialize TransportInfo and set it on the routing pipeline
-  auto transportInfo = std::make_shared<TransportInfo>(connInfo.tinfo);
+template <typename Pipeline, typename R>
+std::shared_ptr<TransportInfo>
+AcceptRoutingHandler<Pipeline, R>::newTransportInfo(
+    const TransportInfo& tinfo,
+    folly::AsyncTransportWrapper* socket) {
+  auto transportInfo = std::make_shared<TransportInfo>(tinfo);
   folly::SocketAddress localAddr, peerAddr;
   try {
     socket->getLocalAddress(&localAddr);
     socket->getPeerAddress(&peerAddr);
   } catch (...) {
-    VLOG(2) << "Socket is no longer valid.";
-    return;
+    return nullptr;
   }
   transportInfo->localAddr = std::make_shared<folly::SocketAddress>(localAddr);
   transportInfo->remoteAddr = std::make_shared<folly::SocketAddress>(peerAddr);
+  return transportInfo;
+}
+
+template <typename Pipeline, typename R>
+void AcceptRoutingHandler<Pipeline, R>::startRoutingPipeline(
+    uint64_t connId,
+    std::shared_ptr<folly::AsyncTransportWrapper> socket,
+    std::shared_ptr<TransportInfo> transportInfo) {
+  // Create a new routing pipeline for this connection to read from
+  // the socket until it parses the routing data
+  auto routingPipeline = newRoutingPipeline();
+  routingPipeline->addBack(wangle::AsyncSocketHandler(socket));
+  routingPipeline->addBack(routingHandlerFactory_->newHandler(connId, this));
+  routingPipeline->finalize();
   routingPipeline->setTransportInfo(transportInfo);
 
   routingPipeline->transportActive();
   routingPipelines_[connId] = std::move(routingPipeline);
 }
 
+template <typename Pipeline, typename R>
+void AcceptRoutingHandler<Pipeline, R>::startPeek(
+    uint64_t connId,
+    int fd,
+    folly::EventBase* evb,
+    std::shared_ptr<TransportInfo> transportInfo) {
+  R routingData;
+  auto result = peekRoutingData(fd, routingData);
+  if (result != PeekResult::WAIT) {
+    finishPeek(connId, fd, evb, result, std::move(routingData),
+               std::move(transportInfo));
+    return;
+  }
+
+  // Nothing to peek yet; wait for the first bytes without reading them
+  auto waiter = std::make_unique<PeekWaiter>(
+      this, connId, fd, evb, std::move(transportInfo));
+  waiter->registerHandler(
+      folly::EventHandler::READ | folly::EventHandler::PERSIST);
+  peekWaiters_[connId] = std::move(waiter);
+}
+
+template <typename Pipeline, typename R>
+void AcceptRoutingHandler<Pipeline, R>::onPeekReady(uint64_t connId) {
+  auto it = peekWaiters_.find(connId);
+  if (it == peekWaiters_.end()) {
+    return;
+  }
+  R routingData;
+  auto result = peekRoutingData(it->second->getFd(), routingData);
+  if (result == PeekResult::WAIT) {
+    return;
+  }
+
+  auto waiter = std::move(it->second);
+  peekWaiters_.erase(it);
+  auto evb = waiter->getEventBase();
+  auto transportInfo = waiter->getTransportInfo();
+  int fd = waiter->releaseFd();
+  // We are inside the waiter's callback, so destroy it from the loop
+  evb->runInLoop([w = std::move(waiter)]() mutable { w.reset(); });
+
+  finishPeek(connId, fd, evb, result, std::move(routingData),
+             std::move(transportInfo));
+}
+
+template <typename Pipeline, typename R>
+typename AcceptRoutingHandler<Pipeline, R>::PeekResult
+AcceptRoutingHandler<Pipeline, R>::peekRoutingData(int fd, R& routingData) {
+  std::array<uint8_t, kMaxPeekBytes> buf;
+  const size_t len =
+      std::min(routingHandlerFactory_->getMaxPeekBytes(), buf.size());
+  auto n = ::recv(fd, buf.data(), len, MSG_PEEK | MSG_DONTWAIT);
+  if (n < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+      return PeekResult::WAIT;
+    }
+    return PeekResult::CLOSE;
+  }
+  if (n == 0) {
+    return PeekResult::CLOSE;
+  }
+  if (routingHandlerFactory_->peekRoutingData(
+          folly::ByteRange(buf.data(), size_t(n)), routingData)) {
+    return PeekResult::ROUTE;
+  }
+  // The socket stays readable while the bytes are unconsumed, so waiting
+  // for more would spin. Let a routing pipeline read them instead.
+  return PeekResult::FALLBACK;
+}
+
+template <typename Pipeline, typename R>
+void AcceptRoutingHandler<Pipeline, R>::finishPeek(
+    uint64_t connId,
+    int fd,
+    folly::EventBase* evb,
+    PeekResult result,
+    R&& routingData,
+    std::shared_ptr<TransportInfo> transportInfo) {
+  switch (result) {
+    case PeekResult::ROUTE:
+      break;
+    case PeekResult::FALLBACK:
+      startRoutingPipeline(
+          connId,
+          std::shared_ptr<folly::AsyncSocket>(
+              new folly::AsyncSocket(evb, fd),
+              folly::DelayedDestruction::Destructor()),
+          std::move(transportInfo));
+      return;
+    case PeekResult::WAIT:
+    case PeekResult::CLOSE: {
+      ::close(fd);
+      auto ctx = getContext();
+      auto pipeline =
+          CHECK_NOTNULL(dynamic_cast<AcceptPipeline*>(ctx->getPipeline()));
+      pipeline->readException(
+          folly::make_exception_wrapper<folly::AsyncSocketException>(
+              folly::AsyncSocketException::END_OF_FILE,
+              "Connection closed before parsing routing data"));
+      return;
+    }
+  }
+
+  uint64_t hash = std::hash<R>()(routingData);
+  auto acceptor = acceptors_[hash % acceptors_.size()];
+
+  // Only the fd crosses threads; the socket is created on the target thread
+  acceptor->getEventBase()->runInEventBaseThread(
+      [ =, routingData = std::move(routingData) ]() mutable {
+        auto socket = std::shared_ptr<folly::AsyncSocket>(
+            new folly::AsyncSocket(acceptor->getEventBase(), fd),
+            folly::DelayedDestruction::Destructor());
+        auto pipeline = childPipelineFactory_->newPipeline(
+            socket, routingData, nullptr, transportInfo);
+
+        auto connection =
+            new typename ServerAcceptor<Pipeline>::ServerConnection(pipeline);
+        acceptor->addConnection(connection);
+
+        pipeline->transportActive();
+      });
+}
+
 template <typename Pipeline, typename R>
 void AcceptRoutingHandler<Pipeline, R>::readEOF(Context*) {
   // Null implementation to terminate the call in this handler
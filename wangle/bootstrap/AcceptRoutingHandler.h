@@ -15,6 +15,7 @@
  */
 #pragma once
 
+#include <folly/io/async/EventHandler.h>
 #include <wangle/bootstrap/RoutingDataHandler.h>
 #include <wangle/bootstrap/ServerBootstrap.h>
 #include <wangle/channel/Pipeline.h>
@@ -33,6 +34,13 @@ namespace wangle {
  * to notify the AcceptRoutingHandler. AcceptRoutingHandler then pauses
  * reads from the socket, moves the connection over to the hashed
  * worker thread, and resumes reading from the socket on the child pipeline.
+ *
+ * If the RoutingDataHandlerFactory can parse routing data from peeked
+ * bytes (see RoutingDataHandlerFactory::getMaxPeekBytes()), plaintext
+ * connections skip the routing pipeline: the routing data is parsed with
+ * MSG_PEEK as soon as the socket is readable, and the fd is handed to the
+ * hashed worker thread, which wraps it in a new socket and reads the
+ * unconsumed bytes itself.
  */
 
 template <typename Pipeline, typename R>
@@ -66,8 +74,93 @@ class AcceptRoutingHandler : public wangle::InboundHandler<AcceptPipelineType>,
     return routingPipelines_.size();
   }
 
+  size_t getPeekingConnectionCount() const {
+    return peekWaiters_.size();
+  }
+
  private:
+  // Most routing keys live in the first few bytes of a protocol
+  static constexpr size_t kMaxPeekBytes = 256;
+
+  enum class PeekResult {
+    ROUTE,
+    WAIT,
+    FALLBACK,
+    CLOSE,
+  };
+
+  /**
+   * Owns an accepted fd while waiting for its first bytes to arrive.
+   */
+  class PeekWaiter : public folly::EventHandler {
+   public:
+    PeekWaiter(AcceptRoutingHandler* parent,
+               uint64_t connId,
+               int fd,
+               folly::EventBase* evb,
+               std::shared_ptr<TransportInfo> transportInfo)
+        : folly::EventHandler(evb, fd),
+          parent_(parent),
+          connId_(connId),
+          fd_(fd),
+          transportInfo_(std::move(transportInfo)) {}
+
+    ~PeekWaiter() override {
+      unregisterHandler();
+      if (fd_ >= 0) {
+        ::close(fd_);
+      }
+    }
+
+    void handlerReady(uint16_t /*events*/) noexcept override {
+      parent_->onPeekReady(connId_);
+    }
+
+    int releaseFd() {
+      unregisterHandler();
+      auto fd = fd_;
+      fd_ = -1;
+      return fd;
+    }
+
+    int getFd() const {
+      return fd_;
+    }
+
+    const std::shared_ptr<TransportInfo>& getTransportInfo() const {
+      return transportInfo_;
+    }
+
+   private:
+    AcceptRoutingHandler* parent_;
+    uint64_t connId_;
+    int fd_;
+    std::shared_ptr<TransportInfo> transportInfo_;
+  };
+
   void populateAcceptors();
+  std::shared_ptr<TransportInfo> newTransportInfo(
+      const TransportInfo& tinfo,
+      folly::AsyncTransportWrapper* socket);
+  void startRoutingPipeline(
+      uint64_t connId,
+      std::shared_ptr<folly::AsyncTransportWrapper> socket,
+      std::shared_ptr<TransportInfo> transportInfo);
+  void startPeek(
+      uint64_t connId,
+      int fd,
+      folly::EventBase* evb,
+      std::shared_ptr<TransportInfo> transportInfo);
+  void onPeekReady(uint64_t connId);
+  PeekResult peekRoutingData(int fd, R& routingData);
+  void finishPeek(
+      uint64_t connId,
+      int fd,
+      folly::EventBase* evb,
+      PeekResult result,
+      R&& routingData,
+      std::shared_ptr<TransportInfo> transportInfo);
+
   virtual DefaultPipeline::Ptr newRoutingPipeline() {
     return DefaultPipeline::create();
   }
@@ -79,6 +172,7 @@ class AcceptRoutingHandler : public wangle::InboundHandler<AcceptPipelineType>,
 
   std::vector<Acceptor*> acceptors_;
   std::map<uint64_t, DefaultPipeline::Ptr> routingPipelines_;
+  std::map<uint64_t, std::unique_ptr<PeekWaiter>> peekWaiters_;
   uint64_t nextConnId_{0};
 };
 
@@ -115,6 +209,7 @@ class RoutingDataPipelineFactory {
  public:
   virtual ~RoutingDataPipelineFactory() {}
 
+  // routingHandler is nullptr for connections routed from peeked bytes
   virtual typename Pipeline::Ptr newPipeline(
       std::shared_ptr<folly::AsyncSocket> socket,
       const R& routingData,
@@ -0,0 +1,121 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <wangle/bootstrap/AcceptSteering.h>
+
+#include <folly/io/async/AsyncServerSocket.h>
+#include <glog/logging.h>
+
+#include <thread>
+
+#ifdef __linux__
+#include <linux/filter.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+#endif
+
+#ifndef SO_INCOMING_CPU
+#define SO_INCOMING_CPU 49
+#endif
+
+#ifndef SO_ATTACH_REUSEPORT_CBPF
+#define SO_ATTACH_REUSEPORT_CBPF 51
+#endif
+
+namespace wangle {
+
+bool pinCurrentThreadToCpu(int cpu) {
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  if (rc != 0) {
+    LOG(ERROR) << "Failed to pin thread to cpu " << cpu << ": rc=" << rc;
+    return false;
+  }
+  return true;
+#else
+  (void)cpu;
+  return false;
+#endif
+}
+
+int getSteeringCpuCount() {
+  auto cpus = std::thread::hardware_concurrency();
+  return cpus > 0 ? cpus : 1;
+}
+
+bool applyListenerSteering(
+    const std::shared_ptr<folly::AsyncSocketBase>& s,
+    AcceptSteering steering,
+    int cpu) {
+  if (steering != AcceptSteering::INCOMING_CPU) {
+    return true;
+  }
+  auto socket = std::dynamic_pointer_cast<folly::AsyncServerSocket>(s);
+  if (!socket) {
+    return false;
+  }
+  bool ok = true;
+  for (auto fd : socket->getSockets()) {
+    if (setsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu)) != 0) {
+      PLOG(ERROR) << "Failed to set SO_INCOMING_CPU=" << cpu;
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+bool applyGroupSteering(
+    const std::shared_ptr<folly::AsyncSocketBase>& s,
+    AcceptSteering steering,
+    uint32_t numListeners) {
+  if (steering != AcceptSteering::REUSEPORT_CBPF) {
+    return true;
+  }
+#ifdef __linux__
+  auto socket = std::dynamic_pointer_cast<folly::AsyncServerSocket>(s);
+  if (!socket || numListeners == 0) {
+    return false;
+  }
+  // A = cpu % numListeners; the return value indexes the reuseport group
+  struct sock_filter code[] = {
+    { BPF_LD | BPF_W | BPF_ABS, 0, 0, uint32_t(SKF_AD_OFF + SKF_AD_CPU) },
+    { BPF_ALU | BPF_MOD | BPF_K, 0, 0, numListeners },
+    { BPF_RET | BPF_A, 0, 0, 0 },
+  };
+  struct sock_fprog prog;
+  prog.len = sizeof(code) / sizeof(code[0]);
+  prog.filter = code;
+  bool ok = true;
+  for (auto fd : socket->getSockets()) {
+    if (setsockopt(
+            fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) !=
+        0) {
+      PLOG(ERROR) << "Failed to attach reuseport cpu program";
+      ok = false;
+    }
+  }
+  return ok;
+#else
+  (void)s;
+  (void)numListeners;
+  return false;
+#endif
+}
+
+} // namespace wangle
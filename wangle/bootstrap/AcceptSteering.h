@@ -0,0 +1,74 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+#include <folly/io/async/AsyncSocketBase.h>
+
+namespace wangle {
+
+/**
+ * How ServerBootstrap spreads incoming connections over its IO threads.
+ *
+ * NONE leaves it to the kernel's SO_REUSEPORT hash over the acceptor
+ * threads' listeners, and accepted connections are then handed to IO
+ * threads round robin.
+ *
+ * The other modes give every IO thread its own listener and pin the thread
+ * to a CPU, so a connection is accepted and served on one core:
+ *  - INCOMING_CPU sets SO_INCOMING_CPU on each listener, which the kernel
+ *    prefers when the SYN was processed on that CPU.
+ *  - REUSEPORT_CBPF attaches a classic BPF program to the reuseport group
+ *    that picks listener number (cpu % listeners), which is exact when
+ *    there is one IO thread per CPU.
+ */
+enum class AcceptSteering {
+  NONE,
+  INCOMING_CPU,
+  REUSEPORT_CBPF,
+};
+
+/**
+ * Pin the calling thread to the given CPU. Returns false if unsupported.
+ */
+bool pinCurrentThreadToCpu(int cpu);
+
+/**
+ * Number of CPUs used to assign IO threads in the steered modes.
+ */
+int getSteeringCpuCount();
+
+/**
+ * Apply the per-listener part of a steering mode to a socket created by a
+ * ServerSocketFactory. Non TCP sockets are left alone.
+ */
+bool applyListenerSteering(
+    const std::shared_ptr<folly::AsyncSocketBase>& socket,
+    AcceptSteering steering,
+    int cpu);
+
+/**
+ * Apply the reuseport-group part of a steering mode once all numListeners
+ * listeners have been created, in CPU order, on the same address.
+ */
+bool applyGroupSteering(
+    const std::shared_ptr<folly::AsyncSocketBase>& socket,
+    AcceptSteering steering,
+    uint32_t numListeners);
+
+} // namespace wangle
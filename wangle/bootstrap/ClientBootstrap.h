@@ -81,6 +81,16 @@ class ClientBootstrap : public BaseClientBootstrap<Pipeline>,
     return this;
   }
 
+  /**
+   * Connect on the next EventBase of the group, or on this thread's
+   * EventBase if there is no group. The socket belongs to that EventBase,
+   * so when called from any other thread the connect is posted to it and
+   * the future is returned straight away; the caller never waits on
+   * another loop. The future completes in that EventBase's thread once the
+   * pipeline is made.
+   *
+   * The bootstrap owns the pipeline, and must outlive the connect.
+   */
   folly::Future<Pipeline*> connect(
       const folly::SocketAddress& address,
       std::chrono::milliseconds timeout =
@@ -88,34 +98,44 @@ class ClientBootstrap : public BaseClientBootstrap<Pipeline>,
     auto base = (group_)
       ? group_->getEventBase()
       : folly::EventBaseManager::get()->getEventBase();
-    folly::Future<Pipeline*> retval((Pipeline*)nullptr);
-    base->runImmediatelyOrRunInEventBaseThreadAndWait([&](){
-      std::shared_ptr<folly::AsyncSocket> socket;
-      if (this->sslContext_)
-      {
-        auto sslSocket = folly::AsyncSSLSocket::newSocket(this->sslContext_, base, this->deferSecurityNegotiation_);
-        if (this->sslSession_)
-        {
-          sslSocket->setSSLSession(this->sslSession_, true);
-        }
-        socket = sslSocket;
-      }
-      else {
-        socket = folly::AsyncSocket::newSocket(base);
-      }
-      folly::Promise<Pipeline*> promise;
-      retval = promise.getFuture();
-      socket->connect(
-          new ConnectCallback(std::move(promise), this, socket),
-          address,
-          timeout.count());
-    });
-    return retval;
+    folly::Promise<Pipeline*> promise;
+    auto future = promise.getFuture();
+    if (base->isInEventBaseThread()) {
+      startConnect(base, std::move(promise), address, timeout);
+    } else {
+      base->runInEventBaseThread(
+        [this, base, promise = std::move(promise), address, timeout]() mutable {
+          startConnect(base, std::move(promise), address, timeout);
+        });
+    }
+    return future;
   }
 
   ~ClientBootstrap() override = default;
 
  protected:
+  void startConnect(
+      folly::EventBase* base,
+      folly::Promise<Pipeline*> promise,
+      const folly::SocketAddress& address,
+      std::chrono::milliseconds timeout) {
+    std::shared_ptr<folly::AsyncSocket> socket;
+    if (this->sslContext_) {
+      auto sslSocket = folly::AsyncSSLSocket::newSocket(
+        this->sslContext_, base, this->deferSecurityNegotiation_);
+      if (this->sslSession_) {
+        sslSocket->setSSLSession(this->sslSession_, true);
+      }
+      socket = sslSocket;
+    } else {
+      socket = folly::AsyncSocket::newSocket(base);
+    }
+    socket->connect(
+        new ConnectCallback(std::move(promise), this, socket),
+        address,
+        timeout.count());
+  }
+
   int port_;
   std::shared_ptr<folly::IOThreadPoolExecutor> group_;
 };
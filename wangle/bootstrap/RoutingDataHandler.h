@@ -15,6 +15,7 @@
  */
 #pragma once
 
+#include <folly/Range.h>
 #include <wangle/channel/AsyncSocketHandler.h>
 
 namespace wangle {
@@ -70,6 +71,26 @@ class RoutingDataHandlerFactory {
 
   virtual std::shared_ptr<RoutingDataHandler<R>> newHandler(
       uint64_t connId, typename RoutingDataHandler<R>::Callback* cob) = 0;
+
+  /**
+   * Optional fast path. If getMaxPeekBytes() is non-zero, the first bytes
+   * of each plaintext connection are peeked with MSG_PEEK and handed to
+   * peekRoutingData() before any routing pipeline is built. The bytes stay
+   * in the kernel, so a connection routed this way is passed to its worker
+   * as a bare fd and the child pipeline reads them itself; no bytes are
+   * buffered or copied between threads.
+   *
+   * Return false if the peeked bytes can't be parsed, in which case the
+   * connection falls back to a routing pipeline and newHandler().
+   */
+  virtual size_t getMaxPeekBytes() const {
+    return 0;
+  }
+
+  virtual bool peekRoutingData(folly::ByteRange /*peeked*/,
+                               R& /*routingData*/) {
+    return false;
+  }
 };
 
 } // namespace wangle
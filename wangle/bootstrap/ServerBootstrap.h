@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <wangle/bootstrap/AcceptSteering.h>
 #include <wangle/bootstrap/ServerBootstrap-inl.h>
 #include <folly/synchronization/Baton.h>
 #include <wangle/channel/Pipeline.h>
@@ -213,6 +214,11 @@ class ServerBootstrap {
       group(nullptr);
     }
 
+    if (acceptSteering_ != AcceptSteering::NONE) {
+      bindSteeredImpl(address);
+      return;
+    }
+
     bool reusePort = reusePort_ || (acceptor_group_->numThreads() > 1);
 
     std::mutex sock_lock;
@@ -268,6 +274,58 @@ class ServerBootstrap {
     }
   }
 
+  /*
+   * One listener per IO thread, each created, pinned and accepting on its
+   * own thread, so accepted connections never cross threads. The acceptor
+   * group is not used. IO threads started after bind are attached to every
+   * listener, as in the default mode.
+   */
+  void bindSteeredImpl(folly::SocketAddress& address) {
+    std::vector<std::shared_ptr<folly::AsyncSocketBase>> new_sockets;
+    std::exception_ptr exn;
+    const int cpus = getSteeringCpuCount();
+    int index = 0;
+
+    workerFactory_->forEachWorker([&](Acceptor* worker) {
+      if (exn) {
+        return;
+      }
+      const int cpu = index++ % cpus;
+      worker->getEventBase()->runImmediatelyOrRunInEventBaseThreadAndWait(
+        [&, worker, cpu]() {
+          try {
+            pinCurrentThreadToCpu(cpu);
+            auto socket = socketFactory_->newSocket(
+                address, socketConfig.acceptBacklog, true, socketConfig);
+            // Later listeners must join the group on the same port
+            socket->getAddress(&address);
+            if (!applyListenerSteering(socket, acceptSteering_, cpu)) {
+              LOG(WARNING) << "Accept steering not applied on cpu " << cpu;
+            }
+            socketFactory_->addAcceptCB(
+                socket, worker, worker->getEventBase());
+            new_sockets.push_back(socket);
+          } catch (...) {
+            exn = std::current_exception();
+          }
+        });
+    });
+
+    if (exn) {
+      std::rethrow_exception(exn);
+    }
+
+    if (!new_sockets.empty() &&
+        !applyGroupSteering(
+            new_sockets.front(), acceptSteering_, new_sockets.size())) {
+      LOG(WARNING) << "Reuseport steering program not attached";
+    }
+
+    for (auto& socket : new_sockets) {
+      sockets_->push_back(socket);
+    }
+  }
+
   /*
    * Stop listening on all sockets.
    */
@@ -328,6 +386,15 @@ class ServerBootstrap {
     return this;
   }
 
+  /*
+   * Opt in to kernel level accept steering, see AcceptSteering. Must be
+   * set before bind.
+   */
+  ServerBootstrap* setAcceptSteering(AcceptSteering steering) {
+    acceptSteering_ = steering;
+    return this;
+  }
+
  private:
   std::shared_ptr<folly::IOThreadPoolExecutor> acceptor_group_;
   std::shared_ptr<folly::IOThreadPoolExecutor> io_group_;
@@ -346,6 +413,7 @@ class ServerBootstrap {
   ServerSocketConfig accConfig_;
 
   bool reusePort_{false};
+  AcceptSteering acceptSteering_{AcceptSteering::NONE};
 
   std::unique_ptr<folly::Baton<>> stopBaton_{
     std::make_unique<folly::Baton<>>()};
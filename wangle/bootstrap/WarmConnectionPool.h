@@ -0,0 +1,154 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <unordered_map>
+
+#include <folly/SocketAddress.h>
+#include <folly/io/async/DestructorCheck.h>
+#include <folly/io/async/EventBase.h>
+#include <wangle/bootstrap/ClientBootstrap.h>
+
+namespace wangle {
+
+/*
+ * Keeps up to connectionsPerDestination connections to each destination
+ * established ahead of time, so that whoever needs one next does not pay
+ * for the connect. acquire() hands out a ready connection, together with
+ * the bootstrap that owns its pipeline, and starts connecting a
+ * replacement in the background. If none is ready it connects as usual.
+ *
+ * Pipelines are made by the factory when their connect completes, before
+ * anyone has acquired them; the handler that wants the connection usually
+ * goes on with addBack() and finalize() once acquired. Connections that
+ * were closed while waiting are dropped on acquire.
+ *
+ * A pool belongs to one EventBase, and must be used and destroyed in its
+ * thread; all its connections live on that EventBase.
+ */
+template <typename Pipeline = DefaultPipeline>
+class WarmConnectionPool : public folly::DestructorCheck {
+ public:
+  using Client = ClientBootstrap<Pipeline>;
+
+  WarmConnectionPool(
+      folly::EventBase* evb,
+      std::shared_ptr<PipelineFactory<Pipeline>> pipelineFactory,
+      size_t connectionsPerDestination,
+      std::chrono::milliseconds connectTimeout = std::chrono::milliseconds(0))
+      : evb_(evb),
+        pipelineFactory_(std::move(pipelineFactory)),
+        connectionsPerDestination_(connectionsPerDestination),
+        connectTimeout_(connectTimeout) {}
+
+  /*
+   * Start keeping connections to address ready
+   */
+  void prewarm(const folly::SocketAddress& address) {
+    refill(address);
+  }
+
+  /*
+   * Take a connection to address. The future holds the bootstrap that owns
+   * the connected pipeline; it is ready at once if a warm connection was
+   * available.
+   */
+  folly::Future<std::shared_ptr<Client>> acquire(
+      const folly::SocketAddress& address) {
+    DCHECK(evb_->isInEventBaseThread());
+    auto& destination = destinations_[address];
+    std::shared_ptr<Client> client;
+    while (!client && !destination.ready.empty()) {
+      client = std::move(destination.ready.front());
+      destination.ready.pop_front();
+      auto transport = client->getPipeline()->getTransport();
+      if (!transport || !transport->good()) {
+        client.reset();
+      }
+    }
+    refill(address);
+    if (client) {
+      return folly::makeFuture(std::move(client));
+    }
+
+    auto fresh = newClient();
+    return fresh->connect(address, connectTimeout_)
+      .then([fresh](Pipeline*) { return fresh; });
+  }
+
+  size_t getNumReady(const folly::SocketAddress& address) const {
+    auto it = destinations_.find(address);
+    return it == destinations_.end() ? 0 : it->second.ready.size();
+  }
+
+  size_t getNumConnecting(const folly::SocketAddress& address) const {
+    auto it = destinations_.find(address);
+    return it == destinations_.end() ? 0 : it->second.connecting;
+  }
+
+ private:
+  struct Destination {
+    std::deque<std::shared_ptr<Client>> ready;
+    size_t connecting{0};
+  };
+
+  std::shared_ptr<Client> newClient() {
+    // Without a group the bootstrap connects on this thread's EventBase
+    auto client = std::make_shared<Client>();
+    client->pipelineFactory(pipelineFactory_);
+    return client;
+  }
+
+  void refill(const folly::SocketAddress& address) {
+    // Counted up front: a connect can fail, and be forgotten, right away
+    auto& destination = destinations_[address];
+    auto have = destination.ready.size() + destination.connecting;
+    for (auto i = have; i < connectionsPerDestination_; i++) {
+      connectOne(address);
+    }
+  }
+
+  void connectOne(const folly::SocketAddress& address) {
+    destinations_[address].connecting++;
+    auto client = newClient();
+    auto safety = std::make_shared<folly::DestructorCheck::Safety>(*this);
+    client->connect(address, connectTimeout_)
+      .then([this, safety, client, address](folly::Try<Pipeline*>&& t) {
+        if (safety->destroyed()) {
+          return;
+        }
+        auto& destination = destinations_[address];
+        destination.connecting--;
+        if (t.hasException()) {
+          // The next acquire tries again
+          VLOG(3) << "Warm connect to " << address.describe()
+                  << " failed: " << t.exception().what();
+          return;
+        }
+        destination.ready.push_back(client);
+      });
+  }
+
+  folly::EventBase* evb_;
+  std::shared_ptr<PipelineFactory<Pipeline>> pipelineFactory_;
+  size_t connectionsPerDestination_;
+  std::chrono::milliseconds connectTimeout_;
+  std::unordered_map<folly::SocketAddress, Destination> destinations_;
+};
+
+} // namespace wangle
@@ -281,3 +281,36 @@ TEST_F(AcceptRoutingHandlerTest, RoutingPipelineErasedOnlyOnce) {
       std::runtime_error("An exception from the socket."));
   acceptRoutingHandler_->onRoutingData(kConnId0, routingData_);
 }
+
+TEST_F(AcceptRoutingHandlerTest, RouteFromPeekedBytes) {
+  routingDataHandlerFactory_->setPeekRouting(true);
+
+  // No routing pipeline is used
+  EXPECT_CALL(*routingDataHandler_, transportActive(_)).Times(0);
+  EXPECT_CALL(*routingDataHandler_, parseRoutingData(_, _)).Times(0);
+
+  // The downstream pipeline reads the peeked byte from the socket itself
+  boost::barrier barrier(2);
+  EXPECT_CALL(*downstreamHandler_, transportActive(_));
+  EXPECT_CALL(*downstreamHandler_, read(_, _))
+      .WillOnce(Invoke([&](MockBytesToBytesHandler::Context* /*ctx*/,
+                           IOBufQueue& bufQueue) {
+        EXPECT_EQ("a", bufQueue.move()->moveToFbString().toStdString());
+      }));
+  EXPECT_CALL(*downstreamHandler_, readEOF(_))
+      .WillOnce(Invoke([&](MockBytesToBytesHandler::Context* ctx) {
+        ctx->fireClose();
+        barrier.wait();
+      }));
+  EXPECT_CALL(*downstreamHandler_, transportInactive(_));
+
+  auto futureClientPipeline = clientConnectAndCleanClose();
+  futureClientPipeline.wait();
+
+  barrier.wait();
+  server_->stop();
+  server_->join();
+
+  EXPECT_EQ(0, acceptRoutingHandler_->getRoutingPipelineCount());
+  EXPECT_EQ(0, acceptRoutingHandler_->getPeekingConnectionCount());
+}
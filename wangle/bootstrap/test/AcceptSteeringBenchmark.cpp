@@ -0,0 +1,230 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+// Compares ServerBootstrap accept steering modes on a connect-heavy echo
+// workload: every request opens a connection, sends a short message, waits
+// for the echo and closes. Reports request latency percentiles and, where
+// perf events are available, cache misses for the whole process (clients
+// included, so only the difference between modes is meaningful).
+//
+//   AcceptSteeringBenchmark --mode=none
+//   AcceptSteeringBenchmark --mode=incoming_cpu
+//   AcceptSteeringBenchmark --mode=cbpf
+
+#include <wangle/bootstrap/ServerBootstrap.h>
+#include <wangle/channel/AsyncSocketHandler.h>
+#include <wangle/channel/Handler.h>
+
+#include <folly/Format.h>
+#include <folly/portability/GFlags.h>
+#include <folly/init/Init.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+DEFINE_string(mode, "none", "Accept steering: none, incoming_cpu or cbpf");
+DEFINE_int32(io_threads, 0, "IO threads, 0 for one per cpu");
+DEFINE_int32(clients, 8, "Concurrent client threads");
+DEFINE_int32(requests, 20000, "Connect/echo/close cycles per client");
+
+using namespace wangle;
+using namespace folly;
+
+typedef Pipeline<IOBufQueue&, std::unique_ptr<IOBuf>> BytesPipeline;
+
+namespace {
+
+class EchoHandler : public BytesToBytesHandler {
+ public:
+  void read(Context* ctx, IOBufQueue& q) override {
+    write(ctx, q.move());
+  }
+};
+
+class EchoPipelineFactory : public PipelineFactory<BytesPipeline> {
+ public:
+  BytesPipeline::Ptr newPipeline(
+      std::shared_ptr<AsyncTransportWrapper> sock) override {
+    auto pipeline = BytesPipeline::create();
+    pipeline->addBack(AsyncSocketHandler(sock));
+    pipeline->addBack(EchoHandler());
+    pipeline->finalize();
+    return pipeline;
+  }
+};
+
+class CacheMissCounter {
+ public:
+  CacheMissCounter() {
+#ifdef __linux__
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_hv = 1;
+    // Opened before any thread is started so inherit covers all of them
+    fd_ = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+  }
+
+  ~CacheMissCounter() {
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+
+  void start() {
+#ifdef __linux__
+    if (fd_ >= 0) {
+      ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+      ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+  }
+
+  // Returns -1 if perf events are unavailable
+  int64_t stop() {
+#ifdef __linux__
+    if (fd_ >= 0) {
+      ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+      uint64_t count = 0;
+      if (read(fd_, &count, sizeof(count)) == sizeof(count)) {
+        return count;
+      }
+    }
+#endif
+    return -1;
+  }
+
+ private:
+  int fd_{-1};
+};
+
+AcceptSteering parseMode(const std::string& mode) {
+  if (mode == "incoming_cpu") {
+    return AcceptSteering::INCOMING_CPU;
+  } else if (mode == "cbpf") {
+    return AcceptSteering::REUSEPORT_CBPF;
+  }
+  CHECK_EQ("none", mode) << "unknown --mode";
+  return AcceptSteering::NONE;
+}
+
+void runClient(uint16_t port, int requests, std::vector<int64_t>& latencies) {
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  const char msg[] = "ping";
+  char buf[sizeof(msg)];
+
+  latencies.reserve(requests);
+  for (int i = 0; i < requests; i++) {
+    auto start = std::chrono::steady_clock::now();
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    PCHECK(fd >= 0);
+    PCHECK(connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0);
+    PCHECK(write(fd, msg, sizeof(msg)) == sizeof(msg));
+    size_t got = 0;
+    while (got < sizeof(buf)) {
+      auto n = read(fd, buf + got, sizeof(buf) - got);
+      PCHECK(n > 0);
+      got += n;
+    }
+    close(fd);
+    latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count());
+  }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  folly::init(&argc, &argv);
+
+  CacheMissCounter cacheMisses;
+
+  int ioThreads = FLAGS_io_threads > 0 ? FLAGS_io_threads
+                                       : getSteeringCpuCount();
+  ServerBootstrap<BytesPipeline> server;
+  server.childPipeline(std::make_shared<EchoPipelineFactory>());
+  server.setAcceptSteering(parseMode(FLAGS_mode));
+  server.group(
+      nullptr,
+      std::make_shared<IOThreadPoolExecutor>(
+          ioThreads, std::make_shared<NamedThreadFactory>("IO Thread")));
+  SocketAddress address("127.0.0.1", 0);
+  server.bind(address);
+  uint16_t port = address.getPort();
+
+  std::vector<std::vector<int64_t>> latencies(FLAGS_clients);
+  std::vector<std::thread> clients;
+  cacheMisses.start();
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < FLAGS_clients; i++) {
+    clients.emplace_back(
+        runClient, port, FLAGS_requests, std::ref(latencies[i]));
+  }
+  for (auto& t : clients) {
+    t.join();
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  auto misses = cacheMisses.stop();
+  server.stop();
+
+  std::vector<int64_t> all;
+  for (auto& l : latencies) {
+    all.insert(all.end(), l.begin(), l.end());
+  }
+  std::sort(all.begin(), all.end());
+  auto pct = [&](double p) {
+    return all.empty() ? 0 : all[std::min(all.size() - 1,
+                                          size_t(p * all.size()))];
+  };
+  auto secs = std::chrono::duration<double>(elapsed).count();
+
+  std::cout << format("mode={} io_threads={} clients={} conns={}\n",
+                      FLAGS_mode, ioThreads, FLAGS_clients, all.size());
+  std::cout << format("  {:.0f} conn/s, p50={}us p99={}us p99.9={}us\n",
+                      all.size() / secs, pct(0.5), pct(0.99), pct(0.999));
+  if (misses >= 0) {
+    std::cout << format("  cache misses: {} ({:.1f} per conn)\n",
+                        misses, double(misses) / std::max<size_t>(
+                            all.size(), 1));
+  } else {
+    std::cout << "  cache misses: perf events unavailable\n";
+  }
+  return 0;
+}
@@ -16,6 +16,7 @@
 
 #include "wangle/bootstrap/ServerBootstrap.h"
 #include "wangle/bootstrap/ClientBootstrap.h"
+#include "wangle/bootstrap/WarmConnectionPool.h"
 #include "wangle/channel/Handler.h"
 
 #include <glog/logging.h>
@@ -23,6 +24,7 @@
 #include <boost/thread.hpp>
 #include <folly/String.h>
 #include <folly/experimental/TestUtil.h>
+#include <folly/synchronization/Baton.h>
 
 using namespace wangle;
 using namespace folly;
@@ -153,6 +155,77 @@ TEST(Bootstrap, ClientConnectionManagerTest) {
   EXPECT_EQ(factory->pipelines, 2);
 }
 
+TEST(Bootstrap, ClientConnectDoesNotWait) {
+  TestServer server;
+  auto factory = std::make_shared<TestPipelineFactory>();
+  server.childPipeline(factory);
+  server.bind(0);
+
+  SocketAddress address;
+  server.getSockets()[0]->getAddress(&address);
+
+  // Keep the client's only loop busy
+  auto group = std::make_shared<IOThreadPoolExecutor>(1);
+  auto clientBase = group->getEventBase();
+  Baton<> blocked;
+  Baton<> release;
+  clientBase->runInEventBaseThread([&] {
+    blocked.post();
+    release.wait();
+  });
+  blocked.wait();
+
+  TestClient client;
+  client.group(group);
+  client.pipelineFactory(std::make_shared<TestPipelineFactory>());
+  auto future = client.connect(address);
+  EXPECT_FALSE(future.isReady());
+
+  release.post();
+  EXPECT_NE(nullptr, future.get());
+  clientBase->runInEventBaseThreadAndWait([&] {
+    client.setPipeline(BytesPipeline::Ptr());
+  });
+
+  server.stop();
+  server.join();
+}
+
+TEST(Bootstrap, WarmConnectionPool) {
+  TestServer server;
+  server.childPipeline(std::make_shared<TestPipelineFactory>());
+  server.bind(0);
+  auto base = EventBaseManager::get()->getEventBase();
+
+  SocketAddress address;
+  server.getSockets()[0]->getAddress(&address);
+
+  auto factory = std::make_shared<TestPipelineFactory>();
+  WarmConnectionPool<BytesPipeline> pool(base, factory, 2);
+  pool.prewarm(address);
+  EXPECT_EQ(2u, pool.getNumConnecting(address));
+  while (pool.getNumConnecting(address) > 0) {
+    base->loopOnce();
+  }
+  EXPECT_EQ(2u, pool.getNumReady(address));
+
+  // Handed out at once, and replaced in the background
+  auto future = pool.acquire(address);
+  ASSERT_TRUE(future.isReady());
+  auto client = future.get();
+  EXPECT_NE(nullptr, client->getPipeline());
+  EXPECT_EQ(1u, pool.getNumReady(address));
+  EXPECT_EQ(1u, pool.getNumConnecting(address));
+  while (pool.getNumConnecting(address) > 0) {
+    base->loopOnce();
+  }
+  EXPECT_EQ(2u, pool.getNumReady(address));
+  EXPECT_EQ(3, factory->pipelines);
+
+  server.stop();
+  server.join();
+}
+
 TEST(Bootstrap, ServerAcceptGroupTest) {
   // Verify that server is using the accept IO group
 
@@ -96,8 +96,21 @@ class MockRoutingDataHandlerFactory : public RoutingDataHandlerFactory<char> {
     routingDataHandler_ = routingDataHandler;
   }
 
+  // Route on the first peeked byte instead of a routing pipeline
+  void setPeekRouting(bool peekRouting) {
+    peekRouting_ = peekRouting;
+  }
+  size_t getMaxPeekBytes() const override {
+    return peekRouting_ ? 1 : 0;
+  }
+  bool peekRoutingData(folly::ByteRange peeked, char& routingData) override {
+    routingData = peeked[0];
+    return true;
+  }
+
  protected:
   MockRoutingDataHandler* routingDataHandler_;
+  bool peekRouting_{false};
 };
 
 class MockDownstreamPipelineFactory
@@ -22,6 +22,31 @@
 
 namespace wangle {
 
+/**
+ * Produces the value handed to an individual subscriber for data that is
+ * being broadcasted. Copyable message types are copied as before.
+ */
+template <typename T>
+struct BroadcastValue {
+  static T share(const T& data) {
+    return data;
+  }
+};
+
+/**
+ * Zero-copy broadcast mode. When the broadcast pipeline decodes upstream
+ * frames into an IOBuf (T = std::unique_ptr<folly::IOBuf>), the frame is
+ * encoded exactly once and every subscriber receives a refcounted clone()
+ * of it, so the per-message cost does not grow with the subscriber count.
+ */
+template <>
+struct BroadcastValue<std::unique_ptr<folly::IOBuf>> {
+  static std::unique_ptr<folly::IOBuf> share(
+      const std::unique_ptr<folly::IOBuf>& buf) {
+    return buf ? buf->clone() : nullptr;
+  }
+};
+
 /**
  * An Observable type handler for broadcasting/streaming data to a list
  * of subscribers.
@@ -91,6 +91,148 @@ void BroadcastPool<T, R, P>::BroadcastManager::handleConnectError(
   sharedPromise.setException(folly::make_exception_wrapper<std::exception>(ex));
 }
 
+template <typename T, typename R, typename P>
+folly::Future<BroadcastHandler<T, R>*>
+BroadcastPool<T, R, P>::BroadcastRelay::getHandler() {
+  // Same contract as BroadcastManager::getHandler(): callbacks on the
+  // returned future run inline with the fulfillment of the promise.
+  auto future = sharedPromise_.getFuture().via(
+    &folly::InlineExecutor::instance());
+
+  if (connectStarted_) {
+    return future;
+  }
+
+  connectStarted_ = true;
+  auto self = this->shared_from_this();
+  owner_.evb->runInEventBaseThread([self] { self->subscribeRemote(); });
+
+  return future;
+}
+
+template <typename T, typename R, typename P>
+void BroadcastPool<T, R, P>::BroadcastRelay::subscribeRemote() noexcept {
+  auto self = this->shared_from_this();
+  auto localEvb = localEvb_;
+  if (!registry_->hasPool(owner_.pool)) {
+    localEvb->runInEventBaseThread([self] {
+      self->handleError(folly::make_exception_wrapper<std::runtime_error>(
+          "Broadcast owner went away"));
+    });
+    return;
+  }
+
+  owner_.pool->getHandler(routingData_)
+      .then([self, localEvb](BroadcastHandler<T, R>* handler) {
+        if (self->cancelled_) {
+          handler->closeIfIdle();
+          return;
+        }
+
+        self->remoteHandler_ = handler;
+        self->subscriptionId_ = handler->subscribe(self.get());
+
+        localEvb->runInEventBaseThread([self] {
+          if (self->closed_) {
+            return;
+          }
+
+          self->sharedPromise_.setValue(&self->localHandler_);
+
+          // Tear the relay down if all the local observers went away
+          // while subscribing.
+          self->localHandler_.closeIfIdle();
+        });
+      })
+      .onError([self, localEvb](const std::exception& ex) {
+        auto ew = folly::make_exception_wrapper<std::runtime_error>(ex.what());
+        localEvb->runInEventBaseThread(
+            [self, ew] { self->handleError(ew); });
+      });
+}
+
+template <typename T, typename R, typename P>
+void BroadcastPool<T, R, P>::BroadcastRelay::onNext(const T& data) {
+  auto self = this->shared_from_this();
+  localEvb_->runInEventBaseThread(
+      [self, data = BroadcastValue<T>::share(data)]() mutable {
+        if (!self->closed_) {
+          self->localHandler_.read(nullptr, std::move(data));
+        }
+      });
+}
+
+template <typename T, typename R, typename P>
+void BroadcastPool<T, R, P>::BroadcastRelay::onError(
+    folly::exception_wrapper ex) {
+  // The owner's BroadcastHandler clears its subscribers and deletes itself
+  remoteHandler_ = nullptr;
+
+  auto self = this->shared_from_this();
+  localEvb_->runInEventBaseThread([self, ex] {
+    if (!self->closed_) {
+      self->localHandler_.readException(nullptr, ex);
+    }
+  });
+}
+
+template <typename T, typename R, typename P>
+void BroadcastPool<T, R, P>::BroadcastRelay::onCompleted() {
+  // The owner's BroadcastHandler clears its subscribers and deletes itself
+  remoteHandler_ = nullptr;
+
+  auto self = this->shared_from_this();
+  localEvb_->runInEventBaseThread([self] {
+    if (!self->closed_) {
+      self->localHandler_.readEOF(nullptr);
+    }
+  });
+}
+
+template <typename T, typename R, typename P>
+void BroadcastPool<T, R, P>::BroadcastRelay::handleError(
+    folly::exception_wrapper ex) {
+  if (closed_) {
+    return;
+  }
+
+  LOG(ERROR) << "Error relaying broadcast: " << exceptionStr(ex);
+
+  closed_ = true;
+  auto self = this->shared_from_this();
+  auto sharedPromise = std::move(sharedPromise_);
+  if (!poolAlive_.expired()) {
+    broadcastPool_->relays_.erase(routingData_);
+  }
+  sharedPromise.setException(ex);
+}
+
+template <typename T, typename R, typename P>
+void BroadcastPool<T, R, P>::BroadcastRelay::shutdown() {
+  if (closed_) {
+    return;
+  }
+
+  closed_ = true;
+  // The lambda below keeps the relay alive until the owner's EventBase
+  // has dropped the remote subscription.
+  auto self = this->shared_from_this();
+  if (!poolAlive_.expired()) {
+    broadcastPool_->relays_.erase(routingData_);
+  }
+
+  owner_.evb->runInEventBaseThread([self] {
+    if (self->remoteHandler_) {
+      auto handler = self->remoteHandler_;
+      self->remoteHandler_ = nullptr;
+      handler->unsubscribe(self->subscriptionId_);
+    } else {
+      // Still subscribing, or the broadcast is already gone
+      self->cancelled_ = true;
+    }
+  });
+}
+
 template <typename T, typename R, typename P>
 folly::Future<BroadcastHandler<T, R>*> BroadcastPool<T, R, P>::getHandler(
     const R& routingData) {
@@ -99,6 +241,24 @@ folly::Future<BroadcastHandler<T, R>*> BroadcastPool<T, R, P>::getHandler(
     return iter->second->getHandler();
   }
 
+  if (sharedRegistry_) {
+    const auto& relayIter = relays_.find(routingData);
+    if (relayIter != relays_.end()) {
+      return relayIter->second->getHandler();
+    }
+
+    typename SharedBroadcastRegistry<T, R, P>::Owner self;
+    self.pool = this;
+    self.evb = evb_;
+    auto owner = sharedRegistry_->findOrAddOwner(routingData, self);
+    if (owner.pool != this) {
+      // Another thread is already connected upstream, relay from it
+      auto relay = std::make_shared<BroadcastRelay>(this, routingData, owner);
+      relays_.insert(std::make_pair(routingData, relay));
+      return relay->getHandler();
+    }
+  }
+
   typename BroadcastManager::UniquePtr broadcast(
       new BroadcastManager(this, routingData));
 
@@ -15,9 +15,14 @@
  */
 #pragma once
 
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
 #include <folly/ThreadLocal.h>
 #include <folly/futures/SharedPromise.h>
 #include <folly/io/async/DelayedDestruction.h>
+#include <folly/io/async/EventBaseManager.h>
 #include <wangle/bootstrap/BaseClientBootstrap.h>
 #include <wangle/bootstrap/ClientBootstrap.h>
 #include <wangle/channel/Pipeline.h>
@@ -25,6 +30,49 @@
 
 namespace wangle {
 
+template <typename T, typename R, typename P>
+class ObservingHandler;
+
+template <typename T, typename R, typename P>
+class BroadcastPool;
+
+/**
+ * What an ObservingHandler does with a new message when its bounded send
+ * queue is already full.
+ */
+enum class SubscriberQueueOverflowPolicy {
+  DROP_OLDEST,
+  DROP_NEWEST,
+  DISCONNECT,
+};
+
+/**
+ * Bounds the number of broadcasted messages that are buffered for a single
+ * subscriber while its transport is busy writing, so that one slow
+ * downstream client cannot make the broadcast buffer data without limit.
+ * A maxQueueDepth of 0 disables queueing and writes every message to the
+ * subscriber's transport as soon as it is broadcasted.
+ */
+struct SubscriberQueueOptions {
+  size_t maxQueueDepth{0};
+  SubscriberQueueOverflowPolicy overflowPolicy{
+      SubscriberQueueOverflowPolicy::DROP_OLDEST};
+};
+
+/**
+ * Counters aggregated over all the subscribers of a BroadcastPool.
+ */
+struct SubscriberQueueStats {
+  // Messages currently buffered across all subscriber queues
+  uint64_t queuedMessages{0};
+  // Deepest single subscriber queue observed
+  uint64_t maxQueueDepth{0};
+  // Messages discarded by the DROP_OLDEST and DROP_NEWEST policies
+  uint64_t droppedMessages{0};
+  // Subscribers closed by the DISCONNECT policy
+  uint64_t disconnectedSubscribers{0};
+};
+
 template <typename R, typename P = DefaultPipeline>
 class ServerPool {
  public:
@@ -39,12 +87,79 @@ class ServerPool {
       const R& routingData) noexcept = 0;
 };
 
+/**
+ * Process-wide index of the thread-local BroadcastPools that share their
+ * upstream connections. For every routing data it records the pool, and
+ * the EventBase of that pool's thread, that owns the upstream broadcast.
+ * Pools on other threads relay from the owner instead of connecting again.
+ */
+template <typename T, typename R, typename P = DefaultPipeline>
+class SharedBroadcastRegistry {
+ public:
+  struct Owner {
+    BroadcastPool<T, R, P>* pool{nullptr};
+    folly::EventBase* evb{nullptr};
+  };
+
+  /**
+   * Returns the owner of the broadcast for the given routingData. If there
+   * is none yet, the candidate becomes the owner and is returned.
+   */
+  Owner findOrAddOwner(const R& routingData, const Owner& candidate) {
+    std::lock_guard<std::mutex> g(mutex_);
+    return owners_.emplace(routingData, candidate).first->second;
+  }
+
+  void removeOwner(const R& routingData, BroadcastPool<T, R, P>* pool) {
+    std::lock_guard<std::mutex> g(mutex_);
+    auto iter = owners_.find(routingData);
+    if (iter != owners_.end() && iter->second.pool == pool) {
+      owners_.erase(iter);
+    }
+  }
+
+  void addPool(BroadcastPool<T, R, P>* pool) {
+    std::lock_guard<std::mutex> g(mutex_);
+    pools_.insert(pool);
+  }
+
+  void removePool(BroadcastPool<T, R, P>* pool) {
+    std::lock_guard<std::mutex> g(mutex_);
+    pools_.erase(pool);
+    for (auto iter = owners_.begin(); iter != owners_.end();) {
+      if (iter->second.pool == pool) {
+        iter = owners_.erase(iter);
+      } else {
+        ++iter;
+      }
+    }
+  }
+
+  /**
+   * Checks if the pool is still alive. Only meaningful when called from
+   * the thread of the pool, since pools are destroyed on their own thread.
+   */
+  bool hasPool(BroadcastPool<T, R, P>* pool) {
+    std::lock_guard<std::mutex> g(mutex_);
+    return pools_.count(pool) > 0;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::unordered_map<R, Owner> owners_;
+  std::unordered_set<BroadcastPool<T, R, P>*> pools_;
+};
+
 /**
  * A pool of upstream broadcast pipelines. There is atmost one broadcast
  * for any unique routing data. Creates and maintains upstream connections
  * and broadcast pipeliens as necessary.
  *
- * Meant to be used as a thread-local instance.
+ * Meant to be used as a thread-local instance. If a SharedBroadcastRegistry
+ * is set, at most one pool across all the threads sharing the registry
+ * connects upstream for any routing data, and the other pools subscribe to
+ * it through a BroadcastRelay that forwards the broadcast to their own
+ * EventBase.
  */
 template <typename T, typename R, typename P = DefaultPipeline>
 class BroadcastPool {
@@ -88,6 +203,82 @@ class BroadcastPool {
     folly::SharedPromise<BroadcastHandler<T, R>*> sharedPromise_;
   };
 
+  /**
+   * Subscribes to a broadcast owned by a pool on another thread and
+   * forwards it to the subscribers of this pool. The Subscriber methods
+   * run on the owner's EventBase; everything else, including the local
+   * BroadcastHandler, lives on the EventBase of this pool.
+   */
+  class BroadcastRelay : public Subscriber<T, R>,
+                         public std::enable_shared_from_this<BroadcastRelay> {
+   public:
+    BroadcastRelay(
+        BroadcastPool<T, R, P>* broadcastPool,
+        const R& routingData,
+        const typename SharedBroadcastRegistry<T, R, P>::Owner& owner)
+        : broadcastPool_(broadcastPool),
+          poolAlive_(broadcastPool->alive_),
+          routingData_(routingData),
+          owner_(owner),
+          localEvb_(broadcastPool->evb_),
+          registry_(broadcastPool->sharedRegistry_),
+          localHandler_(this) {}
+
+    folly::Future<BroadcastHandler<T, R>*> getHandler();
+
+    // Subscriber implementation, invoked on the owner's EventBase
+    void onNext(const T& data) override;
+    void onError(folly::exception_wrapper ex) override;
+    void onCompleted() override;
+    R& routingData() override {
+      return routingData_;
+    }
+
+   private:
+    /**
+     * BroadcastHandler for the local subscribers. It is not part of a
+     * pipeline; closing it tears down the relay instead.
+     */
+    class LocalBroadcastHandler : public BroadcastHandler<T, R> {
+     public:
+      using Context = typename BroadcastHandler<T, R>::Context;
+
+      explicit LocalBroadcastHandler(BroadcastRelay* relay) : relay_(relay) {}
+
+      folly::Future<folly::Unit> close(Context*) override {
+        relay_->shutdown();
+        return folly::makeFuture();
+      }
+
+     private:
+      BroadcastRelay* relay_;
+    };
+
+    void subscribeRemote() noexcept;
+    void handleError(folly::exception_wrapper ex);
+    void shutdown();
+
+    // Immutable after construction
+    BroadcastPool<T, R, P>* broadcastPool_{nullptr};
+    // Expires with the pool, which the relay can outlive
+    std::weak_ptr<bool> poolAlive_;
+    R routingData_;
+    typename SharedBroadcastRegistry<T, R, P>::Owner owner_;
+    folly::EventBase* localEvb_{nullptr};
+    std::shared_ptr<SharedBroadcastRegistry<T, R, P>> registry_;
+
+    // Accessed on the local EventBase only
+    LocalBroadcastHandler localHandler_;
+    bool connectStarted_{false};
+    bool closed_{false};
+    folly::SharedPromise<BroadcastHandler<T, R>*> sharedPromise_;
+
+    // Accessed on the owner's EventBase only
+    BroadcastHandler<T, R>* remoteHandler_{nullptr};
+    uint64_t subscriptionId_{0};
+    bool cancelled_{false};
+  };
+
   BroadcastPool(
       std::shared_ptr<ServerPool<R, P>> serverPool,
       std::shared_ptr<BroadcastPipelineFactory<T, R>> pipelineFactory,
@@ -97,7 +288,11 @@ class BroadcastPool {
         broadcastPipelineFactory_(pipelineFactory),
         clientBootstrapFactory_(clientFactory) {}
 
-  virtual ~BroadcastPool() {}
+  virtual ~BroadcastPool() {
+    if (sharedRegistry_) {
+      sharedRegistry_->removePool(this);
+    }
+  }
 
   // Non-copyable
   BroadcastPool(const BroadcastPool&) = delete;
@@ -129,18 +324,62 @@ class BroadcastPool {
    * Checks if a broadcast is available locally for the given routingData.
    */
   bool isBroadcasting(const R& routingData) {
-    return (broadcasts_.find(routingData) != broadcasts_.end());
+    return (broadcasts_.find(routingData) != broadcasts_.end()) ||
+        (relays_.find(routingData) != relays_.end());
   }
 
   virtual void deleteBroadcast(const R& routingData) {
     broadcasts_.erase(routingData);
+    if (sharedRegistry_) {
+      sharedRegistry_->removeOwner(routingData, this);
+    }
+  }
+
+  /**
+   * Shares upstream broadcasts with the other pools registered with the
+   * given registry. Must be called on the thread whose EventBase serves
+   * this pool, before any broadcast is requested.
+   */
+  void setSharedRegistry(
+      std::shared_ptr<SharedBroadcastRegistry<T, R, P>> registry) {
+    CHECK(broadcasts_.empty() && relays_.empty());
+    sharedRegistry_ = std::move(registry);
+    evb_ = folly::EventBaseManager::get()->getEventBase();
+    sharedRegistry_->addPool(this);
+  }
+
+  /**
+   * Sets the send queue bounds applied to the ObservingHandlers that
+   * subscribe through this pool.
+   */
+  void setSubscriberQueueOptions(const SubscriberQueueOptions& options) {
+    subscriberQueueOptions_ = options;
+  }
+
+  const SubscriberQueueOptions& getSubscriberQueueOptions() const {
+    return subscriberQueueOptions_;
+  }
+
+  const SubscriberQueueStats& getSubscriberQueueStats() const {
+    return subscriberQueueStats_;
   }
 
  private:
+  friend class ObservingHandler<T, R, P>;
+
   std::shared_ptr<ServerPool<R, P>> serverPool_;
   std::shared_ptr<BroadcastPipelineFactory<T, R>> broadcastPipelineFactory_;
   std::shared_ptr<BaseClientBootstrapFactory<>> clientBootstrapFactory_;
-  std::map<R, typename BroadcastManager::UniquePtr> broadcasts_;
+  std::unordered_map<R, typename BroadcastManager::UniquePtr> broadcasts_;
+  std::unordered_map<R, std::shared_ptr<BroadcastRelay>> relays_;
+
+  std::shared_ptr<SharedBroadcastRegistry<T, R, P>> sharedRegistry_;
+  folly::EventBase* evb_{nullptr};
+  // Checked by relays on this pool's EventBase before they touch relays_
+  std::shared_ptr<bool> alive_{std::make_shared<bool>(true)};
+
+  SubscriberQueueOptions subscriberQueueOptions_;
+  SubscriberQueueStats subscriberQueueStats_;
 };
 
 } // namespace wangle
@@ -31,6 +31,8 @@ ObservingHandler<T, R, P>::~ObservingHandler() {
     broadcastHandler->unsubscribe(subscriptionId_);
   }
 
+  broadcastPool_->subscriberQueueStats_.queuedMessages -= queue_.size();
+
   if (deleted_) {
     *deleted_ = true;
   }
@@ -89,9 +91,64 @@ void ObservingHandler<T, R, P>::readException(
 
 template <typename T, typename R, typename P>
 void ObservingHandler<T, R, P>::onNext(const T& data) {
+  const auto& options = broadcastPool_->getSubscriberQueueOptions();
+  if (options.maxQueueDepth == 0) {
+    writeToTransport(BroadcastValue<T>::share(data));
+    return;
+  }
+
+  if (overflowed_) {
+    // Already disconnecting this subscriber
+    return;
+  }
+
+  if (!writePending_ && queue_.empty()) {
+    writePending_ = true;
+    writeToTransport(BroadcastValue<T>::share(data));
+    return;
+  }
+
+  auto& stats = broadcastPool_->subscriberQueueStats_;
+  if (queue_.size() >= options.maxQueueDepth) {
+    switch (options.overflowPolicy) {
+      case SubscriberQueueOverflowPolicy::DROP_OLDEST:
+        popQueue();
+        stats.droppedMessages++;
+        break;
+      case SubscriberQueueOverflowPolicy::DROP_NEWEST:
+        stats.droppedMessages++;
+        return;
+      case SubscriberQueueOverflowPolicy::DISCONNECT:
+        LOG(ERROR) << "Closing slow subscriber with " << queue_.size()
+                   << " queued messages";
+        stats.disconnectedSubscribers++;
+        overflowed_ = true;
+        while (!queue_.empty()) {
+          popQueue();
+        }
+        this->close(this->getContext());
+        return;
+    }
+  }
+
+  queue_.push_back(BroadcastValue<T>::share(data));
+  stats.queuedMessages++;
+  stats.maxQueueDepth =
+      std::max<uint64_t>(stats.maxQueueDepth, queue_.size());
+}
+
+template <typename T, typename R, typename P>
+void ObservingHandler<T, R, P>::writeToTransport(T data) {
   auto ctx = this->getContext();
   auto deleted = deleted_;
-  this->write(ctx, data)
+  this->write(ctx, std::move(data))
+      .then([this, deleted] {
+        if (*deleted) {
+          return;
+        }
+
+        onWriteComplete();
+      })
       .onError([this, ctx, deleted](const std::exception& ex) {
         if (*deleted) {
           return;
@@ -102,6 +159,37 @@ void ObservingHandler<T, R, P>::onNext(const T& data) {
       });
 }
 
+template <typename T, typename R, typename P>
+void ObservingHandler<T, R, P>::onWriteComplete() {
+  writePending_ = false;
+  // Writes that complete inline are picked up by the loop in drainQueue()
+  if (!draining_) {
+    drainQueue();
+  }
+}
+
+template <typename T, typename R, typename P>
+void ObservingHandler<T, R, P>::drainQueue() {
+  auto deleted = deleted_;
+  draining_ = true;
+  while (!writePending_ && !queue_.empty()) {
+    auto data = std::move(queue_.front());
+    popQueue();
+    writePending_ = true;
+    writeToTransport(std::move(data));
+    if (*deleted) {
+      return;
+    }
+  }
+  draining_ = false;
+}
+
+template <typename T, typename R, typename P>
+void ObservingHandler<T, R, P>::popQueue() {
+  queue_.pop_front();
+  broadcastPool_->subscriberQueueStats_.queuedMessages--;
+}
+
 template <typename T, typename R, typename P>
 void ObservingHandler<T, R, P>::onError(folly::exception_wrapper ex) {
   LOG(ERROR) << "Error observing a broadcast: " << exceptionStr(ex);
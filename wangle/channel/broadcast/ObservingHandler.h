@@ -15,6 +15,8 @@
  */
 #pragma once
 
+#include <deque>
+
 #include <wangle/bootstrap/AcceptRoutingHandler.h>
 #include <wangle/bootstrap/ServerBootstrap.h>
 #include <wangle/channel/broadcast/BroadcastPool.h>
@@ -26,6 +28,11 @@ namespace wangle {
  * A Handler-Observer adaptor that can be used for subscribing to broadcasts.
  * Maintains a thread-local BroadcastPool from which a BroadcastHandler is
  * obtained and subscribed to based on the given routing data.
+ *
+ * If the BroadcastPool has a bounded SubscriberQueueOptions::maxQueueDepth,
+ * at most one write is outstanding on the transport and the remaining
+ * messages wait in a per-subscriber queue that is trimmed according to the
+ * configured overflow policy.
  */
 template <typename T, typename R, typename P = DefaultPipeline>
 class ObservingHandler : public HandlerAdapter<folly::IOBufQueue&, T>,
@@ -55,7 +62,19 @@ class ObservingHandler : public HandlerAdapter<folly::IOBufQueue&, T>,
   void onCompleted() override;
   R& routingData() override;
 
+  /**
+   * Number of messages waiting to be written to this subscriber.
+   */
+  size_t getQueueDepth() const {
+    return queue_.size();
+  }
+
  private:
+  void writeToTransport(T data);
+  void onWriteComplete();
+  void drainQueue();
+  void popQueue();
+
   R routingData_;
   BroadcastPool<T, R, P>* broadcastPool_{nullptr};
 
@@ -63,6 +82,11 @@ class ObservingHandler : public HandlerAdapter<folly::IOBufQueue&, T>,
   uint64_t subscriptionId_{0};
   bool paused_{false};
 
+  std::deque<T> queue_;
+  bool writePending_{false};
+  bool draining_{false};
+  bool overflowed_{false};
+
   // True iff the handler has been deleted
   std::shared_ptr<bool> deleted_{new bool(false)};
 };
@@ -107,14 +131,27 @@ class ObservingPipelineFactory
         broadcastPool_.reset(
             new BroadcastPool<T, R, P>(serverPool_, broadcastPipelineFactory_));
       }
+      if (sharedRegistry_) {
+        broadcastPool_->setSharedRegistry(sharedRegistry_);
+      }
     }
     return broadcastPool_.get();
   }
 
+  /**
+   * Shares upstream broadcasts across the thread-local BroadcastPools of
+   * this factory, so that only one upstream connection is made for any
+   * routing data. Must be called before any pipeline is created.
+   */
+  void enableSharedBroadcasts() {
+    sharedRegistry_ = std::make_shared<SharedBroadcastRegistry<T, R, P>>();
+  }
+
  protected:
   std::shared_ptr<ServerPool<R, P>> serverPool_;
   std::shared_ptr<BroadcastPipelineFactory<T, R>> broadcastPipelineFactory_;
   folly::ThreadLocalPtr<BroadcastPool<T, R, P>> broadcastPool_;
+  std::shared_ptr<SharedBroadcastRegistry<T, R, P>> sharedRegistry_;
 };
 
 } // namespace wangle
@@ -320,3 +320,19 @@ TEST_F(BroadcastHandlerTest, OnError) {
   // The handler should be deleted now
   handler->readException(nullptr, make_exception_wrapper<std::exception>());
 }
+
+TEST(BroadcastValueTest, SharedIOBuf) {
+  // Every subscriber should get a clone of the same buffer, not a copy
+  auto buf = IOBuf::copyBuffer("data1");
+  auto clone0 = BroadcastValue<std::unique_ptr<IOBuf>>::share(buf);
+  auto clone1 = BroadcastValue<std::unique_ptr<IOBuf>>::share(buf);
+
+  EXPECT_TRUE(buf->isShared());
+  EXPECT_EQ(buf->data(), clone0->data());
+  EXPECT_EQ(buf->data(), clone1->data());
+  EXPECT_EQ("data1", clone1->moveToFbString().toStdString());
+
+  std::unique_ptr<IOBuf> empty;
+  EXPECT_EQ(nullptr, BroadcastValue<std::unique_ptr<IOBuf>>::share(empty));
+  EXPECT_EQ("data2", BroadcastValue<std::string>::share("data2"));
+}
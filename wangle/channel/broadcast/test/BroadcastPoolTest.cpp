@@ -13,6 +13,8 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <folly/io/async/ScopedEventBaseThread.h>
+#include <folly/synchronization/Baton.h>
 #include <wangle/bootstrap/ServerBootstrap.h>
 #include <wangle/channel/broadcast/BroadcastPool.h>
 #include <wangle/channel/broadcast/test/Mocks.h>
@@ -560,3 +562,211 @@ TEST_F(BroadcastPoolTest, ThreadLocalPool) {
   pipeline2->readEOF();
   pipeline4->readEOF();
 }
+
+TEST(SharedBroadcastRegistryTest, OwnerPerRoutingData) {
+  using Registry = SharedBroadcastRegistry<int, std::string>;
+  auto registry = std::make_shared<Registry>();
+  auto pool0 = reinterpret_cast<BroadcastPool<int, std::string>*>(0x10);
+  auto pool1 = reinterpret_cast<BroadcastPool<int, std::string>*>(0x20);
+  EventBase evb0;
+  EventBase evb1;
+
+  registry->addPool(pool0);
+  registry->addPool(pool1);
+  EXPECT_TRUE(registry->hasPool(pool0));
+
+  Registry::Owner owner0;
+  owner0.pool = pool0;
+  owner0.evb = &evb0;
+  Registry::Owner owner1;
+  owner1.pool = pool1;
+  owner1.evb = &evb1;
+
+  // The first pool to ask becomes the owner
+  EXPECT_EQ(pool0, registry->findOrAddOwner("url1", owner0).pool);
+  EXPECT_EQ(pool0, registry->findOrAddOwner("url1", owner1).pool);
+  EXPECT_EQ(&evb0, registry->findOrAddOwner("url1", owner1).evb);
+  EXPECT_EQ(pool1, registry->findOrAddOwner("url2", owner1).pool);
+
+  // Only the owner can remove itself
+  registry->removeOwner("url1", pool1);
+  EXPECT_EQ(pool0, registry->findOrAddOwner("url1", owner1).pool);
+  registry->removeOwner("url1", pool0);
+  EXPECT_EQ(pool1, registry->findOrAddOwner("url1", owner1).pool);
+
+  // Removing a pool drops all of its broadcasts
+  registry->removePool(pool1);
+  EXPECT_FALSE(registry->hasPool(pool1));
+  EXPECT_EQ(pool0, registry->findOrAddOwner("url1", owner0).pool);
+  EXPECT_EQ(pool0, registry->findOrAddOwner("url2", owner0).pool);
+}
+
+/**
+ * A pool on the main thread that relays from an owner pool connected
+ * upstream on ownerThread, both sharing one registry
+ */
+class SharedBroadcastPoolTest : public BroadcastPoolTest {
+ public:
+  void SetUp() override {
+    BroadcastPoolTest::SetUp();
+    registry = std::make_shared<SharedBroadcastRegistry<int, std::string>>();
+    ownerEvb = ownerThread.getEventBase();
+    ownerEvb->runInEventBaseThreadAndWait([&] {
+      ownerPool = std::make_unique<BroadcastPool<int, std::string>>(
+          serverPool, pipelineFactory, std::make_shared<ClientBootstrapFactory>());
+      ownerPool->setSharedRegistry(registry);
+    });
+    localPool = std::make_unique<BroadcastPool<int, std::string>>(
+        serverPool, pipelineFactory, std::make_shared<ClientBootstrapFactory>());
+    localPool->setSharedRegistry(registry);
+  }
+
+  void TearDown() override {
+    localPool.reset();
+    ownerEvb->runInEventBaseThreadAndWait([&] { ownerPool.reset(); });
+    BroadcastPoolTest::TearDown();
+  }
+
+ protected:
+  // Connects the owner upstream and subscribes ownerSubscriber
+  BroadcastHandler<int, std::string>* subscribeOwner() {
+    EXPECT_CALL(*pipelineFactory, setRoutingData(_, kUrl)).Times(1);
+    BroadcastHandler<int, std::string>* handler = nullptr;
+    Baton<> baton;
+    ownerEvb->runInEventBaseThread([&] {
+      ownerPool->getHandler(kUrl).then(
+          [&](BroadcastHandler<int, std::string>* h) {
+            handler = h;
+            handler->subscribe(&ownerSubscriber);
+            baton.post();
+          });
+    });
+    baton.wait();
+    return handler;
+  }
+
+  bool ownerIsBroadcasting() {
+    bool broadcasting = false;
+    ownerEvb->runInEventBaseThreadAndWait(
+        [&] { broadcasting = ownerPool->isBroadcasting(kUrl); });
+    return broadcasting;
+  }
+
+  void loopUntil(const bool& done) {
+    auto base = EventBaseManager::get()->getEventBase();
+    while (!done) {
+      base->loopOnce();
+    }
+  }
+
+  const std::string kUrl{"url"};
+  ScopedEventBaseThread ownerThread;
+  EventBase* ownerEvb{nullptr};
+  std::shared_ptr<SharedBroadcastRegistry<int, std::string>> registry;
+  std::unique_ptr<BroadcastPool<int, std::string>> ownerPool;
+  std::unique_ptr<BroadcastPool<int, std::string>> localPool;
+  NiceMock<MockSubscriber<int, std::string>> ownerSubscriber;
+  NiceMock<MockSubscriber<int, std::string>> localSubscriber;
+};
+
+TEST_F(SharedBroadcastPoolTest, RelayForwardsData) {
+  auto ownerHandler = subscribeOwner();
+
+  // The local pool relays instead of connecting upstream again
+  BroadcastHandler<int, std::string>* localHandler = nullptr;
+  bool subscribed = false;
+  localPool->getHandler(kUrl).then(
+      [&](BroadcastHandler<int, std::string>* h) {
+        localHandler = h;
+        localHandler->subscribe(&localSubscriber);
+        subscribed = true;
+      });
+  EXPECT_TRUE(localPool->isBroadcasting(kUrl));
+  loopUntil(subscribed);
+  EXPECT_NE(ownerHandler, localHandler);
+
+  // Data read upstream on the owner's thread reaches both subscribers
+  bool received = false;
+  EXPECT_CALL(ownerSubscriber, onNext(42)).Times(1);
+  EXPECT_CALL(localSubscriber, onNext(42))
+      .WillOnce(InvokeWithoutArgs([&] { received = true; }));
+  ownerEvb->runInEventBaseThread(
+      [&] { ownerHandler->read(ownerHandler->getContext(), 42); });
+  loopUntil(received);
+
+  // So does the end of the broadcast, which tears down both sides
+  bool completed = false;
+  EXPECT_CALL(ownerSubscriber, onCompleted()).Times(1);
+  EXPECT_CALL(localSubscriber, onCompleted())
+      .WillOnce(InvokeWithoutArgs([&] { completed = true; }));
+  ownerEvb->runInEventBaseThread(
+      [&] { ownerHandler->readEOF(ownerHandler->getContext()); });
+  loopUntil(completed);
+  EXPECT_FALSE(localPool->isBroadcasting(kUrl));
+  EXPECT_FALSE(ownerIsBroadcasting());
+}
+
+TEST_F(SharedBroadcastPoolTest, RelayForwardsError) {
+  auto ownerHandler = subscribeOwner();
+
+  bool subscribed = false;
+  localPool->getHandler(kUrl).then(
+      [&](BroadcastHandler<int, std::string>* h) {
+        h->subscribe(&localSubscriber);
+        subscribed = true;
+      });
+  loopUntil(subscribed);
+
+  bool failed = false;
+  EXPECT_CALL(ownerSubscriber, onError(_)).Times(1);
+  EXPECT_CALL(localSubscriber, onError(_))
+      .WillOnce(InvokeWithoutArgs([&] { failed = true; }));
+  ownerEvb->runInEventBaseThread([&] {
+    ownerHandler->readException(
+        ownerHandler->getContext(),
+        make_exception_wrapper<std::runtime_error>("upstream error"));
+  });
+  loopUntil(failed);
+  EXPECT_FALSE(localPool->isBroadcasting(kUrl));
+  EXPECT_FALSE(ownerIsBroadcasting());
+}
+
+TEST_F(SharedBroadcastPoolTest, LocalObserversGoneWhileSubscribing) {
+  auto ownerHandler = subscribeOwner();
+
+  // Nobody subscribes to the relayed handler, so the relay closes itself
+  // and drops its subscription on the owner
+  bool done = false;
+  localPool->getHandler(kUrl).then(
+      [&](BroadcastHandler<int, std::string>*) { done = true; });
+  loopUntil(done);
+  EXPECT_FALSE(localPool->isBroadcasting(kUrl));
+
+  // The owner keeps broadcasting to its own subscriber only
+  EXPECT_TRUE(ownerIsBroadcasting());
+  EXPECT_CALL(ownerSubscriber, onNext(7)).Times(1);
+  EXPECT_CALL(localSubscriber, onNext(_)).Times(0);
+  ownerEvb->runInEventBaseThreadAndWait(
+      [&] { ownerHandler->read(ownerHandler->getContext(), 7); });
+  EventBaseManager::get()->getEventBase()->loopOnce(EVLOOP_NONBLOCK);
+
+  EXPECT_CALL(ownerSubscriber, onCompleted()).Times(1);
+  ownerEvb->runInEventBaseThreadAndWait(
+      [&] { ownerHandler->readEOF(ownerHandler->getContext()); });
+}
+
+TEST_F(SharedBroadcastPoolTest, LocalPoolDestroyedWhileSubscribing) {
+  auto ownerHandler = subscribeOwner();
+
+  // The relay outlives its pool and must not touch it when it closes
+  bool done = false;
+  localPool->getHandler(kUrl).then(
+      [&](BroadcastHandler<int, std::string>*) { done = true; });
+  localPool.reset();
+  loopUntil(done);
+  EXPECT_TRUE(ownerIsBroadcasting());
+
+  EXPECT_CALL(ownerSubscriber, onCompleted()).Times(1);
+  ownerEvb->runInEventBaseThreadAndWait(
+      [&] { ownerHandler->readEOF(ownerHandler->getContext()); });
+}
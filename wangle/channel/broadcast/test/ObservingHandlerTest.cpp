@@ -357,3 +357,169 @@ TEST_F(ObservingHandlerTest, WriteErrorHandlerDeletion) {
   pipeline.reset();
   promise.setException(std::exception());
 }
+
+TEST_F(ObservingHandlerTest, SlowSubscriberDropOldest) {
+  InSequence dummy;
+
+  pool.setSubscriberQueueOptions(
+      {2, SubscriberQueueOverflowPolicy::DROP_OLDEST});
+
+  EXPECT_CALL(*prevHandler, transportActive(_))
+      .WillOnce(Invoke([&](MockBytesToBytesHandler::Context* ctx) {
+        ctx->fireTransportActive();
+      }));
+  // Verify that ingress is paused
+  EXPECT_CALL(*prevHandler, transportInactive(_)).WillOnce(Return());
+  EXPECT_CALL(pool, mockGetHandler(_))
+      .WillOnce(Return(MoveWrapper<Future<BroadcastHandler<int, std::string>*>>(
+          broadcastHandler.get())));
+  EXPECT_CALL(*broadcastHandler, subscribe(_)).Times(1);
+  // Verify that ingress is resumed
+  EXPECT_CALL(*prevHandler, transportActive(_))
+      .WillOnce(Invoke([&](MockBytesToBytesHandler::Context* ctx) {
+        ctx->fireTransportActive();
+      }));
+
+  // Initialize the pipeline
+  pipeline->transportActive();
+
+  // The first write doesn't complete, so the rest of the data is queued
+  Promise<Unit> promise;
+  EXPECT_CALL(*observingHandler, mockWrite(_, 1))
+      .WillOnce(Return(makeMoveWrapper(promise.getFuture())));
+
+  observingHandler->onNext(1);
+  observingHandler->onNext(2);
+  observingHandler->onNext(3);
+  observingHandler->onNext(4);
+
+  // 2 should have been dropped to make room for 4
+  EXPECT_EQ(2, observingHandler->getQueueDepth());
+  EXPECT_EQ(2, pool.getSubscriberQueueStats().queuedMessages);
+  EXPECT_EQ(2, pool.getSubscriberQueueStats().maxQueueDepth);
+  EXPECT_EQ(1, pool.getSubscriberQueueStats().droppedMessages);
+
+  // Complete the write and verify that the queue is flushed
+  EXPECT_CALL(*observingHandler, mockWrite(_, 3))
+      .WillOnce(Return(makeMoveWrapper(makeFuture())));
+  EXPECT_CALL(*observingHandler, mockWrite(_, 4))
+      .WillOnce(Return(makeMoveWrapper(makeFuture())));
+  promise.setValue();
+
+  EXPECT_EQ(0, observingHandler->getQueueDepth());
+  EXPECT_EQ(0, pool.getSubscriberQueueStats().queuedMessages);
+
+  EXPECT_CALL(*observingHandler, mockClose(_))
+      .WillOnce(Return(makeMoveWrapper(makeFuture())));
+
+  // Finish the broadcast
+  observingHandler->onCompleted();
+}
+
+TEST_F(ObservingHandlerTest, SlowSubscriberDisconnect) {
+  InSequence dummy;
+
+  pool.setSubscriberQueueOptions(
+      {1, SubscriberQueueOverflowPolicy::DISCONNECT});
+
+  EXPECT_CALL(*prevHandler, transportActive(_))
+      .WillOnce(Invoke([&](MockBytesToBytesHandler::Context* ctx) {
+        ctx->fireTransportActive();
+      }));
+  // Verify that ingress is paused
+  EXPECT_CALL(*prevHandler, transportInactive(_)).WillOnce(Return());
+  EXPECT_CALL(pool, mockGetHandler(_))
+      .WillOnce(Return(MoveWrapper<Future<BroadcastHandler<int, std::string>*>>(
+          broadcastHandler.get())));
+  EXPECT_CALL(*broadcastHandler, subscribe(_)).Times(1);
+  // Verify that ingress is resumed
+  EXPECT_CALL(*prevHandler, transportActive(_))
+      .WillOnce(Invoke([&](MockBytesToBytesHandler::Context* ctx) {
+        ctx->fireTransportActive();
+      }));
+
+  // Initialize the pipeline
+  pipeline->transportActive();
+
+  Promise<Unit> promise;
+  EXPECT_CALL(*observingHandler, mockWrite(_, 1))
+      .WillOnce(Return(makeMoveWrapper(promise.getFuture())));
+
+  observingHandler->onNext(1);
+  observingHandler->onNext(2);
+
+  // Overflowing the queue closes the subscriber
+  EXPECT_CALL(*observingHandler, mockClose(_))
+      .WillOnce(InvokeWithoutArgs([&] {
+        // Delete the pipeline
+        pipeline.reset();
+        return makeMoveWrapper(makeFuture());
+      }));
+  EXPECT_CALL(*broadcastHandler, unsubscribe(_)).Times(1);
+  observingHandler->onNext(3);
+
+  EXPECT_EQ(0, pool.getSubscriberQueueStats().queuedMessages);
+  EXPECT_EQ(1, pool.getSubscriberQueueStats().disconnectedSubscribers);
+  promise.setValue();
+}
+
+TEST_F(ObservingHandlerTest, SlowSubscriberDropNewest) {
+  InSequence dummy;
+
+  pool.setSubscriberQueueOptions(
+      {2, SubscriberQueueOverflowPolicy::DROP_NEWEST});
+
+  EXPECT_CALL(*prevHandler, transportActive(_))
+      .WillOnce(Invoke([&](MockBytesToBytesHandler::Context* ctx) {
+        ctx->fireTransportActive();
+      }));
+  // Verify that ingress is paused
+  EXPECT_CALL(*prevHandler, transportInactive(_)).WillOnce(Return());
+  EXPECT_CALL(pool, mockGetHandler(_))
+      .WillOnce(Return(MoveWrapper<Future<BroadcastHandler<int, std::string>*>>(
+          broadcastHandler.get())));
+  EXPECT_CALL(*broadcastHandler, subscribe(_)).Times(1);
+  // Verify that ingress is resumed
+  EXPECT_CALL(*prevHandler, transportActive(_))
+      .WillOnce(Invoke([&](MockBytesToBytesHandler::Context* ctx) {
+        ctx->fireTransportActive();
+      }));
+
+  // Initialize the pipeline
+  pipeline->transportActive();
+
+  // The first write doesn't complete, so the rest of the data is queued
+  Promise<Unit> promise;
+  EXPECT_CALL(*observingHandler, mockWrite(_, 1))
+      .WillOnce(Return(makeMoveWrapper(promise.getFuture())));
+
+  observingHandler->onNext(1);
+  observingHandler->onNext(2);
+  observingHandler->onNext(3);
+  observingHandler->onNext(4);
+  observingHandler->onNext(5);
+
+  // 4 and 5 should have been dropped, the queue keeps 2 and 3
+  EXPECT_EQ(2, observingHandler->getQueueDepth());
+  EXPECT_EQ(2, pool.getSubscriberQueueStats().queuedMessages);
+  EXPECT_EQ(2, pool.getSubscriberQueueStats().maxQueueDepth);
+  EXPECT_EQ(2, pool.getSubscriberQueueStats().droppedMessages);
+  EXPECT_EQ(0, pool.getSubscriberQueueStats().disconnectedSubscribers);
+
+  // Complete the write and verify that the queue is flushed in order
+  EXPECT_CALL(*observingHandler, mockWrite(_, 2))
+      .WillOnce(Return(makeMoveWrapper(makeFuture())));
+  EXPECT_CALL(*observingHandler, mockWrite(_, 3))
+      .WillOnce(Return(makeMoveWrapper(makeFuture())));
+  promise.setValue();
+
+  EXPECT_EQ(0, observingHandler->getQueueDepth());
+  EXPECT_EQ(0, pool.getSubscriberQueueStats().queuedMessages);
+  EXPECT_EQ(2, pool.getSubscriberQueueStats().droppedMessages);
+
+  EXPECT_CALL(*observingHandler, mockClose(_))
+      .WillOnce(Return(makeMoveWrapper(makeFuture())));
+
+  // Finish the broadcast
+  observingHandler->onCompleted();
+}
@@ -0,0 +1,326 @@
+#include "DubboBackend.h"
+
+#include <iostream>
+#include <random>
+
+#include <folly/io/async/AsyncSocketException.h>
+
+#include <wangle/channel/AsyncSocketHandler.h>
+#include <wangle/codec/DubboHeartbeatHandler.h>
+#include <wangle/codec/DubboProtocol.h>
+#include <wangle/codec/LengthFieldBasedFrameDecoder.h>
+
+using namespace folly;
+using namespace wangle;
+using namespace std;
+
+/*
+ * Top of the backend pipeline: hands response frames and connection loss to
+ * the DubboBackend, until the backend lets go of this connection
+ */
+class DubboBackend::BackendHandler : public HandlerAdapter<std::unique_ptr<IOBuf>>
+{
+public:
+    explicit BackendHandler(DubboBackend* backend) : backend_(backend) {}
+
+    void detach()
+    {
+        backend_ = nullptr;
+    }
+
+    void read(Context*, std::unique_ptr<IOBuf> frame) override
+    {
+        if (backend_)
+        {
+            backend_->onResponse(std::move(frame));
+        }
+    }
+
+    void readEOF(Context*) override
+    {
+        if (backend_)
+        {
+            backend_->onDisconnected(make_exception_wrapper<AsyncSocketException>(
+                    AsyncSocketException::END_OF_FILE, "dubbo provider closed the connection"));
+        }
+    }
+
+    void readException(Context*, exception_wrapper e) override
+    {
+        if (backend_)
+        {
+            backend_->onDisconnected(e);
+        }
+    }
+
+private:
+    DubboBackend* backend_;
+};
+
+/*
+ * Frames the provider's responses and keeps the connection probed; the
+ * BackendHandler goes on top once a backend takes the connection
+ */
+class DubboBackend::BackendPipelineFactory : public PipelineFactory<DefaultPipeline>
+{
+public:
+    explicit BackendPipelineFactory(const DubboBackendOptions& options) : options_(options) {}
+
+    DefaultPipeline::Ptr newPipeline(std::shared_ptr<AsyncTransportWrapper> sock) override
+    {
+        auto& options = options_;
+        auto pipeline = DefaultPipeline::create();
+        pipeline->addBack(AsyncSocketHandler(sock));
+        pipeline->addBack(LengthFieldBasedFrameDecoder(
+                4, kDubboHeaderLength + kDubboDefaultMaxBodyLength,
+                kDubboLengthFieldOffset, 0, 0));
+        if (options.heartbeatInterval.count() > 0)
+        {
+            pipeline->addBack(std::make_shared<DubboHeartbeatHandler>(
+                    options.heartbeatInterval, options.heartbeatMaxMissed));
+        }
+        pipeline->finalize();
+        return pipeline;
+    }
+
+private:
+    DubboBackendOptions options_;
+};
+
+std::shared_ptr<PipelineFactory<DefaultPipeline>> DubboBackend::makePipelineFactory(
+        const DubboBackendOptions& options)
+{
+    return std::make_shared<BackendPipelineFactory>(options);
+}
+
+DubboBackend::DubboBackend(EventBase* evb,
+                           std::shared_ptr<DubboEndpoint> endpoint,
+                           DubboBackendOptions options,
+                           Pool* pool)
+        : evb_(evb),
+          endpoint_(std::move(endpoint)),
+          options_(options),
+          pool_(pool),
+          pipelineFactory_(pool ? nullptr : makePipelineFactory(options))
+{}
+
+DubboBackend::~DubboBackend()
+{
+    stop();
+}
+
+Future<Unit> DubboBackend::connect()
+{
+    auto future = connected_.getFuture();
+    startConnect();
+    return future;
+}
+
+void DubboBackend::stop()
+{
+    if (stopped_)
+    {
+        return;
+    }
+    stopped_ = true;
+    cancelTimeout();
+    attempt_++;     //forget a connect in progress
+    if (pipeline_)
+    {
+        teardown();
+    }
+    client_.reset();
+    failAll(make_exception_wrapper<std::runtime_error>("dubbo backend stopped"));
+    if (!everConnected_)
+    {
+        connected_.setException(make_exception_wrapper<std::runtime_error>(
+                "dubbo backend stopped before connecting"));
+    }
+}
+
+void DubboBackend::send(int64_t id, std::unique_ptr<IOBuf> frame, bool twoWay, Callback cb)
+{
+    DCHECK(evb_->isInEventBaseThread());
+    if (!pipeline_)
+    {
+        cb(Try<std::unique_ptr<IOBuf>>(make_exception_wrapper<AsyncSocketException>(
+                AsyncSocketException::NOT_OPEN, "no connection to dubbo provider")));
+        return;
+    }
+
+    if (!twoWay)
+    {
+        pipeline_->write(std::move(frame));
+        cb(Try<std::unique_ptr<IOBuf>>(std::unique_ptr<IOBuf>()));
+        return;
+    }
+    //a write error closes the socket, which fails the request via readException
+    auto backendId = nextId_++;
+    setDubboRequestId(frame, backendId);
+    inFlight_.emplace(backendId, Request{id, std::move(cb)});
+    endpoint_->inFlight++;
+    pipeline_->write(std::move(frame));
+}
+
+void DubboBackend::timeoutExpired() noexcept
+{
+    startConnect();
+}
+
+void DubboBackend::startConnect()
+{
+    DCHECK(evb_->isInEventBaseThread());
+    if (stopped_)
+    {
+        return;
+    }
+
+    auto attempt = ++attempt_;
+    std::weak_ptr<DubboBackend> self = shared_from_this();
+    try
+    {
+        newConnection()
+                .then([self, attempt](ClientPtr client)
+                      {
+                          auto backend = self.lock();
+                          if (backend && backend->attempt_ == attempt)
+                          {
+                              backend->onConnected(std::move(client));
+                          }
+                      })
+                .onError([self, attempt](const std::exception& e)
+                         {
+                             auto backend = self.lock();
+                             if (backend && backend->attempt_ == attempt)
+                             {
+                                 cout << "connect to dubbo " << backend->getAddress().describe()
+                                      << " error: " << exceptionStr(e) << endl;
+                                 backend->scheduleReconnect();
+                             }
+                         });
+    }
+    catch (const std::exception& e)
+    {
+        cout << "connect to dubbo error: " << exceptionStr(e) << endl;
+        scheduleReconnect();
+    }
+}
+
+Future<DubboBackend::ClientPtr> DubboBackend::newConnection()
+{
+    if (pool_)
+    {
+        return pool_->acquire(getAddress());
+    }
+    //without a group the bootstrap connects on this thread's EventBase
+    auto client = std::make_shared<ClientBootstrap<DefaultPipeline>>();
+    client->pipelineFactory(pipelineFactory_);
+    return client->connect(getAddress(), options_.connectTimeout)
+            .then([client](DefaultPipeline*) { return client; });
+}
+
+void DubboBackend::onConnected(ClientPtr client)
+{
+    auto pipeline = client->getPipeline();
+    auto transport = pipeline->getTransport();
+    if (!transport || !transport->good())
+    {
+        //closed before we got to it
+        cout << "connection to dubbo " << getAddress().describe() << " closed early" << endl;
+        evb_->runInLoop([client]() {});
+        scheduleReconnect();
+        return;
+    }
+
+    cout << "connect to dubbo " << getAddress().describe() << " success!!!" << endl;
+    auto handler = std::make_shared<BackendHandler>(this);
+    pipeline->addBack(handler);
+    pipeline->finalize();
+    client_ = std::move(client);
+    pipeline_ = pipeline;
+    handler_ = handler.get();
+    backoff_ = std::chrono::milliseconds(0);
+    if (!everConnected_)
+    {
+        everConnected_ = true;
+        connected_.setValue();
+    }
+}
+
+void DubboBackend::onResponse(std::unique_ptr<IOBuf> frame)
+{
+    io::Cursor c(frame.get());
+    DubboHeader header;
+    if (frame->computeChainDataLength() < kDubboHeaderLength || !readDubboHeader(c, header))
+    {
+        onDisconnected(make_exception_wrapper<std::runtime_error>("bad dubbo response"));
+        return;
+    }
+
+    auto it = inFlight_.find(header.id);
+    if (it == inFlight_.end())
+    {
+        return;
+    }
+    auto request = std::move(it->second);
+    inFlight_.erase(it);
+    endpoint_->inFlight--;
+    setDubboRequestId(frame, request.id);
+    request.cb(Try<std::unique_ptr<IOBuf>>(std::move(frame)));
+}
+
+void DubboBackend::onDisconnected(const exception_wrapper& ex)
+{
+    if (!pipeline_)
+    {
+        return;
+    }
+    cout << "dubbo connection to " << getAddress().describe() << " lost: " << ex.what() << endl;
+    teardown();
+    failAll(ex);
+    scheduleReconnect();
+}
+
+void DubboBackend::teardown()
+{
+    handler_->detach();
+    handler_ = nullptr;
+    auto pipeline = pipeline_;
+    pipeline_ = nullptr;
+    pipeline->close();
+
+    //we may be running inside this pipeline, let it unwind before freeing it
+    auto client = std::move(client_);
+    evb_->runInLoop([client]() {});
+}
+
+void DubboBackend::failAll(const exception_wrapper& ex)
+{
+    //callbacks may send again, so work on a copy
+    auto inFlight = std::move(inFlight_);
+    inFlight_.clear();
+    endpoint_->inFlight -= inFlight.size();
+    for (auto& request : inFlight)
+    {
+        request.second.cb(Try<std::unique_ptr<IOBuf>>(ex));
+    }
+}
+
+void DubboBackend::scheduleReconnect()
+{
+    if (stopped_)
+    {
+        return;
+    }
+
+    //exponential backoff with equal jitter: half fixed, half random
+    static thread_local std::mt19937_64 rng(std::random_device{}());
+    backoff_ = backoff_.count() == 0
+               ? options_.reconnectInitialDelay
+               : std::min(backoff_ * 2, options_.reconnectMaxDelay);
+    auto half = backoff_.count() / 2;
+    auto delay = std::chrono::milliseconds(
+            half + std::uniform_int_distribution<int64_t>(0, backoff_.count() - half)(rng));
+    cout << "reconnect to dubbo " << getAddress().describe() << " in " << delay.count() << "ms" << endl;
+    evb_->timer().scheduleTimeout(this, delay);
+}
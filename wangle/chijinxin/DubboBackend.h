@@ -0,0 +1,162 @@
+//
+// One ProviderAgent connection to a Dubbo provider, with heartbeats,
+// fail-fast on disconnect and reconnect with backoff.
+//
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <unordered_map>
+
+#include <folly/Function.h>
+#include <folly/SocketAddress.h>
+#include <folly/Try.h>
+#include <folly/futures/Future.h>
+#include <folly/io/async/HHWheelTimer.h>
+
+#include <wangle/bootstrap/ClientBootstrap.h>
+#include <wangle/bootstrap/WarmConnectionPool.h>
+
+struct DubboBackendOptions
+{
+    std::chrono::milliseconds connectTimeout{1000};
+    //heartbeat when nothing was read for this long, 0 disables heartbeats
+    std::chrono::milliseconds heartbeatInterval{5000};
+    //connection is dead after this many silent intervals
+    uint32_t heartbeatMaxMissed{3};
+    std::chrono::milliseconds reconnectInitialDelay{100};
+    std::chrono::milliseconds reconnectMaxDelay{10000};
+};
+
+/*
+ * A provider endpoint. Each io thread keeps its own connection to it;
+ * inFlight counts the requests outstanding over all of them.
+ */
+struct DubboEndpoint
+{
+    explicit DubboEndpoint(folly::SocketAddress addr) : address(std::move(addr)) {}
+
+    folly::SocketAddress address;
+    std::atomic<int64_t> inFlight{0};
+};
+
+/*
+ * Owns the connection to one provider endpoint. Everything runs on the
+ * EventBase of the thread that created it: connect() must be called there,
+ * and so must send().
+ *
+ * Requests from many consumer connections share the connection, so each
+ * is sent under an id of the backend's own; the response gets the caller's
+ * id back before it is handed over.
+ * When the connection goes away (EOF, socket error, or heartbeats going
+ * unanswered) every outstanding callback fails at once, and new requests
+ * fail immediately until a reconnect succeeds, so callers can retry
+ * elsewhere instead of hanging. Reconnects back off exponentially with
+ * jitter and start over after a successful connect.
+ *
+ * With a WarmConnectionPool of the same EventBase, connections are taken
+ * from the pool instead, which must have been made with
+ * makePipelineFactory(); the backend puts its own handler on top.
+ */
+class DubboBackend : public std::enable_shared_from_this<DubboBackend>,
+                     private folly::HHWheelTimer::Callback
+{
+public:
+    //gets the provider's response frame, header included
+    typedef folly::Function<void(folly::Try<std::unique_ptr<folly::IOBuf>>&&)> Callback;
+    typedef wangle::WarmConnectionPool<wangle::DefaultPipeline> Pool;
+
+    DubboBackend(folly::EventBase* evb,
+                 std::shared_ptr<DubboEndpoint> endpoint,
+                 DubboBackendOptions options = DubboBackendOptions(),
+                 Pool* pool = nullptr);
+    ~DubboBackend() override;
+
+    /*
+     * Pipelines of provider connections: framing and heartbeats
+     */
+    static std::shared_ptr<wangle::PipelineFactory<wangle::DefaultPipeline>>
+    makePipelineFactory(const DubboBackendOptions& options);
+
+    /*
+     * Start connecting; the future completes on the first successful connect,
+     * or fails if the backend is stopped before that
+     */
+    folly::Future<folly::Unit> connect();
+
+    /*
+     * Close the connection and fail everything outstanding, for good
+     */
+    void stop();
+
+    /*
+     * Send a request frame whose header carries id. cb is called with the
+     * response, again carrying id,
+     * or with an exception if the connection is down or goes down first.
+     * One-way requests are not tracked; cb is called once written.
+     */
+    void send(int64_t id, std::unique_ptr<folly::IOBuf> frame, bool twoWay, Callback cb);
+
+    bool isConnected() const
+    {
+        return pipeline_ != nullptr;
+    }
+
+    size_t getInFlight() const
+    {
+        return inFlight_.size();
+    }
+
+    const folly::SocketAddress& getAddress() const
+    {
+        return endpoint_->address;
+    }
+
+    const DubboEndpoint& getEndpoint() const
+    {
+        return *endpoint_;
+    }
+
+private:
+    class BackendHandler;
+    class BackendPipelineFactory;
+    typedef std::shared_ptr<wangle::ClientBootstrap<wangle::DefaultPipeline>> ClientPtr;
+
+    // HHWheelTimer::Callback, the reconnect timer
+    void timeoutExpired() noexcept override;
+    void callbackCanceled() noexcept override {}
+
+    void startConnect();
+    folly::Future<ClientPtr> newConnection();
+    void onConnected(ClientPtr client);
+    void onResponse(std::unique_ptr<folly::IOBuf> frame);
+    void onDisconnected(const folly::exception_wrapper& ex);
+    void teardown();
+    void failAll(const folly::exception_wrapper& ex);
+    void scheduleReconnect();
+
+    folly::EventBase* evb_;
+    std::shared_ptr<DubboEndpoint> endpoint_;
+    DubboBackendOptions options_;
+    Pool* pool_;
+    std::shared_ptr<wangle::PipelineFactory<wangle::DefaultPipeline>> pipelineFactory_;
+
+    ClientPtr client_;
+    wangle::DefaultPipeline* pipeline_{nullptr};
+    BackendHandler* handler_{nullptr};
+    struct Request
+    {
+        int64_t id;     //the caller's
+        Callback cb;
+    };
+    //by the id sent to the provider
+    std::unordered_map<int64_t, Request> inFlight_;
+    int64_t nextId_{0};
+
+    uint64_t attempt_{0};
+    bool stopped_{false};
+    std::chrono::milliseconds backoff_{0};
+    bool everConnected_{false};
+    folly::Promise<folly::Unit> connected_;
+};
@@ -0,0 +1,158 @@
+#include "DubboInvocationKey.h"
+
+#include <algorithm>
+#include <vector>
+
+#include <folly/hash/SpookyHashV2.h>
+#include <folly/json.h>
+
+#include <wangle/codec/Hessian2Decoder.h>
+
+#include "utility.h"
+
+using namespace folly;
+using namespace wangle;
+
+namespace {
+
+const uint64_t kSeed1 = 0x64756262;    //"dubb"
+const uint64_t kSeed2 = 0x6f6b6579;    //"okey"
+
+/*
+ * Number of arguments in a JVM method descriptor like "Ljava/lang/String;[II"
+ */
+size_t countParameterTypes(const std::string& types)
+{
+    size_t count = 0;
+    size_t i = 0;
+    while (i < types.size())
+    {
+        while (i < types.size() && types[i] == '[')
+        {
+            i++;
+        }
+        if (i < types.size() && types[i] == 'L')
+        {
+            i = types.find(';', i);
+            if (i == std::string::npos)
+            {
+                throw std::runtime_error("bad parameter types: " + types);
+            }
+        }
+        i++;
+        count++;
+    }
+    return count;
+}
+
+void hashString(hash::SpookyHashV2& hasher, const std::string& str)
+{
+    //length first, so adjacent fields can't run into each other
+    uint64_t size = str.size();
+    hasher.Update(&size, sizeof(size));
+    hasher.Update(str.data(), str.size());
+}
+
+bool makeFastjsonKey(const std::string& body,
+                     const std::function<bool(const std::string&, const std::string&)>& wanted,
+                     hash::SpookyHashV2& hasher,
+                     DubboInvocationKey& key)
+{
+    //one JSON value per line: dubbo version, interface, service version,
+    //method, parameter types, the arguments, attachments
+    std::vector<std::string> lines;
+    StringSplit(body, "\n", 0, lines);
+    if (lines.size() < 5)
+    {
+        return false;
+    }
+    key.interfaceName = parseJson(lines[1]).asString();
+    key.method = parseJson(lines[3]).asString();
+    if (!wanted(key.interfaceName, key.method))
+    {
+        return false;
+    }
+    auto types = parseJson(lines[4]).asString();
+    auto end = 5 + countParameterTypes(types);
+    if (lines.size() < end)
+    {
+        return false;
+    }
+    for (size_t i = 1; i < end; i++)
+    {
+        hashString(hasher, lines[i]);
+    }
+    return true;
+}
+
+bool makeHessian2Key(io::Cursor body,
+                     const std::function<bool(const std::string&, const std::string&)>& wanted,
+                     hash::SpookyHashV2& hasher,
+                     DubboInvocationKey& key)
+{
+    Hessian2Decoder decoder(body);
+    decoder.readString();   //dubbo version
+    key.interfaceName = decoder.readString();
+    auto serviceVersion = decoder.read();
+    key.method = decoder.readString();
+    if (!wanted(key.interfaceName, key.method))
+    {
+        return false;
+    }
+    auto types = decoder.readString();
+
+    hashString(hasher, key.interfaceName);
+    hashString(hasher, serviceVersion.isString() ? serviceVersion.getString() : std::string());
+    hashString(hasher, key.method);
+    hashString(hasher, types);
+
+    //the arguments as they were encoded
+    auto start = decoder.getCursor();
+    for (size_t n = countParameterTypes(types); n > 0; n--)
+    {
+        decoder.read();
+    }
+    size_t length = decoder.getCursor() - start;
+    while (length > 0)
+    {
+        auto bytes = start.peekBytes();
+        auto size = std::min(length, bytes.size());
+        hasher.Update(bytes.data(), size);
+        start.skip(size);
+        length -= size;
+    }
+    return true;
+}
+
+}
+
+bool makeDubboInvocationKey(
+        const DubboHeader& header,
+        const IOBuf& frame,
+        const std::function<bool(const std::string& interfaceName, const std::string& method)>& wanted,
+        DubboInvocationKey& key)
+{
+    hash::SpookyHashV2 hasher;
+    hasher.Init(kSeed1, kSeed2);
+    uint8_t serialization = header.serialization();
+    hasher.Update(&serialization, sizeof(serialization));
+
+    io::Cursor body(&frame);
+    body.skip(kDubboHeaderLength);
+    try
+    {
+        bool ok = serialization == kDubboSerializationHessian2
+                  ? makeHessian2Key(body, wanted, hasher, key)
+                  : makeFastjsonKey(body.readFixedString(header.bodyLength), wanted, hasher, key);
+        if (!ok)
+        {
+            return false;
+        }
+    }
+    catch (const std::exception&)
+    {
+        return false;
+    }
+    hasher.Final(&key.hash1, &key.hash2);
+    return true;
+}
@@ -0,0 +1,90 @@
+//
+// Identifies a Dubbo call by what it asks for, for caching and coalescing.
+//
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+
+#include <folly/io/IOBuf.h>
+
+#include <wangle/codec/DubboProtocol.h>
+
+/*
+ * Interface and method of a request, and a 128 bit hash of everything that
+ * decides its result: serialization, interface, service version, method,
+ * parameter types and the encoded arguments. The dubbo version and the
+ * attachments are left out.
+ */
+struct DubboInvocationKey
+{
+    std::string interfaceName;
+    std::string method;
+    uint64_t hash1{0};
+    uint64_t hash2{0};
+
+    bool operator==(const DubboInvocationKey& other) const
+    {
+        return hash1 == other.hash1 && hash2 == other.hash2;
+    }
+};
+
+struct DubboInvocationKeyHash
+{
+    size_t operator()(const DubboInvocationKey& key) const
+    {
+        return key.hash1;
+    }
+};
+
+/*
+ * Parse the request frame (header included) far enough to fill in
+ * interfaceName and method; if wanted accepts them, hash the rest as well.
+ * Returns false if the body does not parse or wanted said no.
+ */
+bool makeDubboInvocationKey(
+        const wangle::DubboHeader& header,
+        const folly::IOBuf& frame,
+        const std::function<bool(const std::string& interfaceName, const std::string& method)>& wanted,
+        DubboInvocationKey& key);
+
+/*
+ * A value per provider method, looked up by the interface and method names
+ * of a request as they are, without joining them into "interface.method"
+ */
+template <class T>
+class DubboMethodMap
+{
+public:
+    void set(const std::string& interfaceName, const std::string& method, T value)
+    {
+        methods_[interfaceName][method] = std::move(value);
+    }
+
+    //null if the method has no value
+    const T* find(const std::string& interfaceName, const std::string& method) const
+    {
+        auto it = methods_.find(interfaceName);
+        if (it == methods_.end())
+        {
+            return nullptr;
+        }
+        auto m = it->second.find(method);
+        return m == it->second.end() ? nullptr : &m->second;
+    }
+
+    bool contains(const std::string& interfaceName, const std::string& method) const
+    {
+        return find(interfaceName, method) != nullptr;
+    }
+
+    bool empty() const
+    {
+        return methods_.empty();
+    }
+
+private:
+    std::unordered_map<std::string, std::unordered_map<std::string, T>> methods_;
+};
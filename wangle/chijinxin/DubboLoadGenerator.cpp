@@ -0,0 +1,414 @@
+//
+// Load generator for Dubbo providers and ProviderAgent: IHelloService.hash
+// calls in closed loop (fixed concurrency) or open loop (fixed arrival rate).
+//
+// In open loop every latency is measured from the time the request was
+// scheduled to go out, not from when it was written, so a stalled server or
+// a late timer shows up in the percentiles instead of silently lowering the
+// offered load (coordinated omission).
+//
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <thread>
+
+#include <folly/init/Init.h>
+#include <folly/io/async/AsyncTimeout.h>
+
+#include <wangle/bootstrap/ClientBootstrap.h>
+#include <wangle/channel/AsyncSocketHandler.h>
+#include <wangle/codec/DubboRequestEncoder.h>
+#include <wangle/codec/DubboResponseDecoder.h>
+#include <wangle/codec/Hessian2Decoder.h>
+
+#include "utility.h"
+
+using namespace folly;
+using namespace wangle;
+using namespace std;
+
+DEFINE_string(host, "127.0.0.1", "target address, a provider or ProviderAgent");
+DEFINE_int32(port, 20880, "target port");
+DEFINE_int32(threads, 4, "io threads");
+DEFINE_int32(connections, 8, "connections, spread over the io threads");
+DEFINE_string(mode, "closed", "closed: fixed concurrency, open: fixed arrival rate");
+DEFINE_int32(concurrency, 16, "closed loop: requests outstanding per connection");
+DEFINE_double(rate, 1000, "open loop: requests per second over all connections");
+DEFINE_bool(poisson, false, "open loop: exponential instead of fixed inter-arrival times");
+DEFINE_int32(duration_s, 30, "measured seconds");
+DEFINE_int32(warmup_s, 5, "seconds of load before measuring");
+DEFINE_int32(drain_ms, 5000, "wait this long for outstanding responses after the run");
+DEFINE_string(serialization, "fastjson", "fastjson or hessian2");
+DEFINE_string(interface, "com.alibaba.dubbo.performance.demo.provider.IHelloService",
+              "service interface");
+DEFINE_string(method, "hash", "service method");
+DEFINE_int32(argument_length, 16, "length of the random string arguments");
+DEFINE_int32(distinct_arguments, 1024, "number of distinct arguments to cycle through");
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct LoadStats
+{
+    std::vector<uint64_t> latenciesUs;
+    uint64_t errors{0};
+    uint64_t mismatches{0};
+    uint64_t timeouts{0};
+};
+
+struct Workload
+{
+    std::vector<std::string> arguments;
+    std::vector<int32_t> hashes;    //expected result per argument
+    Clock::time_point start;        //first request
+    Clock::time_point measureStart; //end of warmup
+    Clock::time_point end;          //no requests after this
+};
+
+/*
+ * Drives the load on one connection. Everything runs in the connection's
+ * EventBase thread.
+ */
+class LoadDriver : public InboundHandler<DubboResponse>
+{
+    class Pacer : public AsyncTimeout
+    {
+    public:
+        Pacer(LoadDriver* driver, EventBase* evb) : AsyncTimeout(evb), driver_(driver) {}
+
+        void timeoutExpired() noexcept override
+        {
+            driver_->pace();
+        }
+
+    private:
+        LoadDriver* driver_;
+    };
+
+public:
+    LoadDriver(const Workload& workload, size_t index, double rate)
+            : workload_(workload),
+              nextArgument_(index * 7919),
+              rng_(index)
+    {
+        if (rate > 0)
+        {
+            interval_ = std::chrono::duration<double>(1.0 / rate);
+        }
+    }
+
+    void setPipeline(DefaultPipeline* pipeline, EventBase* evb)
+    {
+        pipeline_ = pipeline;
+        evb_ = evb;
+        pacer_ = std::make_unique<Pacer>(this, evb);
+    }
+
+    EventBase* getEventBase() const
+    {
+        return evb_;
+    }
+
+    void start()
+    {
+        if (FLAGS_mode == "open")
+        {
+            nextSend_ = workload_.start;
+            pace();
+        }
+        else
+        {
+            for (int i = 0; i < FLAGS_concurrency; i++)
+            {
+                send(Clock::now());
+            }
+        }
+    }
+
+    /*
+     * Stop sending; whatever is still outstanding is counted as timed out
+     */
+    LoadStats finish()
+    {
+        stopped_ = true;
+        pacer_->cancelTimeout();
+        for (const auto& request : outstanding_)
+        {
+            if (measured(request.second.start))
+            {
+                stats_.timeouts++;
+            }
+        }
+        outstanding_.clear();
+        return std::move(stats_);
+    }
+
+    void read(Context*, DubboResponse response) override
+    {
+        auto it = outstanding_.find(response.id);
+        if (it == outstanding_.end())
+        {
+            return;
+        }
+        auto request = it->second;
+        outstanding_.erase(it);
+        auto now = Clock::now();
+
+        if (measured(request.start))
+        {
+            if (response.exception)
+            {
+                stats_.errors++;
+            }
+            else if (!matches(response, workload_.hashes[request.argument]))
+            {
+                stats_.mismatches++;
+            }
+            else
+            {
+                stats_.latenciesUs.push_back(
+                        std::chrono::duration_cast<std::chrono::microseconds>(
+                                now - request.start).count());
+            }
+        }
+
+        if (FLAGS_mode != "open" && !stopped_ && now < workload_.end)
+        {
+            send(now);
+        }
+    }
+
+    void readEOF(Context*) override
+    {
+        cout << "connection closed by server" << endl;
+        stopped_ = true;
+    }
+
+    void readException(Context*, exception_wrapper e) override
+    {
+        cout << "connection error: " << exceptionStr(e) << endl;
+        stopped_ = true;
+    }
+
+private:
+    struct Request
+    {
+        Clock::time_point start;
+        size_t argument;
+    };
+
+    bool measured(Clock::time_point start) const
+    {
+        return start >= workload_.measureStart && start < workload_.end;
+    }
+
+    static bool matches(const DubboResponse& response, int32_t expected)
+    {
+        if (!response.payload)
+        {
+            return false;
+        }
+        try
+        {
+            if (response.serialization == kDubboSerializationHessian2)
+            {
+                return Hessian2Decoder(response.payload.get()).readInt() == expected;
+            }
+            auto str = response.payload->clone()->moveToFbString();
+            return folly::to<int32_t>(StringPiece(str)) == expected;
+        }
+        catch (const std::exception&)
+        {
+            return false;
+        }
+    }
+
+    /*
+     * Open loop: send everything that is due, then sleep until the next one
+     */
+    void pace()
+    {
+        if (stopped_)
+        {
+            return;
+        }
+        auto now = Clock::now();
+        while (nextSend_ <= now && nextSend_ < workload_.end)
+        {
+            send(nextSend_);
+            if (FLAGS_poisson)
+            {
+                std::exponential_distribution<double> gap(1 / interval_.count());
+                nextSend_ += std::chrono::duration_cast<Clock::duration>(
+                        std::chrono::duration<double>(gap(rng_)));
+            }
+            else
+            {
+                nextSend_ += std::chrono::duration_cast<Clock::duration>(interval_);
+            }
+        }
+        if (nextSend_ < workload_.end)
+        {
+            pacer_->scheduleTimeout(std::chrono::duration_cast<std::chrono::milliseconds>(
+                    nextSend_ - now));
+        }
+    }
+
+    void send(Clock::time_point start)
+    {
+        auto id = nextId_++;
+        auto argument = nextArgument_++ % workload_.arguments.size();
+        DubboInvocation invocation;
+        invocation.interfaceName = FLAGS_interface;
+        invocation.method = FLAGS_method;
+        invocation.parameterTypes = "Ljava/lang/String;";
+        invocation.argument = workload_.arguments[argument];
+        auto buf = FLAGS_serialization == "hessian2"
+                   ? DubboRequestEncoder::encodeHessian2(id, invocation)
+                   : DubboRequestEncoder::encode(id, invocation);
+        outstanding_[id] = Request{start, argument};
+        pipeline_->write(std::move(buf));
+    }
+
+    const Workload& workload_;
+    DefaultPipeline* pipeline_{nullptr};
+    EventBase* evb_{nullptr};
+    std::unique_ptr<Pacer> pacer_;
+    std::unordered_map<int64_t, Request> outstanding_;
+    int64_t nextId_{1};
+    size_t nextArgument_;
+    std::chrono::duration<double> interval_{0};
+    Clock::time_point nextSend_;
+    std::mt19937_64 rng_;
+    bool stopped_{false};
+    LoadStats stats_;
+};
+
+class LoadPipelineFactory : public PipelineFactory<DefaultPipeline>
+{
+public:
+    explicit LoadPipelineFactory(std::shared_ptr<LoadDriver> driver) : driver_(driver) {}
+
+    DefaultPipeline::Ptr newPipeline(std::shared_ptr<AsyncTransportWrapper> sock) override
+    {
+        auto pipeline = DefaultPipeline::create();
+        pipeline->addBack(AsyncSocketHandler(sock));
+        pipeline->addBack(DubboResponseDecoder());
+        pipeline->addBack(driver_);
+        pipeline->finalize();
+        driver_->setPipeline(pipeline.get(), sock->getEventBase());
+        return pipeline;
+    }
+
+private:
+    std::shared_ptr<LoadDriver> driver_;
+};
+
+Workload makeWorkload()
+{
+    Workload workload;
+    std::mt19937_64 rng(42);
+    static const char kChars[] =
+            "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+    std::uniform_int_distribution<size_t> pick(0, sizeof(kChars) - 2);
+    for (int i = 0; i < std::max(1, FLAGS_distinct_arguments); i++)
+    {
+        std::string argument;
+        for (int j = 0; j < FLAGS_argument_length; j++)
+        {
+            argument.push_back(kChars[pick(rng)]);
+        }
+        workload.hashes.push_back(JavaStringHashCode(argument.data(), argument.size()));
+        workload.arguments.push_back(std::move(argument));
+    }
+    return workload;
+}
+
+uint64_t percentile(const std::vector<uint64_t>& sorted, double p)
+{
+    if (sorted.empty())
+    {
+        return 0;
+    }
+    size_t rank = static_cast<size_t>(std::ceil(p * sorted.size()));
+    return sorted[std::min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    folly::Init init(&argc, &argv);
+
+    auto workload = makeWorkload();
+    auto ioPool = std::make_shared<IOThreadPoolExecutor>(FLAGS_threads);
+    std::vector<std::unique_ptr<ClientBootstrap<DefaultPipeline>>> clients;
+    std::vector<std::shared_ptr<LoadDriver>> drivers;
+    for (int i = 0; i < FLAGS_connections; i++)
+    {
+        auto driver = std::make_shared<LoadDriver>(
+                workload, i, FLAGS_mode == "open" ? FLAGS_rate / FLAGS_connections : 0);
+        auto client = std::make_unique<ClientBootstrap<DefaultPipeline>>();
+        client->group(ioPool);
+        client->pipelineFactory(std::make_shared<LoadPipelineFactory>(driver));
+        client->connect(SocketAddress(FLAGS_host, FLAGS_port)).get();
+        clients.push_back(std::move(client));
+        drivers.push_back(std::move(driver));
+    }
+    cout << "connected " << FLAGS_connections << " connections to "
+         << FLAGS_host << ":" << FLAGS_port << ", " << FLAGS_mode << " loop" << endl;
+
+    workload.start = Clock::now() + std::chrono::milliseconds(100);
+    workload.measureStart = workload.start + std::chrono::seconds(FLAGS_warmup_s);
+    workload.end = workload.measureStart + std::chrono::seconds(FLAGS_duration_s);
+    for (auto& driver : drivers)
+    {
+        driver->getEventBase()->runInEventBaseThread([driver] { driver->start(); });
+    }
+
+    std::this_thread::sleep_until(workload.end + std::chrono::milliseconds(FLAGS_drain_ms));
+
+    LoadStats total;
+    for (auto& driver : drivers)
+    {
+        driver->getEventBase()->runInEventBaseThreadAndWait([&] {
+            auto stats = driver->finish();
+            total.latenciesUs.insert(total.latenciesUs.end(),
+                                     stats.latenciesUs.begin(), stats.latenciesUs.end());
+            total.errors += stats.errors;
+            total.mismatches += stats.mismatches;
+            total.timeouts += stats.timeouts;
+        });
+    }
+
+    auto& latencies = total.latenciesUs;
+    std::sort(latencies.begin(), latencies.end());
+    cout << "ok " << latencies.size() << ", errors " << total.errors
+         << ", wrong results " << total.mismatches
+         << ", timeouts " << total.timeouts << endl;
+    cout << "throughput " << std::fixed << std::setprecision(1)
+         << double(latencies.size()) / FLAGS_duration_s << " req/s" << endl;
+    cout << "latency us: p50 " << percentile(latencies, 0.5)
+         << " p90 " << percentile(latencies, 0.9)
+         << " p99 " << percentile(latencies, 0.99)
+         << " p99.9 " << percentile(latencies, 0.999)
+         << " max " << (latencies.empty() ? 0 : latencies.back()) << endl;
+    if (FLAGS_mode != "open")
+    {
+        cout << "(closed loop: latencies exclude time spent waiting to send)" << endl;
+    }
+
+    for (auto& client : clients)
+    {
+        auto pipeline = client->getPipeline();
+        if (pipeline)
+        {
+            pipeline->getTransport()->getEventBase()->runInEventBaseThreadAndWait(
+                    [pipeline] { pipeline->close(); });
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,235 @@
+#include "DubboResponseCache.h"
+
+#include <folly/Conv.h>
+#include <folly/io/Cursor.h>
+
+#include <wangle/codec/DubboProtocol.h>
+
+#include "utility.h"
+
+using namespace folly;
+using namespace wangle;
+using namespace std;
+
+namespace {
+
+//the map node, key copy and bookkeeping around each response
+const size_t kEntryOverhead = 256;
+
+}
+
+DubboResponseCache::DubboResponseCache(size_t maxBytes, size_t numShards,
+                                       std::chrono::milliseconds sweepInterval)
+        : maxShardBytes_(maxBytes / std::max<size_t>(numShards, 1)),
+          sweepInterval_(sweepInterval)
+{
+    for (size_t i = 0; i < std::max<size_t>(numShards, 1); i++)
+    {
+        shards_.push_back(std::make_unique<Shard>());
+    }
+}
+
+void DubboResponseCache::addMethod(const std::string& interfaceName,
+                                   const std::string& method,
+                                   std::chrono::milliseconds ttl)
+{
+    methods_.set(interfaceName, method, ttl);
+}
+
+void DubboResponseCache::addMethods(const std::string& spec)
+{
+    std::vector<std::string> items;
+    StringSplit(spec, ",", 0, items);
+    for (auto& item : items)
+    {
+        if (item.empty())
+        {
+            continue;
+        }
+        auto eq = item.find('=');
+        auto dot = item.rfind('.', eq);
+        if (eq == std::string::npos || dot == std::string::npos)
+        {
+            throw std::invalid_argument("expected interface.method=ttl_ms, got " + item);
+        }
+        addMethod(item.substr(0, dot), item.substr(dot + 1, eq - dot - 1),
+                  std::chrono::milliseconds(to<int64_t>(item.substr(eq + 1))));
+    }
+}
+
+std::unique_ptr<IOBuf> DubboResponseCache::get(const DubboInvocationKey& key, int64_t id) const
+{
+    auto& shard = getShard(key);
+    auto it = shard.entries.find(key);
+    if (it == shard.entries.cend())
+    {
+        return nullptr;
+    }
+    auto entry = it->second;
+    if (Clock::now() >= entry->expires)
+    {
+        return nullptr;
+    }
+    //shares the body; the id goes into a fresh copy of the header
+    auto response = entry->frame->clone();
+    setDubboRequestId(response, id);
+    return response;
+}
+
+void DubboResponseCache::put(const DubboInvocationKey& key, const IOBuf& response)
+{
+    auto ttl = methods_.find(key.interfaceName, key.method);
+    if (!ttl)
+    {
+        return;
+    }
+    if (!isCacheable(response))
+    {
+        return;
+    }
+
+    auto& shard = getShard(key);
+    auto now = Clock::now();
+    auto entry = std::make_shared<Entry>();
+    //a buffer of its own, rather than holding on to the one it was read into
+    auto length = response.computeChainDataLength();
+    entry->frame = IOBuf::create(length);
+    io::Cursor(&response).pull(entry->frame->writableData(), length);
+    entry->frame->append(length);
+    entry->expires = now + *ttl;
+    entry->bytes = length + key.interfaceName.size() + key.method.size() + kEntryOverhead;
+    if (entry->bytes > maxShardBytes_)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> g(shard.writeMutex);
+    entry->seq = shard.nextSeq++;
+    auto old = shard.entries.find(key);
+    if (old != shard.entries.cend())
+    {
+        shard.bytes -= old->second->bytes;
+    }
+    shard.bytes += entry->bytes;
+    shard.order.emplace_back(key, entry->seq);
+    shard.entries.insert_or_assign(key, std::move(entry));
+    reclaimExpired(shard, now);
+    evict(shard);
+}
+
+size_t DubboResponseCache::getBytes() const
+{
+    size_t bytes = 0;
+    for (auto& shard : shards_)
+    {
+        std::lock_guard<std::mutex> g(shard->writeMutex);
+        bytes += shard->bytes;
+    }
+    return bytes;
+}
+
+bool DubboResponseCache::isCacheable(const IOBuf& frame)
+{
+    if (frame.computeChainDataLength() <= kDubboHeaderLength)
+    {
+        return false;
+    }
+    io::Cursor c(&frame);
+    DubboHeader header;
+    if (!readDubboHeader(c, header) || header.isEvent() ||
+        header.status != static_cast<uint8_t>(DubboStatus::OK))
+    {
+        return false;
+    }
+
+    //result type: value or null, with or without attachments
+    int type;
+    uint8_t first = c.read<uint8_t>();
+    if (header.serialization() == kDubboSerializationHessian2)
+    {
+        type = first - 0x90;
+    }
+    else
+    {
+        type = first - '0';
+    }
+    return type == 1 || type == 2 || type == 4 || type == 5;
+}
+
+void DubboResponseCache::evict(Shard& shard)
+{
+    while (shard.bytes > maxShardBytes_ && !shard.order.empty())
+    {
+        auto oldest = std::move(shard.order.front());
+        shard.order.pop_front();
+        auto it = shard.entries.find(oldest.first);
+        //skip keys that were written again since
+        if (it != shard.entries.cend() && it->second->seq == oldest.second)
+        {
+            erase(shard, oldest.first);
+        }
+    }
+
+    //rewritten keys leave stale places in order; drop them now and then
+    if (shard.order.size() > 2 * shard.entries.size() + 64)
+    {
+        std::deque<std::pair<DubboInvocationKey, uint64_t>> live;
+        for (auto& place : shard.order)
+        {
+            auto it = shard.entries.find(place.first);
+            if (it != shard.entries.cend() && it->second->seq == place.second)
+            {
+                live.push_back(std::move(place));
+            }
+        }
+        shard.order = std::move(live);
+    }
+}
+
+void DubboResponseCache::reclaimExpired(Shard& shard, Clock::time_point now)
+{
+    //with one ttl per method, entries mostly expire in insertion order
+    while (!shard.order.empty())
+    {
+        auto& oldest = shard.order.front();
+        auto it = shard.entries.find(oldest.first);
+        if (it != shard.entries.cend() && it->second->seq == oldest.second)
+        {
+            if (now < it->second->expires)
+            {
+                break;
+            }
+            erase(shard, oldest.first);
+        }
+        shard.order.pop_front();
+    }
+
+    //a shorter ttl can expire behind a longer one; catch those now and then
+    if (now < shard.nextSweep)
+    {
+        return;
+    }
+    shard.nextSweep = now + sweepInterval_;
+    std::vector<DubboInvocationKey> expired;
+    for (auto it = shard.entries.cbegin(); it != shard.entries.cend(); ++it)
+    {
+        if (now >= it->second->expires)
+        {
+            expired.push_back(it->first);
+        }
+    }
+    for (auto& key : expired)
+    {
+        erase(shard, key);
+    }
+}
+
+void DubboResponseCache::erase(Shard& shard, const DubboInvocationKey& key)
+{
+    auto it = shard.entries.find(key);
+    if (it != shard.entries.cend())
+    {
+        shard.bytes -= it->second->bytes;
+        shard.entries.erase(key);
+    }
+}
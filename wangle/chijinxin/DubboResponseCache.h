@@ -0,0 +1,110 @@
+//
+// Answers repeated calls of pure provider methods without the provider.
+//
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <folly/concurrency/ConcurrentHashMap.h>
+#include <folly/io/IOBuf.h>
+
+#include "DubboInvocationKey.h"
+
+/*
+ * Responses of opted-in methods, shared by all io threads.
+ *
+ * Only methods added with addMethod() before the agent starts are cached,
+ * each with its own TTL. Only OK responses carrying a value (or null) are
+ * kept; errors and exceptions always go back to the provider.
+ *
+ * Entries are spread over shards by key. Lookups never lock: each shard is
+ * a ConcurrentHashMap, whose readers are protected by hazard pointers.
+ * Writers of a shard take its mutex, which keeps the byte count exact and
+ * the eviction order (oldest insert first) consistent. Together the shards
+ * hold at most maxBytes of responses plus per-entry overhead.
+ *
+ * A response is stored once in a buffer of its own; a hit shares its body
+ * and only copies the header, to carry the caller's id. Expired entries
+ * are reclaimed by writers: those at the front of the insertion order on
+ * every put, and the whole shard every sweepInterval.
+ */
+class DubboResponseCache
+{
+public:
+    explicit DubboResponseCache(size_t maxBytes, size_t numShards = 16,
+                                std::chrono::milliseconds sweepInterval = std::chrono::seconds(1));
+
+    /*
+     * Cache the responses of interfaceName.method for ttl
+     */
+    void addMethod(const std::string& interfaceName, const std::string& method,
+                   std::chrono::milliseconds ttl);
+
+    /*
+     * Add methods given as "interface.method=ttl_ms,..."
+     */
+    void addMethods(const std::string& spec);
+
+    bool isCached(const std::string& interfaceName, const std::string& method) const
+    {
+        return methods_.contains(interfaceName, method);
+    }
+
+    /*
+     * A copy of the cached response to key, carrying request id id, or null
+     */
+    std::unique_ptr<folly::IOBuf> get(const DubboInvocationKey& key, int64_t id) const;
+
+    /*
+     * Keep response (header included) for key, if it is worth keeping
+     */
+    void put(const DubboInvocationKey& key, const folly::IOBuf& response);
+
+    size_t getBytes() const;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Entry
+    {
+        std::unique_ptr<folly::IOBuf> frame;
+        Clock::time_point expires;
+        uint64_t seq;
+        size_t bytes;
+    };
+
+    struct Shard
+    {
+        folly::ConcurrentHashMap<DubboInvocationKey, std::shared_ptr<const Entry>,
+                                 DubboInvocationKeyHash> entries;
+
+        //the rest belongs to writers
+        std::mutex writeMutex;
+        std::deque<std::pair<DubboInvocationKey, uint64_t>> order;
+        size_t bytes{0};
+        uint64_t nextSeq{0};
+        Clock::time_point nextSweep;
+    };
+
+    Shard& getShard(const DubboInvocationKey& key) const
+    {
+        //hash1 also picks the map's own segment; use other bits here
+        return *shards_[key.hash2 % shards_.size()];
+    }
+
+    static bool isCacheable(const folly::IOBuf& frame);
+    void evict(Shard& shard);
+    void reclaimExpired(Shard& shard, Clock::time_point now);
+    static void erase(Shard& shard, const DubboInvocationKey& key);
+
+    size_t maxShardBytes_;
+    std::chrono::milliseconds sweepInterval_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+    //ttl per method, fixed once the agent runs
+    DubboMethodMap<std::chrono::milliseconds> methods_;
+};
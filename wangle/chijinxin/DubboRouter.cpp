@@ -0,0 +1,137 @@
+#include "DubboRouter.h"
+
+#include <folly/io/async/AsyncSocketException.h>
+
+using namespace folly;
+using namespace std;
+
+DubboRouter::DubboRouter(EventBase* evb,
+                         const std::vector<std::shared_ptr<DubboEndpoint>>& endpoints,
+                         DubboBackendOptions options,
+                         DubboBackend::Pool* pool)
+{
+    std::weak_ptr<bool> alive = alive_;
+    for (auto& endpoint : endpoints)
+    {
+        auto backend = std::make_shared<DubboBackend>(evb, endpoint, options, pool);
+        backends_.push_back(backend);
+        backend->connect()
+                .then([this, alive]()
+                      {
+                          if (alive.lock())
+                          {
+                              onConnected();
+                          }
+                      })
+                .onError([this, alive](const std::exception&)
+                         {
+                             if (alive.lock())
+                             {
+                                 onGaveUp();
+                             }
+                         });
+    }
+    if (!connected_ && !backends_.empty())
+    {
+        evb->timer().scheduleTimeout(this, options.connectTimeout);
+    }
+}
+
+DubboRouter::~DubboRouter()
+{
+    alive_.reset();
+    for (auto& backend : backends_)
+    {
+        backend->stop();
+    }
+    failWaiting("dubbo router destroyed");
+}
+
+Future<Unit> DubboRouter::waitConnected()
+{
+    if (connected_)
+    {
+        return makeFuture();
+    }
+    if (timedOut_ || gaveUp_ == backends_.size())
+    {
+        return makeFuture<Unit>(make_exception_wrapper<AsyncSocketException>(
+                AsyncSocketException::NOT_OPEN, "no dubbo provider connected"));
+    }
+    waiting_.emplace_back();
+    return waiting_.back().getFuture();
+}
+
+void DubboRouter::timeoutExpired() noexcept
+{
+    timedOut_ = true;
+    failWaiting("timed out connecting to dubbo providers");
+}
+
+void DubboRouter::onConnected()
+{
+    connected_ = true;
+    cancelTimeout();
+    auto waiting = std::move(waiting_);
+    waiting_.clear();
+    for (auto& promise : waiting)
+    {
+        promise.setValue();
+    }
+}
+
+void DubboRouter::onGaveUp()
+{
+    if (++gaveUp_ == backends_.size() && !connected_)
+    {
+        cancelTimeout();
+        failWaiting("every dubbo provider gave up connecting");
+    }
+}
+
+void DubboRouter::failWaiting(const char* reason)
+{
+    auto waiting = std::move(waiting_);
+    waiting_.clear();
+    for (auto& promise : waiting)
+    {
+        promise.setException(make_exception_wrapper<AsyncSocketException>(
+                AsyncSocketException::NOT_OPEN, reason));
+    }
+}
+
+void DubboRouter::send(int64_t id, std::unique_ptr<IOBuf> frame, bool twoWay, DubboBackend::Callback cb)
+{
+    auto backend = pick();
+    if (!backend)
+    {
+        cb(Try<std::unique_ptr<IOBuf>>(make_exception_wrapper<AsyncSocketException>(
+                AsyncSocketException::NOT_OPEN, "no dubbo provider connected")));
+        return;
+    }
+    backend->send(id, std::move(frame), twoWay, std::move(cb));
+}
+
+DubboBackend* DubboRouter::pick()
+{
+    //start from a rotating index so equal loads take turns
+    DubboBackend* best = nullptr;
+    int64_t bestLoad = 0;
+    auto n = backends_.size();
+    for (size_t i = 0; i < n; i++)
+    {
+        auto& backend = backends_[(next_ + i) % n];
+        if (!backend->isConnected())
+        {
+            continue;
+        }
+        auto load = backend->getEndpoint().inFlight.load(std::memory_order_relaxed);
+        if (!best || load < bestLoad)
+        {
+            best = backend.get();
+            bestLoad = load;
+        }
+    }
+    next_++;
+    return best;
+}
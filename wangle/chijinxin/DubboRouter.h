@@ -0,0 +1,66 @@
+//
+// Spreads the requests of an io thread over the provider endpoints.
+//
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <folly/io/async/HHWheelTimer.h>
+
+#include "DubboBackend.h"
+
+/*
+ * One DubboBackend per endpoint, for the consumer connections of one io
+ * thread. Each request goes to the connected endpoint with the fewest
+ * requests in flight, counted over all io threads, so a busy or slow
+ * provider instance gets less of the load. Ties go round robin.
+ *
+ * Lives on its EventBase like the backends it owns.
+ */
+class DubboRouter : private folly::HHWheelTimer::Callback
+{
+public:
+    DubboRouter(folly::EventBase* evb,
+                const std::vector<std::shared_ptr<DubboEndpoint>>& endpoints,
+                DubboBackendOptions options,
+                DubboBackend::Pool* pool = nullptr);
+    ~DubboRouter() override;
+
+    /*
+     * Completes once any endpoint is connected. Fails if none is within
+     * the connect timeout of creating the router, or once every endpoint
+     * has given up; backends keep reconnecting after that, and a later
+     * wait succeeds as soon as one gets through.
+     */
+    folly::Future<folly::Unit> waitConnected();
+
+    /*
+     * Send to the least loaded connected endpoint; fails at once if none is
+     */
+    void send(int64_t id, std::unique_ptr<folly::IOBuf> frame, bool twoWay, DubboBackend::Callback cb);
+
+    const std::vector<std::shared_ptr<DubboBackend>>& getBackends() const
+    {
+        return backends_;
+    }
+
+private:
+    // HHWheelTimer::Callback, the connect deadline
+    void timeoutExpired() noexcept override;
+    void callbackCanceled() noexcept override {}
+
+    DubboBackend* pick();
+    void onConnected();
+    void onGaveUp();
+    void failWaiting(const char* reason);
+
+    std::vector<std::shared_ptr<DubboBackend>> backends_;
+    size_t next_{0};
+    bool connected_{false};
+    bool timedOut_{false};
+    size_t gaveUp_{0};
+    std::vector<folly::Promise<folly::Unit>> waiting_;
+    //lets backend callbacks detect a destroyed router
+    std::shared_ptr<bool> alive_{std::make_shared<bool>(true)};
+};
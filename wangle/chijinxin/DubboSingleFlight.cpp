@@ -0,0 +1,52 @@
+#include "DubboSingleFlight.h"
+
+#include <wangle/codec/DubboProtocol.h>
+
+using namespace folly;
+using namespace wangle;
+using namespace std;
+
+void DubboSingleFlight::send(const DubboInvocationKey& key, int64_t id,
+                             std::unique_ptr<IOBuf> frame, DubboBackend::Callback cb)
+{
+    auto it = flights_.find(key);
+    if (it != flights_.end())
+    {
+        it->second.push_back(Waiter{id, std::move(cb)});
+        coalesced_++;
+        return;
+    }
+
+    flights_[key].push_back(Waiter{id, std::move(cb)});
+    router_->send(id, std::move(frame), true,
+                  [this, key](Try<std::unique_ptr<IOBuf>>&& response)
+                  {
+                      finish(key, std::move(response));
+                  });
+}
+
+void DubboSingleFlight::finish(const DubboInvocationKey& key, Try<std::unique_ptr<IOBuf>>&& response)
+{
+    //callbacks may send the same call again, which starts a new flight
+    auto it = flights_.find(key);
+    if (it == flights_.end())
+    {
+        return;
+    }
+    auto waiters = std::move(it->second);
+    flights_.erase(it);
+
+    //followers get clones with their own id, the sender the original
+    for (size_t i = 1; i < waiters.size(); i++)
+    {
+        if (response.hasException())
+        {
+            waiters[i].cb(Try<std::unique_ptr<IOBuf>>(response.exception()));
+            continue;
+        }
+        auto copy = response.value()->clone();
+        setDubboRequestId(copy, waiters[i].id);
+        waiters[i].cb(Try<std::unique_ptr<IOBuf>>(std::move(copy)));
+    }
+    waiters[0].cb(std::move(response));
+}
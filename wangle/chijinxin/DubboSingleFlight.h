@@ -0,0 +1,59 @@
+//
+// Lets identical calls in flight at the same time share one provider call.
+//
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include "DubboInvocationKey.h"
+#include "DubboRouter.h"
+
+/*
+ * Single-flight in front of a DubboRouter, for the consumer connections of
+ * one io thread. The first request for a key is sent on; requests for the
+ * same key that arrive while it is outstanding wait for its response
+ * instead. That response is then handed to every waiter, each with its own
+ * request id written into the header. Failures fan out the same way.
+ *
+ * Only meant for idempotent methods: waiters get a response to a call that
+ * was made on someone else's behalf. Lives on its EventBase, so the table
+ * needs no locking; identical calls on different io threads are not
+ * merged.
+ */
+class DubboSingleFlight
+{
+public:
+    explicit DubboSingleFlight(DubboRouter* router) : router_(router) {}
+
+    /*
+     * Send the two-way request frame carrying id, or wait for the identical
+     * one already in flight
+     */
+    void send(const DubboInvocationKey& key, int64_t id,
+              std::unique_ptr<folly::IOBuf> frame, DubboBackend::Callback cb);
+
+    bool isInFlight(const DubboInvocationKey& key) const
+    {
+        return flights_.count(key) != 0;
+    }
+
+    uint64_t getCoalesced() const
+    {
+        return coalesced_;
+    }
+
+private:
+    struct Waiter
+    {
+        int64_t id;
+        DubboBackend::Callback cb;
+    };
+
+    void finish(const DubboInvocationKey& key, folly::Try<std::unique_ptr<folly::IOBuf>>&& response);
+
+    DubboRouter* router_;
+    //the first waiter is the request that was sent
+    std::unordered_map<DubboInvocationKey, std::vector<Waiter>, DubboInvocationKeyHash> flights_;
+    uint64_t coalesced_{0};
+};
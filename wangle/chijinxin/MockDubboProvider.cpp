@@ -0,0 +1,307 @@
+//
+// Stand-in for a Java Dubbo provider of IHelloService, for benchmarking
+// ProviderAgent without a JVM.
+//
+#include <cmath>
+#include <deque>
+#include <iostream>
+#include <random>
+
+#include <folly/init/Init.h>
+#include <folly/io/IOBufQueue.h>
+#include <folly/json.h>
+
+#include <wangle/bootstrap/ServerBootstrap.h>
+#include <wangle/channel/AsyncSocketHandler.h>
+#include <wangle/codec/DubboProtocol.h>
+#include <wangle/codec/Hessian2Decoder.h>
+#include <wangle/codec/Hessian2Encoder.h>
+#include <wangle/codec/LengthFieldBasedFrameDecoder.h>
+
+#include "utility.h"
+
+using namespace folly;
+using namespace wangle;
+using namespace std;
+
+DEFINE_int32(port, 20880, "dubbo provider port");
+DEFINE_int32(threads, 2, "io threads");
+DEFINE_string(service_time, "constant",
+              "service time distribution: constant, uniform, exponential or lognormal");
+DEFINE_double(service_time_ms, 50, "mean service time");
+DEFINE_double(service_time_stddev_ms, 10, "service time stddev (lognormal)");
+DEFINE_double(slow_fraction, 0, "fraction of requests that take slow_ms instead");
+DEFINE_double(slow_ms, 1000, "service time of slow requests");
+DEFINE_int32(max_concurrency, 200,
+             "requests in service at once, like the provider threadpool; split evenly over io threads");
+
+namespace {
+
+/*
+ * Service time of one request in milliseconds
+ */
+double sampleServiceTime()
+{
+    static thread_local std::mt19937_64 rng(std::random_device{}());
+    if (FLAGS_slow_fraction > 0 &&
+        std::uniform_real_distribution<double>(0, 1)(rng) < FLAGS_slow_fraction)
+    {
+        return FLAGS_slow_ms;
+    }
+
+    double mean = FLAGS_service_time_ms;
+    if (FLAGS_service_time == "uniform")
+    {
+        return std::uniform_real_distribution<double>(0, 2 * mean)(rng);
+    }
+    else if (FLAGS_service_time == "exponential")
+    {
+        return std::exponential_distribution<double>(1 / mean)(rng);
+    }
+    else if (FLAGS_service_time == "lognormal")
+    {
+        double stddev = FLAGS_service_time_stddev_ms;
+        double sigma2 = std::log(1 + stddev * stddev / (mean * mean));
+        return std::lognormal_distribution<double>(
+                std::log(mean) - sigma2 / 2, std::sqrt(sigma2))(rng);
+    }
+    return mean;
+}
+
+/*
+ * Requests in service on this io thread, and those waiting for a slot
+ */
+struct ServiceSlots
+{
+    int inService{0};
+    std::deque<std::function<void()>> waiting;
+};
+
+ServiceSlots& getServiceSlots()
+{
+    static thread_local ServiceSlots slots;
+    return slots;
+}
+
+int slotsPerThread()
+{
+    return std::max(1, FLAGS_max_concurrency / std::max(1, FLAGS_threads));
+}
+
+/*
+ * Encode a response frame; the body is written by writeBody
+ */
+std::unique_ptr<IOBuf> makeResponse(const DubboHeader& request,
+                                    DubboStatus status,
+                                    const std::function<void(IOBufQueue&)>& writeBody)
+{
+    IOBufQueue queue(IOBufQueue::cacheChainLength());
+    auto head = IOBuf::create(256);
+    head->append(kDubboHeaderLength);
+    queue.append(std::move(head));
+    writeBody(queue);
+
+    DubboHeader header;
+    header.flags = request.serialization();
+    header.status = static_cast<uint8_t>(status);
+    header.id = request.id;
+    header.bodyLength = queue.chainLength() - kDubboHeaderLength;
+    auto buf = queue.move();
+    io::RWPrivateCursor c(buf.get());
+    writeDubboHeader(c, header);
+    return buf;
+}
+
+std::unique_ptr<IOBuf> makeValueResponse(const DubboHeader& request, int32_t value)
+{
+    return makeResponse(request, DubboStatus::OK, [&](IOBufQueue& queue) {
+        if (request.serialization() == kDubboSerializationHessian2)
+        {
+            Hessian2Encoder encoder(&queue);
+            encoder.writeInt(1);    //RESPONSE_VALUE
+            encoder.writeInt(value);
+        }
+        else
+        {
+            queue.append(folly::to<std::string>("1\n", value, "\n"));
+        }
+    });
+}
+
+/*
+ * Method and string argument of a request body
+ */
+void parseInvocation(const DubboHeader& header,
+                     std::unique_ptr<IOBuf> body,
+                     std::string& method,
+                     std::string& argument)
+{
+    if (!body)
+    {
+        throw std::runtime_error("empty invocation");
+    }
+    if (header.serialization() == kDubboSerializationHessian2)
+    {
+        Hessian2Decoder decoder(body.get());
+        decoder.readString();   //dubbo version
+        decoder.readString();   //interface
+        decoder.read();         //service version
+        method = decoder.readString();
+        decoder.readString();   //parameter types
+        argument = decoder.readString();
+        return;
+    }
+
+    //fastjson: one JSON value per line
+    std::vector<std::string> lines;
+    StringSplit(body->moveToFbString().toStdString(), "\n", 0, lines);
+    if (lines.size() < 6)
+    {
+        throw std::runtime_error("truncated fastjson invocation");
+    }
+    method = folly::parseJson(lines[3]).asString();
+    argument = folly::parseJson(lines[5]).asString();
+}
+
+/*
+ * Implements IHelloService.hash(String): the hashCode of the argument, after
+ * the configured service time
+ */
+class MockProviderHandler : public HandlerAdapter<std::unique_ptr<IOBuf>>
+{
+public:
+    MockProviderHandler() = default;
+    //a copy would share alive_ and clear it when destroyed
+    MockProviderHandler(const MockProviderHandler&) = delete;
+    MockProviderHandler& operator=(const MockProviderHandler&) = delete;
+
+    ~MockProviderHandler() override
+    {
+        *alive_ = false;
+    }
+
+    void read(Context* ctx, std::unique_ptr<IOBuf> frame) override
+    {
+        IOBufQueue queue(IOBufQueue::cacheChainLength());
+        queue.append(std::move(frame));
+        io::Cursor c(queue.front());
+        DubboHeader header;
+        if (!readDubboHeader(c, header))
+        {
+            cout << "bad magic, closing connection" << endl;
+            close(ctx);
+            return;
+        }
+        queue.trimStart(kDubboHeaderLength);
+
+        if (header.isEvent())
+        {
+            if (header.isRequest() && header.isTwoWay())
+            {
+                write(ctx, makeDubboHeartbeat(header.id, false, header.serialization()));
+            }
+            return;
+        }
+        if (!header.isRequest())
+        {
+            return;
+        }
+
+        std::string method;
+        std::string argument;
+        try
+        {
+            parseInvocation(header, queue.move(), method, argument);
+        }
+        catch (const std::exception& e)
+        {
+            write(ctx, makeDubboErrorResponse(header.id, header.serialization(),
+                                             DubboStatus::BAD_REQUEST, e.what()));
+            return;
+        }
+        if (method != "hash")
+        {
+            write(ctx, makeDubboErrorResponse(header.id, header.serialization(),
+                                              DubboStatus::SERVICE_NOT_FOUND,
+                                              "no method " + method));
+            return;
+        }
+
+        auto evb = ctx->getTransport()->getEventBase();
+        auto alive = std::weak_ptr<bool>(alive_);
+        std::shared_ptr<IOBuf> response = makeValueResponse(
+                header, JavaStringHashCode(argument.data(), argument.size()));
+        auto& slots = getServiceSlots();
+        std::function<void()> serve = [this, ctx, evb, alive, response]() {
+            getServiceSlots().inService++;
+            auto delay = std::lround(sampleServiceTime());
+            auto finish = [this, ctx, alive, response]() {
+                auto& slots = getServiceSlots();
+                slots.inService--;
+                if (!slots.waiting.empty())
+                {
+                    auto next = std::move(slots.waiting.front());
+                    slots.waiting.pop_front();
+                    next();
+                }
+                auto isAlive = alive.lock();
+                if (isAlive && *isAlive)
+                {
+                    write(ctx, response->clone());
+                }
+            };
+            if (delay > 0)
+            {
+                evb->runAfterDelay(finish, delay);
+            }
+            else
+            {
+                evb->runInLoop(finish);
+            }
+        };
+
+        if (slots.inService < slotsPerThread())
+        {
+            serve();
+        }
+        else
+        {
+            slots.waiting.push_back(std::move(serve));
+        }
+    }
+
+private:
+    std::shared_ptr<bool> alive_{std::make_shared<bool>(true)};
+};
+
+class MockProviderPipelineFactory : public PipelineFactory<DefaultPipeline>
+{
+public:
+    DefaultPipeline::Ptr newPipeline(std::shared_ptr<AsyncTransportWrapper> sock) override
+    {
+        auto pipeline = DefaultPipeline::create();
+        pipeline->addBack(AsyncSocketHandler(sock));
+        pipeline->addBack(LengthFieldBasedFrameDecoder(
+                4, kDubboHeaderLength + kDubboDefaultMaxBodyLength,
+                kDubboLengthFieldOffset, 0, 0));
+        pipeline->addBack(std::make_shared<MockProviderHandler>());
+        pipeline->finalize();
+        return pipeline;
+    }
+};
+
+}
+
+int main(int argc, char** argv)
+{
+    folly::Init init(&argc, &argv);
+    cout << "MockDubboProvider listening on " << FLAGS_port
+         << ", service time " << FLAGS_service_time << " " << FLAGS_service_time_ms << "ms" << endl;
+
+    ServerBootstrap<DefaultPipeline> server;
+    server.childPipeline(std::make_shared<MockProviderPipelineFactory>());
+    server.group(nullptr, std::make_shared<IOThreadPoolExecutor>(FLAGS_threads));
+    server.bind(FLAGS_port);
+    server.waitForStop();
+    return 0;
+}
@@ -1,9 +1,14 @@
 #include <folly/init/Init.h>
 
-#include <wangle/bootstrap/ClientBootstrap.h>
 #include <wangle/bootstrap/ServerBootstrap.h>
 #include <wangle/channel/AsyncSocketHandler.h>
-#include <wangle/channel/EventBaseHandler.h>
+#include <wangle/codec/DubboProtocol.h>
+#include <wangle/codec/LengthFieldBasedFrameDecoder.h>
+
+#include "DubboResponseCache.h"
+#include "DubboRouter.h"
+#include "DubboSingleFlight.h"
+#include "utility.h"
 
 
 using namespace folly;
@@ -13,122 +18,245 @@ using namespace std;
 DEFINE_int32(ProviderAgentPort, 30000, "provider agent server port");
 DEFINE_string(DubboHost, "127.0.0.1", "dubbo remote host");
 DEFINE_int32(DubboPort, 20880, "dubbo remote port");
+DEFINE_string(DubboEndpoints, "", "comma separated host:port of dubbo providers, overrides DubboHost/DubboPort");
 DEFINE_int32(threadpool, 2, "io threadpool size");
 DEFINE_string(logs, "/root/logs", "logs dir");
-
+DEFINE_int32(heartbeat_ms, 5000, "heartbeat idle dubbo connections after this long, 0 disables");
+DEFINE_int32(heartbeat_missed, 3, "heartbeat intervals without a read before reconnecting");
+DEFINE_int32(reconnect_max_ms, 10000, "upper bound of the reconnect backoff");
+DEFINE_int32(warm_connections, 0, "dubbo connections kept established ahead of time per io thread");
+DEFINE_string(cache_methods, "", "cache responses of pure methods, as interface.method=ttl_ms,...");
+DEFINE_int32(cache_mb, 64, "response cache size");
+DEFINE_string(coalesce_methods, "",
+              "idempotent methods whose identical concurrent calls share one provider call, "
+              "as interface.method,...; cached methods are always coalesced");
 
 /*
- * TCP client
- * 与远程服务器连接的TC客户端pipeline
+ * 所有io线程共用的配置：dubbo provider列表与连接参数
  */
-class ProxyBackendHandler : public InboundBytesToBytesHandler
+struct AgentConfig
 {
-public:
-    explicit ProxyBackendHandler(DefaultPipeline* frontendPipeline) : frontendPipeline_(frontendPipeline) {}
+    std::vector<std::shared_ptr<DubboEndpoint>> endpoints;
+    DubboBackendOptions options;
+    std::shared_ptr<DubboResponseCache> cache;   //--cache_methods为空时没有
+    DubboMethodMap<bool> coalesceMethods;
 
-    void read(Context*, IOBufQueue& q) override
+    //没有缓存也没有合并的方法时，不必解析请求体
+    bool mayCoalesce() const
     {
-        frontendPipeline_->write(q.move());
+        return cache || !coalesceMethods.empty();
     }
 
-private:
-    DefaultPipeline* frontendPipeline_;
+    bool isCoalesced(const std::string& interfaceName, const std::string& method) const
+    {
+        return (cache && cache->isCached(interfaceName, method)) ||
+               coalesceMethods.contains(interfaceName, method);
+    }
 };
 
 /*
- * TCP client
- * 与远程服务器连接的TC客户端pipelineFactory
+ * 每个io线程的预连接池，--warm_connections为0时不使用
+ * 与线程一样长寿，故意不释放：线程退出时EventBase可能已先析构
  */
-class ProxyBackendPipelineFactory : public PipelineFactory<DefaultPipeline> {
-public:
-    explicit ProxyBackendPipelineFactory(DefaultPipeline* frontendPipeline) : frontendPipeline_(frontendPipeline) {}
+DubboBackend::Pool* getWarmPool(EventBase* evb, const AgentConfig& config)
+{
+    static thread_local DubboBackend::Pool* pool = nullptr;
+    if (!pool && FLAGS_warm_connections > 0)
+    {
+        pool = new DubboBackend::Pool(evb, DubboBackend::makePipelineFactory(config.options),
+                                      FLAGS_warm_connections, config.options.connectTimeout);
+        for (auto& endpoint : config.endpoints)
+        {
+            pool->prewarm(endpoint->address);
+        }
+    }
+    return pool;
+}
 
-    DefaultPipeline::Ptr newPipeline(std::shared_ptr<AsyncTransportWrapper> socket) override
+/*
+ * 每个io线程一个DubboRouter，该线程上所有consumer连接共用到各provider的连接
+ * 同样不释放
+ */
+DubboRouter* getRouter(EventBase* evb, const AgentConfig& config)
+{
+    static thread_local DubboRouter* router = nullptr;
+    if (!router)
     {
-        auto pipeline = DefaultPipeline::create();
-        pipeline->addBack(AsyncSocketHandler(socket));
-        pipeline->addBack(EventBaseHandler()); //ensure we can write from any thread
-        pipeline->addBack(ProxyBackendHandler(frontendPipeline_));
-        pipeline->finalize();
+        router = new DubboRouter(evb, config.endpoints, config.options, getWarmPool(evb, config));
+    }
+    return router;
+}
 
-        return pipeline;
+/*
+ * 每个io线程一个DubboSingleFlight，合并该线程上相同的并发请求
+ */
+DubboSingleFlight* getSingleFlight(EventBase* evb, const AgentConfig& config)
+{
+    static thread_local DubboSingleFlight* singleFlight = nullptr;
+    if (!singleFlight)
+    {
+        singleFlight = new DubboSingleFlight(getRouter(evb, config));
     }
-private:
-    DefaultPipeline* frontendPipeline_;
-};
+    return singleFlight;
+}
 
 /*
  * TCP Server
  * TCP Server的每条连接的pipeline
+ * 按dubbo帧把请求交给DubboRouter转发，响应原样写回；provider不可用时立即返回错误响应
  */
-class ProxyFrontendHandler : public BytesToBytesHandler {
+class ProxyFrontendHandler : public HandlerAdapter<std::unique_ptr<IOBuf>> {
 public:
     //构造函数
-    explicit ProxyFrontendHandler(SocketAddress remoteAddress, std::shared_ptr<IOThreadPoolExecutor> ioExecutor)
-            : remoteAddress_(remoteAddress), ioExecutor_(ioExecutor)
+    explicit ProxyFrontendHandler(std::shared_ptr<const AgentConfig> config)
+            : config_(std::move(config))
     {}
-    //写数据到 backendPipeline_ (provider-agent-client -> dubbo-server)中去
-    void read(Context*, IOBufQueue& q) override
+
+    ~ProxyFrontendHandler() override
     {
-        backendPipeline_->write(q.move());
+        *alive_ = false;
+    }
+
+    //写请求到 router_ (provider-agent-client -> dubbo-server)中去
+    void read(Context* ctx, std::unique_ptr<IOBuf> frame) override
+    {
+        io::Cursor c(frame.get());
+        DubboHeader header;
+        if (!readDubboHeader(c, header))
+        {
+            cout << "bad magic from consumer-agent, closing connection" << endl;
+            close(ctx);
+            return;
+        }
+        if (header.isEvent())
+        {
+            if (header.isRequest() && header.isTwoWay())
+            {
+                write(ctx, makeDubboHeartbeat(header.id, false, header.serialization()));
+            }
+            return;
+        }
+        if (!header.isRequest())
+        {
+            return;
+        }
+
+        //幂等方法：相同的并发请求合并为一次调用；纯函数方法：命中缓存直接用consumer的request id应答
+        DubboInvocationKey key;
+        auto config = config_.get();
+        bool coalesce = header.isTwoWay() && config->mayCoalesce() &&
+                        makeDubboInvocationKey(header, *frame,
+                                               [config](const std::string& interfaceName, const std::string& method)
+                                               {
+                                                   return config->isCoalesced(interfaceName, method);
+                                               },
+                                               key);
+        DubboResponseCache* cache = nullptr;
+        if (coalesce && config->cache && config->cache->isCached(key.interfaceName, key.method))
+        {
+            if (auto hit = config->cache->get(key, header.id))
+            {
+                write(ctx, std::move(hit));
+                return;
+            }
+            //waiters on a call in flight leave caching to its sender
+            if (!singleFlight_->isInFlight(key))
+            {
+                cache = config->cache.get();
+            }
+        }
+
+        auto alive = std::weak_ptr<bool>(alive_);
+        auto id = header.id;
+        auto callback = [this, ctx, alive, header, cache, key](Try<std::unique_ptr<IOBuf>>&& response)
+                      {
+                          if (cache && response.hasValue())
+                          {
+                              cache->put(key, *response.value());
+                          }
+                          auto isAlive = alive.lock();
+                          if (!isAlive || !*isAlive || !header.isTwoWay())
+                          {
+                              return;
+                          }
+                          if (response.hasException())
+                          {
+                              //fail fast, the consumer may retry elsewhere
+                              write(ctx, makeDubboErrorResponse(
+                                      header.id, header.serialization(), DubboStatus::SERVER_ERROR,
+                                      response.exception().what().toStdString()));
+                              return;
+                          }
+                          write(ctx, std::move(response.value()));
+                      };
+        if (coalesce)
+        {
+            singleFlight_->send(key, id, std::move(frame), std::move(callback));
+        }
+        else
+        {
+            router_->send(id, std::move(frame), header.isTwoWay(), std::move(callback));
+        }
     }
 
     //连接关闭
     void readEOF(Context* ctx) override
     {
         cout<<"consumer-agent want to close connnection!!!"<<endl;
-        backendPipeline_->close()
-                .then([this, ctx]()
-                      {
-                          this->close(ctx);
-                      });
+        close(ctx);
+    }
+
+    void readException(Context* ctx, exception_wrapper e) override
+    {
+        cout << "consumer-agent connection error: " << exceptionStr(e) << endl;
+        close(ctx);
     }
 
     //控制pipeline的数据传输（暂停：transportInactive； 运行：transportActive）
     void transportActive(Context* ctx) override   //恢复连接
     {
-        if (backendPipeline_)
+        if (router_)
         {
             // Already connected
             return;
         }
 
+        //router与frontend在同一个EventBase上，之后全部单线程处理
+        auto evb = ctx->getTransport()->getEventBase();
+        router_ = getRouter(evb, *config_);
+        singleFlight_ = getSingleFlight(evb, *config_);
+        auto connected = router_->waitConnected();
+        if (connected.isReady())
+        {
+            return;
+        }
+
         // Pause reading from the socket until remote connection succeeds
         auto frontendPipeline = dynamic_cast<DefaultPipeline*>(ctx->getPipeline());  //从ctx上下文获取当前的pipeline
-
         frontendPipeline->transportInactive();  //暂停pipeline数据传输和处理
-
-        client_.pipelineFactory(std::make_shared<ProxyBackendPipelineFactory>(frontendPipeline));  //创建client pipelineFactory
-        client_.group(ioExecutor_);
-        try
-        {
-            client_.connect(remoteAddress_).via(ioExecutor_.get())
-                    .then(
-                            [this, frontendPipeline](DefaultPipeline* pipeline)
+        auto alive = std::weak_ptr<bool>(alive_);
+        connected
+                .onError([](const std::exception& e)
+                         {
+                             //没有可用的provider：照常读取，请求会立即得到错误响应
+                             cout << "dubbo provider not connected: " << exceptionStr(e) << endl;
+                         })
+                .ensure([alive, frontendPipeline]()
+                        {
+                            auto isAlive = alive.lock();
+                            if (isAlive && *isAlive)
                             {
-                                cout<<"connect to dubbo success!!!"<<endl;
-                                backendPipeline_ = pipeline;
                                 // Resume read
                                 frontendPipeline->transportActive();  //TCP client连接成功，恢复pipeline的数据传输和处理
-                            })
-                    .onError(
-                            [this, ctx](const std::exception& e)
-                            {
-                                cout << "Connect to dubbo error: " << exceptionStr(e);
-                            });
-        }
-        catch (const std::exception& e)
-        {
-            cout << "Connect to dubbo error: " << exceptionStr(e);
-        }
-
+                            }
+                        });
     }
 
 private:
-    SocketAddress remoteAddress_;  //远程服务器地址
-    ClientBootstrap<DefaultPipeline> client_;  //连接远程服务器的客户端
-    DefaultPipeline* backendPipeline_;   //客户端与远程服务器之间建立的TCP连接的pipeline
-    std::shared_ptr<IOThreadPoolExecutor> ioExecutor_;
+    std::shared_ptr<const AgentConfig> config_;
+    DubboRouter* router_{nullptr};   //本io线程到各dubbo provider的连接
+    DubboSingleFlight* singleFlight_{nullptr};
+    std::shared_ptr<bool> alive_{std::make_shared<bool>(true)};
 };
 
 /*
@@ -138,25 +266,51 @@ private:
 class ProxyFrontendPipelineFactory : public PipelineFactory<DefaultPipeline> {
 public:
     //ProxyFrontendPipelineFactory构造函数
-    explicit ProxyFrontendPipelineFactory(SocketAddress remoteAddress, std::shared_ptr<IOThreadPoolExecutor> ioExecutor)
-            : remoteAddress_(remoteAddress),ioExecutor_(ioExecutor)
+    explicit ProxyFrontendPipelineFactory(std::shared_ptr<const AgentConfig> config)
+            : config_(std::move(config))
     {}
 
     DefaultPipeline::Ptr newPipeline(std::shared_ptr<AsyncTransportWrapper> sock) override
     {
         auto pipeline = DefaultPipeline::create();
         pipeline->addBack(AsyncSocketHandler(sock));
-        pipeline->addBack(EventBaseHandler()); //ensure we can write from any thread
-        pipeline->addBack(std::make_shared<ProxyFrontendHandler>(remoteAddress_, ioExecutor_));
+        pipeline->addBack(LengthFieldBasedFrameDecoder(
+                4, kDubboHeaderLength + kDubboDefaultMaxBodyLength,
+                kDubboLengthFieldOffset, 0, 0));
+        pipeline->addBack(std::make_shared<ProxyFrontendHandler>(config_));
         pipeline->finalize();
 
         return pipeline;
     }
 private:
-    SocketAddress remoteAddress_;
-    std::shared_ptr<IOThreadPoolExecutor> ioExecutor_;
+    std::shared_ptr<const AgentConfig> config_;
 };
 
+/*
+ * --DubboEndpoints为空时使用--DubboHost:--DubboPort
+ */
+std::vector<std::shared_ptr<DubboEndpoint>> parseEndpoints()
+{
+    std::vector<std::shared_ptr<DubboEndpoint>> endpoints;
+    std::vector<std::string> hostPorts;
+    StringSplit(FLAGS_DubboEndpoints, ",", 0, hostPorts);
+    for (auto& hostPort : hostPorts)
+    {
+        if (hostPort.empty())
+        {
+            continue;
+        }
+        SocketAddress address;
+        address.setFromHostPort(hostPort);
+        endpoints.push_back(std::make_shared<DubboEndpoint>(address));
+    }
+    if (endpoints.empty())
+    {
+        endpoints.push_back(std::make_shared<DubboEndpoint>(SocketAddress(FLAGS_DubboHost, FLAGS_DubboPort)));
+    }
+    return endpoints;
+}
+
 
 
 int main(int argc, char** argv)
@@ -166,11 +320,51 @@ int main(int argc, char** argv)
 
     std::shared_ptr<IOThreadPoolExecutor> IOWorkThreadPool = std::make_shared<IOThreadPoolExecutor>(2);
 
+    auto config = std::make_shared<AgentConfig>();
+    config->endpoints = parseEndpoints();
+    config->options.heartbeatInterval = std::chrono::milliseconds(FLAGS_heartbeat_ms);
+    config->options.heartbeatMaxMissed = FLAGS_heartbeat_missed;
+    config->options.reconnectMaxDelay = std::chrono::milliseconds(FLAGS_reconnect_max_ms);
+    if (!FLAGS_cache_methods.empty())
+    {
+        config->cache = std::make_shared<DubboResponseCache>(size_t(FLAGS_cache_mb) << 20);
+        config->cache->addMethods(FLAGS_cache_methods);
+        cout << "caching responses of " << FLAGS_cache_methods << endl;
+    }
+    std::vector<std::string> coalesceMethods;
+    StringSplit(FLAGS_coalesce_methods, ",", 0, coalesceMethods);
+    for (auto& method : coalesceMethods)
+    {
+        auto dot = method.rfind('.');
+        if (dot == std::string::npos)
+        {
+            if (!method.empty())
+            {
+                cout << "ignoring coalesce method " << method << ", expected interface.method" << endl;
+            }
+            continue;
+        }
+        config->coalesceMethods.set(method.substr(0, dot), method.substr(dot + 1), true);
+    }
+    for (auto& endpoint : config->endpoints)
+    {
+        cout << "dubbo provider " << endpoint->address.describe() << endl;
+    }
+
     ServerBootstrap<DefaultPipeline> providerAsyncTcpServer;  //创建ServerBootstrap
-    providerAsyncTcpServer.childPipeline(
-            std::make_shared<ProxyFrontendPipelineFactory>(SocketAddress(FLAGS_DubboHost, FLAGS_DubboPort), IOWorkThreadPool));
+    providerAsyncTcpServer.childPipeline(std::make_shared<ProxyFrontendPipelineFactory>(config));
     providerAsyncTcpServer.group(nullptr,IOWorkThreadPool);
     providerAsyncTcpServer.bind(FLAGS_ProviderAgentPort);
+
+    //提前连接：getEventBase()轮流返回每个io线程的EventBase
+    for (size_t i = 0; i < IOWorkThreadPool->numThreads(); i++)
+    {
+        auto evb = IOWorkThreadPool->getEventBase();
+        evb->runInEventBaseThread([evb, config]()
+                                  {
+                                      getRouter(evb, *config);
+                                  });
+    }
     providerAsyncTcpServer.waitForStop();
     return 0;
 }
@@ -0,0 +1,202 @@
+#include <chrono>
+#include <thread>
+
+#include <folly/Conv.h>
+#include <gtest/gtest.h>
+
+#include <wangle/codec/DubboRequestEncoder.h>
+
+#include "../DubboResponseCache.h"
+#include "DubboTestUtils.h"
+
+using namespace dubbotest;
+using namespace folly;
+using namespace std;
+using namespace wangle;
+
+namespace
+{
+
+const std::string kInterface = "com.alibaba.dubbo.performance.demo.provider.IHelloService";
+
+DubboInvocation invocation(StringPiece method, StringPiece argument)
+{
+    DubboInvocation inv;
+    inv.interfaceName = kInterface;
+    inv.method = method;
+    inv.parameterTypes = "Ljava/lang/String;";
+    inv.argument = argument;
+    return inv;
+}
+
+DubboInvocationKey keyOf(const IOBuf& request)
+{
+    DubboInvocationKey key;
+    EXPECT_TRUE(makeDubboInvocationKey(
+            headerOf(request), request,
+            [](const std::string&, const std::string&) { return true; }, key));
+    return key;
+}
+
+DubboInvocationKey keyOf(StringPiece method, StringPiece argument)
+{
+    return keyOf(*DubboRequestEncoder::encode(1, invocation(method, argument)));
+}
+
+}
+
+TEST(DubboInvocationKey, SameCallSameKey)
+{
+    //ids are not part of the call
+    auto a = keyOf(*DubboRequestEncoder::encode(1, invocation("hash", "abc")));
+    auto b = keyOf(*DubboRequestEncoder::encode(2, invocation("hash", "abc")));
+    EXPECT_EQ(a, b);
+    EXPECT_EQ(kInterface, a.interfaceName);
+    EXPECT_EQ("hash", a.method);
+
+    auto h1 = keyOf(*DubboRequestEncoder::encodeHessian2(1, invocation("hash", "abc")));
+    auto h2 = keyOf(*DubboRequestEncoder::encodeHessian2(2, invocation("hash", "abc")));
+    EXPECT_EQ(h1, h2);
+    EXPECT_EQ(kInterface, h1.interfaceName);
+    EXPECT_EQ("hash", h1.method);
+}
+
+TEST(DubboInvocationKey, DifferentCallsDiffer)
+{
+    EXPECT_FALSE(keyOf("hash", "abc") == keyOf("hash", "abd"));
+    EXPECT_FALSE(keyOf("hash", "abc") == keyOf("echo", "abc"));
+
+    auto versioned = invocation("hash", "abc");
+    versioned.serviceVersion = "1.0.0";
+    EXPECT_FALSE(keyOf("hash", "abc") == keyOf(*DubboRequestEncoder::encode(1, versioned)));
+
+    //the response comes back in the serialization of the request
+    auto fastjson = keyOf(*DubboRequestEncoder::encode(1, invocation("hash", "abc")));
+    auto hessian2 = keyOf(*DubboRequestEncoder::encodeHessian2(1, invocation("hash", "abc")));
+    EXPECT_FALSE(fastjson == hessian2);
+}
+
+TEST(DubboResponseCache, HitCarriesCallerId)
+{
+    DubboResponseCache cache(1 << 20);
+    cache.addMethod(kInterface, "hash", std::chrono::seconds(60));
+    auto key = keyOf("hash", "abc");
+    EXPECT_FALSE(cache.get(key, 1));
+
+    cache.put(key, *fastjsonResponse(1, "1\n12345\n"));
+    auto first = cache.get(key, 9);
+    ASSERT_TRUE(first);
+    EXPECT_EQ(9, headerOf(*first).id);
+    EXPECT_EQ("1\n12345\n", bodyOf(*first));
+
+    //each hit has a header of its own
+    auto second = cache.get(key, 10);
+    ASSERT_TRUE(second);
+    EXPECT_EQ(10, headerOf(*second).id);
+    EXPECT_EQ(9, headerOf(*first).id);
+    EXPECT_EQ("1\n12345\n", bodyOf(*second));
+}
+
+TEST(DubboResponseCache, OnlyValuesAreCached)
+{
+    DubboResponseCache cache(1 << 20);
+    cache.addMethod(kInterface, "hash", std::chrono::seconds(60));
+
+    //errors and exceptions go back to the provider every time
+    auto error = keyOf("hash", "error");
+    cache.put(error, *fastjsonResponse(1, "\"timeout\"\n", 31));
+    EXPECT_FALSE(cache.get(error, 1));
+
+    auto exception = keyOf("hash", "exception");
+    cache.put(exception, *fastjsonResponse(1, "0\n{\"message\":\"boom\"}\n"));
+    EXPECT_FALSE(cache.get(exception, 1));
+
+    auto event = keyOf("hash", "event");
+    cache.put(event, *frame(kDubboFlagEvent | kDubboSerializationFastjson, 20, 1, "null\n"));
+    EXPECT_FALSE(cache.get(event, 1));
+
+    auto null = keyOf("hash", "null");
+    cache.put(null, *fastjsonResponse(1, "2\n"));
+    EXPECT_TRUE(cache.get(null, 1));
+
+    //a value with attachments
+    auto withAttachments = keyOf("hash", "attachments");
+    cache.put(withAttachments, *fastjsonResponse(1, "4\n1\n{}\n"));
+    EXPECT_TRUE(cache.get(withAttachments, 1));
+
+    //hessian2 spells the result type as a compact int
+    auto hessian2 = keyOf(*DubboRequestEncoder::encodeHessian2(1, invocation("hash", "abc")));
+    std::string value("\x91\x05", 2);
+    cache.put(hessian2, *frame(kDubboSerializationHessian2, 20, 1, value));
+    EXPECT_TRUE(cache.get(hessian2, 1));
+    std::string exceptionValue("\x90N", 2);
+    auto hessian2Exception = keyOf(*DubboRequestEncoder::encodeHessian2(1, invocation("hash", "x")));
+    cache.put(hessian2Exception, *frame(kDubboSerializationHessian2, 20, 1, exceptionValue));
+    EXPECT_FALSE(cache.get(hessian2Exception, 1));
+
+    //methods that were not added
+    auto other = keyOf("echo", "abc");
+    cache.put(other, *fastjsonResponse(1, "1\n\"abc\"\n"));
+    EXPECT_FALSE(cache.get(other, 1));
+}
+
+TEST(DubboResponseCache, Expiry)
+{
+    DubboResponseCache cache(1 << 20, 1, std::chrono::milliseconds(0));
+    cache.addMethod(kInterface, "hash", std::chrono::milliseconds(20));
+    cache.addMethod(kInterface, "echo", std::chrono::seconds(60));
+
+    auto shortLived = keyOf("hash", "abc");
+    cache.put(shortLived, *fastjsonResponse(1, "1\n1\n"));
+    ASSERT_TRUE(cache.get(shortLived, 1));
+    auto bytes = cache.getBytes();
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    EXPECT_FALSE(cache.get(shortLived, 1));
+    EXPECT_EQ(bytes, cache.getBytes());
+
+    //the next write reclaims it, without any byte pressure
+    auto longLived = keyOf("echo", "abc");
+    cache.put(longLived, *fastjsonResponse(1, "1\n1\n"));
+    EXPECT_TRUE(cache.get(longLived, 1));
+    EXPECT_EQ(bytes, cache.getBytes());
+
+    //expired behind an entry that lives longer
+    auto behind = keyOf("hash", "abd");
+    cache.put(behind, *fastjsonResponse(1, "1\n1\n"));
+    EXPECT_EQ(2 * bytes, cache.getBytes());
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    cache.put(keyOf("echo", "abd"), *fastjsonResponse(1, "1\n1\n"));
+    EXPECT_FALSE(cache.get(behind, 1));
+    EXPECT_EQ(2 * bytes, cache.getBytes());
+}
+
+TEST(DubboResponseCache, EvictsOldestPastMaxBytes)
+{
+    size_t bytes;
+    {
+        DubboResponseCache probe(1 << 20, 1);
+        probe.addMethod(kInterface, "hash", std::chrono::seconds(60));
+        probe.put(keyOf("hash", "arg0"), *fastjsonResponse(1, "1\n1\n"));
+        bytes = probe.getBytes();
+    }
+
+    DubboResponseCache cache(3 * bytes, 1);
+    cache.addMethod(kInterface, "hash", std::chrono::seconds(60));
+    for (int i = 0; i < 5; i++)
+    {
+        cache.put(keyOf("hash", "arg" + to<std::string>(i)), *fastjsonResponse(1, "1\n1\n"));
+        EXPECT_LE(cache.getBytes(), 3 * bytes);
+    }
+    EXPECT_FALSE(cache.get(keyOf("hash", "arg0"), 1));
+    EXPECT_FALSE(cache.get(keyOf("hash", "arg1"), 1));
+    for (int i = 2; i < 5; i++)
+    {
+        EXPECT_TRUE(cache.get(keyOf("hash", "arg" + to<std::string>(i)), 1));
+    }
+
+    //writing a key again replaces its bytes rather than adding to them
+    cache.put(keyOf("hash", "arg4"), *fastjsonResponse(1, "1\n1\n"));
+    EXPECT_EQ(3 * bytes, cache.getBytes());
+    EXPECT_TRUE(cache.get(keyOf("hash", "arg2"), 1));
+}
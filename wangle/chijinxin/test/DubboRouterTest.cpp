@@ -0,0 +1,193 @@
+#include <folly/io/async/EventBaseManager.h>
+#include <gtest/gtest.h>
+
+#include "../DubboRouter.h"
+#include "DubboTestUtils.h"
+
+using namespace dubbotest;
+using namespace folly;
+using namespace std;
+
+namespace
+{
+
+DubboBackendOptions testOptions()
+{
+    DubboBackendOptions options;
+    options.heartbeatInterval = std::chrono::milliseconds(0);
+    options.connectTimeout = std::chrono::milliseconds(200);
+    return options;
+}
+
+}
+
+class DubboBackendTest : public testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        endpoint_ = std::make_shared<DubboEndpoint>(provider_.getAddress());
+        backend_ = std::make_shared<DubboBackend>(&evb_, endpoint_, testOptions());
+        backend_->connect();
+        loopUntil(evb_, [&] { return backend_->isConnected() && provider_.isConnected(); });
+    }
+
+    void TearDown() override
+    {
+        backend_->stop();
+    }
+
+    //ClientBootstrap connects on the EventBase of the calling thread
+    EventBase& evb_{*EventBaseManager::get()->getEventBase()};
+    FakeProvider provider_{&evb_};
+    std::shared_ptr<DubboEndpoint> endpoint_;
+    std::shared_ptr<DubboBackend> backend_;
+};
+
+TEST_F(DubboBackendTest, TranslatesIds)
+{
+    //two consumer connections happen to use the same id
+    Result first;
+    Result second;
+    backend_->send(7, fastjsonRequest(7, "a"), true, first.callback());
+    backend_->send(7, fastjsonRequest(7, "b"), true, second.callback());
+    EXPECT_EQ(2, endpoint_->inFlight.load());
+    loopUntil(evb_, [&] { return provider_.requests.size() == 2; });
+
+    //the provider sees distinct ids of the backend's own
+    auto id0 = headerOf(*provider_.requests[0]).id;
+    auto id1 = headerOf(*provider_.requests[1]).id;
+    EXPECT_NE(id0, id1);
+    EXPECT_EQ("a", bodyOf(*provider_.requests[0]));
+    EXPECT_EQ("b", bodyOf(*provider_.requests[1]));
+
+    //answered out of order, each response goes back under the caller's id
+    provider_.respond(1, "1\n\"B\"\n");
+    provider_.respond(0, "1\n\"A\"\n");
+    loopUntil(evb_, [&] { return first.done && second.done; });
+    ASSERT_TRUE(first.frame);
+    ASSERT_TRUE(second.frame);
+    EXPECT_EQ(7, headerOf(*first.frame).id);
+    EXPECT_EQ("1\n\"A\"\n", bodyOf(*first.frame));
+    EXPECT_EQ(7, headerOf(*second.frame).id);
+    EXPECT_EQ("1\n\"B\"\n", bodyOf(*second.frame));
+    EXPECT_EQ(0, endpoint_->inFlight.load());
+    EXPECT_EQ(0u, backend_->getInFlight());
+}
+
+TEST_F(DubboBackendTest, FailAllOnDisconnect)
+{
+    Result first;
+    Result second;
+    backend_->send(1, fastjsonRequest(1, "a"), true, first.callback());
+    backend_->send(2, fastjsonRequest(2, "b"), true, second.callback());
+    loopUntil(evb_, [&] { return provider_.requests.size() == 2; });
+
+    provider_.disconnect();
+    loopUntil(evb_, [&] { return first.done && second.done; });
+    EXPECT_TRUE(first.error);
+    EXPECT_TRUE(second.error);
+    EXPECT_FALSE(backend_->isConnected());
+    EXPECT_EQ(0, endpoint_->inFlight.load());
+
+    //fails at once until the reconnect
+    Result third;
+    backend_->send(3, fastjsonRequest(3, "c"), true, third.callback());
+    EXPECT_TRUE(third.done);
+    EXPECT_TRUE(third.error);
+}
+
+class DubboRouterTest : public testing::Test
+{
+protected:
+    std::unique_ptr<DubboRouter> makeRouter(const std::vector<FakeProvider*>& providers)
+    {
+        for (auto provider : providers)
+        {
+            endpoints_.push_back(std::make_shared<DubboEndpoint>(provider->getAddress()));
+        }
+        return std::make_unique<DubboRouter>(&evb_, endpoints_, testOptions());
+    }
+
+    //an address nobody listens on
+    SocketAddress closedAddress()
+    {
+        FakeProvider provider(&evb_);
+        return provider.getAddress();
+    }
+
+    EventBase& evb_{*EventBaseManager::get()->getEventBase()};
+    std::vector<std::shared_ptr<DubboEndpoint>> endpoints_;
+};
+
+TEST_F(DubboRouterTest, PicksLeastLoaded)
+{
+    FakeProvider a(&evb_);
+    FakeProvider b(&evb_);
+    //outlives the router, which fails whatever is still outstanding
+    std::vector<Result> results(4);
+    auto router = makeRouter({&a, &b});
+    loopUntil(evb_, [&]
+    {
+        return router->getBackends()[0]->isConnected() && router->getBackends()[1]->isConnected();
+    });
+
+    //requests from other io threads count too
+    endpoints_[0]->inFlight += 10;
+    for (int i = 0; i < 3; i++)
+    {
+        router->send(i, fastjsonRequest(i, "x"), true, results[i].callback());
+    }
+    EXPECT_EQ(3, endpoints_[1]->inFlight.load());
+    loopUntil(evb_, [&] { return b.requests.size() == 3; });
+    EXPECT_TRUE(a.requests.empty());
+
+    endpoints_[0]->inFlight -= 10;
+    router->send(3, fastjsonRequest(3, "x"), true, results[3].callback());
+    loopUntil(evb_, [&] { return a.requests.size() == 1; });
+    EXPECT_EQ(3u, b.requests.size());
+}
+
+TEST_F(DubboRouterTest, WaitConnected)
+{
+    FakeProvider provider(&evb_);
+    auto router = makeRouter({&provider});
+    auto connected = router->waitConnected();
+    loopUntil(evb_, [&] { return connected.isReady(); });
+    EXPECT_FALSE(connected.hasException());
+    EXPECT_TRUE(router->waitConnected().isReady());
+}
+
+TEST_F(DubboRouterTest, WaitConnectedTimesOut)
+{
+    endpoints_.push_back(std::make_shared<DubboEndpoint>(closedAddress()));
+    DubboRouter router(&evb_, endpoints_, testOptions());
+    auto connected = router.waitConnected();
+    loopUntil(evb_, [&] { return connected.isReady(); });
+    EXPECT_TRUE(connected.hasException());
+
+    //later waits fail at once while nothing is connected
+    auto again = router.waitConnected();
+    EXPECT_TRUE(again.isReady());
+    EXPECT_TRUE(again.hasException());
+}
+
+TEST_F(DubboRouterTest, WaitConnectedFailsOnceAllGiveUp)
+{
+    endpoints_.push_back(std::make_shared<DubboEndpoint>(closedAddress()));
+    endpoints_.push_back(std::make_shared<DubboEndpoint>(closedAddress()));
+    DubboRouter router(&evb_, endpoints_, testOptions());
+    auto connected = router.waitConnected();
+
+    router.getBackends()[0]->stop();
+    EXPECT_FALSE(connected.isReady());
+    router.getBackends()[1]->stop();
+    ASSERT_TRUE(connected.isReady());
+    EXPECT_TRUE(connected.hasException());
+}
+
+TEST_F(DubboRouterTest, NoEndpoints)
+{
+    DubboRouter router(&evb_, endpoints_, testOptions());
+    EXPECT_TRUE(router.waitConnected().hasException());
+}
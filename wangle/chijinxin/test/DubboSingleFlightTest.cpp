@@ -0,0 +1,135 @@
+#include <folly/io/async/EventBaseManager.h>
+#include <gtest/gtest.h>
+
+#include "../DubboSingleFlight.h"
+#include "DubboTestUtils.h"
+
+using namespace dubbotest;
+using namespace folly;
+using namespace std;
+
+namespace
+{
+
+DubboInvocationKey makeKey(uint64_t hash)
+{
+    DubboInvocationKey key;
+    key.interfaceName = "com.alibaba.dubbo.performance.demo.provider.IHelloService";
+    key.method = "hash";
+    key.hash1 = hash;
+    key.hash2 = hash;
+    return key;
+}
+
+}
+
+class DubboSingleFlightTest : public testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        DubboBackendOptions options;
+        options.heartbeatInterval = std::chrono::milliseconds(0);
+        endpoints_.push_back(std::make_shared<DubboEndpoint>(provider_.getAddress()));
+        router_ = std::make_unique<DubboRouter>(&evb_, endpoints_, options);
+        auto connected = router_->waitConnected();
+        loopUntil(evb_, [&] { return connected.isReady() && provider_.isConnected(); });
+        ASSERT_FALSE(connected.hasException());
+        flight_ = std::make_unique<DubboSingleFlight>(router_.get());
+    }
+
+    void TearDown() override
+    {
+        //fails whatever is still outstanding, through flight_
+        router_.reset();
+    }
+
+    //ClientBootstrap connects on the EventBase of the calling thread
+    EventBase& evb_{*EventBaseManager::get()->getEventBase()};
+    FakeProvider provider_{&evb_};
+    std::vector<Result> results_ = std::vector<Result>(4);
+    std::vector<std::shared_ptr<DubboEndpoint>> endpoints_;
+    std::unique_ptr<DubboRouter> router_;
+    std::unique_ptr<DubboSingleFlight> flight_;
+};
+
+TEST_F(DubboSingleFlightTest, FollowersGetTheirOwnId)
+{
+    auto& flight = *flight_;
+    auto key = makeKey(1);
+    for (int i = 0; i < 3; i++)
+    {
+        flight.send(key, 10 + i, fastjsonRequest(10 + i, "a"), results_[i].callback());
+    }
+    //another call is not held up
+    flight.send(makeKey(2), 20, fastjsonRequest(20, "b"), results_[3].callback());
+    EXPECT_TRUE(flight.isInFlight(key));
+    EXPECT_EQ(2u, flight.getCoalesced());
+    loopUntil(evb_, [&] { return provider_.requests.size() == 2; });
+    EXPECT_EQ("a", bodyOf(*provider_.requests[0]));
+    EXPECT_EQ("b", bodyOf(*provider_.requests[1]));
+
+    provider_.respond(0, "1\n\"A\"\n");
+    loopUntil(evb_, [&] { return results_[0].done && results_[1].done && results_[2].done; });
+    for (int i = 0; i < 3; i++)
+    {
+        ASSERT_TRUE(results_[i].frame);
+        EXPECT_EQ(10 + i, headerOf(*results_[i].frame).id);
+        EXPECT_EQ("1\n\"A\"\n", bodyOf(*results_[i].frame));
+    }
+    EXPECT_FALSE(flight.isInFlight(key));
+    EXPECT_FALSE(results_[3].done);
+}
+
+TEST_F(DubboSingleFlightTest, FailureFansOut)
+{
+    auto& flight = *flight_;
+    auto key = makeKey(1);
+    for (int i = 0; i < 3; i++)
+    {
+        flight.send(key, 10 + i, fastjsonRequest(10 + i, "a"), results_[i].callback());
+    }
+    loopUntil(evb_, [&] { return provider_.requests.size() == 1; });
+
+    provider_.disconnect();
+    loopUntil(evb_, [&] { return results_[0].done && results_[1].done && results_[2].done; });
+    for (int i = 0; i < 3; i++)
+    {
+        EXPECT_TRUE(results_[i].error);
+        EXPECT_FALSE(results_[i].frame);
+    }
+    EXPECT_FALSE(flight.isInFlight(key));
+}
+
+TEST_F(DubboSingleFlightTest, NextCallGoesUpstream)
+{
+    auto& flight = *flight_;
+    auto key = makeKey(1);
+
+    //a caller that asks again from its callback starts a new flight
+    bool resent = false;
+    flight.send(key, 10, fastjsonRequest(10, "a"), [&](Try<std::unique_ptr<IOBuf>>&& response)
+    {
+        EXPECT_FALSE(response.hasException());
+        EXPECT_FALSE(flight.isInFlight(key));
+        flight.send(key, 11, fastjsonRequest(11, "a"), results_[1].callback());
+        resent = true;
+    });
+    flight.send(key, 12, fastjsonRequest(12, "a"), results_[0].callback());
+    loopUntil(evb_, [&] { return provider_.requests.size() == 1; });
+
+    provider_.respond(0, "1\n\"A\"\n");
+    loopUntil(evb_, [&] { return resent && results_[0].done; });
+    EXPECT_TRUE(flight.isInFlight(key));
+    EXPECT_EQ(1u, flight.getCoalesced());
+
+    //its request reaches the provider rather than reusing the old response
+    loopUntil(evb_, [&] { return provider_.requests.size() == 2; });
+    EXPECT_FALSE(results_[1].done);
+    provider_.respond(1, "1\n\"B\"\n");
+    loopUntil(evb_, [&] { return results_[1].done; });
+    ASSERT_TRUE(results_[1].frame);
+    EXPECT_EQ(11, headerOf(*results_[1].frame).id);
+    EXPECT_EQ("1\n\"B\"\n", bodyOf(*results_[1].frame));
+    EXPECT_FALSE(flight.isInFlight(key));
+}
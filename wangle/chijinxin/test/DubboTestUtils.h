@@ -0,0 +1,223 @@
+//
+// Frames, request results and a scripted provider for the ProviderAgent tests.
+//
+#pragma once
+
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <folly/io/Cursor.h>
+#include <folly/io/IOBufQueue.h>
+#include <folly/io/async/AsyncServerSocket.h>
+#include <folly/io/async/AsyncSocket.h>
+#include <folly/io/async/EventBase.h>
+#include <gtest/gtest.h>
+
+#include <wangle/codec/DubboProtocol.h>
+
+#include "../DubboBackend.h"
+
+namespace dubbotest
+{
+
+inline std::string toString(const folly::IOBuf& buf)
+{
+    std::string str;
+    for (const auto& range : buf)
+    {
+        str.append(reinterpret_cast<const char*>(range.data()), range.size());
+    }
+    return str;
+}
+
+inline std::unique_ptr<folly::IOBuf> frame(uint8_t flags, uint8_t status, int64_t id, const std::string& body)
+{
+    wangle::DubboHeader header;
+    header.flags = flags;
+    header.status = status;
+    header.id = id;
+    header.bodyLength = body.size();
+    auto buf = folly::IOBuf::create(wangle::kDubboHeaderLength + body.size());
+    buf->append(wangle::kDubboHeaderLength);
+    folly::io::RWPrivateCursor c(buf.get());
+    wangle::writeDubboHeader(c, header);
+    memcpy(buf->writableTail(), body.data(), body.size());
+    buf->append(body.size());
+    return buf;
+}
+
+inline std::unique_ptr<folly::IOBuf> fastjsonRequest(int64_t id, const std::string& body)
+{
+    return frame(wangle::kDubboFlagRequest | wangle::kDubboFlagTwoWay | wangle::kDubboSerializationFastjson,
+                 0, id, body);
+}
+
+inline std::unique_ptr<folly::IOBuf> fastjsonResponse(int64_t id, const std::string& body,
+                                                      uint8_t status = 20)
+{
+    return frame(wangle::kDubboSerializationFastjson, status, id, body);
+}
+
+inline wangle::DubboHeader headerOf(const folly::IOBuf& buf)
+{
+    folly::io::Cursor c(&buf);
+    wangle::DubboHeader header;
+    EXPECT_TRUE(wangle::readDubboHeader(c, header));
+    return header;
+}
+
+inline std::string bodyOf(const folly::IOBuf& buf)
+{
+    return toString(buf).substr(wangle::kDubboHeaderLength);
+}
+
+/*
+ * Collects what a backend hands back for one request
+ */
+struct Result
+{
+    DubboBackend::Callback callback()
+    {
+        return [this](folly::Try<std::unique_ptr<folly::IOBuf>>&& t)
+        {
+            done = true;
+            if (t.hasException())
+            {
+                error = t.exception();
+            }
+            else
+            {
+                frame = std::move(t.value());
+            }
+        };
+    }
+
+    bool done{false};
+    std::unique_ptr<folly::IOBuf> frame;
+    folly::exception_wrapper error;
+};
+
+/*
+ * Run evb until pred holds, failing the test after a few seconds
+ */
+template <typename Pred>
+void loopUntil(folly::EventBase& evb, Pred pred)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!pred())
+    {
+        ASSERT_LT(std::chrono::steady_clock::now(), deadline);
+        evb.loopOnce(EVLOOP_NONBLOCK);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+/*
+ * A provider on evb that keeps the request frames it reads and only answers
+ * when told to. Takes one connection at a time.
+ */
+class FakeProvider : private folly::AsyncServerSocket::AcceptCallback,
+                     private folly::AsyncReader::ReadCallback
+{
+public:
+    explicit FakeProvider(folly::EventBase* evb)
+            : evb_(evb),
+              server_(folly::AsyncServerSocket::newSocket(evb))
+    {
+        server_->bind(folly::SocketAddress("127.0.0.1", 0));
+        server_->listen(16);
+        server_->addAcceptCallback(this, evb);
+        server_->startAccepting();
+    }
+
+    ~FakeProvider() override
+    {
+        disconnect();
+    }
+
+    folly::SocketAddress getAddress() const
+    {
+        folly::SocketAddress address;
+        server_->getAddress(&address);
+        return address;
+    }
+
+    bool isConnected() const
+    {
+        return socket_ != nullptr;
+    }
+
+    /*
+     * Answer the nth request read with body
+     */
+    void respond(size_t n, const std::string& body)
+    {
+        socket_->write(nullptr, fastjsonResponse(headerOf(*requests[n]).id, body));
+    }
+
+    void disconnect()
+    {
+        if (socket_)
+        {
+            socket_->setReadCB(nullptr);
+            socket_->closeNow();
+            socket_.reset();
+        }
+    }
+
+    std::vector<std::unique_ptr<folly::IOBuf>> requests;
+
+private:
+    void connectionAccepted(int fd, const folly::SocketAddress&) noexcept override
+    {
+        disconnect();
+        socket_ = folly::AsyncSocket::newSocket(evb_, fd);
+        socket_->setReadCB(this);
+    }
+
+    void acceptError(const std::exception&) noexcept override {}
+
+    void getReadBuffer(void** buf, size_t* len) override
+    {
+        auto space = queue_.preallocate(4096, 65536);
+        *buf = space.first;
+        *len = space.second;
+    }
+
+    void readDataAvailable(size_t len) noexcept override
+    {
+        queue_.postallocate(len);
+        while (queue_.chainLength() >= wangle::kDubboHeaderLength)
+        {
+            folly::io::Cursor c(queue_.front());
+            c.skip(wangle::kDubboLengthFieldOffset);
+            size_t length = wangle::kDubboHeaderLength + c.readBE<uint32_t>();
+            if (queue_.chainLength() < length)
+            {
+                break;
+            }
+            requests.push_back(queue_.split(length));
+        }
+    }
+
+    void readEOF() noexcept override
+    {
+        socket_.reset();
+    }
+
+    void readErr(const folly::AsyncSocketException&) noexcept override
+    {
+        socket_.reset();
+    }
+
+    folly::EventBase* evb_;
+    std::shared_ptr<folly::AsyncServerSocket> server_;
+    std::shared_ptr<folly::AsyncSocket> socket_;
+    folly::IOBufQueue queue_{folly::IOBufQueue::cacheChainLength()};
+};
+
+}
@@ -2,6 +2,7 @@
 
 #include <string>
 #include <sstream>
+#include <cstdint>
 
 template< class StringVector, class StringType, class DelimType>
 /*
@@ -42,4 +43,40 @@ void StringSplit( const StringType& str,  const DelimType& delims, unsigned int
         ++numSplits;
 
     } while (pos != StringType::npos);
-}
\ No newline at end of file
+}
+
+/*
+ * java.lang.String#hashCode of a UTF-8 string, the result of
+ * IHelloService.hash
+ */
+inline int32_t JavaStringHashCode(const char* data, size_t size)
+{
+    uint32_t hash = 0;
+    auto addUnit = [&hash](uint32_t unit) { hash = 31 * hash + unit; };
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+    const unsigned char* end = p + size;
+    while (p < end)
+    {
+        uint32_t cp;
+        size_t len;
+        if (*p < 0x80) { cp = *p; len = 1; }
+        else if (*p < 0xe0) { cp = *p & 0x1f; len = 2; }
+        else if (*p < 0xf0) { cp = *p & 0x0f; len = 3; }
+        else { cp = *p & 0x07; len = 4; }
+        if (len > size_t(end - p)) { len = end - p; }
+        for (size_t i = 1; i < len; i++) { cp = (cp << 6) | (p[i] & 0x3f); }
+        p += len;
+        if (cp >= 0x10000)
+        {
+            //UTF-16 surrogate pair
+            cp -= 0x10000;
+            addUnit(0xd800 + (cp >> 10));
+            addUnit(0xdc00 + (cp & 0x3ff));
+        }
+        else
+        {
+            addUnit(cp);
+        }
+    }
+    return static_cast<int32_t>(hash);
+}
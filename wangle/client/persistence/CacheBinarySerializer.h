@@ -0,0 +1,101 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+#include <folly/Bits.h>
+#include <folly/DynamicConverter.h>
+#include <folly/FBString.h>
+#include <folly/Range.h>
+#include <folly/json.h>
+
+namespace wangle {
+
+/**
+ * Converts cache keys and values to and from the bytes stored in a binary
+ * cache snapshot. serialize() appends the encoding of a value to out, and
+ * deserialize() is handed exactly the bytes that serialize() appended.
+ *
+ * Types without a specialization are stored as the JSON of their
+ * folly::toDynamic() form, so every type that can be persisted as JSON can
+ * be persisted in binary as well. Specialize this for types that are
+ * loaded in bulk to skip folly::dynamic entirely.
+ */
+template <typename T, typename Enable = void>
+struct CacheBinarySerializer {
+  static void serialize(const T& value, std::string& out) {
+    folly::json::serialization_opts opts;
+    opts.allow_non_string_keys = true;
+    out += folly::json::serialize(folly::toDynamic(value), opts);
+  }
+
+  static T deserialize(folly::StringPiece bytes) {
+    folly::json::serialization_opts opts;
+    opts.allow_non_string_keys = true;
+    return folly::convertTo<T>(folly::parseJson(bytes, opts));
+  }
+};
+
+template <>
+struct CacheBinarySerializer<std::string> {
+  static void serialize(const std::string& value, std::string& out) {
+    out.append(value);
+  }
+
+  static std::string deserialize(folly::StringPiece bytes) {
+    return bytes.str();
+  }
+};
+
+template <>
+struct CacheBinarySerializer<folly::fbstring> {
+  static void serialize(const folly::fbstring& value, std::string& out) {
+    out.append(value.data(), value.size());
+  }
+
+  static folly::fbstring deserialize(folly::StringPiece bytes) {
+    return folly::fbstring(bytes.data(), bytes.size());
+  }
+};
+
+/**
+ * Integers are stored little endian in their native width.
+ */
+template <typename T>
+struct CacheBinarySerializer<
+    T,
+    typename std::enable_if<
+        std::is_integral<T>::value && !std::is_same<T, bool>::value>::type> {
+  static void serialize(const T& value, std::string& out) {
+    auto le = folly::Endian::little(value);
+    out.append(reinterpret_cast<const char*>(&le), sizeof(le));
+  }
+
+  static T deserialize(folly::StringPiece bytes) {
+    if (bytes.size() != sizeof(T)) {
+      throw std::out_of_range("Bad length for binary cache integer");
+    }
+    T le;
+    std::memcpy(&le, bytes.data(), sizeof(le));
+    return folly::Endian::little(le);
+  }
+};
+
+} // namespace wangle
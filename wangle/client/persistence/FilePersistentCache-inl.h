@@ -16,9 +16,23 @@
 #pragma once
 
 
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <folly/Bits.h>
 #include <folly/FileUtil.h>
+#include <folly/ScopeGuard.h>
+#include <folly/String.h>
+#include <folly/hash/Checksum.h>
 #include <folly/portability/Unistd.h>
 #include <folly/json.h>
+#include <wangle/client/persistence/CacheBinarySerializer.h>
 
 namespace wangle {
 
@@ -110,14 +124,481 @@ void FilePersistenceLayer<K, V>::clear() {
   ::unlink(file_.c_str());
 }
 
+/**
+ * A FilePersistenceLayer that also supports deltas. Deltas are appended
+ * to a log next to the JSON snapshot in <file>.log, one JSON record per
+ * line: ["p", key, value] for a put and ["r", key] for a remove. A full
+ * persist() rewrites the snapshot and truncates the log, and compaction
+ * is requested once the log outgrows the snapshot. load() replays the log
+ * on top of the snapshot.
+ */
+template<typename K, typename V>
+class FileLogPersistenceLayer : public FilePersistenceLayer<K, V> {
+ public:
+  explicit FileLogPersistenceLayer(
+      const std::string& file,
+      size_t minCompactionBytes = kDefaultMinCompactionBytes)
+      : FilePersistenceLayer<K, V>(file),
+        file_(file),
+        logFile_(file + ".log"),
+        minCompactionBytes_(minCompactionBytes) {}
+  ~FileLogPersistenceLayer() override {}
+
+  bool persist(const folly::dynamic& arrayOfKvPairs) noexcept override;
+
+  bool supportsDelta() const noexcept override {
+    return true;
+  }
+
+  bool persistDelta(
+      const folly::dynamic& arrayOfKvPairs,
+      const folly::dynamic& arrayOfKeys) noexcept override;
+
+  bool needsCompaction() const noexcept override {
+    return logBytes_ > std::max(snapshotBytes_, minCompactionBytes_);
+  }
+
+  folly::Optional<folly::dynamic> load() noexcept override;
+
+  void clear() override;
+
+  static constexpr size_t kDefaultMinCompactionBytes = 1024 * 1024;
+
+ private:
+  static size_t fileSize(const std::string& file) {
+    struct stat st;
+    if (::stat(file.c_str(), &st) != 0) {
+      return 0;
+    }
+    return st.st_size;
+  }
+
+  std::string file_;
+  std::string logFile_;
+  size_t minCompactionBytes_;
+  size_t snapshotBytes_{0};
+  size_t logBytes_{0};
+};
+
+template<typename K, typename V>
+constexpr size_t FileLogPersistenceLayer<K, V>::kDefaultMinCompactionBytes;
+
+template<typename K, typename V>
+bool FileLogPersistenceLayer<K, V>::persist(
+  const folly::dynamic& dynObj) noexcept {
+  if (!FilePersistenceLayer<K, V>::persist(dynObj)) {
+    return false;
+  }
+  snapshotBytes_ = fileSize(file_);
+  // the snapshot covers everything in the log now
+  const auto fd = folly::openNoInt(
+    logFile_.c_str(),
+    O_WRONLY | O_CREAT | O_TRUNC,
+    S_IRUSR | S_IWUSR
+  );
+  if (fd == -1) {
+    LOG(ERROR) << "Failed to truncate " << logFile_ << ": errno " << errno;
+    return false;
+  }
+  logBytes_ = 0;
+  if (folly::closeNoInt(fd) != 0) {
+    LOG(ERROR) << "Failed to close " << logFile_ << ": errno " << errno;
+    return false;
+  }
+  return true;
+}
+
+template<typename K, typename V>
+bool FileLogPersistenceLayer<K, V>::persistDelta(
+  const folly::dynamic& kvPairs,
+  const folly::dynamic& keys) noexcept {
+  std::string records;
+  try {
+    folly::json::serialization_opts opts;
+    opts.allow_non_string_keys = true;
+    for (const auto& kv : kvPairs) {
+      records += folly::json::serialize(
+        folly::dynamic::array("p", kv[0], kv[1]), opts);
+      records += '\n';
+    }
+    for (const auto& key : keys) {
+      records += folly::json::serialize(
+        folly::dynamic::array("r", key), opts);
+      records += '\n';
+    }
+  } catch (const std::exception& err) {
+    LOG(ERROR) << "Serializing to JSON failed with error: " << err.what();
+    return false;
+  }
+  if (records.empty()) {
+    return true;
+  }
+  const auto fd = folly::openNoInt(
+    logFile_.c_str(),
+    O_WRONLY | O_CREAT | O_APPEND,
+    S_IRUSR | S_IWUSR
+  );
+  if (fd == -1) {
+    return false;
+  }
+  const auto nWritten = folly::writeFull(fd, records.data(), records.size());
+  bool persisted = nWritten >= 0 &&
+    (static_cast<size_t>(nWritten) == records.size());
+  if (!persisted) {
+    LOG(ERROR) << "Failed to append to " << logFile_ << ":";
+    if (nWritten == -1) {
+      LOG(ERROR) << "write failed with errno " << errno;
+    }
+  }
+  if (nWritten > 0) {
+    logBytes_ += nWritten;
+  }
+  if (folly::fdatasyncNoInt(fd) != 0) {
+    LOG(ERROR) << "Failed to sync " << logFile_ << ": errno " << errno;
+    persisted = false;
+  }
+  if (folly::closeNoInt(fd) != 0) {
+    LOG(ERROR) << "Failed to close " << logFile_ << ": errno " << errno;
+    persisted = false;
+  }
+  return persisted;
+}
+
+template<typename K, typename V>
+folly::Optional<folly::dynamic> FileLogPersistenceLayer<K, V>::load() noexcept {
+  auto snapshot = FilePersistenceLayer<K, V>::load();
+  snapshotBytes_ = snapshot ? fileSize(file_) : 0;
+
+  std::string log;
+  if (!folly::readFile(logFile_.c_str(), log)) {
+    logBytes_ = 0;
+    return snapshot;
+  }
+  logBytes_ = log.size();
+
+  try {
+    folly::json::serialization_opts opts;
+    opts.allow_non_string_keys = true;
+
+    // replay the log on top of the snapshot. entries that are replaced or
+    // removed are nulled out, and a put moves the key to the back so the
+    // most recently used entries are loaded last.
+    folly::dynamic entries =
+      snapshot ? std::move(snapshot.value()) : folly::dynamic::array;
+    std::unordered_map<std::string, size_t> index;
+    for (size_t i = 0; i < entries.size(); ++i) {
+      index[folly::json::serialize(entries[i][0], opts)] = i;
+    }
+
+    std::vector<folly::StringPiece> lines;
+    folly::split('\n', log, lines);
+    for (const auto& line : lines) {
+      if (line.empty()) {
+        continue;
+      }
+      folly::dynamic record;
+      try {
+        record = folly::parseJson(line, opts);
+      } catch (const std::exception& err) {
+        // most likely a torn write at the tail of the log
+        LOG(ERROR) << "Skipping bad record in " << logFile_ << ": "
+                   << err.what();
+        continue;
+      }
+      auto key = folly::json::serialize(record[1], opts);
+      auto itr = index.find(key);
+      if (itr != index.end()) {
+        entries[itr->second] = nullptr;
+        index.erase(itr);
+      }
+      if (record[0] == "p") {
+        index[key] = entries.size();
+        entries.push_back(folly::dynamic::array(record[1], record[2]));
+      }
+    }
+
+    folly::dynamic kvPairs = folly::dynamic::array;
+    for (auto& entry : entries) {
+      if (!entry.isNull()) {
+        kvPairs.push_back(std::move(entry));
+      }
+    }
+    return kvPairs;
+  } catch (const std::exception& err) {
+    LOG(ERROR) << "Replaying cache log " << logFile_
+               << " failed with error: " << err.what();
+  }
+  return folly::none;
+}
+
+template<typename K, typename V>
+void FileLogPersistenceLayer<K, V>::clear() {
+  FilePersistenceLayer<K, V>::clear();
+  // This may fail but it's ok
+  ::unlink(logFile_.c_str());
+  snapshotBytes_ = 0;
+  logBytes_ = 0;
+}
+
+/**
+ * A persistence layer that stores the cache as a compact binary snapshot:
+ *
+ *   header: magic, format version, entry count, payload length and the
+ *           CRC32C of the payload, as little endian integers
+ *   payload: for every entry, a 32-bit length followed by the key bytes
+ *            and a 32-bit length followed by the value bytes
+ *
+ * Keys and values are encoded with CacheBinarySerializer. The snapshot is
+ * written to a temporary file and renamed into place. Loading maps the file
+ * and inserts the entries straight into the cache with loadDirect().
+ */
+template<typename K, typename V>
+class FileBinaryPersistenceLayer : public CachePersistence<K, V> {
+ public:
+  explicit FileBinaryPersistenceLayer(const std::string& file) : file_(file) {}
+  ~FileBinaryPersistenceLayer() override {}
+
+  bool persist(const folly::dynamic& arrayOfKvPairs) noexcept override;
+
+  folly::Optional<folly::dynamic> load() noexcept override;
+
+  bool supportsDirectLoad() const noexcept override {
+    return true;
+  }
+
+  bool loadDirect(
+      const std::function<void(K&&, V&&)>& insert) noexcept override;
+
+  void clear() override;
+
+  static constexpr uint32_t kMagic = 0x57434231; // "WCB1"
+  static constexpr uint32_t kFormatVersion = 1;
+  static constexpr size_t kHeaderSize = 32;
+
+ private:
+  template <typename T>
+  static void appendInt(std::string& out, T value) {
+    auto le = folly::Endian::little(value);
+    out.append(reinterpret_cast<const char*>(&le), sizeof(le));
+  }
+
+  // appends the length prefixed encoding of value
+  template <typename T>
+  static void appendField(std::string& out, const T& value) {
+    auto lengthOffset = out.size();
+    appendInt<uint32_t>(out, 0);
+    CacheBinarySerializer<T>::serialize(value, out);
+    auto length = folly::Endian::little(static_cast<uint32_t>(
+      out.size() - lengthOffset - sizeof(uint32_t)));
+    std::memcpy(&out[lengthOffset], &length, sizeof(length));
+  }
+
+  template <typename T>
+  static T readInt(const char* data) {
+    T le;
+    std::memcpy(&le, data, sizeof(le));
+    return folly::Endian::little(le);
+  }
+
+  std::string file_;
+};
+
+template<typename K, typename V>
+constexpr uint32_t FileBinaryPersistenceLayer<K, V>::kMagic;
+template<typename K, typename V>
+constexpr uint32_t FileBinaryPersistenceLayer<K, V>::kFormatVersion;
+template<typename K, typename V>
+constexpr size_t FileBinaryPersistenceLayer<K, V>::kHeaderSize;
+
+template<typename K, typename V>
+bool FileBinaryPersistenceLayer<K, V>::persist(
+  const folly::dynamic& dynObj) noexcept {
+  std::string snapshot(kHeaderSize, '\0');
+  uint64_t nEntries = 0;
+  try {
+    for (const auto& kv : dynObj) {
+      appendField<K>(snapshot, folly::convertTo<K>(kv[0]));
+      appendField<V>(snapshot, folly::convertTo<V>(kv[1]));
+      ++nEntries;
+    }
+  } catch (const std::exception& err) {
+    LOG(ERROR) << "Serializing to binary failed with error: " << err.what();
+    return false;
+  }
+
+  auto payload = reinterpret_cast<const uint8_t*>(snapshot.data()) +
+    kHeaderSize;
+  auto payloadLength = snapshot.size() - kHeaderSize;
+  std::string header;
+  appendInt<uint32_t>(header, kMagic);
+  appendInt<uint32_t>(header, kFormatVersion);
+  appendInt<uint64_t>(header, nEntries);
+  appendInt<uint64_t>(header, payloadLength);
+  appendInt<uint32_t>(header, folly::crc32c(payload, payloadLength));
+  appendInt<uint32_t>(header, 0);
+  DCHECK_EQ(header.size(), kHeaderSize);
+  snapshot.replace(0, kHeaderSize, header);
+
+  // write a new file and rename it so a crash never leaves a partial one
+  auto tmpFile = file_ + ".tmp";
+  bool persisted = false;
+  const auto fd = folly::openNoInt(
+    tmpFile.c_str(),
+    O_WRONLY | O_CREAT | O_TRUNC,
+    S_IRUSR | S_IWUSR
+  );
+  if (fd == -1) {
+    return false;
+  }
+  const auto nWritten = folly::writeFull(fd, snapshot.data(), snapshot.size());
+  persisted = nWritten >= 0 &&
+    (static_cast<size_t>(nWritten) == snapshot.size());
+  if (!persisted) {
+    LOG(ERROR) << "Failed to write to " << tmpFile << ":";
+    if (nWritten == -1) {
+      LOG(ERROR) << "write failed with errno " << errno;
+    }
+  }
+  if (folly::fdatasyncNoInt(fd) != 0) {
+    LOG(ERROR) << "Failed to sync " << tmpFile << ": errno " << errno;
+    persisted = false;
+  }
+  if (folly::closeNoInt(fd) != 0) {
+    LOG(ERROR) << "Failed to close " << tmpFile << ": errno " << errno;
+    persisted = false;
+  }
+  if (persisted && ::rename(tmpFile.c_str(), file_.c_str()) != 0) {
+    LOG(ERROR) << "Failed to rename " << tmpFile << ": errno " << errno;
+    persisted = false;
+  }
+  if (!persisted) {
+    ::unlink(tmpFile.c_str());
+  }
+  return persisted;
+}
+
+template<typename K, typename V>
+bool FileBinaryPersistenceLayer<K, V>::loadDirect(
+  const std::function<void(K&&, V&&)>& insert) noexcept {
+  // not being able to read the backing storage means we just
+  // start with an empty cache. A corrupt file is a real error.
+  const auto fd = folly::openNoInt(file_.c_str(), O_RDONLY);
+  if (fd == -1) {
+    return false;
+  }
+  SCOPE_EXIT {
+    folly::closeNoInt(fd);
+  };
+  struct stat st;
+  if (::fstat(fd, &st) != 0 || st.st_size < off_t(kHeaderSize)) {
+    LOG(ERROR) << "Cache file " << file_ << " is truncated";
+    return false;
+  }
+  size_t size = st.st_size;
+  void* mapped = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (mapped == MAP_FAILED) {
+    LOG(ERROR) << "Failed to mmap " << file_ << ": errno " << errno;
+    return false;
+  }
+  SCOPE_EXIT {
+    ::munmap(mapped, size);
+  };
+  auto data = static_cast<const char*>(mapped);
+
+  auto nEntries = readInt<uint64_t>(data + 8);
+  auto payloadLength = readInt<uint64_t>(data + 16);
+  if (readInt<uint32_t>(data) != kMagic ||
+      readInt<uint32_t>(data + 4) != kFormatVersion ||
+      payloadLength != size - kHeaderSize) {
+    LOG(ERROR) << "Cache file " << file_ << " has a bad header";
+    return false;
+  }
+  auto payload = data + kHeaderSize;
+  auto checksum = folly::crc32c(
+    reinterpret_cast<const uint8_t*>(payload), payloadLength);
+  if (checksum != readInt<uint32_t>(data + 24)) {
+    LOG(ERROR) << "Cache file " << file_ << " failed checksum validation";
+    return false;
+  }
+
+  try {
+    auto cur = payload;
+    auto end = payload + payloadLength;
+    auto next = [&]() {
+      if (end - cur < ptrdiff_t(sizeof(uint32_t))) {
+        throw std::out_of_range("Truncated entry length");
+      }
+      auto length = readInt<uint32_t>(cur);
+      cur += sizeof(uint32_t);
+      if (size_t(end - cur) < length) {
+        throw std::out_of_range("Truncated entry");
+      }
+      folly::StringPiece bytes(cur, length);
+      cur += length;
+      return bytes;
+    };
+    for (uint64_t i = 0; i < nEntries; ++i) {
+      auto key = CacheBinarySerializer<K>::deserialize(next());
+      auto value = CacheBinarySerializer<V>::deserialize(next());
+      insert(std::move(key), std::move(value));
+    }
+  } catch (const std::exception& err) {
+    LOG(ERROR) << "Deserialization of cache file " << file_
+               << " failed with error: " << err.what();
+    return false;
+  }
+  return true;
+}
+
+template<typename K, typename V>
+folly::Optional<folly::dynamic> FileBinaryPersistenceLayer<K, V>::load()
+  noexcept {
+  folly::dynamic kvPairs = folly::dynamic::array;
+  try {
+    auto loaded = loadDirect([&](K&& key, V&& value) {
+      kvPairs.push_back(folly::toDynamic(std::make_pair(key, value)));
+    });
+    if (loaded) {
+      return kvPairs;
+    }
+  } catch (const std::exception& err) {
+    LOG(ERROR) << "Converting cache file " << file_
+               << " to folly::dynamic failed with error: " << err.what();
+  }
+  return folly::none;
+}
+
+template<typename K, typename V>
+void FileBinaryPersistenceLayer<K, V>::clear() {
+  // This may fail but it's ok
+  ::unlink(file_.c_str());
+}
+
 template<typename K, typename V, typename M>
 FilePersistentCache<K, V, M>::FilePersistentCache(
   const std::string& file,
   const std::size_t cacheCapacity,
   const std::chrono::seconds& syncInterval,
-  const int nSyncRetries)
+  const int nSyncRetries,
+  const FilePersistenceFormat format)
     : cache_(cacheCapacity,
         std::chrono::duration_cast<std::chrono::milliseconds>(syncInterval),
         nSyncRetries,
-        std::make_unique<FilePersistenceLayer<K, V>>(file)) {}
+        makePersistence(file, format)) {}
+
+template<typename K, typename V, typename M>
+std::unique_ptr<CachePersistence<K, V>>
+FilePersistentCache<K, V, M>::makePersistence(
+  const std::string& file,
+  const FilePersistenceFormat format) {
+  switch (format) {
+    case FilePersistenceFormat::JSON_LOG:
+      return std::make_unique<FileLogPersistenceLayer<K, V>>(file);
+    case FilePersistenceFormat::BINARY:
+      return std::make_unique<FileBinaryPersistenceLayer<K, V>>(file);
+    case FilePersistenceFormat::JSON:
+    default:
+      return std::make_unique<FilePersistenceLayer<K, V>>(file);
+  }
+}
 } // namespace wangle
@@ -23,6 +23,18 @@
 
 namespace wangle {
 
+/**
+ * How FilePersistentCache lays out the cache on disk.
+ */
+enum class FilePersistenceFormat {
+  // The whole cache as JSON, rewritten on every sync
+  JSON,
+  // A JSON snapshot plus a log that every sync appends its changes to
+  JSON_LOG,
+  // A checksummed binary snapshot that is mmapped on load
+  BINARY,
+};
+
 /**
  * A PersistentCache implementation that used a regular file for
  * storage. In memory structure fronts the file and the cache
@@ -44,7 +56,8 @@ class FilePersistentCache : public PersistentCache<K, V>,
     const std::string& file,
     const std::size_t cacheCapacity,
     const std::chrono::seconds& syncInterval = std::chrono::seconds(5),
-    const int nSyncRetries = 3);
+    const int nSyncRetries = 3,
+    const FilePersistenceFormat format = FilePersistenceFormat::JSON);
 
   ~FilePersistentCache() override {}
 
@@ -72,6 +85,10 @@ class FilePersistentCache : public PersistentCache<K, V>,
   }
 
  private:
+  static std::unique_ptr<CachePersistence<K, V>> makePersistence(
+    const std::string& file,
+    const FilePersistenceFormat format);
+
   LRUPersistentCache<K, V, M> cache_;
 };
 
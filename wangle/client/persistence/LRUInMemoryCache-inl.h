@@ -15,6 +15,9 @@
  */
 #pragma once
 
+#include <algorithm>
+#include <vector>
+
 #include <folly/DynamicConverter.h>
 #include <folly/Likely.h>
 
@@ -35,6 +38,7 @@ template<typename K, typename V, typename M>
 void LRUInMemoryCache<K, V, M>::put(const K& key, const V& val) {
   typename wangle::CacheLockGuard<M>::Write writeLock(cacheLock_);
   cache_.set(key, val);
+  recordDelta(key, true);
   incrementVersion();
 }
 
@@ -43,6 +47,7 @@ bool LRUInMemoryCache<K, V, M>::remove(const K& key) {
   typename wangle::CacheLockGuard<M>::Write writeLock(cacheLock_);
   size_t nErased = cache_.erase(key);
   if (nErased > 0) {
+    recordDelta(key, false);
     incrementVersion();
     return true;
   }
@@ -61,7 +66,9 @@ void LRUInMemoryCache<K, V, M>::clear() {
   if (cache_.empty()) {
     return;
   }
-  cache_.clear();
+  // the whole delta is dropped anyway, don't record each entry
+  cache_.clear([](K, V&&) {});
+  resetDelta(false);
   incrementVersion();
 }
 
@@ -94,6 +101,32 @@ LRUInMemoryCache<K, V, M>::loadData(const folly::dynamic& data) noexcept {
                 << err.what();
   }
   if (updated) {
+    // loaded entries are not part of any delta
+    resetDelta(false);
+    // we still need to increment the version
+    incrementVersion();
+  }
+  return version_;
+}
+
+template<typename K, typename V, typename M>
+CacheDataVersion LRUInMemoryCache<K, V, M>::loadDataFrom(
+    const std::function<void(const std::function<void(K&&, V&&)>&)>&
+        loader) noexcept {
+  bool updated = false;
+  typename wangle::CacheLockGuard<M>::Write writeLock(cacheLock_);
+  try {
+    loader([&](K&& key, V&& val) {
+      cache_.set(key, std::move(val));
+      updated = true;
+    });
+  } catch (const std::exception& err) {
+    LOG(ERROR) << "Load cache failed with error: "
+                << err.what();
+  }
+  if (updated) {
+    // loaded entries are not part of any delta
+    resetDelta(false);
     // we still need to increment the version
     incrementVersion();
   }
@@ -103,12 +136,14 @@ LRUInMemoryCache<K, V, M>::loadData(const folly::dynamic& data) noexcept {
 template<typename K, typename V, typename M>
 folly::Optional<std::pair<folly::dynamic, CacheDataVersion>>
 LRUInMemoryCache<K, V, M>::convertToKeyValuePairs() noexcept {
-  typename wangle::CacheLockGuard<M>::Read readLock(cacheLock_);
+  // write lock since a full conversion is the new base for deltas
+  typename wangle::CacheLockGuard<M>::Write writeLock(cacheLock_);
   try {
     folly::dynamic dynObj = folly::dynamic::array;
     for (const auto& kv : cache_) {
       dynObj.push_back(folly::toDynamic(std::make_pair(kv.first, kv.second)));
     }
+    resetDelta(true);
     return std::make_pair(std::move(dynObj), version_);
   } catch (const std::exception& err) {
     LOG(ERROR) << "Converting cache to folly::dynamic failed with error: "
@@ -117,4 +152,67 @@ LRUInMemoryCache<K, V, M>::convertToKeyValuePairs() noexcept {
   return folly::none;
 }
 
+template<typename K, typename V, typename M>
+void LRUInMemoryCache<K, V, M>::enableDeltaTracking() {
+  typename wangle::CacheLockGuard<M>::Write writeLock(cacheLock_);
+  trackDeltas_ = true;
+  resetDelta(false);
+}
+
+template<typename K, typename V, typename M>
+folly::Optional<std::tuple<folly::dynamic, folly::dynamic, CacheDataVersion>>
+LRUInMemoryCache<K, V, M>::convertDeltaToKeyValuePairs() noexcept {
+  typename wangle::CacheLockGuard<M>::Write writeLock(cacheLock_);
+  if (!deltaValid_) {
+    return folly::none;
+  }
+  try {
+    // in the order of the changes, so a replay leaves the entries put
+    // last as the most recently used
+    std::vector<const typename decltype(deltaKeys_)::value_type*> deltas;
+    deltas.reserve(deltaKeys_.size());
+    for (const auto& delta : deltaKeys_) {
+      deltas.push_back(&delta);
+    }
+    std::sort(deltas.begin(), deltas.end(), [](const auto* a, const auto* b) {
+      return a->second.first < b->second.first;
+    });
+
+    folly::dynamic puts = folly::dynamic::array;
+    folly::dynamic removes = folly::dynamic::array;
+    for (const auto* delta : deltas) {
+      // don't promote, persisting is not a use of the entry
+      auto itr = delta->second.second
+          ? cache_.findWithoutPromotion(delta->first)
+          : cache_.end();
+      if (itr != cache_.end()) {
+        puts.push_back(
+            folly::toDynamic(std::make_pair(itr->first, itr->second)));
+      } else {
+        // removed or evicted since it was put
+        removes.push_back(folly::toDynamic(delta->first));
+      }
+    }
+    resetDelta(true);
+    return std::make_tuple(std::move(puts), std::move(removes), version_);
+  } catch (const std::exception& err) {
+    LOG(ERROR) << "Converting cache delta to folly::dynamic failed with error: "
+               << err.what();
+  }
+  resetDelta(false);
+  return folly::none;
+}
+
+template<typename K, typename V, typename M>
+void LRUInMemoryCache<K, V, M>::invalidateDelta() {
+  typename wangle::CacheLockGuard<M>::Write writeLock(cacheLock_);
+  resetDelta(false);
+}
+
+template<typename K, typename V, typename M>
+void LRUInMemoryCache<K, V, M>::validateDelta() {
+  typename wangle::CacheLockGuard<M>::Write writeLock(cacheLock_);
+  resetDelta(true);
+}
+
 }
@@ -15,6 +15,9 @@
  */
 #pragma once
 
+#include <functional>
+#include <tuple>
+#include <unordered_map>
 #include <utility>
 
 #include <folly/dynamic.h>
@@ -34,7 +37,12 @@ class LRUInMemoryCache {
   /**
    * Create with the specified capacity.
    */
-  explicit LRUInMemoryCache(size_t capacity) : cache_(capacity) {}
+  explicit LRUInMemoryCache(size_t capacity) : cache_(capacity) {
+    // entries evicted for capacity are removals too, as far as the
+    // persisted data is concerned
+    cache_.setPruneHook(
+        [this](K key, V&&) { recordDelta(key, false); });
+  }
   ~LRUInMemoryCache() = default;
 
   folly::Optional<V> get(const K& key);
@@ -51,12 +59,48 @@ class LRUInMemoryCache {
    */
   CacheDataVersion loadData(const folly::dynamic& kvPairs) noexcept;
 
+  /**
+   * Loads the kv pairs that loader hands to the insert callback it is
+   * given, under a single lock and without an intermediate folly::dynamic,
+   * and bumps version.  Returns the new cache version.
+   */
+  CacheDataVersion loadDataFrom(
+      const std::function<void(const std::function<void(K&&, V&&)>&)>&
+          loader) noexcept;
+
   /**
    * Get the cache data as a list of kv pairs along with the version
    */
   folly::Optional<std::pair<folly::dynamic, CacheDataVersion>>
   convertToKeyValuePairs() noexcept;
 
+  /**
+   * Start recording the keys that change between conversions so that
+   * convertDeltaToKeyValuePairs() can be used.
+   */
+  void enableDeltaTracking();
+
+  /**
+   * Get the changes since the last conversion as a list of kv pairs that
+   * were put, a list of keys that were removed, and the version. Returns
+   * none if the delta is not usable and the full cache has to be converted
+   * with convertToKeyValuePairs() instead.
+   */
+  folly::Optional<std::tuple<folly::dynamic, folly::dynamic, CacheDataVersion>>
+  convertDeltaToKeyValuePairs() noexcept;
+
+  /**
+   * Forget the recorded delta, e.g. because it could not be persisted.
+   * The next conversion has to be a full one.
+   */
+  void invalidateDelta();
+
+  /**
+   * Declare that the current contents are already persisted, e.g. because
+   * they were just loaded, so the next delta can be taken relative to them.
+   */
+  void validateDelta();
+
   /**
    * Determine if the cache has changed since the specified version
    */
@@ -66,6 +110,19 @@ class LRUInMemoryCache {
 
  private:
 
+  // must be called under a write lock
+  void recordDelta(const K& key, bool put) {
+    if (trackDeltas_) {
+      deltaKeys_[key] = std::make_pair(nextDeltaSeq_++, put);
+    }
+  }
+
+  // must be called under a write lock
+  void resetDelta(bool valid) {
+    deltaKeys_.clear();
+    deltaValid_ = trackDeltas_ && valid;
+  }
+
   // must be called under a write lock
   void incrementVersion() {
     ++version_;
@@ -76,6 +133,13 @@ class LRUInMemoryCache {
   folly::EvictingCacheMap<K, V> cache_;
   // Version always starts at 1
   CacheDataVersion version_{1};
+  // Keys put (true) or removed (false) since the last conversion, with the
+  // sequence number of their last change so puts are persisted in order
+  std::unordered_map<K, std::pair<uint64_t, bool>> deltaKeys_;
+  uint64_t nextDeltaSeq_{0};
+  bool trackDeltas_{false};
+  // false until a full conversion happened since tracking started
+  bool deltaValid_{false};
   // mutable so we can take read locks in const methods
   mutable MutexT cacheLock_;
 
@@ -124,6 +124,21 @@ bool LRUPersistentCache<K, V, MutexT>::syncNow(
     return true;
   }
 
+  if (persistence.supportsDelta() && !persistence.needsCompaction()) {
+    auto serializedDelta = cache_.convertDeltaToKeyValuePairs();
+    if (serializedDelta) {
+      auto persisted = persistence.persistVersionedDelta(
+        std::get<0>(serializedDelta.value()),
+        std::get<1>(serializedDelta.value()),
+        std::get<2>(serializedDelta.value()));
+      if (!persisted) {
+        // the delta is lost, fall back to persisting everything next time
+        cache_.invalidateDelta();
+      }
+      return persisted;
+    }
+  }
+
   // serialize the current contents of cache under lock
   auto serializedCacheAndVersion = cache_.convertToKeyValuePairs();
   if (!serializedCacheAndVersion) {
@@ -135,6 +150,9 @@ bool LRUPersistentCache<K, V, MutexT>::syncNow(
   auto& version = std::get<1>(serializedCacheAndVersion.value());
   auto persisted =
     persistence.persistVersionedData(std::move(kvPairs), version);
+  if (!persisted) {
+    cache_.invalidateDelta();
+  }
 
   return persisted;
 }
@@ -154,9 +172,14 @@ void LRUPersistentCache<K, V, MutexT>::setPersistenceHelper(
   persistence_ = std::move(persistence);
   // load the persistence data into memory
   if (persistence_) {
+    if (persistence_->supportsDelta()) {
+      cache_.enableDeltaTracking();
+    }
     auto version = load(*persistence_);
     if (syncVersion) {
       persistence_->setPersistedVersion(version);
+      // memory and persistence agree, deltas can start from here
+      cache_.validateDelta();
     }
   }
 }
@@ -173,6 +196,15 @@ void LRUPersistentCache<K, V, MutexT>::setPersistence(
 template<typename K, typename V, typename MutexT>
 CacheDataVersion LRUPersistentCache<K, V, MutexT>::load(
     CachePersistence<K, V>& persistence) noexcept {
+  if (persistence.supportsDirectLoad()) {
+    bool loaded = false;
+    auto version = cache_.loadDataFrom(
+      [&](const std::function<void(K&&, V&&)>& insert) {
+        loaded = persistence.loadDirect(insert);
+      });
+    return loaded ? version : false;
+  }
+
   auto kvPairs = persistence.load();
   if (!kvPairs) {
     return false;
@@ -17,6 +17,7 @@
 
 #include <chrono>
 #include <condition_variable>
+#include <functional>
 #include <future>
 #include <map>
 #include <thread>
@@ -53,6 +54,21 @@ class CachePersistence {
     return result;
   }
 
+  /**
+   * Persist the changes made to the cache since the last persisted version
+   * at the specified version.  Returns true if persistence succeeded.
+   */
+  bool persistVersionedDelta(
+      const folly::dynamic& kvPairs,
+      const folly::dynamic& removedKeys,
+      const CacheDataVersion& version) {
+    auto result = persistDelta(kvPairs, removedKeys);
+    if (result) {
+      persistedVersion_ = version;
+    }
+    return result;
+  }
+
   /**
    * Get the last version of the data that was successfully persisted.
    */
@@ -74,12 +90,56 @@ class CachePersistence {
    */
   virtual bool persist(const folly::dynamic& kvPairs) noexcept = 0;
 
+  /**
+   * Whether this persistence layer can persist deltas with persistDelta().
+   * Layers that can't are always given the full contents of the cache.
+   */
+  virtual bool supportsDelta() const noexcept {
+    return false;
+  }
+
+  /**
+   * Persist a folly::dynamic array of key value pairs that were put and
+   * a folly::dynamic array of keys that were removed since the last
+   * successful persist() or persistDelta().  Returns true on success.
+   */
+  virtual bool persistDelta(
+      const folly::dynamic& /* kvPairs */,
+      const folly::dynamic& /* removedKeys */) noexcept {
+    return false;
+  }
+
+  /**
+   * Whether the accumulated deltas should be compacted by persisting the
+   * full contents of the cache on the next sync.
+   */
+  virtual bool needsCompaction() const noexcept {
+    return false;
+  }
+
   /**
    * Returns a list of key value pairs that are present in this
    * persistence store.
    */
   virtual folly::Optional<folly::dynamic> load() noexcept = 0;
 
+  /**
+   * Whether this persistence layer can load with loadDirect(), in which
+   * case it is used instead of load().
+   */
+  virtual bool supportsDirectLoad() const noexcept {
+    return false;
+  }
+
+  /**
+   * Hands every key value pair present in this persistence store to
+   * insert, without building a folly::dynamic.  Returns true on success.
+   */
+  virtual bool loadDirect(
+      const std::function<void(K&&, V&&)>& /* insert */) noexcept {
+    return false;
+  }
+
   /**
    * Clears Persistent cache
    */
@@ -100,6 +160,12 @@ class CachePersistence {
  * The in memory structure is an EvictingCacheMap which causes this class
  * to evict entries in an LRU fashion.
  *
+ * If the persistence layer supports deltas, a sync only hands it the keys
+ * that were put or removed since the previous sync, so the cost of a sync
+ * scales with the rate of change rather than with the size of the cache.
+ * The full contents are persisted whenever the layer asks for compaction
+ * or a delta could not be persisted.
+ *
  * NOTE NOTE NOTE: Although this class aims to be a cache for arbitrary,
  * it relies heavily on folly::toJson, folly::dynamic and convertTo for
  * serialization and deserialization. So It may not suit your need until
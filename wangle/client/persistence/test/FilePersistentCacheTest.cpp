@@ -13,6 +13,7 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <folly/Conv.h>
 #include <folly/futures/Barrier.h>
 #include <wangle/client/persistence/FilePersistentCache.h>
 #include <wangle/client/persistence/SharedMutexCacheLockGuard.h>
@@ -321,3 +322,106 @@ TYPED_TEST(FilePersistentCacheTest, threadstress) {
     EXPECT_EQ(*val, i);
   }
 }
+
+TYPED_TEST(FilePersistentCacheTest, jsonLogPersistence) {
+  using CacheType = FilePersistentCache<string, string, TypeParam>;
+  string filename = getPersistentCacheFilename();
+  string logFilename = filename + ".log";
+  size_t cacheCapacity = 10;
+  {
+    CacheType cache(filename, cacheCapacity, chrono::seconds(150), 3,
+        FilePersistenceFormat::JSON_LOG);
+    cache.put("key1", "value1");
+    cache.put("key2", "value2");
+    cache.put("key3", "value3");
+  }
+  // only the changes were appended to the log, no snapshot was written
+  EXPECT_EQ(-1, access(filename.c_str(), F_OK));
+  EXPECT_EQ(0, access(logFilename.c_str(), F_OK));
+  {
+    CacheType cache(filename, cacheCapacity, chrono::seconds(150), 3,
+        FilePersistenceFormat::JSON_LOG);
+    EXPECT_EQ(cache.size(), 3);
+    EXPECT_EQ(cache.get("key1").value(), "value1");
+    EXPECT_EQ(cache.get("key2").value(), "value2");
+    EXPECT_TRUE(cache.remove("key2"));
+    cache.put("key3", "value4");
+  }
+  {
+    CacheType cache(filename, cacheCapacity, chrono::seconds(150), 3,
+        FilePersistenceFormat::JSON_LOG);
+    EXPECT_EQ(cache.size(), 2);
+    EXPECT_EQ(cache.get("key1").value(), "value1");
+    EXPECT_FALSE(cache.get("key2").hasValue());
+    EXPECT_EQ(cache.get("key3").value(), "value4");
+  }
+  EXPECT_TRUE(unlink(logFilename.c_str()) != -1);
+}
+
+TYPED_TEST(FilePersistentCacheTest, jsonLogEviction) {
+  using CacheType = FilePersistentCache<string, string, TypeParam>;
+  string filename = getPersistentCacheFilename();
+  string logFilename = filename + ".log";
+  size_t cacheCapacity = 3;
+  {
+    CacheType cache(filename, cacheCapacity, chrono::seconds(150), 3,
+        FilePersistenceFormat::JSON_LOG);
+    for (int i = 1; i <= 5; ++i) {
+      cache.put(folly::to<string>("key", i), "value");
+    }
+  }
+  {
+    CacheType cache(filename, cacheCapacity, chrono::seconds(150), 3,
+        FilePersistenceFormat::JSON_LOG);
+    // the puts were replayed in order, so key3 is the least recently used
+    EXPECT_EQ(cache.size(), 3);
+    cache.put("key6", "value"); // evicts key3
+    EXPECT_FALSE(cache.get("key3").hasValue());
+    EXPECT_TRUE(cache.get("key4").hasValue());
+    cache.put("key7", "value"); // evicts key5
+  }
+  {
+    // the evictions were logged, so the evicted puts are not replayed
+    CacheType cache(filename, cacheCapacity, chrono::seconds(150), 3,
+        FilePersistenceFormat::JSON_LOG);
+    EXPECT_EQ(cache.size(), 3);
+    EXPECT_FALSE(cache.get("key3").hasValue());
+    EXPECT_FALSE(cache.get("key5").hasValue());
+    EXPECT_TRUE(cache.get("key4").hasValue());
+    EXPECT_TRUE(cache.get("key6").hasValue());
+    EXPECT_TRUE(cache.get("key7").hasValue());
+  }
+  unlink(filename.c_str());
+  EXPECT_TRUE(unlink(logFilename.c_str()) != -1);
+}
+
+TYPED_TEST(FilePersistentCacheTest, binaryPersistence) {
+  using CacheType = FilePersistentCache<string, int, TypeParam>;
+  string filename = getPersistentCacheFilename();
+  size_t cacheCapacity = 10;
+  {
+    CacheType cache(filename, cacheCapacity, chrono::seconds(150), 3,
+        FilePersistenceFormat::BINARY);
+    cache.put("key1", 1);
+    cache.put("key2", -2);
+  }
+  {
+    CacheType cache(filename, cacheCapacity, chrono::seconds(150), 3,
+        FilePersistenceFormat::BINARY);
+    EXPECT_EQ(cache.size(), 2);
+    EXPECT_EQ(cache.get("key1").value(), 1);
+    EXPECT_EQ(cache.get("key2").value(), -2);
+  }
+
+  // flip a payload byte, the checksum should reject the file
+  string content;
+  EXPECT_TRUE(folly::readFile(filename.c_str(), content));
+  content.back() ^= 0xff;
+  EXPECT_TRUE(folly::writeFile(content, filename.c_str()));
+  {
+    CacheType cache(filename, cacheCapacity, chrono::seconds(150), 3,
+        FilePersistenceFormat::BINARY);
+    EXPECT_EQ(cache.size(), 0);
+  }
+  EXPECT_TRUE(unlink(filename.c_str()) != -1);
+}
@@ -18,6 +18,44 @@
 
 using namespace std::chrono;
 
+namespace wangle {
+
+void CacheBinarySerializer<SSLSessionCacheData>::serialize(
+    const SSLSessionCacheData& data, std::string& out) {
+  CacheBinarySerializer<uint32_t>::serialize(
+    static_cast<uint32_t>(data.sessionData.size()), out);
+  out.append(data.sessionData.data(), data.sessionData.size());
+  system_clock::duration::rep rep = data.addedTime.time_since_epoch().count();
+  CacheBinarySerializer<uint64_t>::serialize(static_cast<uint64_t>(rep), out);
+  out.append(data.serviceIdentity.data(), data.serviceIdentity.size());
+}
+
+SSLSessionCacheData CacheBinarySerializer<SSLSessionCacheData>::deserialize(
+    folly::StringPiece bytes) {
+  SSLSessionCacheData data;
+  if (bytes.size() < sizeof(uint32_t)) {
+    throw std::out_of_range("Truncated SSL session cache data");
+  }
+  auto sessionLength = CacheBinarySerializer<uint32_t>::deserialize(
+    bytes.subpiece(0, sizeof(uint32_t)));
+  bytes.advance(sizeof(uint32_t));
+  if (bytes.size() < sessionLength + sizeof(uint64_t)) {
+    throw std::out_of_range("Truncated SSL session cache data");
+  }
+  data.sessionData = CacheBinarySerializer<folly::fbstring>::deserialize(
+    bytes.subpiece(0, sessionLength));
+  bytes.advance(sessionLength);
+  auto rep = CacheBinarySerializer<uint64_t>::deserialize(
+    bytes.subpiece(0, sizeof(uint64_t)));
+  bytes.advance(sizeof(uint64_t));
+  data.addedTime = system_clock::time_point(system_clock::duration(rep));
+  data.serviceIdentity =
+    CacheBinarySerializer<folly::fbstring>::deserialize(bytes);
+  return data;
+}
+
+} // wangle
+
 namespace folly {
 
 template<>
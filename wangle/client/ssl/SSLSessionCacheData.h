@@ -20,6 +20,7 @@
 
 #include <folly/DynamicConverter.h>
 #include <folly/FBString.h>
+#include <wangle/client/persistence/CacheBinarySerializer.h>
 #include <wangle/client/ssl/SSLSession.h>
 
 namespace wangle {
@@ -31,6 +32,14 @@ struct SSLSessionCacheData {
   std::shared_ptr<SSL_SESSION> sessionDuplicateTemplate;
 };
 
+// Binary form for persistent caches: the length prefixed session data,
+// the added time and the service identity.
+template<>
+struct CacheBinarySerializer<SSLSessionCacheData> {
+  static void serialize(const SSLSessionCacheData& data, std::string& out);
+  static SSLSessionCacheData deserialize(folly::StringPiece bytes);
+};
+
 } //proxygen
 
 namespace folly {
@@ -34,10 +34,11 @@ template<typename K>
 SSLSessionPersistentCacheBase<K>::SSLSessionPersistentCacheBase(
   const std::string& filename,
   const std::size_t cacheCapacity,
-  const std::chrono::seconds& syncInterval) :
+  const std::chrono::seconds& syncInterval,
+  const FilePersistenceFormat format) :
     SSLSessionPersistentCacheBase(
       std::make_shared<FilePersistentCache<K, SSLSessionCacheData>>(
-        filename, cacheCapacity, syncInterval)) {}
+        filename, cacheCapacity, syncInterval, 3, format)) {}
 
 template<typename K>
 void SSLSessionPersistentCacheBase<K>::setSSLSession(
@@ -16,6 +16,7 @@
 #pragma once
 
 #include <folly/Memory.h>
+#include <wangle/client/persistence/FilePersistentCache.h>
 #include <wangle/client/persistence/PersistentCache.h>
 #include <wangle/client/ssl/SSLSessionCacheData.h>
 #include <wangle/client/ssl/SSLSession.h>
@@ -52,7 +53,8 @@ class SSLSessionPersistentCacheBase: public SSLSessionCallbacks {
   explicit SSLSessionPersistentCacheBase(
     const std::string& filename,
     const std::size_t cacheCapacity,
-    const std::chrono::seconds& syncInterval);
+    const std::chrono::seconds& syncInterval,
+    const FilePersistenceFormat format = FilePersistenceFormat::JSON);
 
   // Store the session data of the specified identity in cache. Note that the
   // implementation must make it's own memory copy of the session data to put
@@ -98,9 +100,10 @@ class SSLSessionPersistentCache :
   SSLSessionPersistentCache(
     const std::string& filename,
     const std::size_t cacheCapacity,
-    const std::chrono::seconds& syncInterval) :
+    const std::chrono::seconds& syncInterval,
+    const FilePersistenceFormat format = FilePersistenceFormat::JSON) :
       SSLSessionPersistentCacheBase(
-        filename, cacheCapacity, syncInterval) {}
+        filename, cacheCapacity, syncInterval, format) {}
 
  protected:
   std::string getKey(const std::string& identity) const override {
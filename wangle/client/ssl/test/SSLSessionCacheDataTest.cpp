@@ -62,6 +62,27 @@ TEST_F(SSLSessionCacheDataTest, Basic) {
   EXPECT_EQ(deserializedData.serviceIdentity, data.serviceIdentity);
 }
 
+TEST_F(SSLSessionCacheDataTest, Binary) {
+  SSLSessionCacheData data;
+  data.sessionData = folly::fbstring("some session data");
+  data.addedTime = system_clock::now();
+  data.serviceIdentity = "some service";
+
+  std::string bytes;
+  CacheBinarySerializer<SSLSessionCacheData>::serialize(data, bytes);
+  auto deserializedData =
+    CacheBinarySerializer<SSLSessionCacheData>::deserialize(bytes);
+
+  EXPECT_EQ(deserializedData.sessionData, data.sessionData);
+  EXPECT_EQ(deserializedData.addedTime, data.addedTime);
+  EXPECT_EQ(deserializedData.serviceIdentity, data.serviceIdentity);
+
+  EXPECT_THROW(
+    CacheBinarySerializer<SSLSessionCacheData>::deserialize(
+      folly::StringPiece(bytes).subpiece(0, 10)),
+    std::out_of_range);
+}
+
 TEST_F(SSLSessionCacheDataTest, CloneSSLSession) {
   for (auto& it : sessions_) {
     auto sess = SSLSessionPtr(cloneSSLSession(it.first));
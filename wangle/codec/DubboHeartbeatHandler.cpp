@@ -0,0 +1,109 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <wangle/codec/DubboHeartbeatHandler.h>
+
+#include <folly/io/async/AsyncSocketException.h>
+#include <folly/io/async/EventBase.h>
+
+namespace wangle {
+
+using namespace std::chrono;
+
+constexpr int64_t DubboHeartbeatHandler::kFirstHeartbeatId;
+
+void DubboHeartbeatHandler::read(Context* ctx,
+                                 std::unique_ptr<folly::IOBuf> frame) {
+  lastRead_ = steady_clock::now();
+
+  DubboHeader header;
+  folly::io::Cursor c(frame.get());
+  if (frame->computeChainDataLength() < kDubboHeaderLength ||
+      !readDubboHeader(c, header) || !header.isEvent()) {
+    // Not ours to judge
+    ctx->fireRead(std::move(frame));
+    return;
+  }
+
+  if (header.isRequest() && header.isTwoWay()) {
+    ctx->fireWrite(makeDubboHeartbeat(header.id, false, header.serialization()));
+  }
+}
+
+void DubboHeartbeatHandler::transportActive(Context* ctx) {
+  auto transport = ctx->getTransport();
+  if (transport && !isScheduled()) {
+    ctx_ = ctx;
+    evb_ = transport->getEventBase();
+    lastRead_ = steady_clock::now();
+    schedule(interval_);
+  }
+  ctx->fireTransportActive();
+}
+
+void DubboHeartbeatHandler::transportInactive(Context* ctx) {
+  stop();
+  ctx->fireTransportInactive();
+}
+
+void DubboHeartbeatHandler::readEOF(Context* ctx) {
+  stop();
+  ctx->fireReadEOF();
+}
+
+folly::Future<folly::Unit> DubboHeartbeatHandler::close(Context* ctx) {
+  stop();
+  return ctx->fireClose();
+}
+
+void DubboHeartbeatHandler::timeoutExpired() noexcept {
+  auto idle = duration_cast<milliseconds>(steady_clock::now() - lastRead_);
+  if (idle >= interval_ * maxMissed_) {
+    auto ctx = ctx_;
+    // The handlers told about it may well drop the pipeline
+    auto guard = ctx->getPipelineShared();
+    stop();
+    VLOG(2) << "Nothing read from Dubbo peer for " << idle.count()
+            << "ms, closing connection";
+    ctx->fireReadException(
+      folly::make_exception_wrapper<folly::AsyncSocketException>(
+        folly::AsyncSocketException::TIMED_OUT,
+        "Dubbo heartbeat timed out"));
+    ctx->fireClose();
+    return;
+  }
+
+  if (idle < interval_) {
+    // Something was read since the last check; wake up when it goes idle
+    schedule(interval_ - idle);
+    return;
+  }
+
+  ctx_->fireWrite(makeDubboHeartbeat(nextId_++, true, serialization_));
+  heartbeatsSent_++;
+  schedule(interval_);
+}
+
+void DubboHeartbeatHandler::schedule(milliseconds timeout) {
+  evb_->timer().scheduleTimeout(this, timeout);
+}
+
+void DubboHeartbeatHandler::stop() {
+  cancelTimeout();
+  ctx_ = nullptr;
+  evb_ = nullptr;
+}
+
+} // namespace wangle
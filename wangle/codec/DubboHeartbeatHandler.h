@@ -0,0 +1,93 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+
+#include <folly/io/async/HHWheelTimer.h>
+#include <wangle/channel/Handler.h>
+#include <wangle/codec/DubboProtocol.h>
+
+namespace wangle {
+
+/**
+ * Keeps a framed Dubbo connection honest: sits behind a frame decoder and
+ * sends a heartbeat event frame whenever nothing has been read for
+ * interval, and gives up on the connection once nothing has been read for
+ * interval * maxMissed. Only read-idle connections are probed; a
+ * connection that is answering requests needs no heartbeat, while one that
+ * is only being written to proves nothing about its peer.
+ *
+ * The checks run off the EventBase's HHWheelTimer, so an idle connection
+ * costs one timer slot. On a dead connection the handler fires a read
+ * exception with a TIMED_OUT AsyncSocketException and then closes the
+ * pipeline, so the handlers above can fail whatever they had in flight.
+ *
+ * Heartbeat requests from the peer are answered here; heartbeat responses
+ * and other events are consumed. All other frames are passed on untouched.
+ *
+ * The handler holds a timer callback that points back at itself, so add it
+ * to the pipeline by shared_ptr rather than by value.
+ */
+class DubboHeartbeatHandler : public HandlerAdapter<std::unique_ptr<folly::IOBuf>>,
+                              private folly::HHWheelTimer::Callback {
+ public:
+  explicit DubboHeartbeatHandler(
+      std::chrono::milliseconds interval,
+      uint32_t maxMissed = 3,
+      uint8_t serialization = kDubboSerializationHessian2)
+      : interval_(interval),
+        maxMissed_(std::max<uint32_t>(maxMissed, 1)),
+        serialization_(serialization) {}
+
+  DubboHeartbeatHandler(const DubboHeartbeatHandler&) = delete;
+  DubboHeartbeatHandler& operator=(const DubboHeartbeatHandler&) = delete;
+
+  void read(Context* ctx, std::unique_ptr<folly::IOBuf> frame) override;
+
+  void transportActive(Context* ctx) override;
+  void transportInactive(Context* ctx) override;
+  void readEOF(Context* ctx) override;
+  folly::Future<folly::Unit> close(Context* ctx) override;
+
+  uint64_t getHeartbeatsSent() const {
+    return heartbeatsSent_;
+  }
+
+ private:
+  // HHWheelTimer::Callback
+  void timeoutExpired() noexcept override;
+  void callbackCanceled() noexcept override {}
+
+  void schedule(std::chrono::milliseconds timeout);
+  void stop();
+
+  // Ids of our heartbeats, well clear of the ids a client hands out
+  static constexpr int64_t kFirstHeartbeatId = int64_t(1) << 62;
+
+  const std::chrono::milliseconds interval_;
+  const uint32_t maxMissed_;
+  const uint8_t serialization_;
+
+  Context* ctx_{nullptr};
+  folly::EventBase* evb_{nullptr};
+  std::chrono::steady_clock::time_point lastRead_;
+  int64_t nextId_{kFirstHeartbeatId};
+  uint64_t heartbeatsSent_{0};
+};
+
+} // namespace wangle
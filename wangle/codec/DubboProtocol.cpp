@@ -0,0 +1,101 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <wangle/codec/DubboProtocol.h>
+
+#include <folly/io/IOBufQueue.h>
+#include <folly/json.h>
+#include <wangle/codec/Hessian2Encoder.h>
+
+namespace wangle {
+
+void setDubboRequestId(std::unique_ptr<folly::IOBuf>& frame, int64_t id) {
+  constexpr size_t kIdOffset = 4;
+  if (frame->length() >= kDubboHeaderLength && !frame->isSharedOne()) {
+    folly::io::RWPrivateCursor c(frame.get());
+    c.skip(kIdOffset);
+    c.writeBE<int64_t>(id);
+    return;
+  }
+
+  folly::IOBufQueue queue(folly::IOBufQueue::cacheChainLength());
+  queue.append(std::move(frame));
+  auto header = folly::IOBuf::create(kDubboHeaderLength);
+  header->append(kDubboHeaderLength);
+  folly::io::Cursor(queue.front()).pull(header->writableData(),
+                                        kDubboHeaderLength);
+  queue.trimStart(kDubboHeaderLength);
+  folly::io::RWPrivateCursor c(header.get());
+  c.skip(kIdOffset);
+  c.writeBE<int64_t>(id);
+  if (auto body = queue.move()) {
+    header->prependChain(std::move(body));
+  }
+  frame = std::move(header);
+}
+
+std::unique_ptr<folly::IOBuf> makeDubboHeartbeat(int64_t id,
+                                                 bool request,
+                                                 uint8_t serialization) {
+  // null in the frame's serialization
+  folly::StringPiece body = serialization == kDubboSerializationHessian2 ?
+    folly::StringPiece("N") : folly::StringPiece("null\n");
+
+  DubboHeader header;
+  header.flags = kDubboFlagEvent | (serialization & kDubboSerializationMask);
+  if (request) {
+    header.flags |= kDubboFlagRequest | kDubboFlagTwoWay;
+  } else {
+    header.status = static_cast<uint8_t>(DubboStatus::OK);
+  }
+  header.id = id;
+  header.bodyLength = body.size();
+
+  auto buf = folly::IOBuf::create(kDubboHeaderLength + body.size());
+  buf->append(kDubboHeaderLength + body.size());
+  folly::io::RWPrivateCursor c(buf.get());
+  writeDubboHeader(c, header);
+  c.push(reinterpret_cast<const uint8_t*>(body.data()), body.size());
+  return buf;
+}
+
+std::unique_ptr<folly::IOBuf> makeDubboErrorResponse(
+    int64_t id,
+    uint8_t serialization,
+    DubboStatus status,
+    folly::StringPiece message) {
+  folly::IOBufQueue queue(folly::IOBufQueue::cacheChainLength());
+  auto head = folly::IOBuf::create(kDubboHeaderLength + message.size() + 16);
+  head->append(kDubboHeaderLength);
+  queue.append(std::move(head));
+  if (serialization == kDubboSerializationHessian2) {
+    Hessian2Encoder encoder(&queue);
+    encoder.writeString(message);
+  } else {
+    queue.append(folly::toJson(message.str()) + "\n");
+  }
+
+  DubboHeader header;
+  header.flags = serialization & kDubboSerializationMask;
+  header.status = static_cast<uint8_t>(status);
+  header.id = id;
+  header.bodyLength = queue.chainLength() - kDubboHeaderLength;
+  auto buf = queue.move();
+  folly::io::RWPrivateCursor c(buf.get());
+  writeDubboHeader(c, header);
+  return buf;
+}
+
+} // namespace wangle
@@ -0,0 +1,137 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <folly/Range.h>
+#include <folly/io/Cursor.h>
+#include <folly/io/IOBuf.h>
+
+namespace wangle {
+
+/**
+ * Wire constants of the Dubbo exchange protocol. Every frame starts with a
+ * 16 byte header:
+ *
+ * +-------+-------+--------+------------+-------------+
+ * | magic | flags | status | request id | body length |
+ * |  2B   |  1B   |   1B   |  8B (BE)   |   4B (BE)   |
+ * +-------+-------+--------+------------+-------------+
+ *
+ * flags carries the request, two-way and event bits plus the serialization
+ * id in its low five bits. status is only meaningful in responses.
+ */
+constexpr uint16_t kDubboMagic = 0xdabb;
+constexpr size_t kDubboHeaderLength = 16;
+constexpr size_t kDubboLengthFieldOffset = 12;
+// Dubbo's default payload limit
+constexpr uint32_t kDubboDefaultMaxBodyLength = 8 * 1024 * 1024;
+
+constexpr uint8_t kDubboFlagRequest = 0x80;
+constexpr uint8_t kDubboFlagTwoWay = 0x40;
+constexpr uint8_t kDubboFlagEvent = 0x20;
+constexpr uint8_t kDubboSerializationMask = 0x1f;
+
+constexpr uint8_t kDubboSerializationHessian2 = 2;
+constexpr uint8_t kDubboSerializationFastjson = 6;
+
+constexpr char kDubboVersion[] = "2.0.1";
+
+enum class DubboStatus : uint8_t {
+  OK = 20,
+  CLIENT_TIMEOUT = 30,
+  SERVER_TIMEOUT = 31,
+  BAD_REQUEST = 40,
+  BAD_RESPONSE = 50,
+  SERVICE_NOT_FOUND = 60,
+  SERVICE_ERROR = 70,
+  SERVER_ERROR = 80,
+  CLIENT_ERROR = 90,
+  SERVER_THREADPOOL_EXHAUSTED_ERROR = 100,
+};
+
+struct DubboHeader {
+  uint8_t flags{0};
+  uint8_t status{0};
+  int64_t id{0};
+  uint32_t bodyLength{0};
+
+  bool isRequest() const {
+    return flags & kDubboFlagRequest;
+  }
+
+  bool isTwoWay() const {
+    return flags & kDubboFlagTwoWay;
+  }
+
+  bool isEvent() const {
+    return flags & kDubboFlagEvent;
+  }
+
+  uint8_t serialization() const {
+    return flags & kDubboSerializationMask;
+  }
+};
+
+inline void writeDubboHeader(folly::io::RWPrivateCursor& c,
+                             const DubboHeader& header) {
+  c.writeBE<uint16_t>(kDubboMagic);
+  c.write<uint8_t>(header.flags);
+  c.write<uint8_t>(header.status);
+  c.writeBE<int64_t>(header.id);
+  c.writeBE<uint32_t>(header.bodyLength);
+}
+
+/**
+ * Read a header from c. Returns false if the magic does not match, in
+ * which case the rest of the header is left unread.
+ */
+inline bool readDubboHeader(folly::io::Cursor& c, DubboHeader& header) {
+  if (c.readBE<uint16_t>() != kDubboMagic) {
+    return false;
+  }
+  header.flags = c.read<uint8_t>();
+  header.status = c.read<uint8_t>();
+  header.id = c.readBE<int64_t>();
+  header.bodyLength = c.readBE<uint32_t>();
+  return true;
+}
+
+/**
+ * Replace the request id in the header of frame. Written in place when the
+ * header is in a buffer of its own; otherwise a fresh copy of the header
+ * is put in front, so buffers shared with other frames are left alone.
+ */
+void setDubboRequestId(std::unique_ptr<folly::IOBuf>& frame, int64_t id);
+
+/**
+ * Encode a heartbeat event frame with a null body. Requests are two-way,
+ * responses carry an OK status.
+ */
+std::unique_ptr<folly::IOBuf> makeDubboHeartbeat(int64_t id,
+                                                 bool request,
+                                                 uint8_t serialization);
+
+/**
+ * Encode a response to request id that carries an error status, with
+ * message as its body in the given serialization.
+ */
+std::unique_ptr<folly::IOBuf> makeDubboErrorResponse(
+    int64_t id,
+    uint8_t serialization,
+    DubboStatus status,
+    folly::StringPiece message);
+
+} // namespace wangle
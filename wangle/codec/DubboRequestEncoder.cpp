@@ -0,0 +1,241 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <wangle/codec/DubboRequestEncoder.h>
+
+#include <folly/io/IOBufQueue.h>
+#include <glog/logging.h>
+#include <wangle/codec/Hessian2Encoder.h>
+
+#include <limits>
+#include <stdexcept>
+
+using folly::IOBuf;
+using folly::StringPiece;
+using folly::io::RWPrivateCursor;
+
+namespace wangle {
+
+namespace {
+
+const StringPiece kNull{"null"};
+const StringPiece kAttachmentStart{"{\"path\":"};
+const StringPiece kAttachmentEnd{"}\n"};
+
+inline bool needsEscape(char c) {
+  return c == '"' || c == '\\' || static_cast<unsigned char>(c) < 0x20;
+}
+
+// Length of s as the contents of a JSON string
+size_t escapedLength(StringPiece s) {
+  size_t len = s.size();
+  for (char c : s) {
+    if (needsEscape(c)) {
+      len += (c == '"' || c == '\\') ? 1 : 5;
+    }
+  }
+  return len;
+}
+
+// Length of s as a quoted JSON string on its own line
+inline size_t quotedLineLength(StringPiece s) {
+  return escapedLength(s) + 3;
+}
+
+inline void writeRaw(RWPrivateCursor& c, StringPiece s) {
+  c.push(reinterpret_cast<const uint8_t*>(s.data()), s.size());
+}
+
+void writeEscaped(RWPrivateCursor& c, StringPiece s) {
+  static const char kHex[] = "0123456789abcdef";
+  const char* run = s.begin();
+  for (const char* p = s.begin(); p != s.end(); ++p) {
+    if (!needsEscape(*p)) {
+      continue;
+    }
+    writeRaw(c, StringPiece(run, p));
+    run = p + 1;
+    c.write<char>('\\');
+    if (*p == '"' || *p == '\\') {
+      c.write<char>(*p);
+    } else {
+      c.write<char>('u');
+      c.write<char>('0');
+      c.write<char>('0');
+      c.write<char>(kHex[(*p >> 4) & 0xf]);
+      c.write<char>(kHex[*p & 0xf]);
+    }
+  }
+  writeRaw(c, StringPiece(run, s.end()));
+}
+
+void writeQuotedLine(RWPrivateCursor& c, StringPiece s) {
+  c.write<char>('"');
+  writeEscaped(c, s);
+  c.write<char>('"');
+  c.write<char>('\n');
+}
+
+// Everything before the argument, up to its opening quote
+size_t prefixLength(const DubboInvocation& invocation) {
+  return quotedLineLength(kDubboVersion) +
+    quotedLineLength(invocation.interfaceName) +
+    (invocation.serviceVersion.empty() ?
+       kNull.size() + 1 : quotedLineLength(invocation.serviceVersion)) +
+    quotedLineLength(invocation.method) +
+    quotedLineLength(invocation.parameterTypes) + 1;
+}
+
+// Everything after the argument, from its closing quote
+size_t suffixLength(const DubboInvocation& invocation) {
+  return 2 + kAttachmentStart.size() +
+    escapedLength(invocation.interfaceName) + 2 + kAttachmentEnd.size();
+}
+
+void writeRequestHeader(RWPrivateCursor& c,
+                        uint8_t serialization,
+                        int64_t id,
+                        uint32_t bodyLength) {
+  DubboHeader header;
+  header.flags = kDubboFlagRequest | kDubboFlagTwoWay | serialization;
+  header.id = id;
+  header.bodyLength = bodyLength;
+  writeDubboHeader(c, header);
+}
+
+void writePrefix(RWPrivateCursor& c,
+                 int64_t id,
+                 uint32_t bodyLength,
+                 const DubboInvocation& invocation) {
+  writeRequestHeader(c, kDubboSerializationFastjson, id, bodyLength);
+
+  writeQuotedLine(c, kDubboVersion);
+  writeQuotedLine(c, invocation.interfaceName);
+  if (invocation.serviceVersion.empty()) {
+    writeRaw(c, kNull);
+    c.write<char>('\n');
+  } else {
+    writeQuotedLine(c, invocation.serviceVersion);
+  }
+  writeQuotedLine(c, invocation.method);
+  writeQuotedLine(c, invocation.parameterTypes);
+  c.write<char>('"');
+}
+
+void writeSuffix(RWPrivateCursor& c, const DubboInvocation& invocation) {
+  c.write<char>('"');
+  c.write<char>('\n');
+  writeRaw(c, kAttachmentStart);
+  c.write<char>('"');
+  writeEscaped(c, invocation.interfaceName);
+  c.write<char>('"');
+  writeRaw(c, kAttachmentEnd);
+}
+
+uint32_t checkBodyLength(size_t bodyLength) {
+  if (bodyLength > size_t(std::numeric_limits<int32_t>::max())) {
+    throw std::runtime_error("Dubbo request body too large");
+  }
+  return bodyLength;
+}
+
+}
+
+size_t DubboRequestEncoder::bodyLength(const DubboInvocation& invocation) {
+  return prefixLength(invocation) + escapedLength(invocation.argument) +
+    suffixLength(invocation);
+}
+
+std::unique_ptr<IOBuf> DubboRequestEncoder::encode(
+    int64_t id,
+    const DubboInvocation& invocation) {
+  auto bodyLen = checkBodyLength(bodyLength(invocation));
+  auto buf = IOBuf::create(kDubboHeaderLength + bodyLen);
+  buf->append(kDubboHeaderLength + bodyLen);
+
+  RWPrivateCursor c(buf.get());
+  writePrefix(c, id, bodyLen, invocation);
+  writeEscaped(c, invocation.argument);
+  writeSuffix(c, invocation);
+  DCHECK(c.isAtEnd());
+  return buf;
+}
+
+std::unique_ptr<IOBuf> DubboRequestEncoder::encodeScatter(
+    int64_t id,
+    const DubboInvocation& invocation) {
+  const auto& argument = invocation.argument;
+  if (argument.empty() || escapedLength(argument) != argument.size()) {
+    return encode(id, invocation);
+  }
+
+  size_t prefixLen = kDubboHeaderLength + prefixLength(invocation);
+  size_t suffixLen = suffixLength(invocation);
+  auto bodyLen = checkBodyLength(
+    prefixLen - kDubboHeaderLength + argument.size() + suffixLen);
+
+  auto buf = IOBuf::create(prefixLen + suffixLen);
+  buf->append(prefixLen + suffixLen);
+  RWPrivateCursor c(buf.get());
+  writePrefix(c, id, bodyLen, invocation);
+  writeSuffix(c, invocation);
+  DCHECK(c.isAtEnd());
+
+  // The suffix shares the prefix's buffer
+  auto suffix = buf->cloneOne();
+  buf->trimEnd(suffixLen);
+  suffix->trimStart(prefixLen);
+  buf->prependChain(IOBuf::wrapBuffer(argument.data(), argument.size()));
+  buf->prependChain(std::move(suffix));
+  return buf;
+}
+
+std::unique_ptr<IOBuf> DubboRequestEncoder::encodeHessian2(
+    int64_t id,
+    const DubboInvocation& invocation) {
+  // Strings take at most a few bytes more than their UTF-8
+  size_t estimate = kDubboHeaderLength + 64 +
+    2 * invocation.interfaceName.size() + invocation.method.size() +
+    invocation.parameterTypes.size() + invocation.argument.size() +
+    invocation.serviceVersion.size();
+  auto head = IOBuf::create(estimate);
+  head->append(kDubboHeaderLength);
+  folly::IOBufQueue queue(folly::IOBufQueue::cacheChainLength());
+  queue.append(std::move(head));
+
+  Hessian2Encoder encoder(&queue);
+  encoder.writeString(kDubboVersion);
+  encoder.writeString(invocation.interfaceName);
+  if (invocation.serviceVersion.empty()) {
+    encoder.writeNull();
+  } else {
+    encoder.writeString(invocation.serviceVersion);
+  }
+  encoder.writeString(invocation.method);
+  encoder.writeString(invocation.parameterTypes);
+  encoder.writeString(invocation.argument);
+  encoder.writeMapBegin();
+  encoder.writeString("path");
+  encoder.writeString(invocation.interfaceName);
+  encoder.writeMapEnd();
+
+  auto bodyLen = checkBodyLength(queue.chainLength() - kDubboHeaderLength);
+  auto buf = queue.move();
+  RWPrivateCursor c(buf.get());
+  writeRequestHeader(c, kDubboSerializationHessian2, id, bodyLen);
+  return buf;
+}
+
+} // namespace wangle
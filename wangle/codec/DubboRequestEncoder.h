@@ -0,0 +1,91 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <folly/Range.h>
+#include <folly/io/IOBuf.h>
+#include <wangle/codec/DubboProtocol.h>
+
+namespace wangle {
+
+/**
+ * One call to a Dubbo service. The fields only reference their bytes, so
+ * an invocation is cheap to build from whatever the caller already holds.
+ */
+struct DubboInvocation {
+  folly::StringPiece interfaceName;
+  folly::StringPiece method;
+  // JVM type descriptors, e.g. "Ljava/lang/String;"
+  folly::StringPiece parameterTypes;
+  // The string argument of the call
+  folly::StringPiece argument;
+  // Sent as null when empty
+  folly::StringPiece serviceVersion;
+};
+
+/**
+ * Encodes two-way Dubbo requests. The default is the fastjson
+ * serialization, where
+ * the body is one JSON value per line:
+ *
+ *   "2.0.1"
+ *   "<interface>"
+ *   null
+ *   "<method>"
+ *   "<parameter types>"
+ *   "<argument>"
+ *   {"path":"<interface>"}
+ *
+ * The body length is computed up front, so header and body are written
+ * with a single allocation and no intermediate strings.
+ */
+class DubboRequestEncoder {
+ public:
+  /**
+   * Length of the body encode() writes for invocation
+   */
+  static size_t bodyLength(const DubboInvocation& invocation);
+
+  /**
+   * Encode the whole frame into one contiguous IOBuf
+   */
+  static std::unique_ptr<folly::IOBuf> encode(
+      int64_t id,
+      const DubboInvocation& invocation);
+
+  /**
+   * Like encode(), but the argument bytes are referenced rather than
+   * copied: the frame is a chain of the encoded prefix, the caller's
+   * argument and the encoded suffix, with prefix and suffix sharing one
+   * allocation. The argument must stay alive and unchanged until the
+   * write of the frame has completed. Arguments that need JSON escaping
+   * are copied as in encode().
+   */
+  static std::unique_ptr<folly::IOBuf> encodeScatter(
+      int64_t id,
+      const DubboInvocation& invocation);
+
+  /**
+   * Encode the frame with the Hessian2 serialization, the default of Dubbo
+   * providers, instead of fastjson. The body holds the same fields as
+   * Hessian2 values, with the attachments as an untyped map.
+   */
+  static std::unique_ptr<folly::IOBuf> encodeHessian2(
+      int64_t id,
+      const DubboInvocation& invocation);
+};
+
+} // namespace wangle
@@ -0,0 +1,186 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <wangle/codec/DubboResponseDecoder.h>
+
+#include <folly/Conv.h>
+#include <glog/logging.h>
+
+#include <algorithm>
+
+using folly::IOBuf;
+using folly::IOBufQueue;
+
+namespace wangle {
+
+namespace {
+
+// How much of an error payload ends up in the exception message
+constexpr size_t kMaxMessageLength = 256;
+
+std::unique_ptr<IOBuf> split(IOBufQueue& q, size_t length) {
+  return length ? q.split(length) : IOBuf::create(0);
+}
+
+std::string describe(const IOBuf& payload) {
+  std::string str;
+  for (const auto& range : payload) {
+    str.append(reinterpret_cast<const char*>(range.data()),
+               std::min(range.size(), kMaxMessageLength - str.size()));
+    if (str.size() == kMaxMessageLength) {
+      break;
+    }
+  }
+  return str;
+}
+
+}
+
+void DubboResponseDecoder::read(Context* ctx, IOBufQueue& q) {
+  while (decode(ctx, q) == DecodeResult::DECODED) {
+  }
+}
+
+DubboResponseDecoder::DecodeResult
+DubboResponseDecoder::decode(Context* ctx, IOBufQueue& q) {
+  if (q.chainLength() < kDubboHeaderLength) {
+    return DecodeResult::NEED_MORE;
+  }
+
+  DubboHeader header;
+  folly::io::Cursor c(q.front());
+  if (!readDubboHeader(c, header)) {
+    q.move();
+    ctx->fireReadException(folly::make_exception_wrapper<std::runtime_error>(
+      "Bad Dubbo magic"));
+    return DecodeResult::BAD_FRAME;
+  }
+  if (header.bodyLength > maxBodyLength_) {
+    q.move();
+    ctx->fireReadException(folly::make_exception_wrapper<std::runtime_error>(
+      folly::to<std::string>("Dubbo frame body larger than ", maxBodyLength_)));
+    return DecodeResult::BAD_FRAME;
+  }
+  if (q.chainLength() < kDubboHeaderLength + header.bodyLength) {
+    return DecodeResult::NEED_MORE;
+  }
+  q.trimStart(kDubboHeaderLength);
+
+  if (header.isEvent() || header.isRequest()) {
+    if (header.isEvent()) {
+      handleEvent(ctx, header);
+    } else {
+      VLOG(2) << "Dropping Dubbo request " << header.id
+              << " received on a client connection";
+    }
+    q.trimStart(header.bodyLength);
+    return DecodeResult::DECODED;
+  }
+
+  DubboResponse response;
+  response.id = header.id;
+  response.status = static_cast<DubboStatus>(header.status);
+  response.serialization = header.serialization();
+  readResult(q, header, response);
+  ctx->fireRead(std::move(response));
+  return DecodeResult::DECODED;
+}
+
+void DubboResponseDecoder::handleEvent(Context* ctx,
+                                       const DubboHeader& header) {
+  if (header.isRequest() && header.isTwoWay()) {
+    VLOG(4) << "Answering Dubbo heartbeat " << header.id;
+    ctx->fireWrite(
+      makeDubboHeartbeat(header.id, false, header.serialization()));
+  }
+}
+
+void DubboResponseDecoder::readResult(IOBufQueue& q,
+                                      const DubboHeader& header,
+                                      DubboResponse& response) {
+  size_t length = header.bodyLength;
+  if (response.status != DubboStatus::OK) {
+    response.payload = split(q, length);
+    response.exception = folly::make_exception_wrapper<DubboException>(
+      header.id,
+      response.status,
+      folly::to<std::string>("Dubbo request ", header.id,
+                             " failed with status ", int(header.status), ": ",
+                             describe(*response.payload)));
+    return;
+  }
+
+  // The body starts with the kind of result: 0 exception, 1 value,
+  // 2 null, and 3 to 5 the same with attachments after the value
+  int type = -1;
+  size_t prefix = 0;
+  size_t suffix = 0;
+  folly::io::Cursor c(q.front());
+  switch (header.serialization()) {
+    case kDubboSerializationFastjson:
+      // One digit on its own line, and a newline after the value
+      if (length >= 2) {
+        char digit = c.read<char>();
+        if (c.read<char>() == '\n' && digit >= '0' && digit <= '9') {
+          type = digit - '0';
+          prefix = 2;
+        }
+      }
+      if (length > prefix) {
+        folly::io::Cursor end(q.front());
+        end.skip(length - 1);
+        suffix = end.read<char>() == '\n' ? 1 : 0;
+      }
+      break;
+    case kDubboSerializationHessian2:
+      // A compact int
+      if (length >= 1) {
+        uint8_t byte = c.read<uint8_t>();
+        if (byte >= 0x90 && byte <= 0xbf) {
+          type = byte - 0x90;
+          prefix = 1;
+        }
+      }
+      break;
+  }
+
+  switch (type) {
+    case 0:
+    case 3:
+      response.resultType = DubboResultType::EXCEPTION;
+      break;
+    case 2:
+    case 5:
+      response.resultType = DubboResultType::NULL_VALUE;
+      break;
+    default:
+      response.resultType = DubboResultType::VALUE;
+      break;
+  }
+
+  q.trimStart(prefix);
+  response.payload = split(q, length - prefix - suffix);
+  q.trimStart(suffix);
+
+  if (response.resultType == DubboResultType::EXCEPTION) {
+    response.exception = folly::make_exception_wrapper<DubboException>(
+      header.id,
+      response.status,
+      folly::to<std::string>("Dubbo request ", header.id, " threw: ",
+                             describe(*response.payload)));
+  }
+}
+
+} // namespace wangle
@@ -0,0 +1,119 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <folly/ExceptionWrapper.h>
+#include <folly/io/IOBufQueue.h>
+#include <wangle/channel/Handler.h>
+#include <wangle/codec/DubboProtocol.h>
+
+namespace wangle {
+
+/**
+ * Thrown for responses that carry an error status, or whose service call
+ * threw.
+ */
+class DubboException : public std::runtime_error {
+ public:
+  DubboException(int64_t id, DubboStatus status, const std::string& what)
+      : std::runtime_error(what), id_(id), status_(status) {}
+
+  int64_t getId() const {
+    return id_;
+  }
+
+  DubboStatus getStatus() const {
+    return status_;
+  }
+
+ private:
+  int64_t id_;
+  DubboStatus status_;
+};
+
+enum class DubboResultType {
+  VALUE,
+  NULL_VALUE,
+  EXCEPTION,
+};
+
+struct DubboResponse {
+  int64_t id{0};
+  DubboStatus status{DubboStatus::OK};
+  uint8_t serialization{0};
+  DubboResultType resultType{DubboResultType::VALUE};
+  // The serialized result without its type prefix, or the error message if
+  // status is not OK. Shares the buffers it was read into.
+  std::unique_ptr<folly::IOBuf> payload;
+  // Set if status is not OK or the service threw
+  folly::exception_wrapper exception;
+};
+
+/**
+ * Splits the byte stream of a Dubbo client connection into responses, so
+ * no frame decoder is needed in front of it. Headers are read with a
+ * Cursor wherever the frame boundaries fall, and the payload is handed on
+ * as a slice of the buffers it arrived in.
+ *
+ * Heartbeat requests from the provider are answered right here, and
+ * heartbeat responses are dropped, so the handlers above only ever see
+ * responses to their own requests.
+ *
+ * A bad magic or an oversized frame leaves the stream unparseable; the
+ * buffered bytes are discarded and the error is fired as a read exception.
+ */
+class DubboResponseDecoder : public Handler<folly::IOBufQueue&,
+                                            DubboResponse,
+                                            std::unique_ptr<folly::IOBuf>,
+                                            std::unique_ptr<folly::IOBuf>> {
+ public:
+  explicit DubboResponseDecoder(
+      uint32_t maxBodyLength = kDubboDefaultMaxBodyLength)
+      : maxBodyLength_(maxBodyLength) {}
+
+  void read(Context* ctx, folly::IOBufQueue& q) override;
+
+  folly::Future<folly::Unit> write(
+      Context* ctx,
+      std::unique_ptr<folly::IOBuf> buf) override {
+    return ctx->fireWrite(std::move(buf));
+  }
+
+  enum class DecodeResult {
+    // One frame was consumed from q and handled
+    DECODED,
+    // q does not hold a whole frame yet; nothing was consumed
+    NEED_MORE,
+    // The stream is unparseable: everything buffered in q was discarded and
+    // the error fired as a read exception. The connection should be closed.
+    BAD_FRAME,
+  };
+
+  /**
+   * Decode one frame from the front of q
+   */
+  DecodeResult decode(Context* ctx, folly::IOBufQueue& q);
+
+ private:
+  void handleEvent(Context* ctx, const DubboHeader& header);
+  void readResult(folly::IOBufQueue& q,
+                  const DubboHeader& header,
+                  DubboResponse& response);
+
+  uint32_t maxBodyLength_;
+};
+
+} // namespace wangle
@@ -0,0 +1,441 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <wangle/codec/Hessian2Decoder.h>
+
+#include <folly/Conv.h>
+#include <folly/ScopeGuard.h>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace wangle {
+
+constexpr size_t Hessian2Decoder::kMaxNodes;
+constexpr size_t Hessian2Decoder::kMaxBytes;
+
+namespace {
+
+// Nesting of lists, maps and objects allowed before giving up
+constexpr size_t kMaxDepth = 256;
+
+[[noreturn]] void throwBadTag(const char* what, uint8_t tag) {
+  throw std::runtime_error(
+    folly::to<std::string>("Expected ", what, " in Hessian2 input, got tag ",
+                           int(tag)));
+}
+
+void appendUtf8(uint32_t cp, std::string& value) {
+  if (cp < 0x80) {
+    value.push_back(cp);
+  } else if (cp < 0x800) {
+    value.push_back(0xc0 | (cp >> 6));
+    value.push_back(0x80 | (cp & 0x3f));
+  } else if (cp < 0x10000) {
+    value.push_back(0xe0 | (cp >> 12));
+    value.push_back(0x80 | ((cp >> 6) & 0x3f));
+    value.push_back(0x80 | (cp & 0x3f));
+  } else {
+    value.push_back(0xf0 | (cp >> 18));
+    value.push_back(0x80 | ((cp >> 12) & 0x3f));
+    value.push_back(0x80 | ((cp >> 6) & 0x3f));
+    value.push_back(0x80 | (cp & 0x3f));
+  }
+}
+
+}
+
+folly::dynamic Hessian2Decoder::read() {
+  return readNested(cursor_.read<uint8_t>());
+}
+
+int32_t Hessian2Decoder::readInt() {
+  auto tag = cursor_.read<uint8_t>();
+  int64_t value;
+  if (!readInteger(tag, value)) {
+    throwBadTag("an int", tag);
+  }
+  if (value < std::numeric_limits<int32_t>::min() ||
+      value > std::numeric_limits<int32_t>::max()) {
+    throw std::runtime_error("Hessian2 long does not fit an int");
+  }
+  return value;
+}
+
+int64_t Hessian2Decoder::readLong() {
+  auto tag = cursor_.read<uint8_t>();
+  int64_t value;
+  if (!readInteger(tag, value)) {
+    throwBadTag("a long", tag);
+  }
+  return value;
+}
+
+std::string Hessian2Decoder::readString() {
+  auto tag = cursor_.read<uint8_t>();
+  std::string value;
+  if (tag != 'N' && !readStringValue(tag, value)) {
+    throwBadTag("a string", tag);
+  }
+  return value;
+}
+
+folly::dynamic Hessian2Decoder::readNested(uint8_t tag) {
+  if (depth_ >= kMaxDepth) {
+    throw std::runtime_error("Hessian2 input nested too deeply");
+  }
+  ++depth_;
+  SCOPE_EXIT {
+    --depth_;
+  };
+  return readValue(tag);
+}
+
+folly::dynamic Hessian2Decoder::readValue(uint8_t tag) {
+  // Definitions precede the object that first uses them
+  while (tag == 'C') {
+    readClassDef();
+    tag = cursor_.read<uint8_t>();
+  }
+  charge(1, 0);
+
+  int64_t integer;
+  if (readInteger(tag, integer)) {
+    return integer;
+  }
+  std::string str;
+  if (readStringValue(tag, str)) {
+    return str;
+  }
+  if ((tag >= 0x20 && tag <= 0x2f) || (tag >= 0x34 && tag <= 0x37) ||
+      tag == 'A' || tag == 'B') {
+    return readBinary(tag);
+  }
+  if ((tag >= 0x70 && tag <= 0x7f) ||
+      tag == 0x55 || tag == 'V' || tag == 0x57 || tag == 'X') {
+    return readList(tag);
+  }
+  if (tag >= 0x60 && tag <= 0x6f) {
+    return readObject(tag - 0x60);
+  }
+
+  switch (tag) {
+    case 'N':
+      return nullptr;
+    case 'T':
+      return true;
+    case 'F':
+      return false;
+    case 0x5b:
+      return 0.0;
+    case 0x5c:
+      return 1.0;
+    case 0x5d:
+      return double(cursor_.read<int8_t>());
+    case 0x5e:
+      return double(cursor_.readBE<int16_t>());
+    case 0x5f:
+      return cursor_.readBE<int32_t>() * 0.001;
+    case 'D': {
+      auto bits = cursor_.readBE<uint64_t>();
+      double value;
+      std::memcpy(&value, &bits, sizeof(value));
+      return value;
+    }
+    case 0x4a:
+      return cursor_.readBE<int64_t>();
+    case 0x4b:
+      return cursor_.readBE<int32_t>() * int64_t(60000);
+    case 'H':
+      return readMap();
+    case 'M':
+      readType();
+      return readMap();
+    case 'O':
+      return readObject(readInt());
+    case 0x51: {
+      auto ref = readInt();
+      if (ref < 0 || size_t(ref) >= refs_.size() || !refs_[ref].complete) {
+        throw std::runtime_error(
+          folly::to<std::string>("Unsupported Hessian2 reference ", ref));
+      }
+      charge(refs_[ref].nodes, refs_[ref].bytes);
+      return refs_[ref].value;
+    }
+    default:
+      throwBadTag("a value", tag);
+  }
+}
+
+bool Hessian2Decoder::readInteger(uint8_t tag, int64_t& value) {
+  if (tag >= 0x80 && tag <= 0xbf) {
+    value = int(tag) - 0x90;
+  } else if (tag >= 0xc0 && tag <= 0xcf) {
+    value = (int(tag) - 0xc8) * 256 + cursor_.read<uint8_t>();
+  } else if (tag >= 0xd0 && tag <= 0xd7) {
+    value = (int(tag) - 0xd4) * 65536 + cursor_.readBE<uint16_t>();
+  } else if (tag == 'I' || tag == 0x59) {
+    value = cursor_.readBE<int32_t>();
+  } else if (tag >= 0xd8 && tag <= 0xef) {
+    value = int(tag) - 0xe0;
+  } else if (tag >= 0xf0) {
+    value = (int(tag) - 0xf8) * 256 + cursor_.read<uint8_t>();
+  } else if (tag >= 0x38 && tag <= 0x3f) {
+    value = (int(tag) - 0x3c) * 65536 + cursor_.readBE<uint16_t>();
+  } else if (tag == 'L') {
+    value = cursor_.readBE<int64_t>();
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool Hessian2Decoder::readStringValue(uint8_t tag, std::string& value) {
+  for (bool first = true; ; first = false) {
+    size_t units;
+    bool final = true;
+    if (tag <= 0x1f) {
+      units = tag;
+    } else if (tag >= 0x30 && tag <= 0x33) {
+      units = (tag - 0x30) * 256 + cursor_.read<uint8_t>();
+    } else if (tag == 'S') {
+      units = cursor_.readBE<uint16_t>();
+    } else if (tag == 'R') {
+      units = cursor_.readBE<uint16_t>();
+      final = false;
+    } else if (first) {
+      return false;
+    } else {
+      throwBadTag("a string chunk", tag);
+    }
+
+    readUtf8(units, value);
+    if (final) {
+      return true;
+    }
+    tag = cursor_.read<uint8_t>();
+  }
+}
+
+void Hessian2Decoder::readUtf8(size_t units, std::string& value) {
+  charge(0, units);
+  value.reserve(value.size() + units);
+  size_t i = 0;
+  while (i < units) {
+    // Copy runs of ASCII straight out of the buffer
+    auto bytes = cursor_.peekBytes();
+    size_t run = 0;
+    size_t maxRun = std::min(bytes.size(), units - i);
+    while (run < maxRun && bytes[run] < 0x80) {
+      ++run;
+    }
+    if (run > 0) {
+      value.append(reinterpret_cast<const char*>(bytes.data()), run);
+      cursor_.skip(run);
+      i += run;
+      continue;
+    }
+
+    uint8_t c = cursor_.read<uint8_t>();
+    if (c < 0xc0 || c >= 0xf0) {
+      throw std::runtime_error("Bad UTF-8 in Hessian2 string");
+    }
+    if (c < 0xe0) {
+      value.push_back(c);
+      value.push_back(cursor_.read<uint8_t>());
+      ++i;
+      continue;
+    }
+
+    uint32_t unit = (c & 0x0f) << 12;
+    unit |= (cursor_.read<uint8_t>() & 0x3f) << 6;
+    unit |= cursor_.read<uint8_t>() & 0x3f;
+    ++i;
+    if (unit >= 0xd800 && unit <= 0xdbff && i < units) {
+      // Join a surrogate pair into one four byte sequence
+      auto peek = cursor_;
+      if (peek.read<uint8_t>() == 0xed) {
+        uint32_t low = 0xd000 | ((peek.read<uint8_t>() & 0x3f) << 6);
+        low |= peek.read<uint8_t>() & 0x3f;
+        if (low >= 0xdc00 && low <= 0xdfff) {
+          cursor_ = peek;
+          ++i;
+          appendUtf8(0x10000 + ((unit - 0xd800) << 10) + (low - 0xdc00),
+                     value);
+          continue;
+        }
+      }
+    }
+    appendUtf8(unit, value);
+  }
+}
+
+std::string Hessian2Decoder::readBinary(uint8_t tag) {
+  std::string value;
+  while (true) {
+    size_t length;
+    bool final = true;
+    if (tag >= 0x20 && tag <= 0x2f) {
+      length = tag - 0x20;
+    } else if (tag >= 0x34 && tag <= 0x37) {
+      length = (tag - 0x34) * 256 + cursor_.read<uint8_t>();
+    } else if (tag == 'B') {
+      length = cursor_.readBE<uint16_t>();
+    } else if (tag == 'A') {
+      length = cursor_.readBE<uint16_t>();
+      final = false;
+    } else {
+      throwBadTag("a binary chunk", tag);
+    }
+
+    charge(0, length);
+    auto offset = value.size();
+    value.resize(offset + length);
+    cursor_.pull(&value[offset], length);
+    if (final) {
+      return value;
+    }
+    tag = cursor_.read<uint8_t>();
+  }
+}
+
+void Hessian2Decoder::readClassDef() {
+  ClassDef def;
+  def.name = readString();
+  auto numFields = readInt();
+  if (numFields < 0) {
+    throw std::runtime_error("Negative Hessian2 field count");
+  }
+  for (int32_t i = 0; i < numFields; ++i) {
+    def.fields.push_back(readString());
+  }
+  classDefs_.push_back(std::move(def));
+}
+
+std::string Hessian2Decoder::readType() {
+  auto tag = cursor_.read<uint8_t>();
+  std::string type;
+  if (readStringValue(tag, type)) {
+    types_.push_back(type);
+    return type;
+  }
+  int64_t index;
+  if (!readInteger(tag, index)) {
+    throwBadTag("a type", tag);
+  }
+  if (index < 0 || size_t(index) >= types_.size()) {
+    throw std::runtime_error(
+      folly::to<std::string>("Unknown Hessian2 type ", index));
+  }
+  return types_[index];
+}
+
+folly::dynamic Hessian2Decoder::readList(uint8_t tag) {
+  if (tag == 0x55 || tag == 'V' || (tag >= 0x70 && tag <= 0x77)) {
+    readType();
+  }
+  int64_t length = -1;
+  if (tag == 'V' || tag == 'X') {
+    length = readInt();
+    if (length < 0) {
+      throw std::runtime_error("Negative Hessian2 list length");
+    }
+  } else if (tag >= 0x70) {
+    length = (tag - 0x70) & 0x07;
+  }
+
+  auto ref = beginRef();
+  folly::dynamic list = folly::dynamic::array;
+  if (length >= 0) {
+    for (int64_t i = 0; i < length; ++i) {
+      list.push_back(read());
+    }
+  } else {
+    uint8_t next;
+    while ((next = cursor_.read<uint8_t>()) != 'Z') {
+      list.push_back(readNested(next));
+    }
+  }
+  endRef(ref, list);
+  return list;
+}
+
+folly::dynamic Hessian2Decoder::readMap() {
+  auto ref = beginRef();
+  folly::dynamic map = folly::dynamic::object;
+  uint8_t next;
+  while ((next = cursor_.read<uint8_t>()) != 'Z') {
+    auto key = readNested(next);
+    map[std::move(key)] = read();
+  }
+  endRef(ref, map);
+  return map;
+}
+
+folly::dynamic Hessian2Decoder::readObject(uint32_t def) {
+  if (def >= classDefs_.size()) {
+    throw std::runtime_error(
+      folly::to<std::string>("Unknown Hessian2 class definition ", def));
+  }
+  // Fields may define more classes, so don't hold on to a reference
+  auto classDef = classDefs_[def];
+
+  auto ref = beginRef();
+  folly::dynamic object = folly::dynamic::object(kHessian2ClassKey,
+                                                 classDef.name);
+  for (const auto& field : classDef.fields) {
+    object[field] = read();
+  }
+  endRef(ref, object);
+  return object;
+}
+
+size_t Hessian2Decoder::beginRef() {
+  refs_.emplace_back();
+  // Until endRef, hold the totals the value's cost is measured from
+  refs_.back().nodes = nodes_;
+  refs_.back().bytes = bytes_;
+  return refs_.size() - 1;
+}
+
+void Hessian2Decoder::endRef(size_t ref, const folly::dynamic& value) {
+  auto& entry = refs_[ref];
+  // The container's own node was charged before beginRef
+  entry.nodes = nodes_ - entry.nodes + 1;
+  entry.bytes = bytes_ - entry.bytes;
+  // Keeping a copy for references costs as much again, but isn't part of
+  // the values being read
+  refNodes_ += entry.nodes;
+  refBytes_ += entry.bytes;
+  checkLimits();
+  entry.value = value;
+  entry.complete = true;
+}
+
+void Hessian2Decoder::charge(size_t nodes, size_t bytes) {
+  nodes_ += nodes;
+  bytes_ += bytes;
+  checkLimits();
+}
+
+void Hessian2Decoder::checkLimits() const {
+  if (nodes_ + refNodes_ > kMaxNodes || bytes_ + refBytes_ > kMaxBytes) {
+    throw std::runtime_error("Hessian2 input decodes to too large a value");
+  }
+}
+
+} // namespace wangle
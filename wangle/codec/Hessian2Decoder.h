@@ -0,0 +1,121 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <folly/dynamic.h>
+#include <folly/io/Cursor.h>
+#include <wangle/codec/Hessian2Encoder.h>
+
+namespace wangle {
+
+/**
+ * Reads values in the Hessian 2.0 serialization format from an IOBuf
+ * chain, wherever its buffer boundaries fall.
+ *
+ * read() returns any value as a dynamic. Lists become arrays, maps become
+ * objects, objects become objects holding their fields plus their class
+ * name under kHessian2ClassKey, binary data becomes a string and dates
+ * become milliseconds since the epoch. Type names are dropped.
+ *
+ * References are resolved by copying the referenced value, so shared
+ * values are duplicated, and a reference to a value that is still being
+ * read (a cycle) is an error. Since a few bytes of references can expand
+ * to an exponentially large value, decoding stops once more than
+ * kMaxNodes values or kMaxBytes of string and binary data have been
+ * produced, counting those copies.
+ *
+ * Malformed or truncated input throws std::runtime_error or
+ * std::out_of_range.
+ */
+class Hessian2Decoder {
+ public:
+  explicit Hessian2Decoder(const folly::IOBuf* buf) : cursor_(buf) {}
+
+  /**
+   * Start reading where cursor points, e.g. past a frame header
+   */
+  explicit Hessian2Decoder(folly::io::Cursor cursor) : cursor_(cursor) {}
+
+  static constexpr size_t kMaxNodes = 1 << 20;
+  static constexpr size_t kMaxBytes = 64 << 20;
+
+  folly::dynamic read();
+
+  /**
+   * Read a value that must be an int or a long
+   */
+  int32_t readInt();
+  int64_t readLong();
+
+  /**
+   * Read a value that must be a string or null; null reads as empty
+   */
+  std::string readString();
+
+  bool isAtEnd() const {
+    return cursor_.isAtEnd();
+  }
+
+  const folly::io::Cursor& getCursor() const {
+    return cursor_;
+  }
+
+ private:
+  struct ClassDef {
+    std::string name;
+    std::vector<std::string> fields;
+  };
+
+  struct Ref {
+    folly::dynamic value;
+    bool complete{false};
+    // What the value cost to decode, and so what each copy costs
+    size_t nodes{0};
+    size_t bytes{0};
+  };
+
+  folly::dynamic readNested(uint8_t tag);
+  folly::dynamic readValue(uint8_t tag);
+  bool readInteger(uint8_t tag, int64_t& value);
+  bool readStringValue(uint8_t tag, std::string& value);
+  void readUtf8(size_t units, std::string& value);
+  std::string readBinary(uint8_t tag);
+  void readClassDef();
+  std::string readType();
+  folly::dynamic readList(uint8_t tag);
+  folly::dynamic readMap();
+  folly::dynamic readObject(uint32_t def);
+  size_t beginRef();
+  void endRef(size_t ref, const folly::dynamic& value);
+  void charge(size_t nodes, size_t bytes);
+  void checkLimits() const;
+
+  folly::io::Cursor cursor_;
+  std::vector<std::string> types_;
+  std::vector<ClassDef> classDefs_;
+  std::vector<Ref> refs_;
+  size_t depth_{0};
+  // Values and string bytes read so far, and copied into refs_
+  size_t nodes_{0};
+  size_t bytes_{0};
+  size_t refNodes_{0};
+  size_t refBytes_{0};
+};
+
+} // namespace wangle
@@ -0,0 +1,323 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <wangle/codec/Hessian2Encoder.h>
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace wangle {
+
+namespace {
+
+// Characters per string chunk, as Java writes them
+constexpr size_t kStringChunkLength = 0x8000;
+constexpr size_t kBinaryChunkLength = 0x8000;
+
+// Bytes in the UTF-8 sequence led by c
+inline size_t utf8Length(uint8_t c) {
+  if (c < 0xc0) {
+    return 1;
+  } else if (c < 0xe0) {
+    return 2;
+  } else if (c < 0xf0) {
+    return 3;
+  }
+  return 4;
+}
+
+}
+
+void Hessian2Encoder::writeNull() {
+  appender_.write<uint8_t>('N');
+}
+
+void Hessian2Encoder::writeBool(bool value) {
+  appender_.write<uint8_t>(value ? 'T' : 'F');
+}
+
+void Hessian2Encoder::writeInt(int32_t value) {
+  if (value >= -16 && value <= 47) {
+    appender_.write<uint8_t>(0x90 + value);
+  } else if (value >= -2048 && value <= 2047) {
+    appender_.write<uint8_t>(0xc8 + (value >> 8));
+    appender_.write<uint8_t>(value & 0xff);
+  } else if (value >= -262144 && value <= 262143) {
+    appender_.write<uint8_t>(0xd4 + (value >> 16));
+    appender_.writeBE<uint16_t>(value & 0xffff);
+  } else {
+    appender_.write<uint8_t>('I');
+    appender_.writeBE<int32_t>(value);
+  }
+}
+
+void Hessian2Encoder::writeLong(int64_t value) {
+  if (value >= -8 && value <= 15) {
+    appender_.write<uint8_t>(0xe0 + value);
+  } else if (value >= -2048 && value <= 2047) {
+    appender_.write<uint8_t>(0xf8 + (value >> 8));
+    appender_.write<uint8_t>(value & 0xff);
+  } else if (value >= -262144 && value <= 262143) {
+    appender_.write<uint8_t>(0x3c + (value >> 16));
+    appender_.writeBE<uint16_t>(value & 0xffff);
+  } else if (value >= std::numeric_limits<int32_t>::min() &&
+             value <= std::numeric_limits<int32_t>::max()) {
+    appender_.write<uint8_t>(0x59);
+    appender_.writeBE<int32_t>(value);
+  } else {
+    appender_.write<uint8_t>('L');
+    appender_.writeBE<int64_t>(value);
+  }
+}
+
+void Hessian2Encoder::writeDouble(double value) {
+  // -0.0 only survives the full encoding
+  bool compact = value != 0.0 || !std::signbit(value);
+  if (compact && value == 0.0) {
+    appender_.write<uint8_t>(0x5b);
+  } else if (value == 1.0) {
+    appender_.write<uint8_t>(0x5c);
+  } else if (compact && value >= -128.0 && value <= 127.0 &&
+             value == static_cast<int8_t>(value)) {
+    appender_.write<uint8_t>(0x5d);
+    appender_.write<int8_t>(static_cast<int8_t>(value));
+  } else if (compact && value >= -32768.0 && value <= 32767.0 &&
+             value == static_cast<int16_t>(value)) {
+    appender_.write<uint8_t>(0x5e);
+    appender_.writeBE<int16_t>(static_cast<int16_t>(value));
+  } else {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    appender_.write<uint8_t>('D');
+    appender_.writeBE<uint64_t>(bits);
+  }
+}
+
+void Hessian2Encoder::writeString(folly::StringPiece value) {
+  const char* p = value.begin();
+  const char* end = value.end();
+  while (true) {
+    // Lengths count UTF-16 code units, and a chunk never splits a pair
+    const char* chunkEnd = p;
+    size_t units = 0;
+    while (chunkEnd != end) {
+      size_t bytes = std::min<size_t>(utf8Length(*chunkEnd), end - chunkEnd);
+      size_t charUnits = bytes == 4 ? 2 : 1;
+      if (units + charUnits > kStringChunkLength) {
+        break;
+      }
+      units += charUnits;
+      chunkEnd += bytes;
+    }
+
+    if (chunkEnd != end) {
+      appender_.write<uint8_t>('R');
+      appender_.writeBE<uint16_t>(units);
+    } else if (units <= 31) {
+      appender_.write<uint8_t>(units);
+    } else if (units <= 1023) {
+      appender_.write<uint8_t>(0x30 + (units >> 8));
+      appender_.write<uint8_t>(units & 0xff);
+    } else {
+      appender_.write<uint8_t>('S');
+      appender_.writeBE<uint16_t>(units);
+    }
+    writeUtf8(p, chunkEnd);
+
+    if (chunkEnd == end) {
+      break;
+    }
+    p = chunkEnd;
+  }
+}
+
+void Hessian2Encoder::writeUtf8(const char* begin, const char* end) {
+  const char* run = begin;
+  for (const char* p = begin; p < end; ++p) {
+    if (static_cast<uint8_t>(*p) < 0xf0 || end - p < 4) {
+      continue;
+    }
+    // Re-encode as a surrogate pair of three byte sequences
+    appender_.push(reinterpret_cast<const uint8_t*>(run), p - run);
+    auto b = reinterpret_cast<const uint8_t*>(p);
+    uint32_t cp = ((b[0] & 0x07) << 18) | ((b[1] & 0x3f) << 12) |
+      ((b[2] & 0x3f) << 6) | (b[3] & 0x3f);
+    cp -= 0x10000;
+    for (uint32_t unit : {0xd800 + (cp >> 10), 0xdc00 + (cp & 0x3ff)}) {
+      appender_.write<uint8_t>(0xe0 | (unit >> 12));
+      appender_.write<uint8_t>(0x80 | ((unit >> 6) & 0x3f));
+      appender_.write<uint8_t>(0x80 | (unit & 0x3f));
+    }
+    p += 3;
+    run = p + 1;
+  }
+  appender_.push(reinterpret_cast<const uint8_t*>(run), end - run);
+}
+
+void Hessian2Encoder::writeBinary(folly::ByteRange value) {
+  while (value.size() > kBinaryChunkLength) {
+    appender_.write<uint8_t>('A');
+    appender_.writeBE<uint16_t>(kBinaryChunkLength);
+    appender_.push(value.data(), kBinaryChunkLength);
+    value.advance(kBinaryChunkLength);
+  }
+  if (value.size() <= 15) {
+    appender_.write<uint8_t>(0x20 + value.size());
+  } else if (value.size() <= 1023) {
+    appender_.write<uint8_t>(0x34 + (value.size() >> 8));
+    appender_.write<uint8_t>(value.size() & 0xff);
+  } else {
+    appender_.write<uint8_t>('B');
+    appender_.writeBE<uint16_t>(value.size());
+  }
+  appender_.push(value.data(), value.size());
+}
+
+void Hessian2Encoder::writeType(folly::StringPiece type) {
+  auto it = types_.find(type.str());
+  if (it != types_.end()) {
+    writeInt(it->second);
+    return;
+  }
+  types_.emplace(type.str(), types_.size());
+  writeString(type);
+}
+
+void Hessian2Encoder::writeListBegin(size_t length, folly::StringPiece type) {
+  ++numRefs_;
+  if (type.empty()) {
+    if (length <= 7) {
+      appender_.write<uint8_t>(0x78 + length);
+    } else {
+      appender_.write<uint8_t>('X');
+      writeInt(length);
+    }
+  } else {
+    if (length <= 7) {
+      appender_.write<uint8_t>(0x70 + length);
+      writeType(type);
+    } else {
+      appender_.write<uint8_t>('V');
+      writeType(type);
+      writeInt(length);
+    }
+  }
+}
+
+void Hessian2Encoder::writeMapBegin(folly::StringPiece type) {
+  ++numRefs_;
+  if (type.empty()) {
+    appender_.write<uint8_t>('H');
+  } else {
+    appender_.write<uint8_t>('M');
+    writeType(type);
+  }
+}
+
+void Hessian2Encoder::writeMapEnd() {
+  appender_.write<uint8_t>('Z');
+}
+
+void Hessian2Encoder::writeObjectBegin(
+    folly::StringPiece className,
+    const std::vector<std::string>& fieldNames) {
+  auto it = classDefs_.find(className.str());
+  if (it == classDefs_.end()) {
+    it = classDefs_.emplace(className.str(), classDefs_.size()).first;
+    appender_.write<uint8_t>('C');
+    writeString(className);
+    writeInt(fieldNames.size());
+    for (const auto& field : fieldNames) {
+      writeString(field);
+    }
+  }
+
+  ++numRefs_;
+  if (it->second <= 15) {
+    appender_.write<uint8_t>(0x60 + it->second);
+  } else {
+    appender_.write<uint8_t>('O');
+    writeInt(it->second);
+  }
+}
+
+void Hessian2Encoder::writeRef(uint32_t ref) {
+  DCHECK_LT(ref, numRefs_);
+  appender_.write<uint8_t>(0x51);
+  writeInt(ref);
+}
+
+void Hessian2Encoder::write(const folly::dynamic& value) {
+  switch (value.type()) {
+    case folly::dynamic::NULLT:
+      writeNull();
+      break;
+    case folly::dynamic::BOOL:
+      writeBool(value.getBool());
+      break;
+    case folly::dynamic::INT64: {
+      auto i = value.getInt();
+      if (i >= std::numeric_limits<int32_t>::min() &&
+          i <= std::numeric_limits<int32_t>::max()) {
+        writeInt(i);
+      } else {
+        writeLong(i);
+      }
+      break;
+    }
+    case folly::dynamic::DOUBLE:
+      writeDouble(value.getDouble());
+      break;
+    case folly::dynamic::STRING:
+      writeString(value.stringPiece());
+      break;
+    case folly::dynamic::ARRAY:
+      writeListBegin(value.size());
+      for (const auto& element : value) {
+        write(element);
+      }
+      break;
+    case folly::dynamic::OBJECT: {
+      auto className = value.get_ptr(kHessian2ClassKey);
+      if (className && className->isString()) {
+        std::vector<std::string> fields;
+        for (const auto& key : value.keys()) {
+          if (key.isString() && key.stringPiece() != folly::StringPiece(kHessian2ClassKey)) {
+            fields.push_back(key.stringPiece().str());
+          }
+        }
+        std::sort(fields.begin(), fields.end());
+        writeObjectBegin(className->stringPiece(), fields);
+        for (const auto& field : fields) {
+          write(value[field]);
+        }
+      } else {
+        writeMapBegin();
+        for (const auto& item : value.items()) {
+          write(item.first);
+          write(item.second);
+        }
+        writeMapEnd();
+      }
+      break;
+    }
+  }
+}
+
+} // namespace wangle
@@ -0,0 +1,109 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <folly/Range.h>
+#include <folly/dynamic.h>
+#include <folly/io/Cursor.h>
+#include <folly/io/IOBufQueue.h>
+
+namespace wangle {
+
+// Key under which decoded objects carry their class name
+constexpr char kHessian2ClassKey[] = "$class";
+
+/**
+ * Writes values in the Hessian 2.0 serialization format, which is the
+ * default serialization of Dubbo, straight into the buffers of an
+ * IOBufQueue. Every value is written in its most compact form.
+ *
+ * The encoder keeps the type and class definition tables of one Hessian2
+ * stream: a class definition is written before the first object of that
+ * class, and later objects only refer to it. Lists, maps and objects are
+ * numbered in the order they are begun, which is what writeRef() refers
+ * to.
+ *
+ * Strings are UTF-8. Characters outside the BMP are sent as surrogate
+ * pairs, as Java expects.
+ */
+class Hessian2Encoder {
+ public:
+  explicit Hessian2Encoder(folly::IOBufQueue* queue, uint64_t growth = 256)
+      : appender_(queue, growth) {}
+
+  void writeNull();
+  void writeBool(bool value);
+  void writeInt(int32_t value);
+  void writeLong(int64_t value);
+  void writeDouble(double value);
+  void writeString(folly::StringPiece value);
+  void writeBinary(folly::ByteRange value);
+
+  /**
+   * Begin a list of length values, which the caller writes next. An empty
+   * type makes an untyped list.
+   */
+  void writeListBegin(size_t length, folly::StringPiece type = "");
+
+  /**
+   * Begin a map; the caller writes keys and values in turn, then
+   * writeMapEnd(). An empty type makes an untyped map (a HashMap in Java).
+   */
+  void writeMapBegin(folly::StringPiece type = "");
+  void writeMapEnd();
+
+  /**
+   * Begin an object of className with the given fields, whose values the
+   * caller writes next, in order. The class definition is written the first
+   * time className is used; fieldNames must not change after that.
+   */
+  void writeObjectBegin(folly::StringPiece className,
+                        const std::vector<std::string>& fieldNames);
+
+  /**
+   * Refer back to the list, map or object numbered ref
+   */
+  void writeRef(uint32_t ref);
+
+  /**
+   * Write a dynamic: integers as int when they fit and long otherwise,
+   * arrays as untyped lists, and objects as untyped maps unless they carry
+   * a kHessian2ClassKey, in which case the other keys are its fields.
+   */
+  void write(const folly::dynamic& value);
+
+  /**
+   * The number the next list, map or object will get
+   */
+  uint32_t getNextRef() const {
+    return numRefs_;
+  }
+
+ private:
+  void writeType(folly::StringPiece type);
+  void writeUtf8(const char* begin, const char* end);
+
+  folly::io::QueueAppender appender_;
+  std::unordered_map<std::string, uint32_t> types_;
+  std::unordered_map<std::string, uint32_t> classDefs_;
+  uint32_t numRefs_{0};
+};
+
+} // namespace wangle
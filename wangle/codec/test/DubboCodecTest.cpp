@@ -0,0 +1,352 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/io/async/AsyncSocket.h>
+#include <folly/io/async/EventBase.h>
+#include <gtest/gtest.h>
+
+#include <wangle/codec/DubboHeartbeatHandler.h>
+#include <wangle/codec/DubboRequestEncoder.h>
+#include <wangle/codec/DubboResponseDecoder.h>
+
+using namespace folly;
+using namespace wangle;
+
+namespace {
+
+const char kInterface[] =
+  "com.alibaba.dubbo.performance.demo.provider.IHelloService";
+
+DubboInvocation helloInvocation(StringPiece argument) {
+  DubboInvocation invocation;
+  invocation.interfaceName = kInterface;
+  invocation.method = "hash";
+  invocation.parameterTypes = "Ljava/lang/String;";
+  invocation.argument = argument;
+  return invocation;
+}
+
+std::string expectedBody(const std::string& argument) {
+  return std::string("\"2.0.1\"\n\"") + kInterface + "\"\nnull\n\"hash\"\n"
+    "\"Ljava/lang/String;\"\n\"" + argument + "\"\n{\"path\":\"" +
+    kInterface + "\"}\n";
+}
+
+std::string toString(const IOBuf& buf) {
+  std::string str;
+  for (const auto& range : buf) {
+    str.append(reinterpret_cast<const char*>(range.data()), range.size());
+  }
+  return str;
+}
+
+std::string frame(uint8_t flags,
+                  uint8_t status,
+                  int64_t id,
+                  const std::string& body) {
+  DubboHeader header;
+  header.flags = flags;
+  header.status = status;
+  header.id = id;
+  header.bodyLength = body.size();
+  auto buf = IOBuf::create(kDubboHeaderLength);
+  buf->append(kDubboHeaderLength);
+  io::RWPrivateCursor c(buf.get());
+  writeDubboHeader(c, header);
+  return toString(*buf) + body;
+}
+
+std::string fastjsonResponse(int64_t id, const std::string& body) {
+  return frame(kDubboSerializationFastjson, 20, id, body);
+}
+
+class ResponseCollector : public InboundHandler<DubboResponse> {
+ public:
+  void read(Context*, DubboResponse response) override {
+    responses.push_back(std::move(response));
+  }
+
+  void readException(Context*, exception_wrapper ew) override {
+    errors.push_back(std::move(ew));
+  }
+
+  std::vector<DubboResponse> responses;
+  std::vector<exception_wrapper> errors;
+};
+
+class WriteCollector : public OutboundHandler<std::unique_ptr<IOBuf>> {
+ public:
+  Future<Unit> write(Context*, std::unique_ptr<IOBuf> buf) override {
+    writes.push_back(toString(*buf));
+    return makeFuture();
+  }
+
+  std::vector<std::string> writes;
+};
+
+class DubboResponseDecoderTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    pipeline_ = Pipeline<IOBufQueue&, std::unique_ptr<IOBuf>>::create();
+    (*pipeline_)
+      .addBack(writes_)
+      .addBack(DubboResponseDecoder(1024))
+      .addBack(responses_)
+      .finalize();
+  }
+
+  // Feed data in chunks of at most chunkSize bytes
+  void feed(const std::string& data, size_t chunkSize = 1 << 20) {
+    for (size_t i = 0; i < data.size(); i += chunkSize) {
+      q_.append(IOBuf::copyBuffer(data.substr(i, chunkSize)));
+      pipeline_->read(q_);
+    }
+  }
+
+  Pipeline<IOBufQueue&, std::unique_ptr<IOBuf>>::Ptr pipeline_;
+  std::shared_ptr<WriteCollector> writes_{std::make_shared<WriteCollector>()};
+  std::shared_ptr<ResponseCollector> responses_{
+    std::make_shared<ResponseCollector>()};
+  IOBufQueue q_{IOBufQueue::cacheChainLength()};
+};
+
+class FrameCollector : public InboundHandler<std::unique_ptr<IOBuf>> {
+ public:
+  void read(Context*, std::unique_ptr<IOBuf> buf) override {
+    frames.push_back(toString(*buf));
+  }
+
+  void readException(Context*, exception_wrapper ew) override {
+    errors.push_back(std::move(ew));
+  }
+
+  std::vector<std::string> frames;
+  std::vector<exception_wrapper> errors;
+};
+
+class DubboHeartbeatHandlerTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    pipeline_ = Pipeline<std::unique_ptr<IOBuf>, std::unique_ptr<IOBuf>>::create();
+    (*pipeline_)
+      .addBack(writes_)
+      .addBack(heartbeat_)
+      .addBack(frames_)
+      .finalize();
+  }
+
+  void read(const std::string& data) {
+    pipeline_->read(IOBuf::copyBuffer(data));
+  }
+
+  Pipeline<std::unique_ptr<IOBuf>, std::unique_ptr<IOBuf>>::Ptr pipeline_;
+  std::shared_ptr<WriteCollector> writes_{std::make_shared<WriteCollector>()};
+  std::shared_ptr<DubboHeartbeatHandler> heartbeat_{
+    std::make_shared<DubboHeartbeatHandler>(
+      std::chrono::milliseconds(20), 3, kDubboSerializationFastjson)};
+  std::shared_ptr<FrameCollector> frames_{std::make_shared<FrameCollector>()};
+};
+
+}
+
+TEST(DubboRequestEncoder, Encode) {
+  auto buf = DubboRequestEncoder::encode(
+    0x0102030405060708, helloInvocation("123456"));
+  EXPECT_FALSE(buf->isChained());
+
+  auto body = expectedBody("123456");
+  EXPECT_EQ(body.size(),
+            DubboRequestEncoder::bodyLength(helloInvocation("123456")));
+  std::string expected("\xda\xbb\xc6\x00\x01\x02\x03\x04\x05\x06\x07\x08",
+                       12);
+  expected.push_back(0);
+  expected.push_back(0);
+  expected.push_back(body.size() >> 8);
+  expected.push_back(body.size() & 0xff);
+  expected += body;
+  EXPECT_EQ(expected, toString(*buf));
+}
+
+TEST(DubboRequestEncoder, Escape) {
+  auto buf = DubboRequestEncoder::encode(1, helloInvocation("a\"b\\c\n"));
+  EXPECT_EQ(expectedBody("a\\\"b\\\\c\\u000a"),
+            toString(*buf).substr(kDubboHeaderLength));
+  EXPECT_EQ(buf->computeChainDataLength() - kDubboHeaderLength,
+            DubboRequestEncoder::bodyLength(helloInvocation("a\"b\\c\n")));
+}
+
+TEST(DubboRequestEncoder, ServiceVersion) {
+  auto invocation = helloInvocation("x");
+  invocation.serviceVersion = "1.0.0";
+  auto str = toString(*DubboRequestEncoder::encode(1, invocation));
+  EXPECT_NE(std::string::npos, str.find("\n\"1.0.0\"\n\"hash\"\n"));
+  EXPECT_EQ(std::string::npos, str.find("null"));
+}
+
+TEST(DubboRequestEncoder, Scatter) {
+  std::string argument(10000, 'z');
+  auto invocation = helloInvocation(argument);
+  auto buf = DubboRequestEncoder::encodeScatter(42, invocation);
+  ASSERT_EQ(3u, buf->countChainElements());
+  // The argument is referenced, not copied
+  EXPECT_EQ(reinterpret_cast<const uint8_t*>(argument.data()),
+            buf->next()->data());
+  EXPECT_EQ(toString(*DubboRequestEncoder::encode(42, invocation)),
+            toString(*buf));
+
+  // Escaped arguments are copied
+  auto escaped = DubboRequestEncoder::encodeScatter(
+    42, helloInvocation("a\"b"));
+  EXPECT_FALSE(escaped->isChained());
+}
+
+TEST_F(DubboResponseDecoderTest, Value) {
+  // Split across reads in the middle of the header and of the payload
+  feed(fastjsonResponse(7, "1\n-1234567\n") +
+       fastjsonResponse(8, "2\nnull\n"), 5);
+  ASSERT_EQ(2u, responses_->responses.size());
+  auto& value = responses_->responses[0];
+  EXPECT_EQ(7, value.id);
+  EXPECT_EQ(DubboResultType::VALUE, value.resultType);
+  EXPECT_FALSE(value.exception);
+  EXPECT_EQ("-1234567", toString(*value.payload));
+  EXPECT_TRUE(value.payload->isChained());
+
+  EXPECT_EQ(8, responses_->responses[1].id);
+  EXPECT_EQ(DubboResultType::NULL_VALUE,
+            responses_->responses[1].resultType);
+  EXPECT_EQ(0u, q_.chainLength());
+  EXPECT_TRUE(responses_->errors.empty());
+}
+
+TEST_F(DubboResponseDecoderTest, Hessian2) {
+  feed(frame(kDubboSerializationHessian2, 20, 1, "\x91\x05hello"));
+  ASSERT_EQ(1u, responses_->responses.size());
+  EXPECT_EQ("\x05hello", toString(*responses_->responses[0].payload));
+}
+
+TEST_F(DubboResponseDecoderTest, Errors) {
+  feed(frame(kDubboSerializationFastjson, 70, 3, "\"boom\"\n") +
+       fastjsonResponse(4, "0\n{\"message\":\"bad\"}\n"));
+  ASSERT_EQ(2u, responses_->responses.size());
+
+  auto& failed = responses_->responses[0];
+  EXPECT_EQ(DubboStatus::SERVICE_ERROR, failed.status);
+  ASSERT_TRUE(failed.exception.is_compatible_with<DubboException>());
+  failed.exception.with_exception([](const DubboException& ex) {
+    EXPECT_EQ(3, ex.getId());
+    EXPECT_EQ(DubboStatus::SERVICE_ERROR, ex.getStatus());
+  });
+
+  auto& threw = responses_->responses[1];
+  EXPECT_EQ(DubboResultType::EXCEPTION, threw.resultType);
+  EXPECT_TRUE(threw.exception.is_compatible_with<DubboException>());
+  EXPECT_TRUE(responses_->errors.empty());
+}
+
+TEST_F(DubboResponseDecoderTest, Heartbeat) {
+  uint8_t flags = kDubboFlagRequest | kDubboFlagTwoWay | kDubboFlagEvent |
+    kDubboSerializationFastjson;
+  feed(frame(flags, 0, 9, "null\n") +
+       frame(kDubboFlagEvent | kDubboSerializationFastjson, 20, 10,
+             "null\n") +
+       fastjsonResponse(11, "1\n1\n"));
+
+  // Only the real response goes up
+  ASSERT_EQ(1u, responses_->responses.size());
+  EXPECT_EQ(11, responses_->responses[0].id);
+
+  ASSERT_EQ(1u, writes_->writes.size());
+  EXPECT_EQ(frame(kDubboFlagEvent | kDubboSerializationFastjson, 20, 9,
+                  "null\n"),
+            writes_->writes[0]);
+}
+
+TEST_F(DubboResponseDecoderTest, BadFrames) {
+  feed(std::string(kDubboHeaderLength, 'x'));
+  EXPECT_EQ(1u, responses_->errors.size());
+  EXPECT_EQ(0u, q_.chainLength());
+
+  feed(fastjsonResponse(1, std::string(2000, 'x')).substr(0, 100));
+  EXPECT_EQ(2u, responses_->errors.size());
+  EXPECT_EQ(0u, q_.chainLength());
+  EXPECT_TRUE(responses_->responses.empty());
+}
+
+TEST(DubboProtocol, ErrorResponse) {
+  auto json = makeDubboErrorResponse(
+    5, kDubboSerializationFastjson, DubboStatus::SERVER_ERROR, "gone");
+  EXPECT_EQ(frame(kDubboSerializationFastjson, 80, 5, "\"gone\"\n"),
+            toString(*json));
+
+  auto hessian = makeDubboErrorResponse(
+    6, kDubboSerializationHessian2, DubboStatus::BAD_REQUEST, "bad");
+  EXPECT_EQ(frame(kDubboSerializationHessian2, 40, 6, "\x03" "bad"),
+            toString(*hessian));
+}
+
+TEST(DubboProtocol, SetRequestId) {
+  auto response = fastjsonResponse(1, "1\n42\n");
+
+  auto own = IOBuf::copyBuffer(response);
+  setDubboRequestId(own, 7);
+  EXPECT_EQ(fastjsonResponse(7, "1\n42\n"), toString(*own));
+
+  // A clone shares its buffer, which must keep the old id
+  auto original = IOBuf::copyBuffer(response);
+  auto shared = original->clone();
+  setDubboRequestId(shared, 8);
+  EXPECT_EQ(fastjsonResponse(8, "1\n42\n"), toString(*shared));
+  EXPECT_EQ(response, toString(*original));
+
+  // Header split over buffers
+  auto split = IOBuf::copyBuffer(response.substr(0, 10));
+  split->prependChain(IOBuf::copyBuffer(response.substr(10)));
+  setDubboRequestId(split, 9);
+  EXPECT_EQ(fastjsonResponse(9, "1\n42\n"), toString(*split));
+}
+
+TEST_F(DubboHeartbeatHandlerTest, PassThrough) {
+  uint8_t flags = kDubboFlagRequest | kDubboFlagTwoWay | kDubboFlagEvent |
+    kDubboSerializationFastjson;
+  read(frame(flags, 0, 9, "null\n"));
+  read(frame(kDubboFlagEvent | kDubboSerializationFastjson, 20, 10,
+             "null\n"));
+  read(fastjsonResponse(11, "1\n1\n"));
+
+  // Events stop here, the peer's heartbeat is answered
+  ASSERT_EQ(1u, frames_->frames.size());
+  EXPECT_EQ(fastjsonResponse(11, "1\n1\n"), frames_->frames[0]);
+  ASSERT_EQ(1u, writes_->writes.size());
+  EXPECT_EQ(frame(kDubboFlagEvent | kDubboSerializationFastjson, 20, 9,
+                  "null\n"),
+            writes_->writes[0]);
+}
+
+TEST_F(DubboHeartbeatHandlerTest, IdleConnection) {
+  EventBase evb;
+  pipeline_->setTransport(AsyncSocket::newSocket(&evb));
+  pipeline_->transportActive();
+  evb.runAfterDelay([&] { evb.terminateLoopSoon(); }, 300);
+  evb.loop();
+
+  // Probed while idle, then given up on once, with nothing left scheduled
+  EXPECT_GE(heartbeat_->getHeartbeatsSent(), 1u);
+  EXPECT_EQ(heartbeat_->getHeartbeatsSent(), writes_->writes.size());
+  ASSERT_EQ(1u, frames_->errors.size());
+  EXPECT_TRUE(frames_->errors[0].is_compatible_with<AsyncSocketException>());
+  EXPECT_TRUE(frames_->frames.empty());
+}
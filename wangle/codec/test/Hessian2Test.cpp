@@ -0,0 +1,252 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <wangle/codec/DubboRequestEncoder.h>
+#include <wangle/codec/Hessian2Decoder.h>
+#include <wangle/codec/Hessian2Encoder.h>
+
+using namespace folly;
+using namespace wangle;
+
+namespace {
+
+template <class F>
+std::string encode(F&& f) {
+  IOBufQueue queue(IOBufQueue::cacheChainLength());
+  // A small growth puts values across buffer boundaries
+  Hessian2Encoder encoder(&queue, 16);
+  f(encoder);
+  auto buf = queue.move();
+  return buf ? buf->moveToFbString().toStdString() : std::string();
+}
+
+std::string bytes(std::initializer_list<uint8_t> b) {
+  return std::string(b.begin(), b.end());
+}
+
+// Decode from a chain of one byte buffers
+dynamic decode(const std::string& data) {
+  IOBufQueue queue;
+  for (char c : data) {
+    queue.append(IOBuf::copyBuffer(&c, 1));
+  }
+  auto buf = queue.move();
+  Hessian2Decoder decoder(buf.get());
+  auto value = decoder.read();
+  EXPECT_TRUE(decoder.isAtEnd());
+  return value;
+}
+
+dynamic roundTrip(const dynamic& value) {
+  return decode(encode([&](Hessian2Encoder& e) { e.write(value); }));
+}
+
+}
+
+TEST(Hessian2, Integers) {
+  // Examples from the Hessian 2.0 serialization spec
+  EXPECT_EQ(bytes({0x90}), encode([](Hessian2Encoder& e) { e.writeInt(0); }));
+  EXPECT_EQ(bytes({0x80}),
+            encode([](Hessian2Encoder& e) { e.writeInt(-16); }));
+  EXPECT_EQ(bytes({0xbf}), encode([](Hessian2Encoder& e) { e.writeInt(47); }));
+  EXPECT_EQ(bytes({0xc8, 0x30}),
+            encode([](Hessian2Encoder& e) { e.writeInt(48); }));
+  EXPECT_EQ(bytes({0xc0, 0x00}),
+            encode([](Hessian2Encoder& e) { e.writeInt(-2048); }));
+  EXPECT_EQ(bytes({0xd7, 0xff, 0xff}),
+            encode([](Hessian2Encoder& e) { e.writeInt(262143); }));
+  EXPECT_EQ(bytes({'I', 0x00, 0x04, 0x00, 0x00}),
+            encode([](Hessian2Encoder& e) { e.writeInt(262144); }));
+
+  EXPECT_EQ(bytes({0xe0}), encode([](Hessian2Encoder& e) { e.writeLong(0); }));
+  EXPECT_EQ(bytes({0xd8}),
+            encode([](Hessian2Encoder& e) { e.writeLong(-8); }));
+  EXPECT_EQ(bytes({0xf8, 0x10}),
+            encode([](Hessian2Encoder& e) { e.writeLong(16); }));
+  EXPECT_EQ(bytes({0x3f, 0xff, 0xff}),
+            encode([](Hessian2Encoder& e) { e.writeLong(262143); }));
+  EXPECT_EQ(bytes({0x59, 0x80, 0x00, 0x00, 0x00}),
+            encode([](Hessian2Encoder& e) { e.writeLong(INT32_MIN); }));
+
+  for (int64_t value : {int64_t(0), int64_t(-17), int64_t(2047),
+                        int64_t(-262144), int64_t(INT32_MAX),
+                        int64_t(INT64_MIN), int64_t(1) << 40}) {
+    EXPECT_EQ(value, roundTrip(value).asInt());
+    auto buf = IOBuf::copyBuffer(
+      encode([&](Hessian2Encoder& e) { e.writeLong(value); }));
+    EXPECT_EQ(value, Hessian2Decoder(buf.get()).readLong());
+  }
+}
+
+TEST(Hessian2, Doubles) {
+  EXPECT_EQ(bytes({0x5b}),
+            encode([](Hessian2Encoder& e) { e.writeDouble(0.0); }));
+  EXPECT_EQ(bytes({0x5d, 0x80}),
+            encode([](Hessian2Encoder& e) { e.writeDouble(-128.0); }));
+  EXPECT_EQ(bytes({'D', 0x40, 0x28, 0x80, 0, 0, 0, 0, 0}),
+            encode([](Hessian2Encoder& e) { e.writeDouble(12.25); }));
+  for (double value : {1.0, 32767.0, -0.5, 1e300}) {
+    EXPECT_EQ(value, roundTrip(value).asDouble());
+  }
+  EXPECT_DOUBLE_EQ(12.25, decode(bytes({0x5f, 0, 0, 0x2f, 0xda})).asDouble());
+}
+
+TEST(Hessian2, Strings) {
+  EXPECT_EQ(bytes({0x05, 'h', 'e', 'l', 'l', 'o'}),
+            encode([](Hessian2Encoder& e) { e.writeString("hello"); }));
+  EXPECT_EQ(bytes({0x00}),
+            encode([](Hessian2Encoder& e) { e.writeString(""); }));
+
+  // Lengths count characters, not bytes
+  std::string accented("h\xc3\xa9llo");
+  EXPECT_EQ(0x05, encode([&](Hessian2Encoder& e) {
+    e.writeString(accented);
+  })[0]);
+  EXPECT_EQ(accented, roundTrip(accented).asString());
+
+  // Outside the BMP: a surrogate pair of two characters
+  std::string emoji("\xf0\x9f\x98\x80");
+  auto encoded = encode([&](Hessian2Encoder& e) { e.writeString(emoji); });
+  EXPECT_EQ(bytes({0x02, 0xed, 0xa0, 0xbd, 0xed, 0xb8, 0x80}), encoded);
+  EXPECT_EQ(emoji, decode(encoded).asString());
+
+  // Long strings are chunked
+  std::string large(100000, 'x');
+  large += emoji;
+  encoded = encode([&](Hessian2Encoder& e) { e.writeString(large); });
+  EXPECT_EQ('R', encoded[0]);
+  EXPECT_EQ(large, roundTrip(large).asString());
+}
+
+TEST(Hessian2, Binary) {
+  std::string data(70000, '\xfe');
+  auto encoded = encode([&](Hessian2Encoder& e) {
+    e.writeBinary(ByteRange(StringPiece(data)));
+  });
+  EXPECT_EQ('A', encoded[0]);
+  EXPECT_EQ(data, decode(encoded).asString());
+  EXPECT_EQ(bytes({0x23, 1, 2, 3}), encode([](Hessian2Encoder& e) {
+    uint8_t small[] = {1, 2, 3};
+    e.writeBinary(ByteRange(small, sizeof(small)));
+  }));
+}
+
+TEST(Hessian2, Containers) {
+  dynamic value = dynamic::object
+    ("ints", dynamic::array(1, 2, 3, 4, 5, 6, 7, 8, 9))
+    ("nested", dynamic::array(dynamic::array(), nullptr, true, false))
+    ("map", dynamic::object(1, "one")("two", 2.5));
+  EXPECT_EQ(value, roundTrip(value));
+
+  // Typed lists and maps share a type table
+  auto encoded = encode([](Hessian2Encoder& e) {
+    e.writeListBegin(2, "[int");
+    e.writeListBegin(1, "[int");
+    e.writeInt(1);
+    e.writeMapBegin("java.util.TreeMap");
+    e.writeMapEnd();
+  });
+  EXPECT_EQ(bytes({0x72, 0x04, '[', 'i', 'n', 't',
+                   0x71, 0x90, 0x91,
+                   'M', 0x11}) + "java.util.TreeMap" + "Z",
+            encoded);
+  EXPECT_EQ(dynamic::array(dynamic::array(1), dynamic(dynamic::object)),
+            decode(encoded));
+}
+
+TEST(Hessian2, Objects) {
+  auto encoded = encode([](Hessian2Encoder& e) {
+    e.writeListBegin(3);
+    for (int i = 0; i < 2; i++) {
+      e.writeObjectBegin("example.Car", {"color", "model"});
+      e.writeString("red");
+      e.writeInt(i);
+    }
+    // The second car
+    e.writeRef(2);
+  });
+  // The class is only defined once
+  EXPECT_EQ(encoded.find("example.Car"), encoded.rfind("example.Car"));
+  auto car = dynamic::object(kHessian2ClassKey, "example.Car")
+    ("color", "red")("model", 1);
+  auto cars = decode(encoded);
+  ASSERT_EQ(3u, cars.size());
+  EXPECT_EQ(car, cars[1]);
+  EXPECT_EQ(car, cars[2]);
+  EXPECT_EQ(car, roundTrip(car));
+
+  // A list that contains itself
+  EXPECT_THROW(decode(bytes({0x79, 0x51, 0x90})), std::runtime_error);
+}
+
+TEST(Hessian2, ReferenceExpansion) {
+  // Each list holds the previous one and a reference to it, doubling the
+  // decoded size with every three bytes of input
+  auto nested = [](int levels) {
+    auto input = bytes({0x7a, 0x90, 0x90});
+    for (int i = 1; i <= levels; i++) {
+      // Lists are numbered outermost first
+      input = bytes({0x7a}) + input +
+        bytes({0x51, uint8_t(0x90 + levels - i + 1)});
+    }
+    return input;
+  };
+  auto list0 = dynamic::array(0, 0);
+  auto list1 = dynamic::array(list0, list0);
+  EXPECT_EQ(dynamic::array(list1, list1), decode(nested(2)));
+  EXPECT_THROW(decode(nested(40)), std::runtime_error);
+}
+
+TEST(Hessian2, Malformed) {
+  EXPECT_THROW(decode(bytes({0x05, 'h', 'i'})), std::out_of_range);
+  EXPECT_THROW(decode(bytes({0x40})),
+               std::runtime_error);
+  EXPECT_THROW(decode(std::string(1000, 0x79)), std::runtime_error);
+  auto buf = IOBuf::copyBuffer(bytes({0x05, 'h', 'e', 'l', 'l', 'o'}));
+  EXPECT_THROW(Hessian2Decoder(buf.get()).readInt(), std::runtime_error);
+}
+
+TEST(Hessian2, DubboRequest) {
+  DubboInvocation invocation;
+  invocation.interfaceName = "com.example.IHelloService";
+  invocation.method = "hash";
+  invocation.parameterTypes = "Ljava/lang/String;";
+  invocation.argument = "123456";
+  auto buf = DubboRequestEncoder::encodeHessian2(77, invocation);
+
+  io::Cursor c(buf.get());
+  DubboHeader header;
+  ASSERT_TRUE(readDubboHeader(c, header));
+  EXPECT_EQ(77, header.id);
+  EXPECT_EQ(kDubboSerializationHessian2, header.serialization());
+  EXPECT_TRUE(header.isTwoWay());
+  EXPECT_EQ(buf->computeChainDataLength() - kDubboHeaderLength,
+            header.bodyLength);
+
+  buf->trimStart(kDubboHeaderLength);
+  Hessian2Decoder decoder(buf.get());
+  EXPECT_EQ(kDubboVersion, decoder.readString());
+  EXPECT_EQ("com.example.IHelloService", decoder.readString());
+  EXPECT_TRUE(decoder.read().isNull());
+  EXPECT_EQ("hash", decoder.readString());
+  EXPECT_EQ("Ljava/lang/String;", decoder.readString());
+  EXPECT_EQ("123456", decoder.readString());
+  EXPECT_EQ(dynamic::object("path", "com.example.IHelloService"),
+            decoder.read());
+  EXPECT_TRUE(decoder.isAtEnd());
+}
@@ -17,6 +17,7 @@
 #include <gflags/gflags.h>
 
 #include <folly/init/Init.h>
+#include <folly/io/Cursor.h>
 #include <wangle/bootstrap/AcceptRoutingHandler.h>
 #include <wangle/bootstrap/RoutingDataHandler.h>
 #include <wangle/bootstrap/ServerBootstrap.h>
@@ -43,11 +44,10 @@ class NaiveRoutingDataHandler : public RoutingDataHandler<char> {
       return false;
     }
 
-    auto buf = bufQueue.move();
-    buf->coalesce();
     // Use the first byte for hashing to a worker
-    routingData.routingData = buf->data()[0];
-    routingData.bufQueue.append(std::move(buf));
+    folly::io::Cursor cursor(bufQueue.front());
+    routingData.routingData = cursor.read<char>();
+    routingData.bufQueue.append(bufQueue.move());
     return true;
   }
 };
@@ -59,6 +59,19 @@ class NaiveRoutingDataHandlerFactory : public RoutingDataHandlerFactory<char> {
       RoutingDataHandler<char>::Callback* cob) override {
     return std::make_shared<NaiveRoutingDataHandler>(connId, cob);
   }
+
+  // Route straight from the peeked first byte, without a routing pipeline
+  size_t getMaxPeekBytes() const override {
+    return 1;
+  }
+
+  bool peekRoutingData(folly::ByteRange peeked, char& routingData) override {
+    if (peeked.empty()) {
+      return false;
+    }
+    routingData = peeked[0];
+    return true;
+  }
 };
 
 class ThreadPrintingHandler : public BytesToBytesHandler {
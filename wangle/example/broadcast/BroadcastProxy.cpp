@@ -25,7 +25,6 @@
 #include <wangle/channel/broadcast/BroadcastPool.h>
 #include <wangle/channel/broadcast/ObservingHandler.h>
 #include <wangle/codec/ByteToMessageDecoder.h>
-#include <wangle/codec/MessageToByteEncoder.h>
 
 using namespace folly;
 using namespace wangle;
@@ -61,38 +60,26 @@ DEFINE_int32(upstream_port, 8081, "Upstream server port");
  */
 
 /**
- * A simple decoder that decodes bytes in IOBufQueue to std::string.
- * This is used in the BroadcastPipeline to convert bytes read from the
- * upstream server's socket to strings of messages that can be broadcasted
- * to all the clients/observers.
+ * A simple decoder that hands the bytes in IOBufQueue to the broadcast as
+ * a single IOBuf chain. This is used in the BroadcastPipeline so that
+ * each message read from the upstream server is encoded exactly once;
+ * every ObservingPipeline then writes a refcounted clone() of the same
+ * buffer to its client socket instead of copying it.
  */
-class ByteToStringDecoder : public ByteToMessageDecoder<std::string> {
+class ByteToIOBufDecoder : public ByteToByteDecoder {
  public:
   bool decode(Context*,
               IOBufQueue& buf,
-              std::string& result,
+              std::unique_ptr<IOBuf>& result,
               size_t&) override {
     if (buf.chainLength() > 0) {
-      result = buf.move()->moveToFbString().toStdString();
+      result = buf.move();
       return true;
     }
     return false;
   }
 };
 
-/**
- * A simple encoder that encodes strings of messages to IOBuf.
- * This is used in the ObservingPipeline to encode the messages
- * broadcasted by the upstream to IOBuf so that it can be written
- * to the client socket.
- */
-class StringToByteEncoder : public MessageToByteEncoder<std::string> {
- public:
-  std::unique_ptr<folly::IOBuf> encode(std::string& msg) override {
-    return IOBuf::copyBuffer(msg);
-  }
-};
-
 /**
  * Simple RoutingDataHandler that sets the client IP as the routing data.
  * All requests from the same client IP will be hashed to the same worker
@@ -149,7 +136,7 @@ class SimpleServerPool : public ServerPool<std::string> {
  * messages sent by the upstream server to all the observers/clients.
  */
 class SimpleBroadcastPipelineFactory
-    : public BroadcastPipelineFactory<std::string, std::string> {
+    : public BroadcastPipelineFactory<std::unique_ptr<IOBuf>, std::string> {
  public:
   DefaultPipeline::Ptr newPipeline(
       std::shared_ptr<AsyncTransportWrapper> socket) override {
@@ -157,15 +144,17 @@ class SimpleBroadcastPipelineFactory
 
     auto pipeline = DefaultPipeline::create();
     pipeline->addBack(AsyncSocketHandler(socket));
-    pipeline->addBack(ByteToStringDecoder());
-    pipeline->addBack(BroadcastHandler<std::string, std::string>());
+    pipeline->addBack(ByteToIOBufDecoder());
+    pipeline->addBack(
+        BroadcastHandler<std::unique_ptr<IOBuf>, std::string>());
     pipeline->finalize();
     return pipeline;
   }
 
-  BroadcastHandler<std::string, std::string>* getBroadcastHandler(
+  BroadcastHandler<std::unique_ptr<IOBuf>, std::string>* getBroadcastHandler(
       DefaultPipeline* pipeline) noexcept override {
-    return pipeline->getHandler<BroadcastHandler<std::string, std::string>>();
+    return pipeline
+        ->getHandler<BroadcastHandler<std::unique_ptr<IOBuf>, std::string>>();
   }
 
   void setRoutingData(
@@ -173,7 +162,7 @@ class SimpleBroadcastPipelineFactory
       const std::string& /* routingData */) noexcept override {}
 };
 
-using SimpleObservingPipeline = ObservingPipeline<std::string>;
+using SimpleObservingPipeline = ObservingPipeline<std::unique_ptr<IOBuf>>;
 
 /**
  * An ObservingPipeline that maintains the client socket connection and
@@ -182,12 +171,12 @@ using SimpleObservingPipeline = ObservingPipeline<std::string>;
  * connection.
  */
 class SimpleObservingPipelineFactory
-    : public ObservingPipelineFactory<std::string, std::string> {
+    : public ObservingPipelineFactory<std::unique_ptr<IOBuf>, std::string> {
  public:
   SimpleObservingPipelineFactory(
       std::shared_ptr<SimpleServerPool> serverPool,
       std::shared_ptr<SimpleBroadcastPipelineFactory> broadcastPipelineFactory)
-      : ObservingPipelineFactory<std::string, std::string>(
+      : ObservingPipelineFactory<std::unique_ptr<IOBuf>, std::string>(
             serverPool, broadcastPipelineFactory) {}
 
   SimpleObservingPipeline::Ptr newPipeline(
@@ -200,9 +189,8 @@ class SimpleObservingPipelineFactory
 
     auto pipeline = SimpleObservingPipeline::create();
     pipeline->addBack(AsyncSocketHandler(socket));
-    pipeline->addBack(StringToByteEncoder());
     pipeline->addBack(
-        std::make_shared<ObservingHandler<std::string, std::string>>(
+        std::make_shared<ObservingHandler<std::unique_ptr<IOBuf>, std::string>>(
             routingData, broadcastPool()));
     pipeline->finalize();
     return pipeline;
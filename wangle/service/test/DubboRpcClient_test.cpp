@@ -1,9 +1,16 @@
 //
 // Created by chijinxin on 18-6-5.
 //
+#include <atomic>
+#include <chrono>
 #include <iostream>
+#include <thread>
+#include <vector>
 
+#include <folly/AtomicIntrusiveLinkedList.h>
 #include <folly/init/Init.h>
+#include <folly/io/async/AsyncTimeout.h>
+#include <folly/io/async/EventBase.h>
 //#include <folly/AtomicHashMap.h>
 
 #include <wangle/service/Service.h>
@@ -13,6 +20,8 @@
 #include <wangle/channel/AsyncSocketHandler.h>
 #include <wangle/codec/LengthFieldBasedFrameDecoder.h>
 #include <wangle/codec/LengthFieldPrepender.h>
+#include <wangle/codec/DubboRequestEncoder.h>
+#include <wangle/codec/DubboResponseDecoder.h>
 #include <wangle/channel/EventBaseHandler.h>
 
 using namespace std;
@@ -32,6 +41,7 @@ class Xtruct{
 public:
     int64_t resp_id; //dubbo response id
     string result;   //response result
+    folly::exception_wrapper error; //error status or service exception
 };
 
 using SerializePipeline = wangle::Pipeline<IOBufQueue&, Bonk>;
@@ -39,90 +49,65 @@ using SerializePipeline = wangle::Pipeline<IOBufQueue&, Bonk>;
 
 DEFINE_int32(port, 20880, "test server port");
 DEFINE_string(host, "127.0.0.1", "test server address");
+DEFINE_bool(batch, false, "write all requests queued on a connection with one writev");
+DEFINE_int32(batch_delay_ms, 1, "longest a batch waits for more requests, with --batch");
+DEFINE_int32(callers, 1, "threads issuing requests, with --batch");
+
+
+Xtruct toXtruct(DubboResponse response)
+{
+    Xtruct received;
+    received.resp_id = response.id;
+    received.error = std::move(response.exception);
+    if(response.payload)
+    {
+        received.result = response.payload->moveToFbString().toStdString();
+    }
+    return received;
+}
+
+std::unique_ptr<folly::IOBuf> encodeBonk(const Bonk& b)
+{
+    DubboInvocation invocation;
+    invocation.interfaceName = b.interfaceName;
+    invocation.method = b.method;
+    invocation.parameterTypes = b.parameterTypesString;
+    invocation.argument = b.parameter;
+    //header and body in a single buffer
+    return DubboRequestEncoder::encode(b.req_id, invocation);
+}
 
 
 /*
  * Dubbo协议序列化处理句柄
  */
-class DubboRpcClientSerializeHandler : public wangle::Handler<std::unique_ptr<folly::IOBuf>,
+class DubboRpcClientSerializeHandler : public wangle::Handler<DubboResponse,
                                                       Xtruct,
                                                       Bonk,
                                                       std::unique_ptr<folly::IOBuf> >
 {
 public:
-    void read(Context* ctx, std::unique_ptr<folly::IOBuf> ioBuf) override
+    void read(Context* ctx, DubboResponse response) override
     {
-       // cout<<"process DubboRpcClientSerializeHandler -> read!!!"<<endl;
-        if(ioBuf)
-        {
-            ioBuf->coalesce();  //移动IO缓冲区链中的所有数据到一个单一的连续缓冲区内
-            Xtruct received;
-            for(int i=0;i<8;i++)
-            {
-                *( (char*)&received.resp_id + 7 - i ) = *( (const char*)ioBuf->data() + 4 + i );
-            }
-
-            received.result.assign((const char*)ioBuf->data()+16,ioBuf->length()-16);
-            //cout<<"[DubboRpcClientSerializeHandler] Read: request_id="<<received.resp_id<<" result="<<received.result<<endl;
-            ctx->fireRead(received);
-        }
+        ctx->fireRead(toXtruct(std::move(response)));
     }
 
     folly::Future<folly::Unit> write(Context* ctx, Bonk b) override
     {
-        string request;
-        //1. Dubbo version
-        request.append("\"2.0.1\"");  request.append("\n");
-        //2. InterfaceName
-        request.append("\"");
-        request.append(b.interfaceName);
-        request.append("\"");         request.append("\n");
-        //3. Service version
-        request.append("null");       request.append("\n");
-        //4. Method name
-        request.append("\"");
-        request.append(b.method);
-        request.append("\"");         request.append("\n");
-        //5. Method parameter types
-        request.append("\"");
-        request.append(b.parameterTypesString);
-        request.append("\"");         request.append("\n");
-        //6. parameter args
-        request.append("\"");
-        request.append(b.parameter);
-        request.append("\"");         request.append("\n");
-        //7. attachment
-        request.append("{\"path\":\"");
-        request.append(b.interfaceName);
-        request.append("\"}");        request.append("\n");
-       // cout<<"[DubboRpcClientSerializeHandler] Write: request_id="<<b.req_id<<" result="<<request<<endl;
-        int len = request.length();
-
-       // char headData[16];
-        headData[0]=0xda;
-        headData[1]=0xbb; //Magic
-        headData[2]=0x06;  headData[2] |= (1<<7);  headData[2] |= (1<<6);
-        headData[3]=0x00; //Status(not use in request)
-        //request id (8 byte)
-        for(int i=0;i<8;i++)
-        {
-            headData[4+i] = *((char*)&b.req_id + 7 - i);
-        }
-        //data length (4 byte)
-        for(int i=15;i>=12;i--)
-        {
-            headData[i] = *(((char*)&len)+(15-i));
-        }
-
-        auto buf = folly::IOBuf::copyBuffer(headData,16);
-
-        buf->appendChain(folly::IOBuf::copyBuffer(request.data(),request.length()));
-
-        return ctx->fireWrite(std::move(buf));
+        return ctx->fireWrite(encodeBonk(b));
     }
+};
 
-private:
-    char headData[16];
+/*
+ * Dubbo协议反序列化处理句柄，请求由BonkBatchingClientDispatcher自己编码
+ */
+class DubboRpcClientDecodeHandler : public wangle::InboundHandler<DubboResponse, Xtruct>
+{
+public:
+    void read(Context* ctx, DubboResponse response) override
+    {
+        ctx->fireRead(toXtruct(std::move(response)));
+    }
 };
 
 /*
@@ -135,13 +120,30 @@ public:
         auto pipeline = SerializePipeline::create();
         pipeline->addBack(AsyncSocketHandler(socket));
         pipeline->addBack(EventBaseHandler()); //ensure we can write from any thread
-        pipeline->addBack(LengthFieldBasedFrameDecoder(4,4096,12,0,0));
+        pipeline->addBack(DubboResponseDecoder());
         pipeline->addBack(DubboRpcClientSerializeHandler());
         pipeline->finalize();
         return pipeline;
     }
 };
 
+/*
+ * Dubbo rpc pipeline factory for BonkBatchingClientDispatcher, which writes
+ * encoded frames from the io thread
+ */
+class DubboRpcBatchPipelineFactory : public PipelineFactory<DefaultPipeline> {
+public:
+    DefaultPipeline::Ptr newPipeline(std::shared_ptr<AsyncTransportWrapper> socket) override
+    {
+        auto pipeline = DefaultPipeline::create();
+        pipeline->addBack(AsyncSocketHandler(socket));
+        pipeline->addBack(DubboResponseDecoder());
+        pipeline->addBack(DubboRpcClientDecodeHandler());
+        pipeline->finalize();
+        return pipeline;
+    }
+};
+
 /*
  * Client multiplex dispatcher.  Uses Bonk.req_id as request ID
  */
@@ -156,7 +158,12 @@ public:
         //CHECK(search != requests_.end());
         auto p = std::move(search->second);
         requests_.erase(in.resp_id);
-        p.setValue(in);
+        if(in.error)
+        {
+            p.setException(std::move(in.error));
+            return;
+        }
+        p.setValue(std::move(in));
     }
 
     Future<Xtruct> operator()(Bonk arg) override {
@@ -189,33 +196,180 @@ private:
 };
 
 
-int main(int argc, char** argv)
+/*
+ * Client multiplex dispatcher that writes many requests per syscall.
+ * Requests may be issued from any thread: they are pushed onto a lock-free
+ * list, and the one pushed onto an empty list wakes the io thread, which
+ * encodes everything queued by then into one IOBuf chain and writes it with
+ * a single writev.
+ *
+ * Under load a batch waits for more requests, up to maxBatchDelay. The wait
+ * doubles while batches hold more than one request and halves while they
+ * do not, so a lone caller is not held back. The wait is a timeout on the
+ * io thread, so it is in whole milliseconds.
+ */
+class BonkBatchingClientDispatcher : public HandlerAdapter<Xtruct, std::unique_ptr<IOBuf>>,
+                                     public Service<Bonk, Xtruct>
 {
-    folly::Init init(&argc, &argv);
-    ClientBootstrap<SerializePipeline> client;
+    class BatchTimeout : public AsyncTimeout
+    {
+    public:
+        BatchTimeout(BonkBatchingClientDispatcher* dispatcher, EventBase* evb)
+                : AsyncTimeout(evb), dispatcher_(dispatcher) {}
 
-    client.group(std::make_shared<folly::IOThreadPoolExecutor>(4));
+        void timeoutExpired() noexcept override
+        {
+            dispatcher_->flush();
+        }
 
-    cout<<"Dubbo RPC test!!!"<<endl;
+    private:
+        BonkBatchingClientDispatcher* dispatcher_;
+    };
 
-    client.pipelineFactory(std::make_shared<DubboRpcPipelineFactory>());
+public:
+    explicit BonkBatchingClientDispatcher(std::chrono::milliseconds maxBatchDelay)
+            : maxBatchDelay_(maxBatchDelay)
+    {
+    }
+
+    ~BonkBatchingClientDispatcher() override
+    {
+        //requests that never reached the io thread
+        queue_.sweep([](PendingRequest* pending) { delete pending; });
+    }
+
+    void setPipeline(DefaultPipeline* pipeline)
+    {
+        evb_ = pipeline->getTransport()->getEventBase();
+        batchTimeout_ = std::make_unique<BatchTimeout>(this, evb_);
+        pipeline->addBack(this);
+        pipeline->finalize();
+    }
 
-    auto pipeline = client.connect(SocketAddress(FLAGS_host, FLAGS_port)).get();
-    cout<<"connect to dubbo server success!!!!"<<endl;
-    auto dispatcher = std::make_shared<BonkMultiplexClientDispatcher>();
-    dispatcher->setPipeline(pipeline);
-    // Set an idle timeout of 5s using a filter.
+    void read(Context*, Xtruct in) override
+    {
+        auto search = requests_.find(in.resp_id);
+        if(search==requests_.end()) return;
+        auto p = std::move(search->second);
+        requests_.erase(search);
+        if(in.error)
+        {
+            p.setException(std::move(in.error));
+            return;
+        }
+        p.setValue(std::move(in));
+    }
+
+    Future<Xtruct> operator()(Bonk arg) override
+    {
+        auto pending = new PendingRequest(std::move(arg));
+        auto id = pending->request.req_id;
+        auto f = pending->promise.getFuture();
+        //still queued, the flush skips it; already written, drop its promise
+        pending->promise.setInterruptHandler(
+                [this, id, cancelled = pending->cancelled](const folly::exception_wrapper&) {
+            cancelled->store(true);
+            evb_->runInEventBaseThread([this, id]() { requests_.erase(id); });
+        });
+        //the io thread owns pending from here on
+        if (queue_.insertHead(pending))
+        {
+            evb_->runInEventBaseThread([this]() { startBatch(); });
+        }
+        return f;
+    }
+
+    Future<Unit> close() override {
+        cout<<"Channel closed\n";
+        return via(evb_, [this]() { return HandlerAdapter<Xtruct, std::unique_ptr<IOBuf>>::close(getContext()); });
+    }
+
+    Future<Unit> close(Context* ctx) override {
+        cout<<"Channel closed\n";
+        return HandlerAdapter<Xtruct, std::unique_ptr<IOBuf>>::close(ctx);
+    }
+
+private:
+    struct PendingRequest
+    {
+        explicit PendingRequest(Bonk b) : request(std::move(b)) {}
+
+        Bonk request;
+        Promise<Xtruct> promise;
+        //set by the interrupt handler, on any thread
+        std::shared_ptr<std::atomic<bool>> cancelled{std::make_shared<std::atomic<bool>>(false)};
+        folly::AtomicIntrusiveLinkedListHook<PendingRequest> hook;
+    };
+
+    static constexpr std::chrono::milliseconds kMinBatchDelay{1};
+
+    void startBatch()
+    {
+        //an earlier flush may have taken this batch's requests already
+        if (batchTimeout_->isScheduled() || queue_.empty())
+        {
+            return;
+        }
+        if (batchDelay_.count() == 0)
+        {
+            flush();
+            return;
+        }
+        batchTimeout_->scheduleTimeout(batchDelay_);
+    }
+
+    void flush()
+    {
+        IOBufQueue batch(IOBufQueue::cacheChainLength());
+        size_t batchSize = 0;
+        queue_.sweep([&](PendingRequest* p) {
+            std::unique_ptr<PendingRequest> pending(p);
+            if (pending->cancelled->load())
+            {
+                return;
+            }
+            requests_[pending->request.req_id] = std::move(pending->promise);
+            batch.append(encodeBonk(pending->request));
+            batchSize++;
+        });
+        if (batchSize == 0)
+        {
+            return;
+        }
+
+        if (batchSize > 1)
+        {
+            batchDelay_ = std::min(maxBatchDelay_, std::max(batchDelay_ * 2, kMinBatchDelay));
+        }
+        else
+        {
+            batchDelay_ /= 2;
+        }
+        getContext()->fireWrite(batch.move());
+    }
+
+    EventBase* evb_{nullptr};
+    folly::AtomicIntrusiveLinkedList<PendingRequest, &PendingRequest::hook> queue_;
+    //below only touched on the io thread
+    std::unique_ptr<BatchTimeout> batchTimeout_;
+    std::unordered_map<int64_t, Promise<Xtruct>> requests_;
+    const std::chrono::milliseconds maxBatchDelay_;
+    std::chrono::milliseconds batchDelay_{0};
+};
+
+constexpr std::chrono::milliseconds BonkBatchingClientDispatcher::kMinBatchDelay;
+
+
+void issueRequests(std::shared_ptr<Service<Bonk, Xtruct>> dispatcher, std::atomic_long& id)
+{
     ExpiringFilter<Bonk, Xtruct> service(dispatcher);
-    std::atomic_long id={0L};
-    int a=1;
   //  try {
         while (true)
         {
            // cin>>a;
-            id++;
           //  cout<<id<<endl;
             Bonk request;
-            request.req_id = id;
+            request.req_id = ++id;
             request.interfaceName="com.alibaba.dubbo.performance.demo.provider.IHelloService";
             request.method="hash";
             request.parameterTypesString="Ljava/lang/String;";
@@ -230,5 +384,51 @@ int main(int argc, char** argv)
 //    {
 //        std::cout << exceptionStr(e) << std::endl;
 //    }
+}
+
+
+int main(int argc, char** argv)
+{
+    folly::Init init(&argc, &argv);
+    cout<<"Dubbo RPC test!!!"<<endl;
+
+    ClientBootstrap<SerializePipeline> client;
+    ClientBootstrap<DefaultPipeline> batchClient;
+    std::shared_ptr<Service<Bonk, Xtruct>> dispatcher;
+    if (FLAGS_batch)
+    {
+        batchClient.group(std::make_shared<folly::IOThreadPoolExecutor>(4));
+        batchClient.pipelineFactory(std::make_shared<DubboRpcBatchPipelineFactory>());
+        auto pipeline = batchClient.connect(SocketAddress(FLAGS_host, FLAGS_port)).get();
+        cout<<"connect to dubbo server success!!!!"<<endl;
+        auto batching = std::make_shared<BonkBatchingClientDispatcher>(
+                std::chrono::milliseconds(std::max(0, FLAGS_batch_delay_ms)));
+        batching->setPipeline(pipeline);
+        dispatcher = batching;
+    }
+    else
+    {
+        client.group(std::make_shared<folly::IOThreadPoolExecutor>(4));
+        client.pipelineFactory(std::make_shared<DubboRpcPipelineFactory>());
+        auto pipeline = client.connect(SocketAddress(FLAGS_host, FLAGS_port)).get();
+        cout<<"connect to dubbo server success!!!!"<<endl;
+        auto multiplex = std::make_shared<BonkMultiplexClientDispatcher>();
+        multiplex->setPipeline(pipeline);
+        dispatcher = multiplex;
+    }
+
+    std::atomic_long id={0L};
+    //BonkMultiplexClientDispatcher keeps its requests in a plain map, so only one caller
+    int callers = FLAGS_batch ? std::max(1, FLAGS_callers) : 1;
+    std::vector<std::thread> threads;
+    for (int i = 1; i < callers; i++)
+    {
+        threads.emplace_back([dispatcher, &id]() { issueRequests(dispatcher, id); });
+    }
+    issueRequests(dispatcher, id);
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
     return 0;
 }
\ No newline at end of file
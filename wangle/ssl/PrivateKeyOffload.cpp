@@ -0,0 +1,289 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <wangle/ssl/PrivateKeyOffload.h>
+
+#include <folly/executors/CPUThreadPoolExecutor.h>
+#include <glog/logging.h>
+
+#include <cstring>
+#include <vector>
+
+#include <errno.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#if FOLLY_OPENSSL_IS_110 && defined(SSL_MODE_ASYNC) && \
+    !defined(OPENSSL_IS_BORINGSSL)
+#include <openssl/async.h>
+#define WANGLE_HAVE_ASYNC_PRIVATE_KEY 1
+#else
+#define WANGLE_HAVE_ASYNC_PRIVATE_KEY 0
+#endif
+
+namespace wangle {
+
+std::shared_ptr<PrivateKeyOffload> PrivateKeyOffload::create(
+    std::shared_ptr<folly::Executor> executor,
+    uint32_t maxPendingOperations) {
+  return std::shared_ptr<PrivateKeyOffload>(
+      new PrivateKeyOffload(std::move(executor), maxPendingOperations));
+}
+
+std::shared_ptr<PrivateKeyOffload> PrivateKeyOffload::create(
+    size_t numThreads,
+    uint32_t maxPendingOperations) {
+  return create(
+      std::make_shared<folly::CPUThreadPoolExecutor>(numThreads),
+      maxPendingOperations);
+}
+
+void PrivateKeyOffload::limitPendingOperations(
+    uint32_t maxPendingOperations) {
+  auto current = maxPending_.load(std::memory_order_relaxed);
+  while (maxPendingOperations < current &&
+         !maxPending_.compare_exchange_weak(current, maxPendingOperations)) {
+  }
+}
+
+bool PrivateKeyOffload::tryAcquire() {
+  auto pending = numPending_.fetch_add(1, std::memory_order_relaxed);
+  if (pending >= maxPending_.load(std::memory_order_relaxed)) {
+    numPending_.fetch_sub(1, std::memory_order_relaxed);
+    return false;
+  }
+  return true;
+}
+
+void PrivateKeyOffload::release() {
+  numPending_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+#if WANGLE_HAVE_ASYNC_PRIVATE_KEY
+
+namespace {
+
+// Identifies our fd in the job's ASYNC_WAIT_CTX
+const char kWaitFdKey = 0;
+
+/**
+ * One operation handed to the pool. Shared between the paused job and the
+ * pool thread so either can go away first.
+ */
+struct OffloadOperation {
+  ~OffloadOperation() {
+    if (writeFd >= 0) {
+      ::close(writeFd);
+    }
+  }
+
+  std::vector<unsigned char> input;
+  std::vector<unsigned char> output;
+  int result{-1};
+  std::atomic<bool> done{false};
+  // Written once the result is ready, to wake the handshake
+  int writeFd{-1};
+};
+
+typedef std::shared_ptr<OffloadOperation> OperationRef;
+typedef int (*RsaOperation)(int, const unsigned char*, unsigned char*,
+                            RSA*, int);
+
+void freeOffloadRef(void* /* parent */, void* ptr, CRYPTO_EX_DATA* /* ad */,
+                    int /* idx */, long /* argl */, void* /* argp */) {
+  delete static_cast<std::weak_ptr<PrivateKeyOffload>*>(ptr);
+}
+
+int getRsaExIndex() {
+  static int index =
+    RSA_get_ex_new_index(0, nullptr, nullptr, nullptr, freeOffloadRef);
+  return index;
+}
+
+// Called if the SSL goes away while the job is still parked. The read end
+// belongs to the AsyncSSLSocket waiting on it.
+void cleanupWaitFd(ASYNC_WAIT_CTX* /* ctx */, const void* /* key */,
+                   OSSL_ASYNC_FD /* fd */, void* custom) {
+  delete static_cast<OperationRef*>(custom);
+}
+
+void clearWaitFd(ASYNC_WAIT_CTX* waitCtx) {
+  OSSL_ASYNC_FD fd;
+  void* custom = nullptr;
+  if (ASYNC_WAIT_CTX_get_fd(waitCtx, &kWaitFdKey, &fd, &custom)) {
+    // clear_fd leaves cleanup to the caller
+    ASYNC_WAIT_CTX_clear_fd(waitCtx, &kWaitFdKey);
+    delete static_cast<OperationRef*>(custom);
+  }
+}
+
+}
+
+bool PrivateKeyOffload::isSupported() {
+  return true;
+}
+
+RSA_METHOD* PrivateKeyOffload::getOffloadMethod() {
+  static RSA_METHOD* method = [] {
+    auto m = RSA_meth_dup(RSA_PKCS1_OpenSSL());
+    CHECK(m);
+    RSA_meth_set1_name(m, "wangle private key offload");
+    RSA_meth_set_priv_enc(m, &PrivateKeyOffload::privateEncrypt);
+    RSA_meth_set_priv_dec(m, &PrivateKeyOffload::privateDecrypt);
+    return m;
+  }();
+  return method;
+}
+
+bool PrivateKeyOffload::attach(SSL_CTX* ctx) {
+  EVP_PKEY* pkey = SSL_CTX_get0_privatekey(ctx);
+  RSA* rsa = pkey ? EVP_PKEY_get0_RSA(pkey) : nullptr;
+  if (!rsa) {
+    VLOG(2) << "Not offloading private key operations for a non-RSA key";
+    return false;
+  }
+
+  auto ref = static_cast<std::weak_ptr<PrivateKeyOffload>*>(
+    RSA_get_ex_data(rsa, getRsaExIndex()));
+  if (ref) {
+    *ref = shared_from_this();
+  } else {
+    RSA_set_ex_data(rsa, getRsaExIndex(),
+                    new std::weak_ptr<PrivateKeyOffload>(shared_from_this()));
+  }
+  if (RSA_get_method(rsa) != getOffloadMethod()) {
+    RSA_set_method(rsa, getOffloadMethod());
+  }
+  SSL_CTX_set_mode(ctx, SSL_MODE_ASYNC);
+  return true;
+}
+
+int PrivateKeyOffload::privateEncrypt(int flen, const unsigned char* from,
+                                      unsigned char* to, RSA* rsa,
+                                      int padding) {
+  return run(true, flen, from, to, rsa, padding);
+}
+
+int PrivateKeyOffload::privateDecrypt(int flen, const unsigned char* from,
+                                      unsigned char* to, RSA* rsa,
+                                      int padding) {
+  return run(false, flen, from, to, rsa, padding);
+}
+
+int PrivateKeyOffload::run(bool encrypt, int flen, const unsigned char* from,
+                           unsigned char* to, RSA* rsa, int padding) {
+  RsaOperation rsaOp = encrypt ?
+    RSA_meth_get_priv_enc(RSA_PKCS1_OpenSSL()) :
+    RSA_meth_get_priv_dec(RSA_PKCS1_OpenSSL());
+
+  // Outside of a handshake's async job there is nothing to suspend
+  ASYNC_JOB* job = ASYNC_get_current_job();
+  auto ref = static_cast<std::weak_ptr<PrivateKeyOffload>*>(
+    RSA_get_ex_data(rsa, getRsaExIndex()));
+  auto offload = ref ? ref->lock() : nullptr;
+  if (!job || !offload || !offload->tryAcquire()) {
+    return rsaOp(flen, from, to, rsa, padding);
+  }
+
+  // A socket pair rather than a pipe, so that signalling a handshake whose
+  // socket has already closed the read end fails with EPIPE instead of
+  // raising SIGPIPE on the pool thread
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0,
+                 fds) != 0) {
+    PLOG(ERROR) << "Failed to create private key offload wakeup fds";
+    offload->release();
+    return rsaOp(flen, from, to, rsa, padding);
+  }
+  auto op = std::make_shared<OffloadOperation>();
+  op->writeFd = fds[1];
+  op->input.assign(from, from + flen);
+  op->output.resize(RSA_size(rsa));
+
+  ASYNC_WAIT_CTX* waitCtx = ASYNC_get_wait_ctx(job);
+  std::unique_ptr<OperationRef> custom(new OperationRef(op));
+  if (!ASYNC_WAIT_CTX_set_wait_fd(waitCtx, &kWaitFdKey, fds[0],
+                                  custom.get(), cleanupWaitFd)) {
+    ::close(fds[0]);
+    offload->release();
+    return rsaOp(flen, from, to, rsa, padding);
+  }
+  custom.release();
+
+  RSA_up_ref(rsa);
+  try {
+    offload->executor_->add([offload, op, rsa, rsaOp, padding] {
+      op->result = rsaOp(op->input.size(), op->input.data(),
+                         op->output.data(), rsa, padding);
+      RSA_free(rsa);
+      op->done.store(true, std::memory_order_release);
+      offload->release();
+      char signal = 1;
+      ssize_t written;
+      do {
+        written =
+          ::send(op->writeFd, &signal, sizeof(signal), MSG_NOSIGNAL);
+      } while (written < 0 && errno == EINTR);
+    });
+  } catch (const std::exception& ex) {
+    LOG(ERROR) << "Failed to offload private key operation: " << ex.what();
+    clearWaitFd(waitCtx);
+    ::close(fds[0]);
+    RSA_free(rsa);
+    offload->release();
+    return rsaOp(flen, from, to, rsa, padding);
+  }
+
+  // SSL_accept returns SSL_ERROR_WANT_ASYNC here, and we are resumed on
+  // the socket's EventBase after the pool writes to the wakeup fd
+  bool paused = false;
+  while (!op->done.load(std::memory_order_acquire)) {
+    if (!ASYNC_pause_job()) {
+      // Rather than block the EventBase on the pool, sign here and let the
+      // pool's result go unused
+      LOG(ERROR) << "Failed to pause handshake for private key operation, "
+        "running it inline";
+      clearWaitFd(waitCtx);
+      if (!paused) {
+        // The socket never saw the read end
+        ::close(fds[0]);
+      }
+      return rsaOp(flen, from, to, rsa, padding);
+    }
+    paused = true;
+  }
+  clearWaitFd(waitCtx);
+
+  if (op->result > 0) {
+    memcpy(to, op->output.data(), op->result);
+  }
+  return op->result;
+}
+
+#else
+
+bool PrivateKeyOffload::isSupported() {
+  return false;
+}
+
+bool PrivateKeyOffload::attach(SSL_CTX* /* ctx */) {
+  LOG(WARNING) << "Private key offload needs OpenSSL 1.1.0 async support; "
+    "private key operations will run inline";
+  return false;
+}
+
+#endif
+
+} // namespace wangle
@@ -0,0 +1,108 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+#include <folly/Executor.h>
+#include <folly/portability/OpenSSL.h>
+
+namespace wangle {
+
+/**
+ * Runs the RSA private key operations of server handshakes on a CPU pool
+ * instead of on the EventBase that owns the connection.
+ *
+ * attach() switches the key of an SSL_CTX to an RSA method that, when
+ * called from inside an OpenSSL async job, hands the operation to the
+ * executor and pauses the job. SSL_accept then returns
+ * SSL_ERROR_WANT_ASYNC; AsyncSSLSocket parks the handshake on the job's
+ * wait fd and restarts it on its own EventBase once the pool has signalled
+ * that fd, at which point the job picks up the result. The rest of the
+ * connections on that EventBase keep being served in the meantime.
+ *
+ * At most getMaxPendingOperations() operations are queued or running at
+ * once; beyond that they run inline, as they would without offload. The
+ * limit covers every SSL_CTX attached to this instance, whichever thread
+ * or acceptor owns it.
+ *
+ * Requires OpenSSL 1.1.0 async jobs (SSL_MODE_ASYNC). With older libraries
+ * attach() leaves the context alone and handshakes sign inline.
+ */
+class PrivateKeyOffload
+    : public std::enable_shared_from_this<PrivateKeyOffload> {
+ public:
+  static std::shared_ptr<PrivateKeyOffload> create(
+      std::shared_ptr<folly::Executor> executor,
+      uint32_t maxPendingOperations);
+
+  /**
+   * Create an offload with its own CPU pool of numThreads threads
+   */
+  static std::shared_ptr<PrivateKeyOffload> create(
+      size_t numThreads,
+      uint32_t maxPendingOperations);
+
+  /**
+   * Offload the private key operations of ctx, and enable async mode on
+   * it. Keys that are not RSA are left alone. Returns whether offload is
+   * in effect for ctx.
+   */
+  bool attach(SSL_CTX* ctx);
+
+  /**
+   * Lower the limit on pending operations to at most maxPendingOperations
+   */
+  void limitPendingOperations(uint32_t maxPendingOperations);
+
+  uint32_t getMaxPendingOperations() const {
+    return maxPending_.load(std::memory_order_relaxed);
+  }
+
+  uint32_t getNumPendingOperations() const {
+    return numPending_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Whether this build of OpenSSL supports offloading at all
+   */
+  static bool isSupported();
+
+ private:
+  PrivateKeyOffload(
+      std::shared_ptr<folly::Executor> executor,
+      uint32_t maxPendingOperations)
+      : executor_(std::move(executor)),
+        maxPending_(maxPendingOperations) {}
+
+  bool tryAcquire();
+  void release();
+
+  static int privateEncrypt(int flen, const unsigned char* from,
+                            unsigned char* to, RSA* rsa, int padding);
+  static int privateDecrypt(int flen, const unsigned char* from,
+                            unsigned char* to, RSA* rsa, int padding);
+  static int run(bool encrypt, int flen, const unsigned char* from,
+                 unsigned char* to, RSA* rsa, int padding);
+  static RSA_METHOD* getOffloadMethod();
+
+  std::shared_ptr<folly::Executor> executor_;
+  std::atomic<uint32_t> maxPending_;
+  std::atomic<uint32_t> numPending_{0};
+};
+
+} // namespace wangle
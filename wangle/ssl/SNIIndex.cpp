@@ -0,0 +1,186 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <wangle/ssl/SNIIndex.h>
+
+#include <folly/String.h>
+#include <folly/hash/Hash.h>
+#include <glog/logging.h>
+
+#include <map>
+
+namespace wangle {
+
+constexpr uint32_t SNIIndex::kNone;
+constexpr size_t SNIIndex::kNumCertCrypto;
+
+namespace {
+
+inline char lowerAscii(char c) {
+  return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+// Start of the label that ends at end
+inline size_t labelStart(folly::StringPiece name, size_t end) {
+  size_t start = end;
+  while (start > 0 && name[start - 1] != '.') {
+    --start;
+  }
+  return start;
+}
+
+}
+
+SNIIndex::SNIIndex(const DomainNameMap& dnMap) {
+  nodes_.emplace_back();
+
+  // (parent, label) -> child while building; flattened into edges_ below
+  std::map<std::pair<uint32_t, std::string>, uint32_t> children;
+  for (const auto& entry : dnMap) {
+    folly::StringPiece name(entry.first.dnString.data(),
+                            entry.first.dnString.size());
+    bool isWildcard = name.startsWith('.');
+    if (isWildcard) {
+      name.advance(1);
+    }
+
+    uint32_t node = 0;
+    size_t end = name.size();
+    while (true) {
+      size_t start = labelStart(name, end);
+      std::string label(name.data() + start, end - start);
+      folly::toLowerAscii(label);
+      auto it = children.find(std::make_pair(node, label));
+      if (it == children.end()) {
+        uint32_t child = nodes_.size();
+        nodes_.emplace_back();
+        it = children.emplace(std::make_pair(node, std::move(label)),
+                              child).first;
+      }
+      node = it->second;
+      if (start == 0) {
+        break;
+      }
+      end = start - 1;
+    }
+
+    auto crypto = static_cast<size_t>(entry.first.certCrypto);
+    CHECK_LT(crypto, kNumCertCrypto);
+    auto& slots = isWildcard ? nodes_[node].wildcard : nodes_[node].exact;
+    slots[crypto] = ctxs_.size();
+    ctxs_.push_back(entry.second);
+  }
+
+  size_t tableSize = 1;
+  while (tableSize < children.size() * 2) {
+    tableSize <<= 1;
+  }
+  edges_.resize(tableSize);
+  edgeMask_ = tableSize - 1;
+  for (const auto& child : children) {
+    const auto& label = child.first.second;
+    Edge edge;
+    edge.hash = hashLabel(child.first.first, label.data(), label.size());
+    edge.parent = child.first.first;
+    edge.child = child.second;
+    edge.labelOffset = labels_.size();
+    edge.labelLength = label.size();
+    labels_.append(label);
+
+    size_t i = edge.hash & edgeMask_;
+    while (edges_[i].child != kNone) {
+      i = (i + 1) & edgeMask_;
+    }
+    edges_[i] = edge;
+  }
+}
+
+uint64_t SNIIndex::hashLabel(uint32_t parent, const char* label, size_t len) {
+  // FNV-1a over the lowercased label, seeded by the parent node
+  uint64_t hash = 0xcbf29ce484222325ULL ^
+    (uint64_t(parent) * 0x9e3779b97f4a7c15ULL);
+  for (size_t i = 0; i < len; ++i) {
+    hash ^= static_cast<uint8_t>(lowerAscii(label[i]));
+    hash *= 0x100000001b3ULL;
+  }
+  return folly::hash::twang_mix64(hash);
+}
+
+uint32_t SNIIndex::findChild(uint32_t parent,
+                             const char* label,
+                             size_t len) const {
+  uint64_t hash = hashLabel(parent, label, len);
+  for (size_t i = hash & edgeMask_; ; i = (i + 1) & edgeMask_) {
+    const auto& edge = edges_[i];
+    if (edge.child == kNone) {
+      return kNone;
+    }
+    if (edge.hash != hash || edge.parent != parent ||
+        edge.labelLength != len) {
+      continue;
+    }
+    const char* stored = labels_.data() + edge.labelOffset;
+    size_t j = 0;
+    while (j < len && stored[j] == lowerAscii(label[j])) {
+      ++j;
+    }
+    if (j == len) {
+      return edge.child;
+    }
+  }
+}
+
+const std::shared_ptr<folly::SSLContext>* SNIIndex::lookup(
+    folly::StringPiece name,
+    CertCrypto certCrypto,
+    bool exact,
+    bool wildcard) const {
+  auto crypto = static_cast<size_t>(certCrypto);
+  uint32_t node = 0;
+  // The node for everything after the first label, if the name has one
+  uint32_t suffixNode = kNone;
+  size_t end = name.size();
+  while (true) {
+    size_t start = labelStart(name, end);
+    if (start == 0 && end != name.size()) {
+      suffixNode = node;
+      if (!exact) {
+        break;
+      }
+    }
+    node = findChild(node, name.data() + start, end - start);
+    if (node == kNone) {
+      break;
+    }
+    if (start == 0) {
+      auto idx = nodes_[node].exact[crypto];
+      if (exact && idx != kNone) {
+        return &ctxs_[idx];
+      }
+      break;
+    }
+    end = start - 1;
+  }
+
+  if (wildcard && suffixNode != kNone) {
+    auto idx = nodes_[suffixNode].wildcard[crypto];
+    if (idx != kNone) {
+      return &ctxs_[idx];
+    }
+  }
+  return nullptr;
+}
+
+} // namespace wangle
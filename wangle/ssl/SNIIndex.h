@@ -0,0 +1,136 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <array>
+#include <limits>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <folly/Range.h>
+#include <folly/io/async/SSLContext.h>
+
+#include <wangle/acceptor/SSLContextSelectionMisc.h>
+
+namespace wangle {
+
+/**
+ * Immutable index from server name to SSLContext, compiled from the
+ * (DomainName -> SSL_CTX) map that SSLContextManager maintains.
+ *
+ * Names are stored as a trie of their labels from right to left, so
+ * "www.facebook.com" is the path com -> facebook -> www. Each node holds
+ * the context for the exact name it spells and the context for the
+ * wildcard one level below it ("*.facebook.com" lives on the
+ * com -> facebook node). Child edges of all nodes share one open-addressed
+ * hash table keyed by (parent, lowercased label).
+ *
+ * A lookup hashes each label of the server name in place, costs one probe
+ * sequence per label and never allocates, so it is cheap to run on every
+ * ClientHello no matter how many certificates are loaded.
+ */
+class SNIIndex {
+ public:
+  typedef std::unordered_map<
+    SSLContextKey,
+    std::shared_ptr<folly::SSLContext>,
+    SSLContextKeyHash> DomainNameMap;
+
+  /**
+   * Compile an index from a DomainName map. Keys beginning with '.' are
+   * wildcard names ("*." with the '*' removed).
+   */
+  explicit SNIIndex(const DomainNameMap& dnMap);
+
+  /**
+   * Search first by exact domain, then by one level up. Returns nullptr if
+   * nothing matches; the pointer is valid for the lifetime of the index.
+   */
+  const std::shared_ptr<folly::SSLContext>* find(
+    folly::StringPiece name,
+    CertCrypto certCrypto) const {
+    return lookup(name, certCrypto, true, true);
+  }
+
+  /**
+   * Search by the full-string domain name
+   */
+  const std::shared_ptr<folly::SSLContext>* findExact(
+    folly::StringPiece name,
+    CertCrypto certCrypto) const {
+    return lookup(name, certCrypto, true, false);
+  }
+
+  /**
+   * Search by the _one_ level up subdomain
+   */
+  const std::shared_ptr<folly::SSLContext>* findBySuffix(
+    folly::StringPiece name,
+    CertCrypto certCrypto) const {
+    return lookup(name, certCrypto, false, true);
+  }
+
+  /**
+   * Number of names in the index
+   */
+  size_t size() const {
+    return ctxs_.size();
+  }
+
+ private:
+  static constexpr uint32_t kNone = std::numeric_limits<uint32_t>::max();
+  // One slot per CertCrypto value
+  static constexpr size_t kNumCertCrypto = 2;
+
+  struct Node {
+    Node() {
+      exact.fill(kNone);
+      wildcard.fill(kNone);
+    }
+    // Indexes into ctxs_
+    std::array<uint32_t, kNumCertCrypto> exact;
+    std::array<uint32_t, kNumCertCrypto> wildcard;
+  };
+
+  struct Edge {
+    uint64_t hash{0};
+    uint32_t parent{kNone};
+    uint32_t child{kNone};
+    uint32_t labelOffset{0};
+    uint32_t labelLength{0};
+  };
+
+  const std::shared_ptr<folly::SSLContext>* lookup(
+    folly::StringPiece name,
+    CertCrypto certCrypto,
+    bool exact,
+    bool wildcard) const;
+
+  uint32_t findChild(uint32_t parent, const char* label, size_t len) const;
+
+  static uint64_t hashLabel(uint32_t parent, const char* label, size_t len);
+
+  std::vector<Node> nodes_;
+  std::vector<Edge> edges_;
+  size_t edgeMask_{0};
+  // Lowercased labels of all edges, back to back
+  std::string labels_;
+  std::vector<std::shared_ptr<folly::SSLContext>> ctxs_;
+};
+
+} // namespace wangle
@@ -17,6 +17,7 @@
 
 #include <wangle/ssl/ClientHelloExtStats.h>
 #include <wangle/ssl/PasswordInFile.h>
+#include <wangle/ssl/PrivateKeyOffload.h>
 #include <wangle/ssl/SSLCacheOptions.h>
 #include <wangle/ssl/ServerSSLContext.h>
 #include <wangle/ssl/SSLSessionCacheManager.h>
@@ -192,7 +193,7 @@ SSLContextManager::SSLContextManager(
     stats_(stats),
     eventBase_(eventBase),
     strict_(strict) {
-
+  rebuildSNIIndex();
 }
 
 void SSLContextManager::SslContexts::swap(SslContexts& other) noexcept {
@@ -243,6 +244,7 @@ void SSLContextManager::resetSSLContextConfigs(
                         &contexts);
   }
   contexts_.swap(contexts);
+  rebuildSNIIndex();
 }
 
 void SSLContextManager::loadCertificate(
@@ -260,6 +262,7 @@ void SSLContextManager::addSSLContextConfig(
   const std::shared_ptr<SSLCacheProvider>& externalCache,
   SslContexts* contexts) {
 
+  bool liveContexts = !contexts || contexts == &contexts_;
   if (!contexts) {
     contexts = &contexts_;
   }
@@ -351,6 +354,12 @@ void SSLContextManager::addSSLContextConfig(
 
   overrideConfiguration(sslCtx, ctxConfig);
 
+  if (privateKeyOffload_ &&
+      (ctxConfig.isLocalPrivateKey ||
+       ctxConfig.keyOffloadParams.offloadType.empty())) {
+    privateKeyOffload_->attach(sslCtx->getSSLCtx());
+  }
+
   // Let the server pick the highest performing cipher from among the client's
   // choices.
   //
@@ -433,13 +442,14 @@ void SSLContextManager::addSSLContextConfig(
     throw std::runtime_error(msg);
   }
 
+  if (liveContexts) {
+    rebuildSNIIndex();
+  }
 }
 
 #ifdef PROXYGEN_HAVE_SERVERNAMECALLBACK
 SSLContext::ServerNameCallbackResult
 SSLContextManager::serverNameCallback(SSL* ssl) {
-  shared_ptr<SSLContext> ctx;
-
   const char* sn = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
   bool reqHasServerName = true;
   if (!sn) {
@@ -481,16 +491,18 @@ SSLContextManager::serverNameCallback(SSL* ssl) {
     }
   }
 
-  DNString dnstr(sn, snLen);
+  folly::StringPiece dnstr(sn, snLen);
   uint32_t count = 0;
   do {
+    // Reload every time round: noMatchFn_ may have added a cert
+    auto index = getSNIIndex();
+
     // First look for a context with the exact crypto needed. Weaker crypto will
     // be in the map as best available if it is the best we have for that
     // subject name.
-    SSLContextKey key(dnstr, certCryptoReq);
-    ctx = getSSLCtx(key);
-    if (ctx) {
-      sslSocket->switchServerSSLContext(ctx);
+    auto match = index->find(dnstr, certCryptoReq);
+    if (match) {
+      sslSocket->switchServerSSLContext(*match);
       if (clientHelloTLSExtStats_) {
         if (reqHasServerName) {
           clientHelloTLSExtStats_->recordMatch();
@@ -502,10 +514,9 @@ SSLContextManager::serverNameCallback(SSL* ssl) {
 
     // If we didn't find an exact match, look for a cert with upgraded crypto.
     if (certCryptoReq != CertCrypto::BEST_AVAILABLE) {
-      SSLContextKey fallbackKey(dnstr, CertCrypto::BEST_AVAILABLE);
-      ctx = getSSLCtx(fallbackKey);
-      if (ctx) {
-        sslSocket->switchServerSSLContext(ctx);
+      match = index->find(dnstr, CertCrypto::BEST_AVAILABLE);
+      if (match) {
+        sslSocket->switchServerSSLContext(*match);
         if (clientHelloTLSExtStats_) {
           if (reqHasServerName) {
             clientHelloTLSExtStats_->recordMatch();
@@ -760,6 +771,13 @@ void SSLContextManager::insertIntoDnMap(SSLContextKey key,
 
 void SSLContextManager::clear() {
   contexts_.clear();
+  rebuildSNIIndex();
+}
+
+void SSLContextManager::rebuildSNIIndex() {
+  auto index = std::make_shared<const SNIIndex>(contexts_.dnMap);
+  VLOG(4) << "Compiled SNI index with " << index->size() << " names";
+  std::atomic_store(&sniIndex_, std::shared_ptr<const SNIIndex>(index));
 }
 
 shared_ptr<SSLContext>
@@ -775,18 +793,13 @@ SSLContextManager::getSSLCtx(const SSLContextKey& key) const
 shared_ptr<SSLContext>
 SSLContextManager::getSSLCtxBySuffix(const SSLContextKey& key) const
 {
-  size_t dot;
-
-  if ((dot = key.dnString.find_first_of(".")) != DNString::npos) {
-    SSLContextKey suffixKey(DNString(key.dnString, dot),
-        key.certCrypto);
-    const auto v = contexts_.dnMap.find(suffixKey);
-    if (v != contexts_.dnMap.end()) {
-      VLOG(6) << folly::stringPrintf("\"%s\" is a willcard match to \"%s\"",
-                                     key.dnString.c_str(),
-                                     suffixKey.dnString.c_str());
-      return v->second;
-    }
+  auto match = getSNIIndex()->findBySuffix(
+    folly::StringPiece(key.dnString.data(), key.dnString.size()),
+    key.certCrypto);
+  if (match) {
+    VLOG(6) << folly::stringPrintf("\"%s\" is a willcard match",
+                                   key.dnString.c_str());
+    return *match;
   }
 
   VLOG(6) << folly::stringPrintf("\"%s\" is not a wildcard match",
@@ -797,15 +810,17 @@ SSLContextManager::getSSLCtxBySuffix(const SSLContextKey& key) const
 shared_ptr<SSLContext>
 SSLContextManager::getSSLCtxByExactDomain(const SSLContextKey& key) const
 {
-  const auto v = contexts_.dnMap.find(key);
-  if (v == contexts_.dnMap.end()) {
+  auto match = getSNIIndex()->findExact(
+    folly::StringPiece(key.dnString.data(), key.dnString.size()),
+    key.certCrypto);
+  if (!match) {
     VLOG(6) << folly::stringPrintf("\"%s\" is not an exact match",
                                    key.dnString.c_str());
     return shared_ptr<SSLContext>();
   } else {
     VLOG(6) << folly::stringPrintf("\"%s\" is an exact match",
                                    key.dnString.c_str());
-    return v->second;
+    return *match;
   }
 }
 
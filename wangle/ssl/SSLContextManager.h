@@ -23,6 +23,7 @@
 #include <list>
 #include <memory>
 #include <wangle/ssl/SSLContextConfig.h>
+#include <wangle/ssl/SNIIndex.h>
 #include <wangle/ssl/SSLSessionCacheManager.h>
 #include <wangle/ssl/TLSTicketKeySeeds.h>
 #include <wangle/acceptor/SSLContextSelectionMisc.h>
@@ -38,6 +39,7 @@ class SSLContext;
 namespace wangle {
 
 class ClientHelloExtStats;
+class PrivateKeyOffload;
 struct SSLCacheOptions;
 class SSLStats;
 class TLSTicketKeyManager;
@@ -55,12 +57,10 @@ class SSLContextManager {
     std::string defaultCtxDomainName;
 
     /**
-     * Container to store the (DomainName -> SSL_CTX) mapping
+     * Container to store the (DomainName -> SSL_CTX) mapping. SNI lookups
+     * go through the SNIIndex compiled from it.
      */
-    std::unordered_map<
-      SSLContextKey,
-      std::shared_ptr<folly::SSLContext>,
-      SSLContextKeyHash> dnMap;
+    SNIIndex::DomainNameMap dnMap;
   };
 
  public:
@@ -88,6 +88,9 @@ class SSLContextManager {
    * Add a new X509 to SSLContextManager.  The details of a X509
    * is passed as a SSLContextConfig object.
    *
+   * Adding to the live contexts recompiles the whole SNI index, so use
+   * resetSSLContextConfigs() to add many configs at once.
+   *
    * @param ctxConfig     Details of a X509, its private key, password, etc.
    * @param cacheOptions  Options for how to do session caching.
    * @param ticketSeeds   If non-null, the initial ticket key seeds to use.
@@ -170,6 +173,14 @@ class SSLContextManager {
         clientCertVerifyCallback_ = std::move(cb);
   }
 
+  /**
+   * Offload private key operations of contexts added from now on whose
+   * keys live in this process
+   */
+  void setPrivateKeyOffload(std::shared_ptr<PrivateKeyOffload> offload) {
+    privateKeyOffload_ = std::move(offload);
+  }
+
  protected:
   virtual void enableAsyncCrypto(
     const std::shared_ptr<folly::SSLContext>&,
@@ -206,6 +217,7 @@ class SSLContextManager {
     std::shared_ptr<folly::SSLContext> sslCtx,
     CertCrypto certCrypto = CertCrypto::BEST_AVAILABLE) {
     insertSSLCtxByDomainName(dn, len, sslCtx, contexts_, certCrypto);
+    rebuildSNIIndex();
   }
 
  private:
@@ -238,7 +250,8 @@ class SSLContextManager {
    *
    * 3. It uses one std::unordered_map<DomainName, SSL_CTX> object to
    *    do this.  For wildcard name like "*.facebook.com", ".facebook.com"
-   *    is used as the key.
+   *    is used as the key.  Whenever the map changes it is compiled into
+   *    an SNIIndex, which is what handshakes search.
    *
    * 4. After getting tlsext_hostname from the client hello message, it
    *    will do a full string search first and then try one level up to
@@ -264,12 +277,24 @@ class SSLContextManager {
     bool overwrite,
     SslContexts& contexts);
 
+  /**
+   * Compile contexts_.dnMap into a new SNIIndex and publish it
+   */
+  void rebuildSNIIndex();
+
+  std::shared_ptr<const SNIIndex> getSNIIndex() const {
+    return std::atomic_load(&sniIndex_);
+  }
+
   SslContexts contexts_;
+  // Replaced as a whole (never modified) so lookups need no locking
+  std::shared_ptr<const SNIIndex> sniIndex_;
   folly::EventBase* eventBase_;
   ClientHelloExtStats* clientHelloTLSExtStats_{nullptr};
   SSLContextConfig::SNINoMatchFn noMatchFn_;
   bool strict_{true};
   std::unique_ptr<ClientCertVerifyCallback> clientCertVerifyCallback_{nullptr};
+  std::shared_ptr<PrivateKeyOffload> privateKeyOffload_;
 };
 
 } // namespace wangle
@@ -22,6 +22,8 @@
 #include <folly/io/async/EventBase.h>
 #include <folly/portability/GFlags.h>
 
+#include <algorithm>
+
 using folly::SSLContext;
 using folly::EventBase;
 using folly::AsyncSSLSocket;
@@ -49,90 +51,265 @@ using namespace folly::ssl;
 int SSLSessionCacheManager::sExDataIndex_ = -1;
 shared_ptr<ShardedLocalSSLSessionCache> SSLSessionCacheManager::sCache_;
 std::mutex SSLSessionCacheManager::sCacheLock_;
+std::unordered_map<std::string, SSLSessionCacheManager::GlobalLookup>
+  SSLSessionCacheManager::sGlobalLookups_;
+std::mutex SSLSessionCacheManager::sGlobalLookupsLock_;
+
+namespace {
+
+size_t nextPowerOfTwo(size_t n) {
+  size_t p = 1;
+  while (p < n) {
+    p <<= 1;
+  }
+  return p;
+}
+
+// The shard index is taken from the low bits of the key hash, so remix it
+// before probing or every key in a shard would start in the same slots
+size_t probeStart(size_t hash) {
+  return folly::hash::twang_mix64(hash);
+}
+
+}
+
+// ClockSSLSessionCacheShard Implementation
+ClockSSLSessionCacheShard::ClockSSLSessionCacheShard(uint32_t capacity)
+    : capacity_(std::max<uint32_t>(capacity, 1)),
+      // At most half full, so probes for misses stay short
+      table_(new Table(nextPowerOfTwo(2 * size_t(capacity_)))),
+      ring_(capacity_, nullptr) {
+  freeRing_.reserve(capacity_);
+  for (size_t i = capacity_; i > 0; i--) {
+    freeRing_.push_back(i - 1);
+  }
+}
+
+ClockSSLSessionCacheShard::~ClockSSLSessionCacheShard() {
+  // No readers can be left at this point
+  for (auto entry : ring_) {
+    delete entry;
+  }
+  delete table_.load();
+}
+
+SSL_SESSION* ClockSSLSessionCacheShard::lookup(
+    const std::string& sessionId,
+    size_t hash) {
+  folly::hazptr::hazptr_holder tableHazard;
+  folly::hazptr::hazptr_holder entryHazard;
+  const size_t start = probeStart(hash);
+  while (true) {
+    Table* table = tableHazard.get_protected(table_);
+    bool retry = false;
+    for (size_t n = 0; n <= table->mask; n++) {
+      Entry* entry = entryHazard.get_protected(
+          table->slots[(start + n) & table->mask]);
+      if (!entry) {
+        break;
+      }
+      if (entry == tombstone()) {
+        continue;
+      }
+      // A replaced table is not updated when entries are removed later, so
+      // its slots only validate entries while it is still the current table
+      if (table_.load() != table) {
+        retry = true;
+        break;
+      }
+      if (entry->hash == hash && entry->id == sessionId) {
+        // Avoid dirtying the cache line on every hit
+        if (!entry->referenced.load(std::memory_order_relaxed)) {
+          entry->referenced.store(true, std::memory_order_relaxed);
+        }
+        SSL_SESSION_up_ref(entry->session);
+        return entry->session;
+      }
+    }
+    if (!retry) {
+      return nullptr;
+    }
+  }
+}
+
+uint32_t ClockSSLSessionCacheShard::store(
+    const std::string& sessionId,
+    size_t hash,
+    SSL_SESSION* session) {
+  std::lock_guard<std::mutex> g(lock_);
+  Table* table = table_.load(std::memory_order_relaxed);
+  auto entry = new Entry(sessionId, hash, session);
+
+  size_t slot = findSlot(table, sessionId, hash);
+  if (slot <= table->mask) {
+    // This can happen in race conditions; replace the session in place
+    Entry* old = table->slots[slot].load(std::memory_order_relaxed);
+    entry->ringPos = old->ringPos;
+    ring_[entry->ringPos] = entry;
+    table->slots[slot].store(entry, std::memory_order_release);
+    old->retire();
+    return 0;
+  }
+
+  uint32_t evicted = 0;
+  if (freeRing_.empty()) {
+    evictOne();
+    evicted++;
+  }
+  entry->ringPos = freeRing_.back();
+  freeRing_.pop_back();
+  ring_[entry->ringPos] = entry;
+  insertIndex(table, entry);
+  size_.fetch_add(1, std::memory_order_relaxed);
+  maybeRebuild();
+  return evicted;
+}
+
+void ClockSSLSessionCacheShard::remove(
+    const std::string& sessionId,
+    size_t hash) {
+  std::lock_guard<std::mutex> g(lock_);
+  Table* table = table_.load(std::memory_order_relaxed);
+  size_t slot = findSlot(table, sessionId, hash);
+  if (slot <= table->mask) {
+    unlinkEntry(table->slots[slot].load(std::memory_order_relaxed));
+    maybeRebuild();
+  }
+}
+
+size_t ClockSSLSessionCacheShard::size() const {
+  return size_.load(std::memory_order_relaxed);
+}
+
+size_t ClockSSLSessionCacheShard::findSlot(
+    Table* table,
+    const std::string& sessionId,
+    size_t hash) const {
+  const size_t start = probeStart(hash);
+  for (size_t n = 0; n <= table->mask; n++) {
+    size_t slot = (start + n) & table->mask;
+    Entry* entry = table->slots[slot].load(std::memory_order_relaxed);
+    if (!entry) {
+      break;
+    }
+    if (entry != tombstone() && entry->hash == hash &&
+        entry->id == sessionId) {
+      return slot;
+    }
+  }
+  return table->mask + 1;
+}
+
+void ClockSSLSessionCacheShard::insertIndex(Table* table, Entry* entry) {
+  const size_t start = probeStart(entry->hash);
+  for (size_t n = 0; n <= table->mask; n++) {
+    auto& slot = table->slots[(start + n) & table->mask];
+    Entry* current = slot.load(std::memory_order_relaxed);
+    if (!current || current == tombstone()) {
+      if (current) {
+        tombstones_--;
+      }
+      // Publishes the fully constructed entry to readers
+      slot.store(entry, std::memory_order_release);
+      return;
+    }
+  }
+  // The table is sized to twice the ring, so this can't happen
+  LOG(FATAL) << "SSL session cache index is full";
+}
+
+void ClockSSLSessionCacheShard::unlinkEntry(Entry* entry) {
+  Table* table = table_.load(std::memory_order_relaxed);
+  const size_t start = probeStart(entry->hash);
+  for (size_t n = 0; n <= table->mask; n++) {
+    auto& slot = table->slots[(start + n) & table->mask];
+    if (slot.load(std::memory_order_relaxed) == entry) {
+      slot.store(tombstone(), std::memory_order_release);
+      tombstones_++;
+      break;
+    }
+  }
+  ring_[entry->ringPos] = nullptr;
+  freeRing_.push_back(entry->ringPos);
+  size_.fetch_sub(1, std::memory_order_relaxed);
+  // Freed along with its session once no lookup holds it
+  entry->retire();
+}
 
-LocalSSLSessionCache::LocalSSLSessionCache(uint32_t maxCacheSize,
-                                           uint32_t cacheCullSize)
-    : sessionCache(maxCacheSize, cacheCullSize) {
-  sessionCache.setPruneHook(std::bind(
-                              &LocalSSLSessionCache::pruneSessionCallback,
-                              this, std::placeholders::_1,
-                              std::placeholders::_2));
+size_t ClockSSLSessionCacheShard::evictOne() {
+  // Terminates within two turns of the hand: the first clears every bit
+  while (true) {
+    size_t pos = hand_;
+    hand_ = (hand_ + 1) % capacity_;
+    Entry* entry = ring_[pos];
+    if (!entry) {
+      continue;
+    }
+    if (entry->referenced.load(std::memory_order_relaxed)) {
+      entry->referenced.store(false, std::memory_order_relaxed);
+      continue;
+    }
+    VLOG(4) << "Free SSL session from local cache; id="
+            << SSLUtil::hexlify(entry->id);
+    unlinkEntry(entry);
+    return pos;
+  }
 }
 
-void LocalSSLSessionCache::pruneSessionCallback(const string& sessionId,
-                                                SSL_SESSION* session) {
-  VLOG(4) << "Free SSL session from local cache; id="
-          << SSLUtil::hexlify(sessionId);
-  SSL_SESSION_free(session);
-  ++removedSessions_;
+void ClockSSLSessionCacheShard::maybeRebuild() {
+  Table* old = table_.load(std::memory_order_relaxed);
+  // Tombstones make misses probe further; rebuild once a quarter of the
+  // index is tombstones
+  if (tombstones_ * 4 <= old->mask + 1) {
+    return;
+  }
+  auto table = new Table(old->mask + 1);
+  for (auto entry : ring_) {
+    if (entry) {
+      insertIndex(table, entry);
+    }
+  }
+  tombstones_ = 0;
+  table_.store(table);
+  old->retire();
 }
 
 // ShardedLocalSSLSessionCache Implementation
 ShardedLocalSSLSessionCache::ShardedLocalSSLSessionCache(
     uint32_t n_buckets,
     uint32_t maxCacheSize,
-    uint32_t cacheCullSize) {
+    uint32_t /*cacheCullSize*/) {
   CHECK(n_buckets > 0);
   maxCacheSize = (uint32_t)(((double)maxCacheSize) / n_buckets);
-  cacheCullSize = (uint32_t)(((double)cacheCullSize) / n_buckets);
   if (maxCacheSize == 0) {
     maxCacheSize = 1;
   }
-  if (cacheCullSize == 0) {
-    cacheCullSize = 1;
-  }
   for (uint32_t i = 0; i < n_buckets; i++) {
-    caches_.push_back(std::unique_ptr<LocalSSLSessionCache>(
-        new LocalSSLSessionCache(maxCacheSize, cacheCullSize)));
+    caches_.push_back(std::unique_ptr<ClockSSLSessionCacheShard>(
+        new ClockSSLSessionCacheShard(maxCacheSize)));
   }
 }
 
 SSL_SESSION* ShardedLocalSSLSessionCache::lookupSession(
     const std::string& sessionId) {
-  size_t bucket = hash(sessionId);
-  SSL_SESSION* session = nullptr;
-  std::lock_guard<std::mutex> g(caches_[bucket]->lock);
-
-  auto itr = caches_[bucket]->sessionCache.find(sessionId);
-  if (itr != caches_[bucket]->sessionCache.end()) {
-    session = itr->second;
-  }
-
-  if (session) {
-    SSL_SESSION_up_ref(session);
-  }
-  return session;
+  size_t h = folly::Hash()(sessionId);
+  return caches_[h % caches_.size()]->lookup(sessionId, h);
 }
 
 void ShardedLocalSSLSessionCache::storeSession(
     const std::string& sessionId,
     SSL_SESSION* session,
     SSLStats* stats) {
-  size_t bucket = hash(sessionId);
-  SSL_SESSION* oldSession = nullptr;
-  std::lock_guard<std::mutex> g(caches_[bucket]->lock);
-
-  auto itr = caches_[bucket]->sessionCache.find(sessionId);
-  if (itr != caches_[bucket]->sessionCache.end()) {
-    oldSession = itr->second;
-  }
-
-  if (oldSession) {
-    // LRUCacheMap doesn't free on overwrite, so 2x the work for us
-    // This can happen in race conditions
-    SSL_SESSION_free(oldSession);
-  }
-  caches_[bucket]->removedSessions_ = 0;
-  caches_[bucket]->sessionCache.set(sessionId, session, true);
+  size_t h = folly::Hash()(sessionId);
+  auto removed = caches_[h % caches_.size()]->store(sessionId, h, session);
   if (stats) {
-    stats->recordSSLSessionFree(caches_[bucket]->removedSessions_);
+    stats->recordSSLSessionFree(removed);
   }
 }
 
 void ShardedLocalSSLSessionCache::removeSession(const std::string& sessionId) {
-  size_t bucket = hash(sessionId);
-  std::lock_guard<std::mutex> g(caches_[bucket]->lock);
-  caches_[bucket]->sessionCache.erase(sessionId);
+  size_t h = folly::Hash()(sessionId);
+  caches_[h % caches_.size()]->remove(sessionId, h);
 }
 
 // SSLSessionCacheManager implementation
@@ -170,6 +347,28 @@ SSLSessionCacheManager::SSLSessionCacheManager(
 }
 
 SSLSessionCacheManager::~SSLSessionCacheManager() {
+  // Results already posted to our EventBase see alive_ expire; just stop
+  // new ones from being posted. Lookups we sent will never be answered to
+  // anyone else, so fail them for the managers attached to them.
+  std::vector<std::string> owned;
+  {
+    std::lock_guard<std::mutex> g(sGlobalLookupsLock_);
+    for (auto& entry : sGlobalLookups_) {
+      if (entry.second.owner == this) {
+        owned.push_back(entry.first);
+      }
+      auto& waiters = entry.second.waiters;
+      waiters.erase(
+        std::remove_if(waiters.begin(), waiters.end(),
+                       [this](const RemoteWaiter& w) {
+                         return w.manager == this;
+                       }),
+        waiters.end());
+    }
+  }
+  for (const auto& sessionId : owned) {
+    completeGlobalLookup(sessionId, nullptr);
+  }
 }
 
 void SSLSessionCacheManager::shutdown() {
@@ -300,6 +499,19 @@ SSL_SESSION* SSLSessionCacheManager::getSession(
       PendingLookupMap::iterator pit = pendingLookups_.find(sessionId);
       if (pit == pendingLookups_.end()) {
         auto result = pendingLookups_.emplace(sessionId, PendingLookup());
+        if (!startOrAttachGlobalLookup(sessionId,
+                                       sslSocket->getEventBase())) {
+          // Another thread is already fetching it; we get the answer on
+          // our EventBase through onRemoteLookupComplete
+          VLOG(4) << "Get SSL session [Pending]: Request in progress on "
+            "another thread: attach; fd=" << sslSocket->getFd() <<
+            " id=" << SSLUtil::hexlify(sessionId);
+          std::unique_ptr<DelayedDestruction::DestructorGuard> dg(
+            new DelayedDestruction::DestructorGuard(sslSocket));
+          result.first->second.waiters.emplace_back(sslSocket, std::move(dg));
+          *copyflag = SSL_SESSION_CB_WOULD_BLOCK;
+          return nullptr;
+        }
         // initiate fetch
         VLOG(4) << "Get SSL session [Pending]: Initiate Fetch; fd=" <<
           sslSocket->getFd() << " id=" << SSLUtil::hexlify(sessionId);
@@ -310,6 +522,7 @@ SSL_SESSION* SSLSessionCacheManager::getSession(
         } else {
           missReason = "reason: failed to send lookup request;";
           pendingLookups_.erase(result.first);
+          completeGlobalLookup(sessionId, nullptr);
         }
       } else {
         // A lookup was already initiated from this thread
@@ -397,6 +610,68 @@ void SSLSessionCacheManager::restartSSLAccept(
     attachedLookup.first->restartSSLAccept();
   }
   pendingLookups_.erase(pit);
+  completeGlobalLookup(cacheCtx->sessionId, cacheCtx->session);
+}
+
+bool SSLSessionCacheManager::startOrAttachGlobalLookup(
+    const string& sessionId,
+    EventBase* evb) {
+  std::lock_guard<std::mutex> g(sGlobalLookupsLock_);
+  auto result = sGlobalLookups_.emplace(sessionId, GlobalLookup{this, {}});
+  if (result.second) {
+    // We own the request
+    return true;
+  }
+  result.first->second.waiters.push_back(RemoteWaiter{this, alive_, evb});
+  return false;
+}
+
+void SSLSessionCacheManager::completeGlobalLookup(
+    const string& sessionId,
+    SSL_SESSION* session) {
+  std::vector<RemoteWaiter> waiters;
+  {
+    std::lock_guard<std::mutex> g(sGlobalLookupsLock_);
+    auto it = sGlobalLookups_.find(sessionId);
+    if (it == sGlobalLookups_.end()) {
+      return;
+    }
+    waiters = std::move(it->second.waiters);
+    sGlobalLookups_.erase(it);
+  }
+  for (auto& waiter : waiters) {
+    // Each waiter gets its own reference, released once it has resumed
+    if (session != nullptr) {
+      SSL_SESSION_up_ref(session);
+    }
+    auto manager = waiter.manager;
+    auto alive = waiter.alive;
+    waiter.evb->runInEventBaseThread([manager, alive, sessionId, session] {
+      if (alive.lock()) {
+        manager->onRemoteLookupComplete(sessionId, session);
+      }
+      if (session != nullptr) {
+        SSL_SESSION_free(session);
+      }
+    });
+  }
+}
+
+void SSLSessionCacheManager::onRemoteLookupComplete(
+    const string& sessionId,
+    SSL_SESSION* session) {
+  PendingLookupMap::iterator pit = pendingLookups_.find(sessionId);
+  if (pit == pendingLookups_.end()) {
+    return;
+  }
+  pit->second.request_in_progress = false;
+  pit->second.session = session;
+  for (const auto& attachedLookup: pit->second.waiters) {
+    VLOG(4) << "Restart SSL accept (remote lookup) for fd=" <<
+      attachedLookup.first->getFd();
+    attachedLookup.first->restartSSLAccept();
+  }
+  pendingLookups_.erase(pit);
 }
 
 void SSLSessionCacheManager::restoreSession(
@@ -423,6 +698,7 @@ void SSLSessionCacheManager::onGetSuccess(
     SSLCacheProvider::CacheContext* cacheCtx,
     std::unique_ptr<folly::IOBuf> valueBuf) {
   if (!valueBuf) {
+    onGetFailure(cacheCtx);
     return;
   }
   valueBuf->coalesce();
@@ -18,8 +18,11 @@
 #include <wangle/ssl/SSLCacheProvider.h>
 #include <wangle/ssl/SSLStats.h>
 
-#include <folly/container/EvictingCacheMap.h>
+#include <atomic>
 #include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <folly/experimental/hazptr/hazptr.h>
 #include <folly/hash/Hash.h>
 #include <folly/io/async/AsyncSSLSocket.h>
 
@@ -28,40 +31,96 @@ namespace wangle {
 class SSLStats;
 
 /**
- * Basic SSL session cache map: Maps session id -> session
- */
-typedef folly::EvictingCacheMap<std::string, SSL_SESSION*> SSLSessionCacheMap;
-
-/**
- * Holds an SSLSessionCacheMap and associated lock
+ * One shard of the local SSL session cache.
+ *
+ * Lookups take no lock. Sessions are kept in an open addressed index of
+ * immutable entries which readers walk under hazard pointers, so a lookup
+ * is a few atomic loads plus SSL_SESSION_up_ref. Writers serialize on the
+ * shard lock, and removed entries and replaced index tables are retired to
+ * the hazard pointer domain, which frees them once no reader holds them.
+ *
+ * Eviction is CLOCK (second chance) rather than strict LRU: a lookup only
+ * sets the entry's referenced bit, and an insert into a full shard sweeps
+ * the clock hand, clearing bits, until it finds an entry that was not
+ * referenced since the last sweep.
  */
-class LocalSSLSessionCache: private boost::noncopyable {
+class ClockSSLSessionCacheShard : private boost::noncopyable {
  public:
-  LocalSSLSessionCache(uint32_t maxCacheSize, uint32_t cacheCullSize);
+  explicit ClockSSLSessionCacheShard(uint32_t capacity);
+  ~ClockSSLSessionCacheShard();
 
-  ~LocalSSLSessionCache() {
-    std::lock_guard<std::mutex> g(lock);
-    // EvictingCacheMap dtor doesn't free values
-    sessionCache.clear();
-  }
+  /**
+   * Returns a new reference to the session, or nullptr.
+   */
+  SSL_SESSION* lookup(const std::string& sessionId, size_t hash);
 
-  SSLSessionCacheMap sessionCache;
-  std::mutex lock;
-  uint32_t removedSessions_{0};
+  /**
+   * Takes ownership of session. Returns the number of sessions evicted.
+   */
+  uint32_t store(const std::string& sessionId, size_t hash,
+                 SSL_SESSION* session);
+
+  void remove(const std::string& sessionId, size_t hash);
+
+  size_t size() const;
 
  private:
+  struct Entry : public folly::hazptr::hazptr_obj_base<Entry> {
+    Entry(const std::string& i, size_t h, SSL_SESSION* s)
+        : id(i), hash(h), session(s) {}
+    ~Entry() {
+      SSL_SESSION_free(session);
+    }
+
+    const std::string id;
+    const size_t hash;
+    SSL_SESSION* const session;
+    std::atomic<bool> referenced{false};
+    // Position in the clock ring, guarded by the shard lock
+    size_t ringPos{0};
+  };
+
+  struct Table : public folly::hazptr::hazptr_obj_base<Table> {
+    explicit Table(size_t n) : slots(new std::atomic<Entry*>[n]), mask(n - 1) {
+      for (size_t i = 0; i < n; i++) {
+        slots[i].store(nullptr, std::memory_order_relaxed);
+      }
+    }
+
+    std::unique_ptr<std::atomic<Entry*>[]> slots;
+    const size_t mask;
+  };
+
+  static Entry* tombstone() {
+    return reinterpret_cast<Entry*>(uintptr_t(1));
+  }
 
-  void pruneSessionCallback(const std::string& sessionId,
-                            SSL_SESSION* session);
+  // The following require lock_ to be held
+  size_t findSlot(Table* table, const std::string& sessionId,
+                  size_t hash) const;
+  void insertIndex(Table* table, Entry* entry);
+  void unlinkEntry(Entry* entry);
+  size_t evictOne();
+  void maybeRebuild();
+
+  const uint32_t capacity_;
+  std::atomic<Table*> table_;
+
+  std::mutex lock_;
+  std::vector<Entry*> ring_;
+  std::vector<size_t> freeRing_;
+  size_t hand_{0};
+  size_t tombstones_{0};
+  std::atomic<size_t> size_{0};
 };
 
 /**
- * A sharded LRU for SSL sessions.  The sharding is inteneded to reduce
- * contention for the LRU locks.  Assuming uniform distribution, two workers
- * will contend for the same lock with probability 1 / n_buckets^2.
+ * A sharded, lock-free-read cache for SSL sessions. Sharding keeps writers
+ * of different sessions from contending, and readers take no locks at all.
  */
 class ShardedLocalSSLSessionCache : private boost::noncopyable {
  public:
+  // cacheCullSize is kept for compatibility; CLOCK evicts one at a time
   ShardedLocalSSLSessionCache(uint32_t n_buckets, uint32_t maxCacheSize,
                               uint32_t cacheCullSize);
 
@@ -76,7 +135,7 @@ class ShardedLocalSSLSessionCache : private boost::noncopyable {
     return folly::Hash()(key) % caches_.size();
   }
 
-  std::vector< std::unique_ptr<LocalSSLSessionCache> > caches_;
+  std::vector< std::unique_ptr<ClockSSLSessionCacheShard> > caches_;
 };
 
 /* A socket/DestructorGuard pair */
@@ -102,7 +161,7 @@ struct PendingLookup {
 };
 
 /* Maps SSL session id to a PendingLookup structure */
-typedef std::map<std::string, PendingLookup> PendingLookupMap;
+typedef std::unordered_map<std::string, PendingLookup> PendingLookupMap;
 
 /**
  * SSLSessionCacheManager handles all stateful session caching.  There is an
@@ -111,26 +170,29 @@ typedef std::map<std::string, PendingLookup> PendingLookupMap;
  * to share sessions across instances.
  *
  * There is a single in memory session cache shared by all VIPs.  The cache is
- * split into N buckets (currently 16) with a separate lock per bucket.  The
+ * split into N buckets (currently 16) with a separate writer lock per bucket;
+ * lookups are lock free.  The
  * VIP ID is hashed and stored as part of the session to handle the
  * (very unlikely) case of session ID collision.
  *
- * When a new SSL session is created, it is added to the LRU cache and
+ * When a new SSL session is created, it is added to the local cache and
  * sent to the external cache to be stored.  The external cache
  * expiration is equal to the SSL session's expiration.
  *
  * When a resume request is received, SSLSessionCacheManager first looks in the
- * local LRU cache for the VIP.  If there is a miss there, an asynchronous
+ * local cache for the VIP.  If there is a miss there, an asynchronous
  * request for this session is dispatched to the external cache.  When the
- * external cache query returns, the LRU cache is updated if the session was
+ * external cache query returns, the local cache is updated if the session was
  * found, and the SSL_accept call is resumed.
  *
  * If additional resume requests for the same session ID arrive in the same
  * thread while the request is pending, the 2nd - Nth callers attach to the
- * original external cache requests and are resumed when it comes back.  No
- * attempt is made to coalesce external cache requests for the same session
- * ID in different worker threads.  Previous work did this, but the
- * complexity was deemed to outweigh the potential savings.
+ * original external cache requests and are resumed when it comes back.
+ * Requests from other threads (or other VIPs) attach through a process-wide
+ * table of in-flight lookups instead of sending their own request; when the
+ * external cache answers, the result is handed to each of those managers on
+ * its own EventBase, which resumes its waiters.  Reconnect storms thus send
+ * one external lookup per session ID rather than one per thread.
  *
  */
 class SSLSessionCacheManager : private boost::noncopyable {
@@ -184,9 +246,28 @@ class SSLSessionCacheManager : private boost::noncopyable {
 
  private:
 
+  /**
+   * A manager on another thread waiting for an in-flight external lookup
+   */
+  struct RemoteWaiter {
+    SSLSessionCacheManager* manager;
+    std::weak_ptr<bool> alive;
+    folly::EventBase* evb;
+  };
+
+  /**
+   * An in-flight external lookup: the manager that sent it and the
+   * managers on other threads waiting for its answer
+   */
+  struct GlobalLookup {
+    SSLSessionCacheManager* owner;
+    std::vector<RemoteWaiter> waiters;
+  };
+
   folly::SSLContext* ctx_;
   std::shared_ptr<ShardedLocalSSLSessionCache> localCache_;
-  PendingLookupMap pendingLookups_;
+  // Lets completions posted from other threads detect a destroyed manager
+  std::shared_ptr<bool> alive_{std::make_shared<bool>(true)};
   SSLStats* stats_{nullptr};
   std::shared_ptr<SSLCacheProvider> externalCache_;
 
@@ -237,7 +318,7 @@ class SSLSessionCacheManager : private boost::noncopyable {
   void restartSSLAccept(const SSLCacheProvider::CacheContext* cacheCtx);
 
   /**
-   * Get or create the LRU cache for the given VIP ID
+   * Get or create the local cache for the given VIP ID
    */
   static std::shared_ptr<ShardedLocalSSLSessionCache> getLocalCache(
     uint32_t maxCacheSize, uint32_t cacheCullSize);
@@ -264,6 +345,37 @@ class SSLSessionCacheManager : private boost::noncopyable {
   static int32_t sExDataIndex_;
   static std::shared_ptr<ShardedLocalSSLSessionCache> sCache_;
   static std::mutex sCacheLock_;
+  static std::unordered_map<std::string, GlobalLookup> sGlobalLookups_;
+  static std::mutex sGlobalLookupsLock_;
+
+ protected:
+  // The cross-thread coalescing below is reachable from subclasses so it can
+  // be exercised without an OpenSSL that supports asynchronous session
+  // lookups.
+
+  PendingLookupMap pendingLookups_;
+
+  /**
+   * Register an external lookup for sessionId in the process-wide table.
+   * Returns true if this manager should send the request, or false if it
+   * was attached to a request already in flight from another manager.
+   */
+  bool startOrAttachGlobalLookup(const std::string& sessionId,
+                                 folly::EventBase* evb);
+
+  /**
+   * Hand the result of an external lookup to every manager attached to it
+   * through the process-wide table. session may be nullptr.
+   */
+  static void completeGlobalLookup(const std::string& sessionId,
+                                   SSL_SESSION* session);
+
+  /**
+   * Resume local waiters for a lookup that another manager performed
+   */
+  void onRemoteLookupComplete(const std::string& sessionId,
+                              SSL_SESSION* session);
+
 };
 
 } // namespace wangle
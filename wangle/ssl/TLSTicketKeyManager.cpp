@@ -18,6 +18,7 @@
 #include <folly/Random.h>
 #include <folly/String.h>
 #include <folly/io/async/AsyncTimeout.h>
+#include <folly/portability/OpenSSL.h>
 #include <openssl/aes.h>
 #include <openssl/rand.h>
 #include <openssl/ssl.h>
@@ -40,6 +41,8 @@ namespace wangle {
 
 // TLSTicketKeyManager Implementation
 int32_t TLSTicketKeyManager::sExDataIndex_ = -1;
+constexpr uint32_t TLSTicketKeyManager::kMaxTicketsPerSalt;
+constexpr size_t TLSTicketKeyManager::kMaxPreparedDecryptionKeys;
 
 TLSTicketKeyManager::TLSTicketKeyManager(
     folly::SSLContext* ctx,
@@ -72,12 +75,8 @@ TLSTicketKeyManager::processTicket(SSL*, unsigned char* keyName,
                                    unsigned char* iv,
                                    EVP_CIPHER_CTX* cipherCtx,
                                    HMAC_CTX* hmacCtx, int encrypt) {
-  uint8_t salt[kTLSTicketKeySaltLen];
-  uint8_t* saltptr = nullptr;
-  uint8_t output[SHA256_DIGEST_LENGTH];
-  uint8_t* hmacKey = nullptr;
-  uint8_t* aesKey = nullptr;
   TLSTicketKeySource* key = nullptr;
+  PreparedTicketKey* prepared = nullptr;
   int result = 0;
 
   if (encrypt) {
@@ -90,29 +89,24 @@ TLSTicketKeyManager::processTicket(SSL*, unsigned char* keyName,
     VLOG(4) << "Encrypting new ticket with key name=" <<
       SSLUtil::hexlify(key->keyName_);
 
-    // Get a random salt and write out key name
-    if (RAND_bytes(salt, (int)sizeof(salt)) != 1 &&
-        ERR_GET_LIB(ERR_peek_error()) == ERR_LIB_RAND) {
-      ERR_get_error();
+    prepared = getEncryptionContexts(key);
+    if (prepared == nullptr) {
+      VLOG(2) << "Failed to set up TLS ticket key";
+      return -1;
     }
+    // Write out key name and salt
     memcpy(keyName, key->keyName_.data(), kTLSTicketKeyNameLen);
-    memcpy(keyName + kTLSTicketKeyNameLen, salt, kTLSTicketKeySaltLen);
-
-    // Create the unique keys by hashing with the salt
-    makeUniqueKeys(key->keySource_, sizeof(key->keySource_), salt, output);
-    // This relies on the fact that SHA256 has 32 bytes of output
-    // and that AES-128 keys are 16 bytes
-    hmacKey = output;
-    aesKey = output + SHA256_DIGEST_LENGTH / 2;
+    memcpy(keyName + kTLSTicketKeyNameLen, prepared->salt_.data(),
+           kTLSTicketKeySaltLen);
 
     // Initialize iv and cipher/mac CTX
     if (RAND_bytes(iv, AES_BLOCK_SIZE) != 1 &&
         ERR_GET_LIB(ERR_peek_error()) == ERR_LIB_RAND) {
       ERR_get_error();
     }
-    HMAC_Init_ex(hmacCtx, hmacKey, SHA256_DIGEST_LENGTH / 2,
-                 EVP_sha256(), nullptr);
-    EVP_EncryptInit_ex(cipherCtx, EVP_aes_128_cbc(), nullptr, aesKey, iv);
+    if (!applyPreparedKey(*prepared, iv, cipherCtx, hmacCtx)) {
+      return -1;
+    }
 
     result = 1;
   } else {
@@ -131,15 +125,12 @@ TLSTicketKeyManager::processTicket(SSL*, unsigned char* keyName,
         SSLUtil::hexlify(key->keyName_);
 
       // Reconstruct the unique key via the salt
-      saltptr = keyName + kTLSTicketKeyNameLen;
-      makeUniqueKeys(key->keySource_, sizeof(key->keySource_), saltptr, output);
-      hmacKey = output;
-      aesKey = output + SHA256_DIGEST_LENGTH / 2;
-
-      // Initialize cipher/mac CTX
-      HMAC_Init_ex(hmacCtx, hmacKey, SHA256_DIGEST_LENGTH / 2,
-                   EVP_sha256(), nullptr);
-      EVP_DecryptInit_ex(cipherCtx, EVP_aes_128_cbc(), nullptr, aesKey, iv);
+      prepared = getDecryptionContexts(key, keyName);
+      if (prepared == nullptr ||
+          !applyPreparedKey(*prepared, iv, cipherCtx, hmacCtx)) {
+        VLOG(2) << "Failed to set up TLS ticket key";
+        return -1;
+      }
 
       result = 1;
     }
@@ -164,6 +155,7 @@ TLSTicketKeyManager::setTLSTicketKeySeeds(
   bool result = true;
 
   activeKeys_.clear();
+  decryptionKeys_.clear();
   ticketKeys_.clear();
   ticketSeeds_.clear();
   const std::vector<string> *seedList = &oldSeeds;
@@ -270,9 +262,8 @@ TLSTicketKeyManager::insertNewKey(TLSTicketSeed* seed, uint32_t hashCount,
   newKey->hashCount_ = hashCount;
   newKey->keyName_ = makeKeyName(seed, hashCount, nameBuf);
   newKey->type_ = seed->type_;
-  auto newKeyName = newKey->keyName_;
-  auto it = ticketKeys_.insert(std::make_pair(std::move(newKeyName),
-        std::move(newKey)));
+  auto index = keyIndex((const unsigned char*)newKey->keyName_.data());
+  auto it = ticketKeys_.insert(std::make_pair(index, std::move(newKey)));
 
   auto key = it.first->second.get();
   if (key->type_ == SEED_CURRENT) {
@@ -334,19 +325,102 @@ TLSTicketKeyManager::findEncryptionKey() {
 
 TLSTicketKeyManager::TLSTicketKeySource *
 TLSTicketKeyManager::findDecryptionKey(unsigned char* keyName) {
-  string name((char *)keyName, kTLSTicketKeyNameLen);
   TLSTicketKeySource* key = nullptr;
-  TLSTicketKeyMap::iterator mapit = ticketKeys_.find(name);
+  TLSTicketKeyMap::iterator mapit = ticketKeys_.find(keyIndex(keyName));
   if (mapit != ticketKeys_.end()) {
     key = mapit->second.get();
   }
   return key;
 }
 
+uint32_t
+TLSTicketKeyManager::keyIndex(const unsigned char* keyName) {
+  static_assert(sizeof(uint32_t) == kTLSTicketKeyNameLen,
+                "key name must fit the index");
+  uint32_t index;
+  memcpy(&index, keyName, sizeof(index));
+  return index;
+}
+
+std::unique_ptr<TLSTicketKeyManager::PreparedTicketKey>
+TLSTicketKeyManager::prepareKey(TLSTicketKeySource* key,
+                                const unsigned char* salt,
+                                int encrypt) {
+  uint8_t output[SHA256_DIGEST_LENGTH];
+
+  // Create the unique keys by hashing with the salt
+  makeUniqueKeys(key->keySource_, sizeof(key->keySource_), salt, output);
+  // This relies on the fact that SHA256 has 32 bytes of output
+  // and that AES-128 keys are 16 bytes
+  uint8_t* hmacKey = output;
+  uint8_t* aesKey = output + SHA256_DIGEST_LENGTH / 2;
+
+  auto prepared = std::make_unique<PreparedTicketKey>();
+  prepared->salt_.assign((const char*)salt, kTLSTicketKeySaltLen);
+  prepared->cipherCtx_.reset(EVP_CIPHER_CTX_new());
+  prepared->hmacCtx_.reset(HMAC_CTX_new());
+  if (!prepared->cipherCtx_ || !prepared->hmacCtx_ ||
+      HMAC_Init_ex(prepared->hmacCtx_.get(), hmacKey,
+                   SHA256_DIGEST_LENGTH / 2, EVP_sha256(), nullptr) != 1 ||
+      EVP_CipherInit_ex(prepared->cipherCtx_.get(), EVP_aes_128_cbc(),
+                        nullptr, aesKey, nullptr, encrypt) != 1) {
+    OPENSSL_cleanse(output, sizeof(output));
+    return nullptr;
+  }
+  OPENSSL_cleanse(output, sizeof(output));
+  return prepared;
+}
+
+TLSTicketKeyManager::PreparedTicketKey*
+TLSTicketKeyManager::getEncryptionContexts(TLSTicketKeySource* key) {
+  if (!key->encryptionKey_ || key->encryptionUses_ >= kMaxTicketsPerSalt) {
+    // Get a random salt
+    uint8_t salt[kTLSTicketKeySaltLen];
+    if (RAND_bytes(salt, (int)sizeof(salt)) != 1 &&
+        ERR_GET_LIB(ERR_peek_error()) == ERR_LIB_RAND) {
+      ERR_get_error();
+    }
+    key->encryptionKey_ = prepareKey(key, salt, 1);
+    key->encryptionUses_ = 0;
+  }
+  ++key->encryptionUses_;
+  return key->encryptionKey_.get();
+}
+
+TLSTicketKeyManager::PreparedTicketKey*
+TLSTicketKeyManager::getDecryptionContexts(TLSTicketKeySource* key,
+                                           unsigned char* keyName) {
+  string fullName((char *)keyName,
+                  kTLSTicketKeyNameLen + kTLSTicketKeySaltLen);
+  auto it = decryptionKeys_.find(fullName);
+  if (it != decryptionKeys_.end()) {
+    return it->second.get();
+  }
+  auto prepared = prepareKey(key, keyName + kTLSTicketKeyNameLen, 0);
+  if (!prepared) {
+    return nullptr;
+  }
+  auto result = prepared.get();
+  decryptionKeys_.set(fullName, std::move(prepared));
+  return result;
+}
+
+bool
+TLSTicketKeyManager::applyPreparedKey(const PreparedTicketKey& prepared,
+                                      unsigned char* iv,
+                                      EVP_CIPHER_CTX* cipherCtx,
+                                      HMAC_CTX* hmacCtx) {
+  // Copying the keyed contexts skips the AES key expansion and the HMAC
+  // pad hashing; only the iv differs per ticket
+  return HMAC_CTX_copy(hmacCtx, prepared.hmacCtx_.get()) == 1 &&
+    EVP_CIPHER_CTX_copy(cipherCtx, prepared.cipherCtx_.get()) == 1 &&
+    EVP_CipherInit_ex(cipherCtx, nullptr, nullptr, nullptr, iv, -1) == 1;
+}
+
 void
 TLSTicketKeyManager::makeUniqueKeys(unsigned char* parentKey,
                                     size_t keyLen,
-                                    unsigned char* salt,
+                                    const unsigned char* salt,
                                     unsigned char* output) {
   SHA256_CTX hash_ctx;
 
@@ -15,8 +15,12 @@
  */
 #pragma once
 
+#include <folly/container/EvictingCacheMap.h>
 #include <folly/io/async/SSLContext.h>
 #include <folly/io/async/EventBase.h>
+#include <folly/ssl/OpenSSLPtrTypes.h>
+
+#include <unordered_map>
 
 namespace wangle {
 
@@ -56,6 +60,13 @@ class SSLStats;
  * Sessions will be valid for less time than that, which results in an extra
  * symmetric decryption to discover the session is expired.
  *
+ * Deriving the per-salt keys and running the AES and HMAC key setup costs
+ * more than the ticket crypto itself, so the manager keeps initialized
+ * cipher and HMAC contexts around and copies them into each handshake.
+ * An encryption salt is reused for kMaxTicketsPerSalt tickets before a new
+ * one is drawn, and contexts for the kMaxPreparedDecryptionKeys most recently
+ * used salts seen in incoming tickets are kept for decryption.
+ *
  * A TLSTicketKeyManager should be used in only one thread, and should have
  * a 1:1 relationship with the SSLContext provided.
  *
@@ -111,6 +122,9 @@ class TLSTicketKeyManager : private boost::noncopyable {
 
   Unsafe unsafe() { return Unsafe{this}; }
 
+  static constexpr uint32_t kMaxTicketsPerSalt = 4096;
+  static constexpr size_t kMaxPreparedDecryptionKeys = 1024;
+
  private:
   enum TLSTicketSeedType {
     SEED_OLD = 0,
@@ -125,11 +139,22 @@ class TLSTicketKeyManager : private boost::noncopyable {
     unsigned char seedName_[SHA256_DIGEST_LENGTH];
   };
 
+  /* Cipher and HMAC contexts keyed for one (key, salt) pair */
+  struct PreparedTicketKey {
+    std::string salt_;
+    folly::ssl::EvpCipherCtxUniquePtr cipherCtx_;
+    folly::ssl::HmacCtxUniquePtr hmacCtx_;
+  };
+
   struct TLSTicketKeySource {
     int32_t hashCount_;
     std::string keyName_;
     TLSTicketSeedType type_;
     unsigned char keySource_[SHA256_DIGEST_LENGTH];
+    // Contexts used to encrypt new tickets, and how many tickets they
+    // have encrypted
+    std::unique_ptr<PreparedTicketKey> encryptionKey_;
+    uint32_t encryptionUses_{0};
   };
 
   /**
@@ -189,6 +214,41 @@ class TLSTicketKeyManager : private boost::noncopyable {
    */
   TLSTicketKeySource* findDecryptionKey(unsigned char* keyName);
 
+  /**
+   * Derive the unique keys for key and salt and initialize contexts with
+   * them. Returns nullptr if OpenSSL fails.
+   */
+  std::unique_ptr<PreparedTicketKey> prepareKey(TLSTicketKeySource* key,
+                                                const unsigned char* salt,
+                                                int encrypt);
+
+  /**
+   * Prepared contexts for encrypting a new ticket with key, drawing a new
+   * salt when the current one is used up
+   */
+  PreparedTicketKey* getEncryptionContexts(TLSTicketKeySource* key);
+
+  /**
+   * Prepared contexts for decrypting a ticket with the given full key name
+   * (key name followed by salt)
+   */
+  PreparedTicketKey* getDecryptionContexts(TLSTicketKeySource* key,
+                                           unsigned char* keyName);
+
+  /**
+   * Copy prepared contexts into the ones supplied by OpenSSL for a ticket
+   * with the given iv
+   */
+  static bool applyPreparedKey(const PreparedTicketKey& prepared,
+                               unsigned char* iv,
+                               EVP_CIPHER_CTX* cipherCtx,
+                               HMAC_CTX* hmacCtx);
+
+  /**
+   * The index of a key name in ticketKeys_
+   */
+  static uint32_t keyIndex(const unsigned char* keyName);
+
   /**
    * Record the rotation of the ticket seeds with a new set
    */
@@ -201,18 +261,24 @@ class TLSTicketKeyManager : private boost::noncopyable {
    * Derive a unique key from the parent key and the salt via hashing
    */
   void makeUniqueKeys(unsigned char* parentKey, size_t keyLen,
-                      unsigned char* salt, unsigned char* output);
+                      const unsigned char* salt, unsigned char* output);
 
   typedef std::vector<std::unique_ptr<TLSTicketSeed>> TLSTicketSeedList;
-  typedef std::map<std::string, std::unique_ptr<TLSTicketKeySource> >
+  typedef std::unordered_map<uint32_t, std::unique_ptr<TLSTicketKeySource>>
     TLSTicketKeyMap;
   typedef std::vector<TLSTicketKeySource *> TLSActiveKeyList;
+  typedef folly::EvictingCacheMap<std::string,
+                                  std::unique_ptr<PreparedTicketKey>>
+    PreparedKeyMap;
 
   TLSTicketSeedList ticketSeeds_;
-  // All key sources that can be used for decryption
+  // All key sources that can be used for decryption, by key name
   TLSTicketKeyMap ticketKeys_;
   // Key sources that can be used for encryption
   TLSActiveKeyList activeKeys_;
+  // Decryption contexts by full ticket key name (key name + salt), least
+  // recently used evicted first
+  PreparedKeyMap decryptionKeys_{kMaxPreparedDecryptionKeys};
 
   folly::SSLContext* ctx_;
   SSLStats* stats_{nullptr};
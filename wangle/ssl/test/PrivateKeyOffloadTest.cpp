@@ -0,0 +1,249 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <folly/executors/CPUThreadPoolExecutor.h>
+#include <folly/executors/InlineExecutor.h>
+#include <folly/io/async/AsyncSSLSocket.h>
+#include <folly/io/async/EventBase.h>
+#include <folly/io/async/SSLContext.h>
+#include <folly/ssl/OpenSSLPtrTypes.h>
+#include <gtest/gtest.h>
+#include <wangle/ssl/PrivateKeyOffload.h>
+
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+
+using namespace folly;
+using namespace wangle;
+
+namespace {
+
+std::shared_ptr<folly::Executor> inlineExecutor() {
+  return std::make_shared<folly::InlineExecutor>();
+}
+
+/**
+ * A CPU pool that holds on to operations until the test opens it, so the
+ * test can observe handshakes while they are parked
+ */
+class GatedExecutor : public folly::Executor {
+ public:
+  void add(folly::Func func) override {
+    std::lock_guard<std::mutex> g(mutex_);
+    added_++;
+    if (open_) {
+      pool_.add(std::move(func));
+    } else {
+      held_.push_back(std::move(func));
+    }
+  }
+
+  void open() {
+    std::lock_guard<std::mutex> g(mutex_);
+    open_ = true;
+    for (auto& func : held_) {
+      pool_.add(std::move(func));
+    }
+    held_.clear();
+  }
+
+  size_t numAdded() {
+    std::lock_guard<std::mutex> g(mutex_);
+    return added_;
+  }
+
+ private:
+  std::mutex mutex_;
+  bool open_{false};
+  size_t added_{0};
+  std::vector<folly::Func> held_;
+  folly::CPUThreadPoolExecutor pool_{2};
+};
+
+// A server context with a freshly generated RSA key and self-signed cert
+std::shared_ptr<SSLContext> makeRsaServerContext() {
+  ssl::BIGNUMUniquePtr exponent(BN_new());
+  BN_set_word(exponent.get(), RSA_F4);
+  RSA* rsa = RSA_new();
+  CHECK_EQ(1, RSA_generate_key_ex(rsa, 2048, exponent.get(), nullptr));
+  ssl::EvpPkeyUniquePtr pkey(EVP_PKEY_new());
+  EVP_PKEY_assign_RSA(pkey.get(), rsa);
+
+  ssl::X509UniquePtr cert(X509_new());
+  ASN1_INTEGER_set(X509_get_serialNumber(cert.get()), 1);
+  X509_gmtime_adj(X509_get_notBefore(cert.get()), 0);
+  X509_gmtime_adj(X509_get_notAfter(cert.get()), 3600);
+  X509_set_pubkey(cert.get(), pkey.get());
+  auto name = X509_get_subject_name(cert.get());
+  X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+                             (const unsigned char*)"offload.test", -1, -1, 0);
+  X509_set_issuer_name(cert.get(), name);
+  CHECK(X509_sign(cert.get(), pkey.get(), EVP_sha256()));
+
+  auto ctx = std::make_shared<SSLContext>();
+  CHECK_EQ(1, SSL_CTX_use_certificate(ctx->getSSLCtx(), cert.get()));
+  CHECK_EQ(1, SSL_CTX_use_PrivateKey(ctx->getSSLCtx(), pkey.get()));
+  return ctx;
+}
+
+class HandshakeCallback : public AsyncSSLSocket::HandshakeCB {
+ public:
+  void handshakeSuc(AsyncSSLSocket* /* sock */) noexcept override {
+    done = true;
+  }
+
+  void handshakeErr(AsyncSSLSocket* /* sock */,
+                    const AsyncSocketException& ex) noexcept override {
+    done = true;
+    error = ex.what();
+  }
+
+  bool done{false};
+  std::string error;
+};
+
+/**
+ * A client and a server handshaking with each other over a socket pair,
+ * both on evb
+ */
+struct LoopbackHandshake {
+  LoopbackHandshake(EventBase* evb, std::shared_ptr<SSLContext> serverCtx) {
+    int fds[2];
+    CHECK_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+    server = AsyncSSLSocket::newSocket(serverCtx, evb, fds[0], true);
+    client = AsyncSSLSocket::newSocket(
+      std::make_shared<SSLContext>(), evb, fds[1], false);
+    server->sslAccept(&serverCb);
+    client->sslConn(&clientCb);
+  }
+
+  bool done() const {
+    return serverCb.done && clientCb.done;
+  }
+
+  // Declared first so they outlive the sockets
+  HandshakeCallback serverCb;
+  HandshakeCallback clientCb;
+  std::shared_ptr<AsyncSSLSocket> server;
+  std::shared_ptr<AsyncSSLSocket> client;
+};
+
+// Runs evb until pred holds, failing the test after a few seconds
+template <typename Pred>
+void loopUntil(EventBase& evb, Pred pred) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (!pred()) {
+    ASSERT_LT(std::chrono::steady_clock::now(), deadline);
+    evb.loopOnce(EVLOOP_NONBLOCK);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+}
+
+TEST(PrivateKeyOffloadTest, LimitPendingOperations) {
+  auto offload = PrivateKeyOffload::create(inlineExecutor(), 100);
+  EXPECT_EQ(100u, offload->getMaxPendingOperations());
+  offload->limitPendingOperations(10);
+  EXPECT_EQ(10u, offload->getMaxPendingOperations());
+  // Limits only ever go down
+  offload->limitPendingOperations(50);
+  EXPECT_EQ(10u, offload->getMaxPendingOperations());
+  EXPECT_EQ(0u, offload->getNumPendingOperations());
+}
+
+TEST(PrivateKeyOffloadTest, AttachWithoutKey) {
+  auto offload = PrivateKeyOffload::create(inlineExecutor(), 100);
+  folly::SSLContext ctx;
+  EXPECT_FALSE(offload->attach(ctx.getSSLCtx()));
+}
+
+TEST(PrivateKeyOffloadTest, HandshakeParksUntilPoolSigns) {
+  if (!PrivateKeyOffload::isSupported()) {
+    return;
+  }
+  auto executor = std::make_shared<GatedExecutor>();
+  auto offload = PrivateKeyOffload::create(executor, 10);
+  auto serverCtx = makeRsaServerContext();
+  ASSERT_TRUE(offload->attach(serverCtx->getSSLCtx()));
+
+  EventBase evb;
+  LoopbackHandshake hs(&evb, serverCtx);
+
+  // The signature is queued on the pool and the handshake is parked
+  loopUntil(evb, [&] { return executor->numAdded() == 1; });
+  EXPECT_FALSE(hs.serverCb.done);
+  EXPECT_EQ(1u, offload->getNumPendingOperations());
+
+  // The pool's wakeup resumes it on evb
+  executor->open();
+  loopUntil(evb, [&] { return hs.done(); });
+  EXPECT_EQ("", hs.serverCb.error);
+  EXPECT_EQ("", hs.clientCb.error);
+  EXPECT_EQ(1u, executor->numAdded());
+  EXPECT_EQ(0u, offload->getNumPendingOperations());
+}
+
+TEST(PrivateKeyOffloadTest, InlinePastLimit) {
+  if (!PrivateKeyOffload::isSupported()) {
+    return;
+  }
+  auto executor = std::make_shared<GatedExecutor>();
+  auto offload = PrivateKeyOffload::create(executor, 1);
+  auto serverCtx = makeRsaServerContext();
+  ASSERT_TRUE(offload->attach(serverCtx->getSSLCtx()));
+
+  EventBase evb;
+  LoopbackHandshake first(&evb, serverCtx);
+  loopUntil(evb, [&] { return executor->numAdded() == 1; });
+
+  // The pool is full, so the second handshake signs inline and completes
+  // while the first is still parked
+  LoopbackHandshake second(&evb, serverCtx);
+  loopUntil(evb, [&] { return second.done(); });
+  EXPECT_EQ("", second.serverCb.error);
+  EXPECT_FALSE(first.serverCb.done);
+  EXPECT_EQ(1u, executor->numAdded());
+
+  executor->open();
+  loopUntil(evb, [&] { return first.done(); });
+  EXPECT_EQ("", first.serverCb.error);
+}
+
+TEST(PrivateKeyOffloadTest, SocketClosedWhileParked) {
+  if (!PrivateKeyOffload::isSupported()) {
+    return;
+  }
+  auto executor = std::make_shared<GatedExecutor>();
+  auto offload = PrivateKeyOffload::create(executor, 10);
+  auto serverCtx = makeRsaServerContext();
+  ASSERT_TRUE(offload->attach(serverCtx->getSSLCtx()));
+
+  EventBase evb;
+  auto hs = std::make_unique<LoopbackHandshake>(&evb, serverCtx);
+  loopUntil(evb, [&] { return executor->numAdded() == 1; });
+
+  hs->server->closeNow();
+  hs->client->closeNow();
+  hs.reset();
+
+  // Finishing the operation signals a wakeup fd nobody reads any more
+  executor->open();
+  loopUntil(evb, [&] { return offload->getNumPendingOperations() == 0; });
+}
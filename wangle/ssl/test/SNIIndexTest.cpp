@@ -0,0 +1,105 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <folly/Conv.h>
+#include <gtest/gtest.h>
+#include <wangle/ssl/SNIIndex.h>
+
+using folly::SSLContext;
+using std::shared_ptr;
+
+namespace wangle {
+
+namespace {
+
+DNString toDN(const std::string& name) {
+  return DNString(name.data(), name.size());
+}
+
+shared_ptr<SSLContext> find(const SNIIndex& index,
+                            folly::StringPiece name,
+                            CertCrypto crypto = CertCrypto::BEST_AVAILABLE) {
+  auto match = index.find(name, crypto);
+  return match ? *match : nullptr;
+}
+
+}
+
+TEST(SNIIndexTest, ExactAndWildcard) {
+  auto wwwCtx = std::make_shared<SSLContext>();
+  auto starCtx = std::make_shared<SSLContext>();
+  auto starSha1Ctx = std::make_shared<SSLContext>();
+  auto apexCtx = std::make_shared<SSLContext>();
+
+  SNIIndex::DomainNameMap dnMap;
+  dnMap.emplace(SSLContextKey("www.facebook.com"), wwwCtx);
+  dnMap.emplace(SSLContextKey(".facebook.com"), starCtx);
+  dnMap.emplace(
+    SSLContextKey(".facebook.com", CertCrypto::SHA1_SIGNATURE), starSha1Ctx);
+  dnMap.emplace(SSLContextKey("facebook.com"), apexCtx);
+  SNIIndex index(dnMap);
+  EXPECT_EQ(4u, index.size());
+
+  EXPECT_EQ(wwwCtx, find(index, "www.facebook.com"));
+  EXPECT_EQ(wwwCtx, find(index, "WWW.FaceBook.COM"));
+  EXPECT_EQ(starCtx, find(index, "xyz.facebook.com"));
+  EXPECT_EQ(apexCtx, find(index, "facebook.com"));
+  EXPECT_EQ(starSha1Ctx,
+            find(index, "xyz.facebook.com", CertCrypto::SHA1_SIGNATURE));
+  // No SHA1 cert for www, so the SHA1 wildcard is the best match
+  EXPECT_EQ(starSha1Ctx,
+            find(index, "www.facebook.com", CertCrypto::SHA1_SIGNATURE));
+
+  // Wildcards only match one level up
+  EXPECT_FALSE(find(index, "abc.xyz.facebook.com"));
+  EXPECT_FALSE(find(index, "Xfacebook.com"));
+  EXPECT_FALSE(find(index, "com"));
+  EXPECT_FALSE(find(index, ""));
+  EXPECT_FALSE(find(index, "www.facebook.com."));
+
+  EXPECT_FALSE(index.findExact("xyz.facebook.com",
+                               CertCrypto::BEST_AVAILABLE));
+  EXPECT_FALSE(index.findBySuffix("www.facebook.com.net",
+                                  CertCrypto::BEST_AVAILABLE));
+  auto suffix = index.findBySuffix("www.facebook.com",
+                                   CertCrypto::BEST_AVAILABLE);
+  ASSERT_TRUE(suffix);
+  EXPECT_EQ(starCtx, *suffix);
+}
+
+TEST(SNIIndexTest, ManyNames) {
+  SNIIndex::DomainNameMap dnMap;
+  std::vector<shared_ptr<SSLContext>> ctxs;
+  for (int i = 0; i < 2000; i++) {
+    ctxs.push_back(std::make_shared<SSLContext>());
+    dnMap.emplace(
+      SSLContextKey(toDN(folly::to<std::string>("host", i, ".example.com"))),
+      ctxs.back());
+    dnMap.emplace(
+      SSLContextKey(toDN(folly::to<std::string>(".svc", i, ".example.net"))),
+      ctxs.back());
+  }
+  SNIIndex index(dnMap);
+  for (int i = 0; i < 2000; i++) {
+    EXPECT_EQ(ctxs[i],
+              find(index, folly::to<std::string>("host", i, ".example.com")));
+    EXPECT_EQ(ctxs[i],
+              find(index, folly::to<std::string>("a.svc", i, ".example.net")));
+  }
+  EXPECT_FALSE(find(index, "host2000.example.com"));
+  EXPECT_FALSE(find(index, "example.com"));
+}
+
+} // namespace wangle
@@ -16,7 +16,13 @@
 #include <glog/logging.h>
 #include <folly/portability/GTest.h>
 #include <wangle/ssl/SSLSessionCacheManager.h>
+#include <folly/Conv.h>
 #include <folly/Random.h>
+#include <folly/io/async/SSLContext.h>
+#include <folly/io/async/ScopedEventBaseThread.h>
+
+#include <atomic>
+#include <thread>
 
 using std::shared_ptr;
 using namespace folly;
@@ -33,3 +39,243 @@ TEST(ShardedLocalSSLSessionCacheTest, TestHash) {
   ShardedLocalSSLSessionCache cache(buckets, cacheSize, cacheCullSize);
   cache.hash(std::string((char*)id.data(), id.size()));
 }
+
+TEST(ShardedLocalSSLSessionCacheTest, ClockEviction) {
+  ClockSSLSessionCacheShard shard(2);
+  std::hash<std::string> hasher;
+  auto store = [&](const std::string& id) {
+    return shard.store(id, hasher(id), SSL_SESSION_new());
+  };
+  auto contains = [&](const std::string& id) {
+    auto session = shard.lookup(id, hasher(id));
+    if (session) {
+      SSL_SESSION_free(session);
+    }
+    return session != nullptr;
+  };
+
+  EXPECT_EQ(0, store("a"));
+  EXPECT_EQ(0, store("b"));
+  EXPECT_EQ(2, shard.size());
+
+  // "a" was looked up since the last sweep, so "b" is evicted instead
+  EXPECT_TRUE(contains("a"));
+  EXPECT_EQ(1, store("c"));
+  EXPECT_TRUE(contains("a"));
+  EXPECT_FALSE(contains("b"));
+  EXPECT_TRUE(contains("c"));
+
+  // Overwriting a session doesn't evict
+  EXPECT_EQ(0, store("c"));
+  EXPECT_EQ(2, shard.size());
+
+  shard.remove("a", hasher("a"));
+  EXPECT_FALSE(contains("a"));
+  EXPECT_EQ(1, shard.size());
+}
+
+TEST(ShardedLocalSSLSessionCacheTest, ManyRemovals) {
+  // Enough churn to rebuild the index several times
+  ShardedLocalSSLSessionCache cache(1, 8, 1);
+  for (int i = 0; i < 1000; i++) {
+    auto id = folly::to<std::string>(i);
+    cache.storeSession(id, SSL_SESSION_new(), nullptr);
+    if (i % 2) {
+      cache.removeSession(id);
+    }
+    auto session = cache.lookupSession(folly::to<std::string>(i - i % 2));
+    ASSERT_NE(nullptr, session);
+    SSL_SESSION_free(session);
+  }
+}
+
+// Readers race lookups against writers that keep the shard evicting and
+// swapping tables. Each session carries its key in its timestamp, so a
+// session freed or recycled under a reader shows up as a mismatch here and
+// as a use-after-free under ASAN; TSAN checks the publication ordering.
+TEST(ShardedLocalSSLSessionCacheTest, ConcurrentLookupsDuringRebuild) {
+  constexpr size_t kCapacity = 16;
+  constexpr long kKeys = 64;
+  constexpr size_t kReaders = 4;
+  constexpr size_t kWriters = 2;
+  constexpr size_t kWriterOps = 20000;
+
+  ClockSSLSessionCacheShard shard(kCapacity);
+  std::hash<std::string> hasher;
+  std::vector<std::string> ids;
+  for (long i = 0; i < kKeys; i++) {
+    ids.push_back(folly::to<std::string>("session-", i));
+  }
+
+  std::atomic<bool> done{false};
+  std::atomic<size_t> hits{0};
+  std::vector<std::thread> threads;
+  for (size_t r = 0; r < kReaders; r++) {
+    threads.emplace_back([&] {
+      while (!done.load()) {
+        auto key = (long)Random::rand32(kKeys);
+        auto session = shard.lookup(ids[key], hasher(ids[key]));
+        if (session) {
+          EXPECT_EQ(key, SSL_SESSION_get_time(session));
+          hits++;
+          SSL_SESSION_free(session);
+        }
+      }
+    });
+  }
+  for (size_t w = 0; w < kWriters; w++) {
+    threads.emplace_back([&] {
+      for (size_t n = 0; n < kWriterOps; n++) {
+        auto key = (long)Random::rand32(kKeys);
+        if (Random::oneIn(3)) {
+          // Removals leave tombstones behind and force table rebuilds
+          shard.remove(ids[key], hasher(ids[key]));
+        } else {
+          auto session = SSL_SESSION_new();
+          SSL_SESSION_set_time(session, key);
+          shard.store(ids[key], hasher(ids[key]), session);
+        }
+      }
+    });
+  }
+  for (size_t i = kReaders; i < threads.size(); i++) {
+    threads[i].join();
+  }
+  done = true;
+  for (size_t i = 0; i < kReaders; i++) {
+    threads[i].join();
+  }
+
+  EXPECT_GT(hits.load(), 0);
+  EXPECT_LE(shard.size(), kCapacity);
+}
+
+namespace {
+
+/**
+ * Drives the cross-thread lookup table the way getSession() and the external
+ * cache callbacks do, without needing a handshake blocked on the cache.
+ */
+class CoalescingCacheManager : public SSLSessionCacheManager {
+ public:
+  CoalescingCacheManager(SSLContext* ctx, EventBase* evb)
+      : SSLSessionCacheManager(20, 100, ctx, "test", nullptr, nullptr),
+        evb_(evb) {}
+
+  // A local miss: returns true if this manager sends the external request
+  bool miss(const std::string& sessionId) {
+    bool owner = false;
+    evb_->runInEventBaseThreadAndWait([&] {
+      pendingLookups_.emplace(sessionId, PendingLookup());
+      owner = startOrAttachGlobalLookup(sessionId, evb_);
+    });
+    return owner;
+  }
+
+  // The external cache answering the request this manager sent
+  void answer(const std::string& sessionId, SSL_SESSION* session) {
+    evb_->runInEventBaseThreadAndWait([&] {
+      pendingLookups_.erase(sessionId);
+      completeGlobalLookup(sessionId, session);
+    });
+  }
+
+  // Completions are posted to our EventBase, so this sees any posted so far
+  bool isPending(const std::string& sessionId) {
+    bool pending = false;
+    evb_->runInEventBaseThreadAndWait(
+      [&] { pending = pendingLookups_.count(sessionId) > 0; });
+    return pending;
+  }
+
+ private:
+  EventBase* evb_;
+};
+
+}
+
+TEST(SSLSessionCacheManagerTest, CoalesceLookupsAcrossEventBases) {
+  ScopedEventBaseThread t1;
+  ScopedEventBaseThread t2;
+  SSLContext ctx1;
+  SSLContext ctx2;
+  CoalescingCacheManager m1(&ctx1, t1.getEventBase());
+  CoalescingCacheManager m2(&ctx2, t2.getEventBase());
+  const std::string id = "coalesce-across-evbs";
+
+  // Only the first manager sends the external request
+  EXPECT_TRUE(m1.miss(id));
+  EXPECT_FALSE(m2.miss(id));
+  EXPECT_TRUE(m2.isPending(id));
+
+  auto session = SSL_SESSION_new();
+  m1.answer(id, session);
+  EXPECT_FALSE(m2.isPending(id));
+
+  // The answered lookup is gone; the next miss sends a new request
+  EXPECT_TRUE(m2.miss(id));
+  m2.answer(id, nullptr);
+  SSL_SESSION_free(session);
+}
+
+TEST(SSLSessionCacheManagerTest, FailureFansOut) {
+  ScopedEventBaseThread t1;
+  ScopedEventBaseThread t2;
+  ScopedEventBaseThread t3;
+  SSLContext ctx1;
+  SSLContext ctx2;
+  SSLContext ctx3;
+  CoalescingCacheManager m1(&ctx1, t1.getEventBase());
+  CoalescingCacheManager m2(&ctx2, t2.getEventBase());
+  CoalescingCacheManager m3(&ctx3, t3.getEventBase());
+  const std::string id = "failure-fans-out";
+
+  EXPECT_TRUE(m1.miss(id));
+  EXPECT_FALSE(m2.miss(id));
+  EXPECT_FALSE(m3.miss(id));
+
+  // A miss or failed request in the external cache resumes every waiter
+  m1.answer(id, nullptr);
+  EXPECT_FALSE(m2.isPending(id));
+  EXPECT_FALSE(m3.isPending(id));
+}
+
+TEST(SSLSessionCacheManagerTest, OwnerDestroyedMidLookup) {
+  ScopedEventBaseThread t1;
+  ScopedEventBaseThread t2;
+  SSLContext ctx1;
+  SSLContext ctx2;
+  auto m1 = std::make_unique<CoalescingCacheManager>(
+      &ctx1, t1.getEventBase());
+  CoalescingCacheManager m2(&ctx2, t2.getEventBase());
+  const std::string id = "owner-destroyed";
+
+  EXPECT_TRUE(m1->miss(id));
+  EXPECT_FALSE(m2.miss(id));
+
+  // Nobody will answer the destroyed manager's request; the waiter must not
+  // stay parked on it
+  m1.reset();
+  EXPECT_FALSE(m2.isPending(id));
+  EXPECT_TRUE(m2.miss(id));
+  m2.answer(id, nullptr);
+}
+
+TEST(SSLSessionCacheManagerTest, WaiterDestroyedMidLookup) {
+  ScopedEventBaseThread t1;
+  ScopedEventBaseThread t2;
+  SSLContext ctx1;
+  SSLContext ctx2;
+  CoalescingCacheManager m1(&ctx1, t1.getEventBase());
+  auto m2 = std::make_unique<CoalescingCacheManager>(
+      &ctx2, t2.getEventBase());
+  const std::string id = "waiter-destroyed";
+
+  EXPECT_TRUE(m1.miss(id));
+  EXPECT_FALSE(m2->miss(id));
+  m2.reset();
+
+  auto session = SSL_SESSION_new();
+  m1.answer(id, session);
+  SSL_SESSION_free(session);
+}
@@ -0,0 +1,210 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+// Compares TLS ticket handling that keys the cipher and HMAC contexts from
+// raw key bytes on every ticket (what TLSTicketKeyManager used to do) with
+// the manager's prepared contexts. The resumption benchmarks run complete
+// abbreviated TLS 1.2 handshakes over an in-memory BIO pair, so iters/s is
+// resumption handshakes per second on one core; the callback benchmarks
+// isolate one ticket encryption plus one decryption.
+//
+//   TLSTicketKeyManagerBenchmark --cert=test.cert.pem --key=test.key.pem
+
+#include <wangle/ssl/TLSTicketKeyManager.h>
+
+#include <folly/Benchmark.h>
+#include <folly/portability/GFlags.h>
+#include <folly/portability/OpenSSL.h>
+#include <folly/ssl/OpenSSLPtrTypes.h>
+#include <glog/logging.h>
+#include <openssl/aes.h>
+#include <openssl/rand.h>
+
+#include <cstring>
+
+DEFINE_string(cert, "wangle/ssl/test/certs/test.cert.pem",
+              "Server certificate");
+DEFINE_string(key, "wangle/ssl/test/certs/test.key.pem",
+              "Server private key");
+
+using folly::BenchmarkSuspender;
+using wangle::TLSTicketKeyManager;
+
+namespace {
+
+const int kKeyNameLen = 4;
+const int kSaltLen = 12;
+
+// Per-ticket key derivation and context setup from raw key bytes, as done
+// before the manager kept prepared contexts
+int rederiveTicketKey(SSL*, unsigned char* keyName, unsigned char* iv,
+                      EVP_CIPHER_CTX* cipherCtx, HMAC_CTX* hmacCtx,
+                      int encrypt) {
+  static const unsigned char keySource[SHA256_DIGEST_LENGTH] = {0x68};
+  uint8_t output[SHA256_DIGEST_LENGTH];
+
+  if (encrypt) {
+    memset(keyName, 0x42, kKeyNameLen);
+    RAND_bytes(keyName + kKeyNameLen, kSaltLen);
+    RAND_bytes(iv, AES_BLOCK_SIZE);
+  }
+  SHA256_CTX hashCtx;
+  SHA256_Init(&hashCtx);
+  SHA256_Update(&hashCtx, keySource, sizeof(keySource));
+  SHA256_Update(&hashCtx, keyName + kKeyNameLen, kSaltLen);
+  SHA256_Final(output, &hashCtx);
+
+  HMAC_Init_ex(hmacCtx, output, SHA256_DIGEST_LENGTH / 2,
+               EVP_sha256(), nullptr);
+  if (encrypt) {
+    EVP_EncryptInit_ex(cipherCtx, EVP_aes_128_cbc(), nullptr,
+                       output + SHA256_DIGEST_LENGTH / 2, iv);
+  } else {
+    EVP_DecryptInit_ex(cipherCtx, EVP_aes_128_cbc(), nullptr,
+                       output + SHA256_DIGEST_LENGTH / 2, iv);
+  }
+  return 1;
+}
+
+class ResumptionFixture {
+ public:
+  explicit ResumptionFixture(bool prepared) {
+    server_.loadCertificate(FLAGS_cert.c_str());
+    server_.loadPrivateKey(FLAGS_key.c_str());
+    server_.setSessionCacheContext("ticket-benchmark");
+    // Only tickets can resume
+    SSL_CTX_set_session_cache_mode(server_.getSSLCtx(), SSL_SESS_CACHE_OFF);
+#ifdef TLS1_3_VERSION
+    SSL_CTX_set_max_proto_version(server_.getSSLCtx(), TLS1_2_VERSION);
+#endif
+    if (prepared) {
+      manager_ = std::make_unique<TLSTicketKeyManager>(&server_, nullptr);
+      CHECK(manager_->setTLSTicketKeySeeds({}, {"68"}, {}));
+    } else {
+      SSL_CTX_set_tlsext_ticket_key_cb(server_.getSSLCtx(),
+                                       rederiveTicketKey);
+    }
+    session_ = handshake(nullptr);
+  }
+
+  ~ResumptionFixture() {
+    SSL_SESSION_free(session_);
+  }
+
+  void resume() {
+    handshake(session_);
+  }
+
+ private:
+  // Returns the client session after a full handshake
+  SSL_SESSION* handshake(SSL_SESSION* resumeFrom) {
+    SSL* client = SSL_new(client_.getSSLCtx());
+    SSL* server = SSL_new(server_.getSSLCtx());
+    BIO* clientBio = nullptr;
+    BIO* serverBio = nullptr;
+    CHECK_EQ(1, BIO_new_bio_pair(&clientBio, 0, &serverBio, 0));
+    SSL_set_bio(client, clientBio, clientBio);
+    SSL_set_bio(server, serverBio, serverBio);
+    SSL_set_connect_state(client);
+    SSL_set_accept_state(server);
+    if (resumeFrom) {
+      SSL_set_session(client, resumeFrom);
+    }
+
+    bool clientDone = false;
+    bool serverDone = false;
+    for (int i = 0; i < 16 && !(clientDone && serverDone); i++) {
+      clientDone = clientDone || SSL_do_handshake(client) == 1;
+      serverDone = serverDone || SSL_do_handshake(server) == 1;
+    }
+    CHECK(clientDone && serverDone) << "Handshake did not complete";
+
+    SSL_SESSION* session = nullptr;
+    if (resumeFrom) {
+      CHECK(SSL_session_reused(client)) << "Ticket was not accepted";
+    } else {
+      session = SSL_get1_session(client);
+    }
+    SSL_free(client);
+    SSL_free(server);
+    return session;
+  }
+
+  folly::SSLContext client_;
+  folly::SSLContext server_;
+  std::unique_ptr<TLSTicketKeyManager> manager_;
+  SSL_SESSION* session_{nullptr};
+};
+
+void resumption(uint32_t iters, bool prepared) {
+  BenchmarkSuspender bs;
+  ResumptionFixture fixture(prepared);
+  bs.dismiss();
+  for (uint32_t i = 0; i < iters; i++) {
+    fixture.resume();
+  }
+}
+
+template <typename Callback>
+void ticketCallback(uint32_t iters, Callback&& cb) {
+  folly::ssl::EvpCipherCtxUniquePtr cipherCtx(EVP_CIPHER_CTX_new());
+  folly::ssl::HmacCtxUniquePtr hmacCtx(HMAC_CTX_new());
+  unsigned char keyName[kKeyNameLen + kSaltLen];
+  unsigned char iv[EVP_MAX_IV_LENGTH];
+  for (uint32_t i = 0; i < iters; i++) {
+    cb(keyName, iv, cipherCtx.get(), hmacCtx.get(), 1);
+    cb(keyName, iv, cipherCtx.get(), hmacCtx.get(), 0);
+  }
+}
+
+}
+
+BENCHMARK(resumptionRederivedKeys, iters) {
+  resumption(iters, false);
+}
+
+BENCHMARK_RELATIVE(resumptionPreparedKeys, iters) {
+  resumption(iters, true);
+}
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK(ticketCallbackRederivedKeys, iters) {
+  ticketCallback(iters, [](unsigned char* keyName, unsigned char* iv,
+                           EVP_CIPHER_CTX* cipherCtx, HMAC_CTX* hmacCtx,
+                           int encrypt) {
+    rederiveTicketKey(nullptr, keyName, iv, cipherCtx, hmacCtx, encrypt);
+  });
+}
+
+BENCHMARK_RELATIVE(ticketCallbackPreparedKeys, iters) {
+  BenchmarkSuspender bs;
+  folly::SSLContext ctx;
+  TLSTicketKeyManager manager(&ctx, nullptr);
+  CHECK(manager.setTLSTicketKeySeeds({}, {"68"}, {}));
+  bs.dismiss();
+  ticketCallback(iters, [&](unsigned char* keyName, unsigned char* iv,
+                            EVP_CIPHER_CTX* cipherCtx, HMAC_CTX* hmacCtx,
+                            int encrypt) {
+    manager.unsafe().processTicket(
+        nullptr, keyName, iv, cipherCtx, hmacCtx, encrypt);
+  });
+}
+
+int main(int argc, char** argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  folly::runBenchmarks();
+  return 0;
+}
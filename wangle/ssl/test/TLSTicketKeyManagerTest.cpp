@@ -14,7 +14,10 @@
  * limitations under the License.
  */
 #include <folly/portability/GMock.h>
+#include <folly/portability/OpenSSL.h>
+#include <folly/ssl/OpenSSLPtrTypes.h>
 #include <gtest/gtest.h>
+#include <openssl/aes.h>
 #include <wangle/ssl/SSLStats.h>
 #include <wangle/ssl/TLSTicketKeyManager.h>
 
@@ -139,3 +142,69 @@ TEST(TLSTicketKeyManager, TestValidateTicketSeedsSubsetPass) {
   manager.setTLSTicketKeySeeds(origOld, origCurr, origNext);
   manager.setTLSTicketKeySeeds(newOld, newCurr, newNext);
 }
+
+namespace {
+
+struct TicketCtx {
+  folly::ssl::EvpCipherCtxUniquePtr cipher{EVP_CIPHER_CTX_new()};
+  folly::ssl::HmacCtxUniquePtr hmac{HMAC_CTX_new()};
+};
+
+std::string runCipher(EVP_CIPHER_CTX* ctx, const std::string& in) {
+  std::string out(in.size() + AES_BLOCK_SIZE, '\0');
+  int len = 0;
+  int finalLen = 0;
+  EXPECT_EQ(1, EVP_CipherUpdate(ctx, (unsigned char*)&out[0], &len,
+                                (const unsigned char*)in.data(), in.size()));
+  EXPECT_EQ(1, EVP_CipherFinal_ex(ctx, (unsigned char*)&out[len],
+                                  &finalLen));
+  out.resize(len + finalLen);
+  return out;
+}
+
+std::string hmacOf(HMAC_CTX* ctx, const std::string& in) {
+  unsigned char mac[EVP_MAX_MD_SIZE];
+  unsigned int macLen = 0;
+  HMAC_Update(ctx, (const unsigned char*)in.data(), in.size());
+  HMAC_Final(ctx, mac, &macLen);
+  return std::string((char*)mac, macLen);
+}
+
+}
+
+TEST(TLSTicketKeyManager, TestPreparedKeysRoundTrip) {
+  folly::SSLContext ctx;
+  wangle::TLSTicketKeyManager manager(&ctx, nullptr);
+  manager.setTLSTicketKeySeeds({"67"}, {"68"}, {"69"});
+
+  std::string plaintext = "session state for ticket round trip";
+  std::string ciphertexts[2];
+  std::string macs[2];
+  unsigned char keyNames[2][16];
+  unsigned char ivs[2][AES_BLOCK_SIZE];
+  for (int i = 0; i < 2; i++) {
+    TicketCtx enc;
+    ASSERT_EQ(1, manager.unsafe().processTicket(
+        nullptr, keyNames[i], ivs[i], enc.cipher.get(), enc.hmac.get(), 1));
+    ciphertexts[i] = runCipher(enc.cipher.get(), plaintext);
+    macs[i] = hmacOf(enc.hmac.get(), ciphertexts[i]);
+  }
+  // Consecutive tickets share the prepared salt but not the iv
+  EXPECT_EQ(0, memcmp(keyNames[0], keyNames[1], sizeof(keyNames[0])));
+  EXPECT_NE(0, memcmp(ivs[0], ivs[1], sizeof(ivs[0])));
+  EXPECT_NE(ciphertexts[0], ciphertexts[1]);
+
+  for (int i = 0; i < 2; i++) {
+    TicketCtx dec;
+    ASSERT_EQ(1, manager.unsafe().processTicket(
+        nullptr, keyNames[i], ivs[i], dec.cipher.get(), dec.hmac.get(), 0));
+    EXPECT_EQ(macs[i], hmacOf(dec.hmac.get(), ciphertexts[i]));
+    EXPECT_EQ(plaintext, runCipher(dec.cipher.get(), ciphertexts[i]));
+  }
+
+  // A key name we never issued is not found
+  keyNames[0][0] ^= 0xff;
+  TicketCtx dec;
+  EXPECT_EQ(0, manager.unsafe().processTicket(
+      nullptr, keyNames[0], ivs[0], dec.cipher.get(), dec.hmac.get(), 0));
+}